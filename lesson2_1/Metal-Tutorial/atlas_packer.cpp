@@ -0,0 +1,98 @@
+//
+//  atlas_packer.cpp
+//  Metal-Guide
+//
+
+#include "atlas_packer.hpp"
+
+#include <algorithm>
+#include <climits>
+
+AtlasPacker::AtlasPacker(int width, int height) : atlasWidth(width), atlasHeight(height) {
+    reset();
+}
+
+void AtlasPacker::reset() {
+    usedArea = 0;
+    skyline.assign(1, Segment{0, 0, atlasWidth});
+}
+
+int AtlasPacker::usedHeight() const {
+    int top = 0;
+    for (const Segment& segment : skyline) {
+        top = std::max(top, segment.y);
+    }
+    return top;
+}
+
+int AtlasPacker::fit(size_t index, int width, int height) const {
+    if (skyline[index].x + width > atlasWidth) {
+        return -1;
+    }
+    // The rectangle rests on the highest segment it spans.
+    int y = 0;
+    int remaining = width;
+    for (size_t i = index; remaining > 0; ++i) {
+        y = std::max(y, skyline[i].y);
+        remaining -= skyline[i].width;
+    }
+    return (y + height <= atlasHeight) ? y : -1;
+}
+
+bool AtlasPacker::insert(int width, int height, int& x, int& y) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    // Lowest top edge wins; ties go to the narrowest segment, which leaves
+    // wide segments for wide rectangles.
+    size_t best = SIZE_MAX;
+    int bestTop = INT_MAX, bestWidth = INT_MAX;
+    for (size_t i = 0; i < skyline.size(); ++i) {
+        int top = fit(i, width, height);
+        if (top < 0) {
+            continue;
+        }
+        top += height;
+        if (top < bestTop || (top == bestTop && skyline[i].width < bestWidth)) {
+            best = i;
+            bestTop = top;
+            bestWidth = skyline[i].width;
+        }
+    }
+    if (best == SIZE_MAX) {
+        return false;
+    }
+
+    x = skyline[best].x;
+    y = bestTop - height;
+    skyline.insert(skyline.begin() + best, Segment{x, bestTop, width});
+
+    // Trim or drop the segments now underneath the new one.
+    for (size_t i = best + 1; i < skyline.size(); ) {
+        const int shadowEnd = skyline[i - 1].x + skyline[i - 1].width;
+        if (skyline[i].x >= shadowEnd) {
+            break;
+        }
+        const int overlap = shadowEnd - skyline[i].x;
+        if (skyline[i].width > overlap) {
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Merge neighbours at the same height.
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            ++i;
+        }
+    }
+
+    usedArea += uint64_t(width) * height;
+    return true;
+}
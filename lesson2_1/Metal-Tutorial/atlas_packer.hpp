@@ -0,0 +1,45 @@
+//
+//  atlas_packer.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Skyline bottom-left rectangle packer. Rectangles are placed one at a time
+// in arrival order, so it works as textures stream in; each insert is linear
+// in the number of skyline segments.
+class AtlasPacker {
+public:
+    AtlasPacker(int width, int height);
+
+    // Finds a spot for a width x height rectangle. Returns false when the
+    // atlas is too full to hold it.
+    bool insert(int width, int height, int& x, int& y);
+    void reset();
+
+    int width() const { return atlasWidth; }
+    int height() const { return atlasHeight; }
+    // Fraction of the atlas covered by inserted rectangles.
+    double occupancy() const { return double(usedArea) / (double(atlasWidth) * atlasHeight); }
+    // Height of the highest skyline segment.
+    int usedHeight() const;
+
+private:
+    struct Segment {
+        int x;
+        int y;
+        int width;
+    };
+
+    // Top of a rectangle placed at segment index, or -1 if it doesn't fit.
+    int fit(size_t index, int width, int height) const;
+
+    int atlasWidth;
+    int atlasHeight;
+    uint64_t usedArea{0};
+    std::vector<Segment> skyline;
+};
@@ -0,0 +1,202 @@
+//
+//  command_stream.cpp
+//  Metal-Guide
+//
+
+#include "command_stream.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+uint8_t* writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+uint8_t* writeHandle(uint8_t* out, const void* handle) {
+    const uint64_t value = reinterpret_cast<uintptr_t>(handle);
+    std::memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+uint64_t readVarint(const uint8_t*& in) {
+    uint64_t value = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+const void* readHandle(const uint8_t*& in) {
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return reinterpret_cast<const void*>(uintptr_t(value));
+}
+
+template <typename Target>
+void replayInto(const uint8_t* in, const uint8_t* end, Target& target) {
+    using Op = CommandStream::Op;
+    while (in < end) {
+        const Op op = Op(*in++);
+        switch (op) {
+        case Op::SetRenderPipelineState:
+            target.setRenderPipelineState(readHandle(in));
+            break;
+        case Op::SetDepthStencilState:
+            target.setDepthStencilState(readHandle(in));
+            break;
+        case Op::SetFrontFacingWinding:
+            target.setFrontFacingWinding(uint32_t(readVarint(in)));
+            break;
+        case Op::SetCullMode:
+            target.setCullMode(uint32_t(readVarint(in)));
+            break;
+        case Op::SetTriangleFillMode:
+            target.setTriangleFillMode(uint32_t(readVarint(in)));
+            break;
+        case Op::SetVertexBuffer: {
+            const void* buffer = readHandle(in);
+            const uint64_t offset = readVarint(in);
+            target.setVertexBuffer(buffer, offset, uint32_t(readVarint(in)));
+            break;
+        }
+        case Op::SetVertexBufferOffset: {
+            const uint64_t offset = readVarint(in);
+            target.setVertexBufferOffset(offset, uint32_t(readVarint(in)));
+            break;
+        }
+        case Op::SetFragmentBuffer: {
+            const void* buffer = readHandle(in);
+            const uint64_t offset = readVarint(in);
+            target.setFragmentBuffer(buffer, offset, uint32_t(readVarint(in)));
+            break;
+        }
+        case Op::SetFragmentTexture: {
+            const void* texture = readHandle(in);
+            target.setFragmentTexture(texture, uint32_t(readVarint(in)));
+            break;
+        }
+        case Op::DrawPrimitives: {
+            const uint32_t primitiveType = uint32_t(readVarint(in));
+            const uint64_t vertexStart = readVarint(in);
+            target.drawPrimitives(primitiveType, vertexStart, readVarint(in));
+            break;
+        }
+        }
+    }
+}
+
+}
+
+uint8_t* CommandStream::beginCommand(Op op) {
+    if (used + kMaxCommandBytes > bytes.size()) {
+        bytes.resize(std::max<size_t>(bytes.size() * 2, 4096));
+    }
+    uint8_t* out = bytes.data() + used;
+    *out = uint8_t(op);
+    ++commands;
+    return out + 1;
+}
+
+void CommandStream::endCommand(uint8_t* end) {
+    used = size_t(end - bytes.data());
+}
+
+void CommandStream::setRenderPipelineState(const void* state) {
+    endCommand(writeHandle(beginCommand(Op::SetRenderPipelineState), state));
+}
+
+void CommandStream::setDepthStencilState(const void* state) {
+    endCommand(writeHandle(beginCommand(Op::SetDepthStencilState), state));
+}
+
+void CommandStream::setFrontFacingWinding(uint32_t winding) {
+    endCommand(writeVarint(beginCommand(Op::SetFrontFacingWinding), winding));
+}
+
+void CommandStream::setCullMode(uint32_t cullMode) {
+    endCommand(writeVarint(beginCommand(Op::SetCullMode), cullMode));
+}
+
+void CommandStream::setTriangleFillMode(uint32_t fillMode) {
+    endCommand(writeVarint(beginCommand(Op::SetTriangleFillMode), fillMode));
+}
+
+void CommandStream::setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) {
+    uint8_t* out = writeHandle(beginCommand(Op::SetVertexBuffer), buffer);
+    endCommand(writeVarint(writeVarint(out, offset), index));
+}
+
+void CommandStream::setVertexBufferOffset(uint64_t offset, uint32_t index) {
+    endCommand(writeVarint(writeVarint(beginCommand(Op::SetVertexBufferOffset), offset), index));
+}
+
+void CommandStream::setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) {
+    uint8_t* out = writeHandle(beginCommand(Op::SetFragmentBuffer), buffer);
+    endCommand(writeVarint(writeVarint(out, offset), index));
+}
+
+void CommandStream::setFragmentTexture(const void* texture, uint32_t index) {
+    endCommand(writeVarint(writeHandle(beginCommand(Op::SetFragmentTexture), texture), index));
+}
+
+void CommandStream::drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) {
+    uint8_t* out = writeVarint(beginCommand(Op::DrawPrimitives), primitiveType);
+    endCommand(writeVarint(writeVarint(out, vertexStart), vertexCount));
+}
+
+void CommandStream::clear() {
+    used = 0;
+    commands = 0;
+}
+
+void CommandStream::append(const CommandStream& other) {
+    if (used + other.used > bytes.size()) {
+        bytes.resize(std::max(bytes.size() * 2, used + other.used));
+    }
+    if (other.used > 0) {
+        std::memcpy(bytes.data() + used, other.bytes.data(), other.used);
+    }
+    used += other.used;
+    commands += other.commands;
+}
+
+void CommandStream::replay(RenderEncoderBackend& target) const {
+    replayInto(bytes.data(), bytes.data() + used, target);
+}
+
+void CommandStream::replay(StateFilteredEncoder& target) const {
+    replayInto(bytes.data(), bytes.data() + used, target);
+}
+
+const CommandStream& ParallelRecorder::record(size_t count, const Record& record) {
+    activeStreams = (count + itemsPerStream - 1) / itemsPerStream;
+    if (partitionStreams.size() < activeStreams) {
+        partitionStreams.resize(activeStreams);
+    }
+    pool.parallelFor(activeStreams, 1, [&](size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            CommandStream& stream = partitionStreams[partition];
+            stream.clear();
+            StateFilteredEncoder encoder(stream);
+            encoder.invalidate();
+            record(partition * itemsPerStream, std::min(count, (partition + 1) * itemsPerStream), encoder);
+        }
+    });
+
+    mergedStream.clear();
+    for (size_t partition = 0; partition < activeStreams; ++partition) {
+        mergedStream.append(partitionStreams[partition]);
+    }
+    return mergedStream;
+}
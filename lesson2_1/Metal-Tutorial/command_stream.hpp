@@ -0,0 +1,111 @@
+//
+//  command_stream.hpp
+//  Metal-Guide
+//
+//  Records render encoder calls into a compact byte stream, so that draws
+//  can be recorded on many threads and encoded later on one. Each command
+//  is an opcode byte followed by its operands. Object handles take 8
+//  bytes, and offsets, indices and counts are LEB128 varints, so most
+//  take a byte or two. A draw that moves a buffer offset takes about 10
+//  bytes.
+//
+//  ParallelRecorder splits a frame's items into fixed-size partitions and
+//  records each one into its own stream on the thread pool. It then joins
+//  the streams in partition order. Partitions depend only on the item
+//  count, so the merged stream is byte-for-byte the same whatever the
+//  thread count or scheduling. Each partition records through its own
+//  StateFilteredEncoder, so the caller can set all the state every draw
+//  needs and only changes are stored. The filter starts out knowing
+//  nothing, because a partition cannot know what the one before it leaves
+//  bound. Replaying through another StateFilteredEncoder drops what turns
+//  out to be redundant across partitions.
+//
+//  Handles are recorded as addresses. The objects must outlive the
+//  replay. Like RenderEncoderBackend, this is backend-independent.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "render_state_filter.hpp"
+#include "thread_pool.hpp"
+
+class CommandStream final : public RenderEncoderBackend {
+public:
+    enum class Op : uint8_t {
+        SetRenderPipelineState,
+        SetDepthStencilState,
+        SetFrontFacingWinding,
+        SetCullMode,
+        SetTriangleFillMode,
+        SetVertexBuffer,
+        SetVertexBufferOffset,
+        SetFragmentBuffer,
+        SetFragmentTexture,
+        DrawPrimitives,
+    };
+
+    void setRenderPipelineState(const void* state) override;
+    void setDepthStencilState(const void* state) override;
+    void setFrontFacingWinding(uint32_t winding) override;
+    void setCullMode(uint32_t cullMode) override;
+    void setTriangleFillMode(uint32_t fillMode) override;
+    void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) override;
+    void setVertexBufferOffset(uint64_t offset, uint32_t index) override;
+    void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) override;
+    void setFragmentTexture(const void* texture, uint32_t index) override;
+    void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) override;
+
+    // Keeps the memory for the next recording.
+    void clear();
+    void append(const CommandStream& other);
+
+    // Issues the recorded calls in order.
+    void replay(RenderEncoderBackend& target) const;
+    void replay(StateFilteredEncoder& target) const;
+
+    const uint8_t* data() const { return bytes.data(); }
+    size_t size() const { return used; }
+    size_t commandCount() const { return commands; }
+
+private:
+    // Room for the longest command: an opcode, a handle and three varints.
+    static constexpr size_t kMaxCommandBytes = 1 + 8 + 3 * 10;
+
+    uint8_t* beginCommand(Op op);
+    void endCommand(uint8_t* end);
+
+    std::vector<uint8_t> bytes;
+    size_t used{0};
+    size_t commands{0};
+};
+
+class ParallelRecorder {
+public:
+    // Records the calls for items [begin, end) through encoder.
+    using Record = std::function<void(size_t begin, size_t end, StateFilteredEncoder& encoder)>;
+
+    explicit ParallelRecorder(size_t itemsPerStream = 1024, ThreadPool& pool = ThreadPool::shared())
+        : itemsPerStream(itemsPerStream), pool(pool) {}
+
+    // Records items [0, count) and merges the streams. The result stays
+    // valid until the next call.
+    const CommandStream& record(size_t count, const Record& record);
+
+    const CommandStream& merged() const { return mergedStream; }
+    // The partitions' streams, in order, e.g. for one encoder each under a
+    // parallel render encoder.
+    const std::vector<CommandStream>& streams() const { return partitionStreams; }
+    size_t streamCount() const { return activeStreams; }
+
+private:
+    size_t itemsPerStream;
+    ThreadPool& pool;
+    std::vector<CommandStream> partitionStreams;
+    size_t activeStreams{0};
+    CommandStream mergedStream;
+};
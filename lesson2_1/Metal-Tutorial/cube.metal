@@ -40,3 +40,31 @@ fragment float4 fragmentShader(VertexOut in [[stage_in]],
     return colorSample;
 }
 
+
+// Samples a virtual texture (see virtual_texture.hpp) at a given level. The
+// indirection texel of the page under uv holds the tile cache slot of that
+// page, or of its nearest resident coarser ancestor, and that page's level.
+float4 sampleVirtualTexture(float2 uv, float level,
+                            texture2d<uint> indirection,
+                            texture2d<float> tileCache,
+                            constant VirtualTextureParams& params) {
+    constexpr sampler cacheSampler (mag_filter::linear,
+                                    min_filter::linear);
+    uv = saturate(uv);
+    const uint wanted = min(uint(max(level, 0.0f)), params.levelCount - 1);
+    const uint2 wantedSize = max(params.size >> wanted, uint2(1));
+    const uint2 wantedTiles = (wantedSize + params.tileSize - 1) / params.tileSize;
+    const uint2 page = min(uint2(uv * float2(wantedSize)) / params.tileSize, wantedTiles - 1);
+    const uint4 entry = indirection.read(page, wanted);
+
+    // Position inside the mapped page, in texels of the page's own level.
+    const uint2 mappedSize = max(params.size >> entry.b, uint2(1));
+    const uint2 mappedTiles = (mappedSize + params.tileSize - 1) / params.tileSize;
+    const float2 mappedTexel = uv * float2(mappedSize);
+    const uint2 mappedPage = min(uint2(mappedTexel) / params.tileSize, mappedTiles - 1);
+    const float2 local = mappedTexel - float2(mappedPage * params.tileSize);
+
+    const float pageSize = float(params.tileSize + 2 * params.border);
+    const float2 cacheTexel = float2(entry.rg) * pageSize + float(params.border) + local;
+    return tileCache.sample(cacheSampler, cacheTexel / params.cacheSize);
+}
@@ -0,0 +1,178 @@
+//
+//  draw_list.cpp
+//  Metal-Guide
+//
+
+#include "draw_list.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t kStateBits = DrawList::kPipelineBits + DrawList::kMaterialBits + DrawList::kTextureBits;
+constexpr uint32_t kTransparentShift = 63 - DrawList::kPassBits;
+static_assert(DrawList::kPassBits + 1 + kStateBits + DrawList::kDepthBits == 64);
+
+constexpr uint64_t mask(uint32_t bits) {
+    return (uint64_t(1) << bits) - 1;
+}
+
+uint64_t field(uint32_t value, uint32_t bits) {
+    assert(value <= mask(bits));
+    return value & mask(bits);
+}
+
+// The float's top bits without the sign, which order like the value for
+// non-negative floats.
+uint64_t depthBits(float depth) {
+    if (!(depth > 0.0f)) {
+        return 0;
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> (31 - DrawList::kDepthBits);
+}
+
+}
+
+uint64_t DrawList::makeKey(const Draw& draw) {
+    const uint64_t state = field(draw.pipeline, kPipelineBits) << (kMaterialBits + kTextureBits) |
+                           field(draw.material, kMaterialBits) << kTextureBits | field(draw.texture, kTextureBits);
+    const uint64_t depth = depthBits(draw.depth);
+    uint64_t key = field(draw.pass, kPassBits) << (kTransparentShift + 1) | uint64_t(draw.transparent) << kTransparentShift;
+    if (draw.transparent) {
+        key |= (~depth & mask(kDepthBits)) << kStateBits | state;
+    } else {
+        key |= state << kDepthBits | depth;
+    }
+    return key;
+}
+
+DrawList::Draw DrawList::decodeKey(uint64_t key) {
+    Draw draw;
+    draw.pass = uint32_t(key >> (kTransparentShift + 1));
+    draw.transparent = (key >> kTransparentShift) & 1;
+    uint64_t state, depth;
+    if (draw.transparent) {
+        state = key & mask(kStateBits);
+        depth = ~(key >> kStateBits) & mask(kDepthBits);
+    } else {
+        state = (key >> kDepthBits) & mask(kStateBits);
+        depth = key & mask(kDepthBits);
+    }
+    draw.pipeline = uint32_t(state >> (kMaterialBits + kTextureBits));
+    draw.material = uint32_t(state >> kTextureBits) & mask(kMaterialBits);
+    draw.texture = uint32_t(state) & mask(kTextureBits);
+    const uint32_t bits = uint32_t(depth << (31 - kDepthBits));
+    std::memcpy(&draw.depth, &bits, sizeof(bits));
+    return draw;
+}
+
+void DrawList::clear() {
+    keys.clear();
+    items.clear();
+}
+
+void DrawList::add(const Draw& draw, uint32_t item) {
+    keys.push_back(makeKey(draw));
+    items.push_back(item);
+}
+
+void DrawList::sort() {
+    sortKeys(keys, items);
+}
+
+void DrawList::sortKeys(std::vector<uint64_t>& sortedKeys, std::vector<uint32_t>& sortedItems) {
+    const size_t count = sortedKeys.size();
+    assert(sortedItems.size() == count && count <= UINT32_MAX);
+    if (count < 2) {
+        return;
+    }
+    const size_t chunkCount =
+        count < kParallelKeys ? 1 : std::min<size_t>(pool.threadCount(), count / (kParallelKeys / 2));
+    auto chunkBegin = [&](size_t chunk) { return chunk * count / chunkCount; };
+    auto forEachChunk = [&](auto&& function) {
+        if (chunkCount == 1) {
+            function(0);
+        } else {
+            pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+                for (size_t chunk = begin; chunk < end; ++chunk) {
+                    function(chunk);
+                }
+            });
+        }
+    };
+
+    // Every digit's histogram in one read, per chunk. Only the first pass
+    // can use the per-chunk counts as they are, since later passes see the
+    // keys in a different order, but the totals hold for every pass. They
+    // show which digits are the same for all keys and need no pass.
+    counts.assign(chunkCount * kDigits * kBuckets, 0);
+    uint64_t* fromKeys = sortedKeys.data();
+    forEachChunk([&](size_t chunk) {
+        uint32_t* histograms = &counts[chunk * kDigits * kBuckets];
+        for (size_t i = chunkBegin(chunk), end = chunkBegin(chunk + 1); i < end; ++i) {
+            const uint64_t key = fromKeys[i];
+            for (uint32_t digit = 0; digit < kDigits; ++digit) {
+                ++histograms[digit * kBuckets + ((key >> (digit * kDigitBits)) & (kBuckets - 1))];
+            }
+        }
+    });
+
+    scratchKeys.resize(count);
+    scratchItems.resize(count);
+    uint32_t* fromItems = sortedItems.data();
+    uint64_t* toKeys = scratchKeys.data();
+    uint32_t* toItems = scratchItems.data();
+    bool firstPass = true, inScratch = false;
+    for (uint32_t digit = 0; digit < kDigits; ++digit) {
+        const uint32_t shift = digit * kDigitBits;
+        const uint64_t firstBucket = (fromKeys[0] >> shift) & (kBuckets - 1);
+        uint64_t inFirstBucket = 0;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            inFirstBucket += counts[(chunk * kDigits + digit) * kBuckets + firstBucket];
+        }
+        if (inFirstBucket == count) {
+            continue;
+        }
+        if (!firstPass && chunkCount > 1) {
+            forEachChunk([&](size_t chunk) {
+                uint32_t* histogram = &counts[(chunk * kDigits + digit) * kBuckets];
+                std::fill(histogram, histogram + kBuckets, 0);
+                for (size_t i = chunkBegin(chunk), end = chunkBegin(chunk + 1); i < end; ++i) {
+                    ++histogram[(fromKeys[i] >> shift) & (kBuckets - 1)];
+                }
+            });
+        }
+        firstPass = false;
+        // Each chunk writes each bucket after the same bucket from earlier
+        // chunks, which keeps the sort stable.
+        uint32_t offset = 0;
+        for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                uint32_t& bucketCount = counts[(chunk * kDigits + digit) * kBuckets + bucket];
+                const uint32_t bucketSize = bucketCount;
+                bucketCount = offset;
+                offset += bucketSize;
+            }
+        }
+        forEachChunk([&](size_t chunk) {
+            uint32_t* next = &counts[(chunk * kDigits + digit) * kBuckets];
+            for (size_t i = chunkBegin(chunk), end = chunkBegin(chunk + 1); i < end; ++i) {
+                const uint32_t to = next[(fromKeys[i] >> shift) & (kBuckets - 1)]++;
+                toKeys[to] = fromKeys[i];
+                toItems[to] = fromItems[i];
+            }
+        });
+        std::swap(fromKeys, toKeys);
+        std::swap(fromItems, toItems);
+        inScratch = !inScratch;
+    }
+    if (inScratch) {
+        sortedKeys.swap(scratchKeys);
+        sortedItems.swap(scratchItems);
+    }
+}
@@ -0,0 +1,75 @@
+//
+//  draw_list.hpp
+//  Metal-Guide
+//
+//  A frame's draws, each reduced to a 64-bit sort key and the caller's
+//  index for it. After sort(), walking the list in key order changes state
+//  as little as possible and draws in the order depth testing wants. Keys
+//  are, from the top bit down:
+//
+//    opaque:       pass:4 | 0 | pipeline:10 | material:12 | texture:12 | depth:25
+//    transparent:  pass:4 | 1 | ~depth:25   | pipeline:10 | material:12 | texture:12
+//
+//  Passes run in order, and opaque draws come before transparent ones.
+//  Opaque draws are grouped by state and, within the same state, go front
+//  to back so that early depth testing rejects hidden fragments.
+//  Transparent draws have to blend back to front, so depth comes before
+//  their state. Depth is the top 25 bits of the float, which sort like the
+//  value for non-negative floats.
+//
+//  Keys are sorted with an LSD radix sort, 11 bits per pass, split across
+//  the thread pool once there are enough keys. Passes over digits that all
+//  keys share are skipped. The sort is stable: draws with equal keys stay
+//  in the order they were added.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+class DrawList {
+public:
+    static constexpr uint32_t kPassBits = 4, kPipelineBits = 10, kMaterialBits = 12, kTextureBits = 12, kDepthBits = 25;
+
+    struct Draw {
+        uint32_t pass;
+        uint32_t pipeline;
+        uint32_t material;
+        uint32_t texture;
+        float depth;  // distance from the camera; negative counts as 0
+        bool transparent;
+    };
+
+    explicit DrawList(ThreadPool& pool = ThreadPool::shared()) : pool(pool) {}
+
+    static uint64_t makeKey(const Draw& draw);
+    static Draw decodeKey(uint64_t key);  // depth comes back quantized
+
+    void clear();
+    // item is returned in key order by the accessors below, e.g. an index
+    // into the caller's objects.
+    void add(const Draw& draw, uint32_t item);
+    void sort();
+
+    size_t size() const { return keys.size(); }
+    uint64_t key(size_t i) const { return keys[i]; }
+    uint32_t item(size_t i) const { return items[i]; }
+
+    // Sorts keys and reorders items to match, with the list's thread pool
+    // and scratch memory. Below kParallelKeys keys the sort stays on the
+    // calling thread.
+    static constexpr size_t kParallelKeys = 16384;
+    void sortKeys(std::vector<uint64_t>& keys, std::vector<uint32_t>& items);
+
+private:
+    ThreadPool& pool;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchItems;
+    static constexpr uint32_t kDigitBits = 11, kDigits = (64 + kDigitBits - 1) / kDigitBits, kBuckets = 1 << kDigitBits;
+    std::vector<uint32_t> counts;  // per chunk and digit
+};
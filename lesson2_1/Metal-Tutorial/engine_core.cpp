@@ -0,0 +1,256 @@
+//
+//  engine_core.cpp
+//  Metal-Guide
+//
+
+#include "engine_core.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "mip_feedback.hpp"
+
+namespace {
+
+// Texture data copied to the GPU per frame, and the staging it goes through.
+constexpr size_t kUploadBudgetBytes = size_t(8) << 20;
+constexpr size_t kUploadStagingBytes = size_t(32) << 20;
+
+// Same layouts as VertexData and TransformationData, without simd.
+struct CubeVertex {
+    alignas(16) float position[4];
+    float textureCoordinate[2];
+};
+
+struct Transforms {
+    alignas(16) float modelMatrix[16];
+    float viewMatrix[16];
+    float perspectiveMatrix[16];
+};
+
+// Per-instance transforms sit at this stride in one buffer, so each draw
+// only moves the buffer offset. 256 bytes satisfies every Metal GPU's
+// constant buffer offset alignment.
+constexpr size_t kTransformStride = 256;
+static_assert(sizeof(Transforms) <= kTransformStride);
+
+// A cube for a right-handed coordinate system, with counter-clockwise
+// faces that each map the whole texture.
+void cubeVertices(CubeVertex vertices[36]) {
+    static const float corners[8][3] = {
+        {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f},
+        {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f},
+    };
+    // Front, back, top, bottom, left, right, as corner indices.
+    static const int faces[6][4] = {
+        {0, 1, 2, 3}, {5, 4, 7, 6}, {3, 2, 6, 7}, {4, 5, 1, 0}, {4, 0, 3, 7}, {1, 5, 6, 2},
+    };
+    static const float uvs[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    static const int triangles[6] = {0, 1, 2, 2, 3, 0};
+    for (int face = 0; face < 6; ++face) {
+        for (int i = 0; i < 6; ++i) {
+            const int corner = triangles[i];
+            const float* position = corners[faces[face][corner]];
+            vertices[face * 6 + i] = {{position[0], position[1], position[2], 1.0f},
+                                      {uvs[corner][0], uvs[corner][1]}};
+        }
+    }
+}
+
+// Column-major matrices, as in AAPLMathUtilities.
+void fromRows(const float rows[16], float m[16]) {
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m[c * 4 + r] = rows[r * 4 + c];
+        }
+    }
+}
+
+void translationRotationY(float x, float y, float z, float angle, float m[16]) {
+    const float c = std::cos(angle), s = std::sin(angle);
+    const float rows[16] = {c, 0, s, x, 0, 1, 0, y, -s, 0, c, z, 0, 0, 0, 1};
+    fromRows(rows, m);
+}
+
+void perspectiveRightHand(float fovY, float aspect, float nearZ, float farZ, float m[16]) {
+    const float ys = 1.0f / std::tan(fovY * 0.5f), xs = ys / aspect, zs = farZ / (nearZ - farZ);
+    const float rows[16] = {xs, 0, 0, 0, 0, ys, 0, 0, 0, 0, zs, nearZ * zs, 0, 0, -1, 0};
+    fromRows(rows, m);
+}
+
+}
+
+EngineCore::EngineCore(MTL::Device* device, MTL::Library* library, int width, int height, const Options& options)
+    : options(options), metalDevice(device), metalCommandQueue(device->newCommandQueue()),
+      pipelineCompiler(device, library), pipelineCache(pipelineCompiler), metalRenderGraph(device),
+      targetWidth(width), targetHeight(height) {
+    uploadBackend = new MetalUploadBackend(metalDevice, metalCommandQueue, kUploadStagingBytes);
+    uploadQueue = new UploadQueue(*uploadBackend);
+
+    CubeVertex vertices[36];
+    cubeVertices(vertices);
+    cubeVertexBuffer = metalDevice->newBuffer(vertices, sizeof(vertices), MTL::ResourceStorageModeShared);
+    transformBuffer = metalDevice->newBuffer(kTransformStride * options.instances, MTL::ResourceStorageModeShared);
+    for (std::vector<float>* values : {&centerX, &centerY, &centerZ, &radius, &texelDensity, &distance}) {
+        values->resize(options.instances);
+    }
+    levels.resize(options.instances);
+
+    // The pipeline compiles on the thread pool; the cubes are drawn once
+    // it is ready.
+    PipelineDescription cubeDescription;
+    cubeDescription.vertexFunction = "vertexShader";
+    cubeDescription.fragmentFunction = "fragmentShader";
+    cubeDescription.colorFormats[0] = options.colorFormat;
+    cubeDescription.sampleCount = uint32_t(options.sampleCount);
+    cubeDescription.depthFormat = MTL::PixelFormatDepth32Float;
+    cubePipeline = pipelineCache.request(cubeDescription);
+
+    MTL::DepthStencilDescriptor* depthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLessEqual);
+    depthStencilDescriptor->setDepthWriteEnabled(true);
+    depthStencilState = metalDevice->newDepthStencilState(depthStencilDescriptor);
+    depthStencilDescriptor->release();
+
+    createRenderGraph();
+}
+
+EngineCore::~EngineCore() {
+    delete uploadQueue;
+    delete uploadBackend;
+    depthStencilState->release();
+    transformBuffer->release();
+    cubeVertexBuffer->release();
+    metalCommandQueue->release();
+}
+
+void EngineCore::resize(int width, int height) {
+    targetWidth = width;
+    targetHeight = height;
+    // While the attachments still fit the graph's heap, this only
+    // re-creates the textures in it.
+    createRenderGraph();
+}
+
+void EngineCore::createRenderGraph() {
+    // The frame as a graph: the graph sizes the attachments to the target,
+    // places them in its heap and picks their load and store actions.
+    // Without MSAA the pass renders straight into the target.
+    const uint32_t width = uint32_t(targetWidth), height = uint32_t(targetHeight);
+    const uint32_t sampleCount = uint32_t(options.sampleCount);
+    graph = RenderGraph();
+    targetResource = graph.importTexture("target");
+    RenderGraph::Resource depth =
+        graph.createTexture("depth", {MTL::PixelFormatDepth32Float, width, height, sampleCount});
+    const float clearColor[4] = {41.0f/255.0f, 42.0f/255.0f, 48.0f/255.0f, 1.0f};
+    RenderGraph::PassBuilder cubes = graph.addPass("cubes", [this](void* encoder) {
+        encodeCubes(static_cast<MTL::RenderCommandEncoder*>(encoder));
+    });
+    if (sampleCount > 1) {
+        RenderGraph::Resource msaaColor =
+            graph.createTexture("msaa colour", {options.colorFormat, width, height, sampleCount});
+        cubes.clearColor(msaaColor, clearColor, targetResource);
+    } else {
+        cubes.clearColor(targetResource, clearColor);
+    }
+    cubes.clearDepth(depth, 1.0f);
+    metalRenderGraph.compile(graph);
+}
+
+void EngineCore::update() {
+    // Upload copies are committed ahead of the frame's render commands on
+    // the same queue, so anything submitted here can be drawn this frame.
+    uploadQueue->beginFrame();
+    uploadQueue->flush(kUploadBudgetBytes);
+    pipelineCache.update();
+}
+
+MTL::CommandBuffer* EngineCore::encode(MTL::Texture* target, double seconds) {
+    writeTransforms(seconds);
+    MTL::CommandBuffer* commandBuffer = metalCommandQueue->commandBuffer();
+    metalRenderGraph.setImport(targetResource, target);
+    metalRenderGraph.execute(commandBuffer);
+    return commandBuffer;
+}
+
+// Instances stand in a square grid far enough back to fit in view, each
+// turning with its own phase. A single cube sits 1 unit down the negative
+// z-axis. The camera is at z = 1, looking down -z.
+void EngineCore::writeTransforms(double seconds) {
+    const int side = int(std::ceil(std::sqrt(double(options.instances))));
+    const float spacing = 1.5f;
+    const float gridDistance = 2.0f + 0.5f * spacing * side;
+    fovY = float(M_PI) / 2.0f;
+    aspect = float(targetWidth) / float(targetHeight);
+    nearZ = 0.1f;
+    farZ = 100.0f + (side > 1 ? gridDistance : 0.0f);
+
+    Transforms transforms;
+    const float view[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, -1, 0, 0, 0, 1};
+    fromRows(view, viewMatrix);
+    std::memcpy(transforms.viewMatrix, viewMatrix, sizeof(viewMatrix));
+    perspectiveRightHand(fovY, aspect, nearZ, farZ, transforms.perspectiveMatrix);
+    uint8_t* contents = static_cast<uint8_t*>(transformBuffer->contents());
+    const float angle = float(seconds / 2.0 * 45.0 * M_PI / 180.0);
+    const float density = textureSource ? textureSource->texelDensity() : 0.0f;
+    for (int i = 0; i < options.instances; ++i) {
+        const float x = (float(i % side) - 0.5f * (side - 1)) * spacing;
+        const float y = (float(i / side) - 0.5f * (side - 1)) * spacing;
+        const float z = side > 1 ? -gridDistance : -1.0f;
+        translationRotationY(x, y, z, angle + 0.37f * i, transforms.modelMatrix);
+        std::memcpy(contents + kTransformStride * i, &transforms, sizeof(transforms));
+        centerX[i] = x;
+        centerY[i] = y;
+        centerZ[i] = z;
+        radius[i] = 0.5f * std::sqrt(3.0f);
+        texelDensity[i] = density;
+        distance[i] = std::sqrt(x * x + y * y + (z - 1.0f) * (z - 1.0f));
+    }
+}
+
+void EngineCore::encodeCubes(MTL::RenderCommandEncoder* encoder) {
+    // Stream in only the mip levels the cubes need at their current
+    // distance; off screen, that is just the smallest level.
+    MTL::Texture* texture = nullptr;
+    if (textureSource) {
+        MipFeedback::View view = {{}, fovY, aspect, nearZ, farZ, float(targetHeight)};
+        std::memcpy(view.viewMatrix, viewMatrix, sizeof(view.viewMatrix));
+        const MipFeedback::Objects cubes = {centerX.data(), centerY.data(), centerZ.data(), radius.data(),
+                                            texelDensity.data(), levels.size()};
+        MipFeedback::computeLevelsParallel(view, cubes, levels.data());
+        texture = textureSource->texture(*std::min_element(levels.begin(), levels.end()));
+    }
+    // Until the pipeline has compiled and the texture's first upload has
+    // gone out there is nothing to draw with.
+    void* cubePSO = pipelineCache.get(cubePipeline);
+    if (!cubePSO || !texture) {
+        return;
+    }
+
+    // Nearest instances first, so that depth testing rejects what they hide.
+    drawList.clear();
+    for (int i = 0; i < options.instances; ++i) {
+        drawList.add({0, 0, 0, 0, distance[i], false}, uint32_t(i));
+    }
+    drawList.sort();
+    // Instances are recorded on the thread pool, every one with all the
+    // state it needs, and replayed in order into the encoder. The filter
+    // leaves one state change per draw, the transform offset.
+    const CommandStream& commands = recorder.record(drawList.size(), [&](size_t begin, size_t end,
+                                                                         StateFilteredEncoder& recording) {
+        for (size_t draw = begin; draw < end; ++draw) {
+            recording.setFrontFacingWinding(MTL::WindingCounterClockwise);
+            recording.setCullMode(MTL::CullModeBack);
+            recording.setRenderPipelineState(cubePSO);
+            recording.setDepthStencilState(depthStencilState);
+            recording.setVertexBuffer(cubeVertexBuffer, 0, 0);
+            recording.setVertexBuffer(transformBuffer, kTransformStride * drawList.item(draw), 1);
+            recording.setFragmentTexture(texture, 0);
+            recording.drawPrimitives(MTL::PrimitiveTypeTriangle, 0, 36);
+        }
+    });
+    encoderBackend.setEncoder(encoder);
+    stateFilter.reset();
+    commands.replay(stateFilter);
+}
@@ -0,0 +1,116 @@
+//
+//  engine_core.hpp
+//  Metal-Guide
+//
+//  The engine's frame without its window: the command queue, texture
+//  uploads, the cube's pipeline, the render graph and the cube pass. The
+//  pass draws a square grid of turning cubes, one by default. It records
+//  their draws on the thread pool and asks a TextureSource for the mip
+//  level the cubes need. MTLEngine renders into the drawable with it.
+//  Headless mode renders into a texture of its own with it, as does
+//  tools/encodebench.cpp against null-metal/.
+//
+//  Only metal-cpp is needed: no GLFW, no CAMetalLayer and no simd.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Metal/Metal.hpp>
+
+#include "command_stream.hpp"
+#include "draw_list.hpp"
+#include "metal_pipeline_compiler.hpp"
+#include "metal_render_encoder_backend.hpp"
+#include "metal_render_graph.hpp"
+#include "metal_upload_backend.hpp"
+#include "upload_queue.hpp"
+
+class EngineCore {
+public:
+    struct Options {
+        uint32_t colorFormat{MTL::PixelFormatBGRA8Unorm};
+        int sampleCount{4};
+        int instances{1};
+    };
+
+    // Where the cubes' texture comes from.
+    class TextureSource {
+    public:
+        virtual ~TextureSource() = default;
+        // Texels per world unit at level 0; each cube face maps the whole
+        // texture onto 1 unit.
+        virtual float texelDensity() const = 0;
+        // Called once per frame with the finest level any cube needs, or
+        // MipFeedback::kNotVisible. Returns nullptr while there is nothing
+        // to draw with.
+        virtual MTL::Texture* texture(uint8_t level) = 0;
+    };
+
+    // The device and library stay the caller's.
+    EngineCore(MTL::Device* device, MTL::Library* library, int width, int height, const Options& options);
+    ~EngineCore();
+    EngineCore(const EngineCore&) = delete;
+    EngineCore& operator=(const EngineCore&) = delete;
+
+    void setTextureSource(TextureSource* source) { textureSource = source; }
+    // Re-plans the attachments for the new target size.
+    void resize(int width, int height);
+
+    // Retires and submits texture uploads and collects compiled pipelines.
+    // Call once per frame before encode().
+    void update();
+    // A command buffer that renders the cubes at `seconds` into target. The
+    // caller presents, commits and waits for it.
+    MTL::CommandBuffer* encode(MTL::Texture* target, double seconds);
+
+    bool pipelineFailed() const { return pipelineCache.state(cubePipeline) == PipelineCache::State::Failed; }
+    const std::string& pipelineError() const { return pipelineCache.error(cubePipeline); }
+
+    MTL::Device* device() const { return metalDevice; }
+    MTL::CommandQueue* commandQueue() const { return metalCommandQueue; }
+    UploadQueue& uploads() { return *uploadQueue; }
+    PipelineCache& pipelines() { return pipelineCache; }
+    const MetalRenderGraph& renderGraph() const { return metalRenderGraph; }
+    int width() const { return targetWidth; }
+    int height() const { return targetHeight; }
+
+private:
+    void createRenderGraph();
+    void writeTransforms(double seconds);
+    void encodeCubes(MTL::RenderCommandEncoder* encoder);
+
+    const Options options;
+    MTL::Device* metalDevice;
+    MTL::CommandQueue* metalCommandQueue;
+    // Freed before the queue they copy on.
+    MetalUploadBackend* uploadBackend;
+    UploadQueue* uploadQueue;
+    MetalPipelineCompiler pipelineCompiler;
+    PipelineCache pipelineCache;
+    PipelineCache::Key cubePipeline;
+    MTL::DepthStencilState* depthStencilState;
+    MTL::Buffer* cubeVertexBuffer;
+    MTL::Buffer* transformBuffer;
+
+    RenderGraph graph;
+    MetalRenderGraph metalRenderGraph;
+    RenderGraph::Resource targetResource;
+    int targetWidth;
+    int targetHeight;
+
+    TextureSource* textureSource{nullptr};
+    // Per instance, for mip feedback and draw order.
+    std::vector<float> centerX, centerY, centerZ, radius, texelDensity, distance;
+    std::vector<uint8_t> levels;
+    float viewMatrix[16];
+    float fovY, aspect, nearZ, farZ;
+
+    DrawList drawList;
+    ParallelRecorder recorder;
+    MetalRenderEncoderBackend encoderBackend;
+    StateFilteredEncoder stateFilter{encoderBackend};
+};
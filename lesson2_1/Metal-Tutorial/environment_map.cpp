@@ -0,0 +1,422 @@
+//
+//  environment_map.cpp
+//  Metal-Guide
+//
+
+#include "environment_map.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "thread_pool.hpp"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace EnvironmentMap {
+
+namespace {
+
+// Face rows per unit of parallel work.
+constexpr size_t kGrainRows = 4;
+constexpr float kPi = 3.14159265358979f;
+
+// One RGBA texel in float lanes, as in ImageResize.
+#if defined(__ARM_NEON)
+using Pixel = float32x4_t;
+inline Pixel zero() { return vdupq_n_f32(0.0f); }
+inline Pixel load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, Pixel v) { vst1q_f32(p, v); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) { return vmlaq_n_f32(acc, v, w); }
+#elif defined(__SSE2__)
+using Pixel = __m128;
+inline Pixel zero() { return _mm_setzero_ps(); }
+inline Pixel load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+#else
+struct Pixel { float v[4]; };
+inline Pixel zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+inline Pixel load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, Pixel v) { std::copy(v.v, v.v + 4, p); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) {
+    for (int i = 0; i < 4; ++i) {
+        acc.v[i] += v.v[i] * w;
+    }
+    return acc;
+}
+#endif
+
+inline Pixel lerp(Pixel a, Pixel b, float t) {
+    return multiplyAdd(multiplyAdd(zero(), a, 1.0f - t), b, t);
+}
+
+// Unnormalized direction for face coordinates s, t in [-1, 1], with t
+// growing downwards. Matches Metal's cube face layout.
+void faceDirection(int face, float s, float t, float direction[3]) {
+    switch (face) {
+        case 0: direction[0] = 1.0f; direction[1] = -t; direction[2] = -s; break;
+        case 1: direction[0] = -1.0f; direction[1] = -t; direction[2] = s; break;
+        case 2: direction[0] = s; direction[1] = 1.0f; direction[2] = t; break;
+        case 3: direction[0] = s; direction[1] = -1.0f; direction[2] = -t; break;
+        case 4: direction[0] = s; direction[1] = -t; direction[2] = 1.0f; break;
+        default: direction[0] = -s; direction[1] = -t; direction[2] = -1.0f; break;
+    }
+}
+
+// Inverse of faceDirection; direction need not be normalized.
+void directionToFace(const float direction[3], int& face, float& s, float& t) {
+    const float ax = std::abs(direction[0]), ay = std::abs(direction[1]), az = std::abs(direction[2]);
+    if (ax >= ay && ax >= az) {
+        face = direction[0] > 0.0f ? 0 : 1;
+        s = (direction[0] > 0.0f ? -direction[2] : direction[2]) / ax;
+        t = -direction[1] / ax;
+    } else if (ay >= az) {
+        face = direction[1] > 0.0f ? 2 : 3;
+        s = direction[0] / ay;
+        t = (direction[1] > 0.0f ? direction[2] : -direction[2]) / ay;
+    } else {
+        face = direction[2] > 0.0f ? 4 : 5;
+        s = (direction[2] > 0.0f ? direction[0] : -direction[0]) / az;
+        t = -direction[1] / az;
+    }
+}
+
+// Bilinear, clamped to the face; edge texels don't blend across seams.
+Pixel sampleFace(const float* face, int size, float fx, float fy) {
+    fx = std::clamp(fx, 0.0f, float(size - 1));
+    fy = std::clamp(fy, 0.0f, float(size - 1));
+    const int x0 = int(fx), y0 = int(fy);
+    const int x1 = std::min(x0 + 1, size - 1), y1 = std::min(y0 + 1, size - 1);
+    const float ax = fx - x0, ay = fy - y0;
+    const float* row0 = face + size_t(y0) * size * 4;
+    const float* row1 = face + size_t(y1) * size * 4;
+    Pixel acc = multiplyAdd(zero(), load(row0 + x0 * 4), (1.0f - ax) * (1.0f - ay));
+    acc = multiplyAdd(acc, load(row0 + x1 * 4), ax * (1.0f - ay));
+    acc = multiplyAdd(acc, load(row1 + x0 * 4), (1.0f - ax) * ay);
+    return multiplyAdd(acc, load(row1 + x1 * 4), ax * ay);
+}
+
+// Trilinear lookup in a cubemap's mip chain.
+Pixel sampleCube(const Cubemap& cubemap, const float direction[3], float lod) {
+    int face;
+    float s, t;
+    directionToFace(direction, face, s, t);
+    const int level = int(lod);
+    auto sampleLevel = [&](int l) {
+        const int size = cubemap.levelSize(l);
+        return sampleFace(cubemap.face(l, face), size, (s + 1.0f) * 0.5f * size - 0.5f, (t + 1.0f) * 0.5f * size - 0.5f);
+    };
+    const float fraction = lod - level;
+    if (fraction <= 0.0f || level + 1 >= int(cubemap.levels.size())) {
+        return sampleLevel(level);
+    }
+    return lerp(sampleLevel(level), sampleLevel(level + 1), fraction);
+}
+
+// Bilinear, wrapping around horizontally and clamped at the poles.
+Pixel sampleEquirectangular(const float* pixels, int width, int height, const float direction[3]) {
+    const float u = 0.5f + std::atan2(direction[0], -direction[2]) / (2.0f * kPi);
+    const float v = std::acos(std::clamp(direction[1], -1.0f, 1.0f)) / kPi;
+    const float fx = u * width - 0.5f;
+    const float fy = std::clamp(v * height - 0.5f, 0.0f, float(height - 1));
+    const int x0 = int(std::floor(fx)), y0 = int(fy);
+    const int y1 = std::min(y0 + 1, height - 1);
+    const float ax = fx - x0, ay = fy - y0;
+    const int wrapped0 = (x0 % width + width) % width;
+    const int wrapped1 = (wrapped0 + 1) % width;
+    const float* row0 = pixels + size_t(y0) * width * 4;
+    const float* row1 = pixels + size_t(y1) * width * 4;
+    Pixel acc = multiplyAdd(zero(), load(row0 + wrapped0 * 4), (1.0f - ax) * (1.0f - ay));
+    acc = multiplyAdd(acc, load(row0 + wrapped1 * 4), ax * (1.0f - ay));
+    acc = multiplyAdd(acc, load(row1 + wrapped0 * 4), (1.0f - ax) * ay);
+    return multiplyAdd(acc, load(row1 + wrapped1 * 4), ax * ay);
+}
+
+void shBasis(const float d[3], float basis[9]) {
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * d[1];
+    basis[2] = 0.488603f * d[2];
+    basis[3] = 0.488603f * d[0];
+    basis[4] = 1.092548f * d[0] * d[1];
+    basis[5] = 1.092548f * d[1] * d[2];
+    basis[6] = 0.315392f * (3.0f * d[2] * d[2] - 1.0f);
+    basis[7] = 1.092548f * d[0] * d[2];
+    basis[8] = 0.546274f * (d[0] * d[0] - d[1] * d[1]);
+}
+
+float radicalInverse(uint32_t bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+    bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+    bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+// One GGX sample around +Z: the reflected direction, its cosine weight
+// and the source level whose texels match the sample's solid angle.
+struct LobeSample {
+    float direction[3];
+    float weight;
+    float lod;
+};
+
+std::vector<LobeSample> ggxSamples(float roughness, int sampleCount, int sourceSize, int sourceLevels) {
+    const float alpha = roughness * roughness;
+    const float alpha2 = alpha * alpha;
+    const float texelSolidAngle = 4.0f * kPi / (6.0f * sourceSize * sourceSize);
+    std::vector<LobeSample> samples;
+    for (int i = 0; i < sampleCount; ++i) {
+        const float phi = 2.0f * kPi * (float(i) + 0.5f) / float(sampleCount);
+        const float xi = radicalInverse(uint32_t(i));
+        const float cosTheta = std::sqrt((1.0f - xi) / (1.0f + (alpha2 - 1.0f) * xi));
+        const float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+        // With N = V, reflecting V about H puts L at twice H's angle.
+        const float cosL = 2.0f * cosTheta * cosTheta - 1.0f;
+        if (cosL <= 0.0f) {
+            continue;
+        }
+        const float sinL = 2.0f * sinTheta * cosTheta;
+        const float denominator = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+        const float distribution = alpha2 / (kPi * denominator * denominator);
+        // pdf(L) = D * NdotH / (4 * VdotH), and NdotH = VdotH here.
+        const float pdf = std::max(distribution * 0.25f, 1e-6f);
+        const float sampleSolidAngle = 1.0f / (float(sampleCount) * pdf);
+        const float lod = std::clamp(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f,
+                                     float(sourceLevels - 1));
+        samples.push_back({{sinL * std::cos(phi), sinL * std::sin(phi), cosL}, cosL, lod});
+    }
+    return samples;
+}
+
+}
+
+void texelDirection(int face, int x, int y, int size, float direction[3]) {
+    faceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, direction);
+    const float scale = 1.0f / std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] +
+                                         direction[2] * direction[2]);
+    for (int i = 0; i < 3; ++i) {
+        direction[i] *= scale;
+    }
+}
+
+Cubemap fromEquirectangular(const float* pixels, int width, int height, int faceSize) {
+    assert(width > 0 && height > 0 && faceSize > 0);
+    Cubemap cubemap;
+    cubemap.size = faceSize;
+    cubemap.levels.emplace_back(size_t(6) * faceSize * faceSize * 4);
+
+    // Around the equator four faces share the panorama's width; near the
+    // poles texels shrink further, which the grid does not chase.
+    const int grid = std::clamp(int(std::ceil(double(width) / (4.0 * faceSize))), 1, 8);
+    const float sampleWeight = 1.0f / float(grid * grid);
+    ThreadPool::shared().parallelFor(size_t(6) * faceSize, kGrainRows, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            const int face = int(row / faceSize), y = int(row % faceSize);
+            float* out = cubemap.face(0, face) + size_t(y) * faceSize * 4;
+            for (int x = 0; x < faceSize; ++x) {
+                Pixel acc = zero();
+                for (int j = 0; j < grid; ++j) {
+                    const float t = 2.0f * (y + (j + 0.5f) / grid) / faceSize - 1.0f;
+                    for (int i = 0; i < grid; ++i) {
+                        const float s = 2.0f * (x + (i + 0.5f) / grid) / faceSize - 1.0f;
+                        float direction[3];
+                        faceDirection(face, s, t, direction);
+                        const float scale = 1.0f / std::sqrt(direction[0] * direction[0] +
+                                                             direction[1] * direction[1] + direction[2] * direction[2]);
+                        for (float& component : direction) {
+                            component *= scale;
+                        }
+                        acc = multiplyAdd(acc, sampleEquirectangular(pixels, width, height, direction), sampleWeight);
+                    }
+                }
+                store(out + x * 4, acc);
+            }
+        }
+    });
+    return cubemap;
+}
+
+void buildMipChain(Cubemap& cubemap) {
+    cubemap.levels.resize(1);
+    for (int level = 1; cubemap.levelSize(level - 1) > 1; ++level) {
+        const int sourceSize = cubemap.levelSize(level - 1), size = cubemap.levelSize(level);
+        cubemap.levels.emplace_back(size_t(6) * size * size * 4);
+        ThreadPool::shared().parallelFor(size_t(6) * size, kGrainRows, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                const int face = int(row / size), y = int(row % size);
+                const float* source = cubemap.face(level - 1, face);
+                const float* row0 = source + size_t(2 * y) * sourceSize * 4;
+                const float* row1 = source + size_t(std::min(2 * y + 1, sourceSize - 1)) * sourceSize * 4;
+                float* out = cubemap.face(level, face) + size_t(y) * size * 4;
+                for (int x = 0; x < size; ++x) {
+                    const int x0 = 2 * x, x1 = std::min(2 * x + 1, sourceSize - 1);
+                    Pixel acc = multiplyAdd(zero(), load(row0 + x0 * 4), 0.25f);
+                    acc = multiplyAdd(acc, load(row0 + x1 * 4), 0.25f);
+                    acc = multiplyAdd(acc, load(row1 + x0 * 4), 0.25f);
+                    store(out + x * 4, multiplyAdd(acc, load(row1 + x1 * 4), 0.25f));
+                }
+            }
+        });
+    }
+}
+
+SphericalHarmonics9 projectRadiance(const Cubemap& cubemap) {
+    const int size = cubemap.size;
+    const size_t rows = size_t(6) * size;
+    // Per-row sums, added up in row order afterwards so the result does
+    // not depend on how rows were split between threads.
+    std::vector<float> rowSums(rows * 9 * 4);
+    std::vector<double> rowWeights(rows);
+    ThreadPool::shared().parallelFor(rows, kGrainRows, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            const int face = int(row / size), y = int(row % size);
+            const float* texels = cubemap.face(0, face) + size_t(y) * size * 4;
+            const float t = 2.0f * (y + 0.5f) / size - 1.0f;
+            Pixel acc[9];
+            for (Pixel& a : acc) {
+                a = zero();
+            }
+            double weights = 0.0;
+            for (int x = 0; x < size; ++x) {
+                const float s = 2.0f * (x + 0.5f) / size - 1.0f;
+                float direction[3];
+                faceDirection(face, s, t, direction);
+                const float inverseLength = 1.0f / std::sqrt(1.0f + s * s + t * t);
+                for (float& component : direction) {
+                    component *= inverseLength;
+                }
+                // Solid angle of a texel, up to the constant (2 / size)^2.
+                const float weight = inverseLength * inverseLength * inverseLength;
+                weights += weight;
+                float basis[9];
+                shBasis(direction, basis);
+                const Pixel texel = load(texels + x * 4);
+                for (int k = 0; k < 9; ++k) {
+                    acc[k] = multiplyAdd(acc[k], texel, basis[k] * weight);
+                }
+            }
+            for (int k = 0; k < 9; ++k) {
+                store(&rowSums[(row * 9 + k) * 4], acc[k]);
+            }
+            rowWeights[row] = weights;
+        }
+    });
+
+    double sums[9][3] = {};
+    double totalWeight = 0.0;
+    for (size_t row = 0; row < rows; ++row) {
+        for (int k = 0; k < 9; ++k) {
+            for (int c = 0; c < 3; ++c) {
+                sums[k][c] += rowSums[(row * 9 + k) * 4 + c];
+            }
+        }
+        totalWeight += rowWeights[row];
+    }
+    // Normalizing by the summed weights makes the texel solid angles add
+    // up to exactly 4 pi.
+    SphericalHarmonics9 sh;
+    const double scale = 4.0 * M_PI / totalWeight;
+    for (int k = 0; k < 9; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            sh.coefficients[k][c] = float(sums[k][c] * scale);
+        }
+    }
+    return sh;
+}
+
+SphericalHarmonics9 irradianceFromRadiance(const SphericalHarmonics9& radiance) {
+    // Clamped cosine lobe in SH: pi, 2 pi / 3, pi / 4 for bands 0, 1, 2.
+    const float bands[9] = {kPi, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f,
+                            kPi / 4.0f, kPi / 4.0f, kPi / 4.0f, kPi / 4.0f, kPi / 4.0f};
+    SphericalHarmonics9 irradiance;
+    for (int k = 0; k < 9; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            irradiance.coefficients[k][c] = radiance.coefficients[k][c] * bands[k];
+        }
+    }
+    return irradiance;
+}
+
+void evaluate(const SphericalHarmonics9& sh, const float direction[3], float rgb[3]) {
+    float basis[9];
+    shBasis(direction, basis);
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = 0.0f;
+        for (int k = 0; k < 9; ++k) {
+            rgb[c] += sh.coefficients[k][c] * basis[k];
+        }
+    }
+}
+
+Cubemap prefilterSpecular(const Cubemap& source, int levelCount, int sampleCount) {
+    assert(levelCount >= 1 && sampleCount >= 1);
+    Cubemap chained;
+    const Cubemap* radiance = &source;
+    if (source.levels.size() == 1 && source.size > 1) {
+        chained.size = source.size;
+        chained.levels.push_back(source.levels[0]);
+        buildMipChain(chained);
+        radiance = &chained;
+    }
+    const int sourceLevels = int(radiance->levels.size());
+
+    Cubemap result;
+    result.size = source.size;
+    result.levels.push_back(source.levels[0]);
+    for (int level = 1; level < levelCount; ++level) {
+        const float roughness = float(level) / float(levelCount - 1);
+        const std::vector<LobeSample> samples = ggxSamples(roughness, sampleCount, source.size, sourceLevels);
+        float totalWeight = 0.0f;
+        for (const LobeSample& sample : samples) {
+            totalWeight += sample.weight;
+        }
+        const float inverseWeight = 1.0f / totalWeight;
+
+        const int size = result.levelSize(level);
+        result.levels.emplace_back(size_t(6) * size * size * 4);
+        ThreadPool::shared().parallelFor(size_t(6) * size, 1, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                const int face = int(row / size), y = int(row % size);
+                float* out = result.face(level, face) + size_t(y) * size * 4;
+                for (int x = 0; x < size; ++x) {
+                    float normal[3];
+                    texelDirection(face, x, y, size, normal);
+                    // Tangent frame around the normal.
+                    const float up[3] = {std::abs(normal[2]) < 0.999f ? 0.0f : 1.0f, 0.0f,
+                                         std::abs(normal[2]) < 0.999f ? 1.0f : 0.0f};
+                    float tangent[3] = {up[1] * normal[2] - up[2] * normal[1], up[2] * normal[0] - up[0] * normal[2],
+                                        up[0] * normal[1] - up[1] * normal[0]};
+                    const float tangentScale = 1.0f / std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] +
+                                                                tangent[2] * tangent[2]);
+                    for (float& component : tangent) {
+                        component *= tangentScale;
+                    }
+                    const float bitangent[3] = {normal[1] * tangent[2] - normal[2] * tangent[1],
+                                                normal[2] * tangent[0] - normal[0] * tangent[2],
+                                                normal[0] * tangent[1] - normal[1] * tangent[0]};
+
+                    Pixel acc = zero();
+                    for (const LobeSample& sample : samples) {
+                        float direction[3];
+                        for (int i = 0; i < 3; ++i) {
+                            direction[i] = tangent[i] * sample.direction[0] + bitangent[i] * sample.direction[1] +
+                                           normal[i] * sample.direction[2];
+                        }
+                        acc = multiplyAdd(acc, sampleCube(*radiance, direction, sample.lod), sample.weight);
+                    }
+                    store(out + x * 4, multiplyAdd(zero(), acc, inverseWeight));
+                }
+            }
+        });
+    }
+    return result;
+}
+
+}
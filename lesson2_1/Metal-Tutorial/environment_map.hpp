@@ -0,0 +1,68 @@
+//
+//  environment_map.hpp
+//  Metal-Guide
+//
+//  Image-based lighting preprocessing on the CPU: equirectangular panorama
+//  to cubemap, 9-coefficient spherical harmonics for diffuse irradiance, and
+//  a GGX-prefiltered mip chain for specular. Everything works on RGBA32F,
+//  filters four channels at a time with NEON or SSE2, and splits rows across
+//  ThreadPool::shared().
+//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace EnvironmentMap {
+
+// Faces are ordered +X, -X, +Y, -Y, +Z, -Z and oriented like Metal cube
+// textures. Row 0 of each face is its top.
+struct Cubemap {
+    int size = 0;  // face edge in texels at level 0
+    // levels[l] holds the six faces of level l back to back, each
+    // max(size >> l, 1) squared RGBA32F texels.
+    std::vector<std::vector<float>> levels;
+
+    int levelSize(int level) const { return size >> level > 0 ? size >> level : 1; }
+    float* face(int level, int face) {
+        return levels[level].data() + size_t(face) * levelSize(level) * levelSize(level) * 4;
+    }
+    const float* face(int level, int face) const {
+        return levels[level].data() + size_t(face) * levelSize(level) * levelSize(level) * 4;
+    }
+};
+
+// Unit direction through the centre of texel (x, y) of a face.
+void texelDirection(int face, int x, int y, int size, float direction[3]);
+
+// Resamples an RGBA32F panorama (row 0 at +Y, u = 0.5 looking down -Z,
+// u increasing towards +X) into a single-level cubemap. Each face texel
+// averages a grid of bilinear samples sized to the source texels it covers.
+Cubemap fromEquirectangular(const float* pixels, int width, int height, int faceSize);
+
+// Box-filters levels 1 and up from level 0.
+void buildMipChain(Cubemap& cubemap);
+
+// RGB coefficients in the real SH basis, ordered l = 0, then l = 1 as
+// (y, z, x), then l = 2 as (xy, yz, 3z^2 - 1, xz, x^2 - y^2).
+struct SphericalHarmonics9 {
+    float coefficients[9][3];
+};
+
+// Projects level 0, weighting each texel by its solid angle. The result
+// is the same for any thread count.
+SphericalHarmonics9 projectRadiance(const Cubemap& cubemap);
+// Convolves radiance with the clamped cosine lobe, so evaluate() returns
+// irradiance. Divide by pi for the diffuse radiance of a white surface.
+SphericalHarmonics9 irradianceFromRadiance(const SphericalHarmonics9& radiance);
+void evaluate(const SphericalHarmonics9& sh, const float direction[3], float rgb[3]);
+
+// Split-sum prefiltered radiance: level l is convolved with the GGX lobe
+// for roughness l / (levelCount - 1), with N = V = R. Level 0 is a copy.
+// Samples read the source's mip chain at the level matching their PDF,
+// which keeps low sample counts free of fireflies; the chain is built
+// here if source has only level 0.
+Cubemap prefilterSpecular(const Cubemap& source, int levelCount, int sampleCount = 128);
+
+}
@@ -0,0 +1,248 @@
+//
+//  headless_benchmark.cpp
+//  Metal-Guide
+//
+
+#include "headless_benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+
+#include "engine_core.hpp"
+
+namespace HeadlessBenchmark {
+
+const char* const kUsage = "--headless [--frames N] [--warmup N] [--size WxH] [--msaa 1|2|4|8] [--instances N]";
+
+namespace {
+
+constexpr int kTextureSize = 256;
+
+bool parseInt(const char* text, int minimum, int maximum, int& value) {
+    char* end;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+    value = int(parsed);
+    return true;
+}
+
+struct Summary {
+    double mean, median, p95, p99, min, max;
+};
+
+Summary summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (double sample : samples) {
+        total += sample;
+    }
+    auto percentile = [&](double p) { return samples[std::min(samples.size() - 1, size_t(p * samples.size()))]; };
+    return {total / samples.size(), percentile(0.5), percentile(0.95), percentile(0.99), samples.front(),
+            samples.back()};
+}
+
+void writeSummary(std::ostream& out, const char* name, const Summary& summary, bool last) {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "  \"%s\": {\"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, "
+                  "\"max\": %.4f}%s\n",
+                  name, summary.mean, summary.median, summary.p95, summary.p99, summary.min, summary.max,
+                  last ? "" : ",");
+    out << line;
+}
+
+double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Drives the engine's EngineCore into a texture that stands in for the
+// drawable, with a checkerboard in place of the image the engine loads.
+class Renderer : private EngineCore::TextureSource {
+public:
+    explicit Renderer(const Options& options);
+    ~Renderer() override;
+
+    bool ready() const { return core && !core->pipelineFailed(); }
+    const char* deviceName() const { return name.c_str(); }
+
+    // Encodes and commits one frame and waits for it. encodeMilliseconds
+    // covers the CPU work up to commit().
+    void frame(int index, double& encodeMilliseconds, double& frameMilliseconds);
+
+private:
+    float texelDensity() const override { return float(kTextureSize); }
+    MTL::Texture* texture(uint8_t) override { return checkerboard; }
+
+    std::string name;
+    MTL::Device* device;
+    MTL::Library* library;
+    MTL::Texture* target;
+    MTL::Texture* checkerboard;
+    EngineCore* core{nullptr};
+};
+
+Renderer::Renderer(const Options& options) {
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    device = MTL::CreateSystemDefaultDevice();
+    name = device->name()->utf8String();
+
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    textureDescriptor->setWidth(options.width);
+    textureDescriptor->setHeight(options.height);
+    textureDescriptor->setUsage(MTL::TextureUsageRenderTarget);
+    textureDescriptor->setStorageMode(MTL::StorageModePrivate);
+    target = device->newTexture(textureDescriptor);
+    textureDescriptor->release();
+
+    std::vector<uint8_t> pixels(size_t(kTextureSize) * kTextureSize * 4);
+    for (int y = 0; y < kTextureSize; ++y) {
+        for (int x = 0; x < kTextureSize; ++x) {
+            const uint8_t shade = ((x / 32) ^ (y / 32)) & 1 ? 200 : 60;
+            uint8_t* pixel = &pixels[(size_t(y) * kTextureSize + x) * 4];
+            pixel[0] = shade / 2; pixel[1] = shade; pixel[2] = shade / 3; pixel[3] = 255;
+        }
+    }
+    textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setWidth(kTextureSize);
+    textureDescriptor->setHeight(kTextureSize);
+    checkerboard = device->newTexture(textureDescriptor);
+    textureDescriptor->release();
+    checkerboard->replaceRegion(MTL::Region(0, 0, 0, kTextureSize, kTextureSize, 1), 0, pixels.data(),
+                                kTextureSize * 4);
+
+    library = device->newDefaultLibrary();
+    if (!library) {
+        std::fprintf(stderr, "Failed to load default library.\n");
+        pool->release();
+        return;
+    }
+    EngineCore::Options coreOptions;
+    coreOptions.sampleCount = options.sampleCount;
+    coreOptions.instances = options.instances;
+    core = new EngineCore(device, library, options.width, options.height, coreOptions);
+    core->setTextureSource(this);
+    // Timing starts with the pipeline compiled.
+    core->pipelines().finish();
+    core->update();
+    if (core->pipelineFailed()) {
+        std::fprintf(stderr, "Error creating render pipeline state: %s\n", core->pipelineError().c_str());
+    }
+    pool->release();
+}
+
+Renderer::~Renderer() {
+    delete core;
+    if (library) {
+        library->release();
+    }
+    checkerboard->release();
+    target->release();
+    device->release();
+}
+
+// The cubes turn with the frame index, as if frames came at 60 Hz.
+void Renderer::frame(int index, double& encodeMilliseconds, double& frameMilliseconds) {
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    const auto start = std::chrono::steady_clock::now();
+    core->update();
+    MTL::CommandBuffer* commandBuffer = core->encode(target, index / 60.0);
+    commandBuffer->commit();
+    const auto committed = std::chrono::steady_clock::now();
+    commandBuffer->waitUntilCompleted();
+    const auto completed = std::chrono::steady_clock::now();
+    pool->release();
+
+    encodeMilliseconds = millisecondsBetween(start, committed);
+    frameMilliseconds = millisecondsBetween(start, completed);
+}
+
+}
+
+bool parseOptions(int argc, const char* const argv[], Options& options, std::string& error) {
+    for (int i = 0; i < argc; ++i) {
+        const std::string flag = argv[i];
+        if (i + 1 == argc) {
+            error = "Missing value for " + flag;
+            return false;
+        }
+        const char* value = argv[++i];
+        bool valid;
+        if (flag == "--frames") {
+            valid = parseInt(value, 1, 10000000, options.frames);
+        } else if (flag == "--warmup") {
+            valid = parseInt(value, 0, 10000000, options.warmupFrames);
+        } else if (flag == "--instances") {
+            valid = parseInt(value, 1, 1 << 20, options.instances);
+        } else if (flag == "--msaa") {
+            valid = parseInt(value, 1, 8, options.sampleCount) && !(options.sampleCount & (options.sampleCount - 1));
+        } else if (flag == "--size") {
+            int width, height;
+            valid = std::sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0 &&
+                    width <= 16384 && height <= 16384;
+            if (valid) {
+                options.width = width;
+                options.height = height;
+            }
+        } else {
+            error = "Unknown option " + flag;
+            return false;
+        }
+        if (!valid) {
+            error = "Invalid value for " + flag + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+int run(const Options& options, std::ostream& out) {
+    Renderer renderer(options);
+    if (!renderer.ready()) {
+        return 1;
+    }
+
+    double encode, frame;
+    for (int i = 0; i < options.warmupFrames; ++i) {
+        renderer.frame(i, encode, frame);
+    }
+    std::vector<double> encodeMilliseconds(options.frames), frameMilliseconds(options.frames);
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.frames; ++i) {
+        renderer.frame(options.warmupFrames + i, encodeMilliseconds[i], frameMilliseconds[i]);
+    }
+    const double seconds = millisecondsBetween(start, std::chrono::steady_clock::now()) / 1000.0;
+
+#ifdef NULL_METAL
+    const char* backend = "null";
+#else
+    const char* backend = "metal";
+#endif
+    char line[256];
+    out << "{\n";
+    std::snprintf(line, sizeof(line), "  \"backend\": \"%s\",\n  \"device\": \"%s\",\n", backend, renderer.deviceName());
+    out << line;
+    std::snprintf(line, sizeof(line),
+                  "  \"width\": %d,\n  \"height\": %d,\n  \"sampleCount\": %d,\n  \"instances\": %d,\n"
+                  "  \"drawCallsPerFrame\": %d,\n  \"frames\": %d,\n  \"warmupFrames\": %d,\n",
+                  options.width, options.height, options.sampleCount, options.instances, options.instances,
+                  options.frames, options.warmupFrames);
+    out << line;
+    std::snprintf(line, sizeof(line), "  \"seconds\": %.6f,\n  \"fps\": %.3f,\n", seconds, options.frames / seconds);
+    out << line;
+    writeSummary(out, "encodeMs", summarize(encodeMilliseconds), false);
+    writeSummary(out, "frameMs", summarize(frameMilliseconds), true);
+    out << "}" << std::endl;
+    return 0;
+}
+
+}
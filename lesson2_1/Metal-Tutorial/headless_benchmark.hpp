@@ -0,0 +1,53 @@
+//
+//  headless_benchmark.hpp
+//  Metal-Guide
+//
+//  Reproducible performance run of the engine's cube pass: a fixed number
+//  of frames rendered offscreen, at a fixed resolution, sample count and
+//  number of cube instances, with animation driven by the frame index
+//  instead of the clock. It drives the same EngineCore MTLEngine draws
+//  with, minus the GLFW window and the CAMetalLayer: the pass resolves into
+//  a texture of its own. Every frame is timed, and a JSON summary is
+//  written at the end.
+//
+//  Only metal-cpp is needed, so on Linux it builds against the null device
+//  in null-metal/ and can gate CPU-side regressions in CI. From lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Inull-metal -IMetal-Tutorial Metal-Tutorial/main.cpp
+//        Metal-Tutorial/headless_benchmark.cpp Metal-Tutorial/engine_core.cpp
+//        Metal-Tutorial/draw_list.cpp Metal-Tutorial/command_stream.cpp
+//        Metal-Tutorial/render_state_filter.cpp Metal-Tutorial/upload_queue.cpp
+//        Metal-Tutorial/metal_upload_backend.cpp Metal-Tutorial/render_graph.cpp
+//        Metal-Tutorial/metal_render_graph.cpp Metal-Tutorial/pipeline_cache.cpp
+//        Metal-Tutorial/metal_pipeline_compiler.cpp Metal-Tutorial/mip_feedback.cpp
+//        Metal-Tutorial/texture_residency.cpp Metal-Tutorial/texture_cache.cpp
+//        Metal-Tutorial/mapped_file.cpp Metal-Tutorial/thread_pool.cpp -o metal-headless
+//    ./metal-headless --headless --frames 1000 --size 1920x1080 --instances 64
+//
+
+#pragma once
+
+#include <ostream>
+#include <string>
+
+namespace HeadlessBenchmark {
+
+struct Options {
+    int frames{600};
+    int warmupFrames{10};  // rendered before timing starts
+    int width{1920};
+    int height{1080};
+    int sampleCount{4};
+    int instances{1};
+};
+
+// Parses --frames N, --warmup N, --size WxH, --msaa N and --instances N.
+// On failure returns false and describes the problem in error.
+bool parseOptions(int argc, const char* const argv[], Options& options, std::string& error);
+
+extern const char* const kUsage;
+
+// Renders and writes the summary to out. Returns the process exit code.
+int run(const Options& options, std::ostream& out);
+
+}
@@ -0,0 +1,143 @@
+//
+//  image_diff.cpp
+//  Metal-Guide
+//
+
+#include "image_diff.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ImageDiff {
+
+namespace {
+
+// Blocks of 4 pixels add at most 2 * 2 * 255^2 to each 32-bit lane of the
+// squared error, so lanes are spilled to 64 bits this often.
+constexpr size_t kFlushBlocks = 4096;
+
+}
+
+double Result::psnr() const {
+    const double mse = meanSquaredError();
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+}
+
+namespace Scalar {
+
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance) {
+    Result result{0, 0, 0, pixels};
+    for (size_t i = 0; i < pixels; ++i) {
+        bool differs = false;
+        for (int c = 0; c < 3; ++c) {
+            const int difference = std::abs(int(rgba[i * 4 + c]) - int(reference[i * 4 + c]));
+            result.squaredError += uint64_t(difference * difference);
+            result.maxDifference = std::max(result.maxDifference, uint8_t(difference));
+            differs |= difference > tolerance;
+        }
+        result.differingPixels += differs;
+    }
+    return result;
+}
+
+}
+
+#if defined(__ARM_NEON)
+
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance) {
+    const size_t blocks = pixels / 4;
+    const uint8x16_t colorMask = vreinterpretq_u8_u32(vdupq_n_u32(0x00ffffff));
+    const uint8x16_t tolerances = vdupq_n_u8(tolerance);
+    uint8x16_t maximum = vdupq_n_u8(0);
+    Result result{0, 0, 0, pixels};
+    for (size_t start = 0; start < blocks; start += kFlushBlocks) {
+        const size_t end = std::min(blocks, start + kFlushBlocks);
+        uint32x4_t squares = vdupq_n_u32(0), differing = vdupq_n_u32(0);
+        for (size_t block = start; block < end; ++block) {
+            const uint8x16_t a = vld1q_u8(rgba + block * 16), b = vld1q_u8(reference + block * 16);
+            const uint8x16_t difference = vandq_u8(vabdq_u8(a, b), colorMask);
+            maximum = vmaxq_u8(maximum, difference);
+            const uint32x4_t over = vreinterpretq_u32_u8(vcgtq_u8(difference, tolerances));
+            differing = vaddq_u32(differing, vshrq_n_u32(vtstq_u32(over, over), 31));
+            squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(difference), vget_low_u8(difference)));
+            squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(difference), vget_high_u8(difference)));
+        }
+        uint32_t lanes[4], counts[4];
+        vst1q_u32(lanes, squares);
+        vst1q_u32(counts, differing);
+        for (int i = 0; i < 4; ++i) {
+            result.squaredError += lanes[i];
+            result.differingPixels += counts[i];
+        }
+    }
+    uint8_t maxima[16];
+    vst1q_u8(maxima, maximum);
+    result.maxDifference = *std::max_element(maxima, maxima + 16);
+
+    const Result tail = Scalar::compare(rgba + blocks * 16, reference + blocks * 16, pixels - blocks * 4, tolerance);
+    result.differingPixels += tail.differingPixels;
+    result.squaredError += tail.squaredError;
+    result.maxDifference = std::max(result.maxDifference, tail.maxDifference);
+    return result;
+}
+
+#elif defined(__SSE2__)
+
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance) {
+    const size_t blocks = pixels / 4;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i tolerances = _mm_set1_epi8(char(tolerance));
+    __m128i maximum = zero;
+    Result result{0, 0, 0, pixels};
+    uint64_t within = 0;
+    for (size_t start = 0; start < blocks; start += kFlushBlocks) {
+        const size_t end = std::min(blocks, start + kFlushBlocks);
+        __m128i squares = zero;
+        for (size_t block = start; block < end; ++block) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + block * 16));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference + block * 16));
+            const __m128i difference = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)), colorMask);
+            maximum = _mm_max_epu8(maximum, difference);
+            // All ones for pixels with every channel within the tolerance.
+            const __m128i inside = _mm_cmpeq_epi32(_mm_subs_epu8(difference, tolerances), zero);
+            within += std::popcount(unsigned(_mm_movemask_ps(_mm_castsi128_ps(inside))));
+            const __m128i low = _mm_unpacklo_epi8(difference, zero), high = _mm_unpackhi_epi8(difference, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        }
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), squares);
+        for (uint32_t lane : lanes) {
+            result.squaredError += lane;
+        }
+    }
+    result.differingPixels = blocks * 4 - within;
+    alignas(16) uint8_t maxima[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxima), maximum);
+    result.maxDifference = *std::max_element(maxima, maxima + 16);
+
+    const Result tail = Scalar::compare(rgba + blocks * 16, reference + blocks * 16, pixels - blocks * 4, tolerance);
+    result.differingPixels += tail.differingPixels;
+    result.squaredError += tail.squaredError;
+    result.maxDifference = std::max(result.maxDifference, tail.maxDifference);
+    return result;
+}
+
+#else
+
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance) {
+    return Scalar::compare(rgba, reference, pixels, tolerance);
+}
+
+#endif
+
+}
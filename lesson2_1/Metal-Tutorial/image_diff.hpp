@@ -0,0 +1,37 @@
+//
+//  image_diff.hpp
+//  Metal-Guide
+//
+//  Compares a rendered RGBA8 image against a reference with a per-channel
+//  tolerance, so small rounding differences between SIMD paths or
+//  rasterizers pass while real rendering changes do not. NEON or SSE2 paths
+//  are picked at compile time; the Scalar namespace holds the reference
+//  version, which also handles the tails.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ImageDiff {
+
+struct Result {
+    uint64_t differingPixels;  // pixels with a colour channel off by more than the tolerance
+    uint64_t squaredError;     // summed over the colour channels
+    uint8_t maxDifference;     // largest colour channel difference
+    size_t pixels;
+
+    double meanSquaredError() const { return pixels ? double(squaredError) / (3.0 * pixels) : 0.0; }
+    // Peak signal-to-noise ratio in dB; infinite for identical images.
+    double psnr() const;
+};
+
+// Alpha is ignored: the engine's passes render opaque.
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance);
+
+namespace Scalar {
+Result compare(const uint8_t* rgba, const uint8_t* reference, size_t pixels, uint8_t tolerance);
+}
+
+}
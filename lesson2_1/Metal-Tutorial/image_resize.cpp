@@ -0,0 +1,202 @@
+//
+//  image_resize.cpp
+//  Metal-Guide
+//
+
+#include "image_resize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ImageResize {
+
+namespace {
+
+// Output rows per unit of parallel work. Each band re-filters the few
+// source rows it shares with its neighbours, so bands should be tall
+// compared to the vertical filter footprint.
+constexpr int kBandRows = 32;
+
+// One RGBA pixel in float lanes.
+#if defined(__ARM_NEON)
+using Pixel = float32x4_t;
+inline Pixel zero() { return vdupq_n_f32(0.0f); }
+inline Pixel load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, Pixel v) { vst1q_f32(p, v); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) { return vmlaq_n_f32(acc, v, w); }
+#elif defined(__SSE2__)
+using Pixel = __m128;
+inline Pixel zero() { return _mm_setzero_ps(); }
+inline Pixel load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+#else
+struct Pixel { float v[4]; };
+inline Pixel zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+inline Pixel load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, Pixel v) { std::copy(v.v, v.v + 4, p); }
+inline Pixel multiplyAdd(Pixel acc, Pixel v, float w) {
+    for (int i = 0; i < 4; ++i) {
+        acc.v[i] += v.v[i] * w;
+    }
+    return acc;
+}
+#endif
+
+double filterRadius(Filter filter) {
+    return filter == Filter::Lanczos3 ? 3.0 : 2.0;
+}
+
+double evaluate(Filter filter, double x) {
+    x = std::abs(x);
+    if (filter == Filter::Lanczos3) {
+        if (x < 1e-8) {
+            return 1.0;
+        }
+        if (x >= 3.0) {
+            return 0.0;
+        }
+        const double px = M_PI * x;
+        return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+    }
+    // Mitchell-Netravali with B = C = 1/3.
+    const double B = 1.0 / 3.0, C = 1.0 / 3.0;
+    if (x < 1.0) {
+        return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0;
+    }
+    if (x < 2.0) {
+        return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0;
+    }
+    return 0.0;
+}
+
+// Polyphase weights for one axis. Every output sample reads exactly `taps`
+// consecutive source samples starting at first[i]; edge samples are clamped
+// into that window, so the inner loops need no bounds checks.
+struct Weights {
+    int taps = 0;
+    std::vector<int> first;
+    std::vector<float> values;
+};
+
+Weights computeWeights(int srcSize, int dstSize, Filter filter) {
+    const double scale = double(dstSize) / srcSize;
+    // Minifying stretches the filter over more source samples.
+    const double filterScale = std::min(scale, 1.0);
+    const double support = filterRadius(filter) / filterScale;
+
+    Weights weights;
+    weights.taps = std::min(srcSize, int(std::ceil(2.0 * support)) + 2);
+    weights.first.resize(dstSize);
+    weights.values.assign(size_t(dstSize) * weights.taps, 0.0f);
+
+    std::vector<double> row(weights.taps);
+    for (int i = 0; i < dstSize; ++i) {
+        const double center = (i + 0.5) / scale;
+        const int low = int(std::floor(center - support));
+        const int high = int(std::ceil(center + support));
+        const int first = std::min(std::clamp(low, 0, srcSize - 1), srcSize - weights.taps);
+
+        std::fill(row.begin(), row.end(), 0.0);
+        double sum = 0.0;
+        for (int j = low; j <= high; ++j) {
+            const double w = evaluate(filter, (j + 0.5 - center) * filterScale);
+            row[std::clamp(j, 0, srcSize - 1) - first] += w;
+            sum += w;
+        }
+        weights.first[i] = first;
+        float* values = &weights.values[size_t(i) * weights.taps];
+        for (int t = 0; t < weights.taps; ++t) {
+            values[t] = float(row[t] / sum);
+        }
+    }
+    return weights;
+}
+
+void filterRow(const float* src, const Weights& weights, float* dst, int dstWidth) {
+    for (int x = 0; x < dstWidth; ++x) {
+        const float* w = &weights.values[size_t(x) * weights.taps];
+        const float* s = src + size_t(weights.first[x]) * 4;
+        Pixel acc = zero();
+        for (int t = 0; t < weights.taps; ++t) {
+            acc = multiplyAdd(acc, load(s + t * 4), w[t]);
+        }
+        store(dst + size_t(x) * 4, acc);
+    }
+}
+
+}
+
+void fitWithin(int width, int height, int maxDimension, size_t maxBytes, size_t bytesPerPixel,
+               int& fittedWidth, int& fittedHeight) {
+    double scale = 1.0;
+    if (maxDimension > 0) {
+        scale = std::min(scale, double(maxDimension) / std::max(width, height));
+    }
+    if (maxBytes > 0) {
+        scale = std::min(scale, std::sqrt(double(maxBytes) / (double(width) * height * bytesPerPixel)));
+    }
+    fittedWidth = std::max(1, int(width * scale));
+    fittedHeight = std::max(1, int(height * scale));
+}
+
+void resizeRgba8(const uint8_t* src, int srcWidth, int srcHeight, size_t srcBytesPerRow,
+                 uint8_t* dst, int dstWidth, int dstHeight, size_t dstBytesPerRow,
+                 Filter filter) {
+    const Weights horizontal = computeWeights(srcWidth, dstWidth, filter);
+    const Weights vertical = computeWeights(srcHeight, dstHeight, filter);
+    const size_t dstFloats = size_t(dstWidth) * 4;
+
+    const size_t bandCount = (dstHeight + kBandRows - 1) / kBandRows;
+    ThreadPool::shared().parallelFor(bandCount, 1, [&](size_t bandBegin, size_t bandEnd) {
+        std::vector<float> sourceRow(size_t(srcWidth) * 4);
+        std::vector<float> filtered;
+        std::vector<float> accumulated(dstFloats);
+
+        for (size_t band = bandBegin; band < bandEnd; ++band) {
+            const int y0 = int(band) * kBandRows;
+            const int y1 = std::min(y0 + kBandRows, dstHeight);
+            const int rowFirst = vertical.first[y0];
+            const int rowEnd = vertical.first[y1 - 1] + vertical.taps;
+
+            // Horizontal pass over just the source rows this band reads.
+            filtered.resize(size_t(rowEnd - rowFirst) * dstFloats);
+            for (int sy = rowFirst; sy < rowEnd; ++sy) {
+                const uint8_t* in = src + size_t(sy) * srcBytesPerRow;
+                for (size_t i = 0; i < sourceRow.size(); ++i) {
+                    sourceRow[i] = in[i];
+                }
+                filterRow(sourceRow.data(), horizontal, &filtered[size_t(sy - rowFirst) * dstFloats], dstWidth);
+            }
+
+            for (int y = y0; y < y1; ++y) {
+                const float* w = &vertical.values[size_t(y) * vertical.taps];
+                const float* rows = &filtered[size_t(vertical.first[y] - rowFirst) * dstFloats];
+                for (size_t i = 0; i < dstFloats; i += 4) {
+                    Pixel acc = zero();
+                    for (int t = 0; t < vertical.taps; ++t) {
+                        acc = multiplyAdd(acc, load(rows + t * dstFloats + i), w[t]);
+                    }
+                    store(&accumulated[i], acc);
+                }
+
+                // Lanczos lobes overshoot, so clamp before rounding.
+                uint8_t* out = dst + size_t(y) * dstBytesPerRow;
+                for (size_t i = 0; i < dstFloats; ++i) {
+                    out[i] = uint8_t(std::clamp(accumulated[i], 0.0f, 255.0f) + 0.5f);
+                }
+            }
+        }
+    });
+}
+
+}
@@ -0,0 +1,29 @@
+//
+//  image_resize.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Separable polyphase resampling. Filter weights are computed once per
+// output row/column; rows are filtered in parallel on ThreadPool::shared().
+namespace ImageResize {
+
+enum class Filter {
+    Lanczos3,
+    Mitchell,
+};
+
+// Largest size with the same aspect ratio that fits both limits; a limit
+// of 0 means unlimited. Never grows the image.
+void fitWithin(int width, int height, int maxDimension, size_t maxBytes, size_t bytesPerPixel,
+               int& fittedWidth, int& fittedHeight);
+
+void resizeRgba8(const uint8_t* src, int srcWidth, int srcHeight, size_t srcBytesPerRow,
+                 uint8_t* dst, int dstWidth, int dstHeight, size_t dstBytesPerRow,
+                 Filter filter = Filter::Lanczos3);
+
+}
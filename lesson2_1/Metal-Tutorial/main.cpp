@@ -3,14 +3,35 @@
 //  Metal-Guide
 //
 
+#include <cstring>
 #include <iostream>
+#include <unistd.h>
 
+#include "headless_benchmark.hpp"
+
+// Builds without GLFW, e.g. on Linux against null-metal/, only have the
+// headless mode.
+#if __has_include(<GLFW/glfw3.h>)
 #include "mtl_engine.hpp"
+#define HAS_WINDOW 1
+#endif
 
 int main(int argc, char* argv[]) {
-    
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        HeadlessBenchmark::Options options;
+        std::string error;
+        if (!HeadlessBenchmark::parseOptions(argc - 2, argv + 2, options, error)) {
+            std::cerr << error << std::endl
+                      << "Usage: " << argv[0] << " " << HeadlessBenchmark::kUsage << std::endl;
+            return 1;
+        }
+        return HeadlessBenchmark::run(options, std::cout);
+    }
+
+#ifdef HAS_WINDOW
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <image file path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <image file path>" << std::endl
+                  << "       " << argv[0] << " " << HeadlessBenchmark::kUsage << std::endl;
         return 1;
     }
 
@@ -24,4 +45,8 @@ int main(int argc, char* argv[]) {
     engine.cleanup();
 
     return 0;
+#else
+    std::cerr << "Usage: " << argv[0] << " " << HeadlessBenchmark::kUsage << std::endl;
+    return 1;
+#endif
 }
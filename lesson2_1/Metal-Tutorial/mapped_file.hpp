@@ -0,0 +1,22 @@
+//
+//  mapped_file.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const char* filepath);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return data != nullptr; }
+    const uint8_t* data{nullptr};
+    size_t size{0};
+};
@@ -0,0 +1,60 @@
+//
+//  metal_pipeline_compiler.cpp
+//  Metal-Guide
+//
+
+#include "metal_pipeline_compiler.hpp"
+
+namespace {
+
+MTL::Function* newFunction(MTL::Library* library, const std::string& name) {
+    return name.empty() ? nullptr : library->newFunction(NS::String::string(name.c_str(), NS::UTF8StringEncoding));
+}
+
+}
+
+void* MetalPipelineCompiler::compile(const PipelineDescription& description, std::string& error) {
+    // Workers have no autorelease pool of their own.
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    MTL::Function* vertexFunction = newFunction(library, description.vertexFunction);
+    MTL::Function* fragmentFunction = newFunction(library, description.fragmentFunction);
+
+    MTL::RenderPipelineDescriptor* renderPipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    renderPipelineDescriptor->setVertexFunction(vertexFunction);
+    renderPipelineDescriptor->setFragmentFunction(fragmentFunction);
+    for (uint32_t i = 0; i < PipelineDescription::kMaxColorAttachments; ++i) {
+        if (!description.colorFormats[i]) {
+            continue;
+        }
+        const BlendState& blend = description.blend[i];
+        MTL::RenderPipelineColorAttachmentDescriptor* attachment = renderPipelineDescriptor->colorAttachments()->object(i);
+        attachment->setPixelFormat(MTL::PixelFormat(description.colorFormats[i]));
+        attachment->setBlendingEnabled(blend.enabled);
+        attachment->setSourceRGBBlendFactor(MTL::BlendFactor(blend.sourceRGB));
+        attachment->setDestinationRGBBlendFactor(MTL::BlendFactor(blend.destinationRGB));
+        attachment->setRgbBlendOperation(MTL::BlendOperation(blend.rgbOperation));
+        attachment->setSourceAlphaBlendFactor(MTL::BlendFactor(blend.sourceAlpha));
+        attachment->setDestinationAlphaBlendFactor(MTL::BlendFactor(blend.destinationAlpha));
+        attachment->setAlphaBlendOperation(MTL::BlendOperation(blend.alphaOperation));
+        attachment->setWriteMask(MTL::ColorWriteMask(blend.writeMask));
+    }
+    renderPipelineDescriptor->setSampleCount(description.sampleCount);
+    renderPipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormat(description.depthFormat));
+    renderPipelineDescriptor->setStencilAttachmentPixelFormat(MTL::PixelFormat(description.stencilFormat));
+
+    NS::Error* compileError = nullptr;
+    MTL::RenderPipelineState* pipeline = device->newRenderPipelineState(renderPipelineDescriptor, &compileError);
+    if (!pipeline) {
+        error = compileError ? compileError->localizedDescription()->utf8String() : "unknown error";
+    }
+
+    renderPipelineDescriptor->release();
+    if (vertexFunction) {
+        vertexFunction->release();
+    }
+    if (fragmentFunction) {
+        fragmentFunction->release();
+    }
+    pool->release();
+    return pipeline;
+}
@@ -0,0 +1,25 @@
+//
+//  metal_pipeline_compiler.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "pipeline_cache.hpp"
+
+// PipelineCache backend that builds MTL::RenderPipelineStates from the
+// functions in one library. Metal's device and library are thread-safe, so
+// compiles run on the cache's workers as they are.
+class MetalPipelineCompiler : public PipelineCompiler {
+public:
+    MetalPipelineCompiler(MTL::Device* metalDevice, MTL::Library* library) : device(metalDevice), library(library) {}
+
+    void* compile(const PipelineDescription& description, std::string& error) override;
+    void release(void* pipeline) override { static_cast<MTL::RenderPipelineState*>(pipeline)->release(); }
+
+private:
+    MTL::Device* device;
+    MTL::Library* library;
+};
@@ -0,0 +1,44 @@
+//
+//  metal_render_encoder_backend.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "render_state_filter.hpp"
+
+// StateFilteredEncoder backend: forwards to the current
+// MTL::RenderCommandEncoder. Set a new encoder together with resetting
+// the filter.
+class MetalRenderEncoderBackend : public RenderEncoderBackend {
+public:
+    void setEncoder(MTL::RenderCommandEncoder* renderEncoder) { encoder = renderEncoder; }
+
+    void setRenderPipelineState(const void* state) override {
+        encoder->setRenderPipelineState(static_cast<const MTL::RenderPipelineState*>(state));
+    }
+    void setDepthStencilState(const void* state) override {
+        encoder->setDepthStencilState(static_cast<const MTL::DepthStencilState*>(state));
+    }
+    void setFrontFacingWinding(uint32_t winding) override { encoder->setFrontFacingWinding(MTL::Winding(winding)); }
+    void setCullMode(uint32_t cullMode) override { encoder->setCullMode(MTL::CullMode(cullMode)); }
+    void setTriangleFillMode(uint32_t fillMode) override { encoder->setTriangleFillMode(MTL::TriangleFillMode(fillMode)); }
+    void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        encoder->setVertexBuffer(static_cast<const MTL::Buffer*>(buffer), offset, index);
+    }
+    void setVertexBufferOffset(uint64_t offset, uint32_t index) override { encoder->setVertexBufferOffset(offset, index); }
+    void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        encoder->setFragmentBuffer(static_cast<const MTL::Buffer*>(buffer), offset, index);
+    }
+    void setFragmentTexture(const void* texture, uint32_t index) override {
+        encoder->setFragmentTexture(static_cast<const MTL::Texture*>(texture), index);
+    }
+    void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) override {
+        encoder->drawPrimitives(MTL::PrimitiveType(primitiveType), vertexStart, vertexCount);
+    }
+
+private:
+    MTL::RenderCommandEncoder* encoder{nullptr};
+};
@@ -0,0 +1,112 @@
+//
+//  metal_render_graph.cpp
+//  Metal-Guide
+//
+
+#include "metal_render_graph.hpp"
+
+MetalRenderGraph::~MetalRenderGraph() {
+    releaseTextures();
+    if (heap) {
+        heap->release();
+    }
+}
+
+MTL::TextureDescriptor* MetalRenderGraph::newTextureDescriptor(const RenderGraph::TextureDescription& description) const {
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setTextureType(description.sampleCount > 1 ? MTL::TextureType2DMultisample : MTL::TextureType2D);
+    textureDescriptor->setPixelFormat(MTL::PixelFormat(description.pixelFormat));
+    textureDescriptor->setWidth(description.width);
+    textureDescriptor->setHeight(description.height);
+    textureDescriptor->setSampleCount(description.sampleCount);
+    textureDescriptor->setStorageMode(MTL::StorageModePrivate);
+    textureDescriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+    return textureDescriptor;
+}
+
+void MetalRenderGraph::releaseTextures() {
+    for (const RenderGraph::PlannedTexture& planned : compiled.textures) {
+        if (textures[planned.resource]) {
+            textures[planned.resource]->release();
+        }
+    }
+    for (MTL::RenderPassDescriptor* renderPassDescriptor : renderPassDescriptors) {
+        renderPassDescriptor->release();
+    }
+    renderPassDescriptors.clear();
+    textures.clear();
+}
+
+void MetalRenderGraph::compile(const RenderGraph& renderGraph) {
+    releaseTextures();
+    graph = &renderGraph;
+    textures.assign(graph->textures().size(), nullptr);
+    compiled = graph->compile([this](const RenderGraph::TextureDescription& description) {
+        MTL::TextureDescriptor* textureDescriptor = newTextureDescriptor(description);
+        const MTL::SizeAndAlign sizeAndAlign = metalDevice->heapTextureSizeAndAlign(textureDescriptor);
+        textureDescriptor->release();
+        return RenderGraph::SizeAndAlign{sizeAndAlign.size, sizeAndAlign.align};
+    });
+    ++counters.compiles;
+    counters.planBytes = compiled.heapSize;
+    counters.unaliasedBytes = compiled.unaliasedSize;
+
+    if (compiled.heapSize > 0 && (!heap || heap->size() < compiled.heapSize)) {
+        if (heap) {
+            heap->release();
+        }
+        MTL::HeapDescriptor* heapDescriptor = MTL::HeapDescriptor::alloc()->init();
+        heapDescriptor->setType(MTL::HeapTypePlacement);
+        heapDescriptor->setStorageMode(MTL::StorageModePrivate);
+        heapDescriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+        heapDescriptor->setSize(compiled.heapSize + compiled.heapSize / 4);
+        heap = metalDevice->newHeap(heapDescriptor);
+        heapDescriptor->release();
+        ++counters.heapAllocations;
+        counters.heapBytes = heap->size();
+    }
+    for (const RenderGraph::PlannedTexture& planned : compiled.textures) {
+        MTL::TextureDescriptor* textureDescriptor = newTextureDescriptor(graph->textures()[planned.resource].description);
+        textures[planned.resource] = heap->newTexture(textureDescriptor, planned.offset);
+        textureDescriptor->release();
+    }
+
+    for (const RenderGraph::PlannedPass& planned : compiled.passes) {
+        MTL::RenderPassDescriptor* renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+        for (size_t i = 0; i < planned.colors.size(); ++i) {
+            const RenderGraph::PlannedAttachment& color = planned.colors[i];
+            MTL::RenderPassColorAttachmentDescriptor* colorAttachment = renderPassDescriptor->colorAttachments()->object(i);
+            colorAttachment->setLoadAction(MTL::LoadAction(color.load));
+            colorAttachment->setStoreAction(MTL::StoreAction(color.store));
+            const float* clear = color.attachment.clearValue;
+            colorAttachment->setClearColor(MTL::ClearColor(clear[0], clear[1], clear[2], clear[3]));
+        }
+        if (planned.hasDepth) {
+            MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = renderPassDescriptor->depthAttachment();
+            depthAttachment->setLoadAction(MTL::LoadAction(planned.depth.load));
+            depthAttachment->setStoreAction(MTL::StoreAction(planned.depth.store));
+            depthAttachment->setClearDepth(planned.depth.attachment.clearValue[0]);
+        }
+        renderPassDescriptors.push_back(renderPassDescriptor);
+    }
+}
+
+void MetalRenderGraph::execute(MTL::CommandBuffer* commandBuffer) {
+    for (size_t p = 0; p < compiled.passes.size(); ++p) {
+        const RenderGraph::PlannedPass& planned = compiled.passes[p];
+        MTL::RenderPassDescriptor* renderPassDescriptor = renderPassDescriptors[p];
+        // Bound here rather than in compile(), as imports change per frame.
+        for (size_t i = 0; i < planned.colors.size(); ++i) {
+            const RenderGraph::Attachment& color = planned.colors[i].attachment;
+            MTL::RenderPassColorAttachmentDescriptor* colorAttachment = renderPassDescriptor->colorAttachments()->object(i);
+            colorAttachment->setTexture(textures[color.texture]);
+            colorAttachment->setResolveTexture(color.resolve != RenderGraph::kNoResource ? textures[color.resolve] : nullptr);
+        }
+        if (planned.hasDepth) {
+            renderPassDescriptor->depthAttachment()->setTexture(textures[planned.depth.attachment.texture]);
+        }
+        MTL::RenderCommandEncoder* renderCommandEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
+        graph->passes()[planned.pass].execute(renderCommandEncoder);
+        renderCommandEncoder->endEncoding();
+    }
+}
@@ -0,0 +1,59 @@
+//
+//  metal_render_graph.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <vector>
+
+#include <Metal/Metal.hpp>
+
+#include "render_graph.hpp"
+
+// Runs a compiled RenderGraph on Metal. Transient textures are placed at
+// their planned offsets in one placement heap, with hazard tracking on
+// the whole heap so aliased textures are safe across passes. Each live
+// pass gets a render pass descriptor, built once per compile. The heap is
+// kept while the plan fits and grown with a quarter of slack when it does
+// not, so a window resize mostly just re-creates the textures in it.
+class MetalRenderGraph {
+public:
+    struct Stats {
+        uint64_t compiles;
+        uint64_t heapAllocations;
+        uint64_t heapBytes;       // size of the current heap
+        uint64_t planBytes;       // what the last plan needs, with aliasing
+        uint64_t unaliasedBytes;  // what it would need without
+    };
+
+    explicit MetalRenderGraph(MTL::Device* metalDevice) : metalDevice(metalDevice) {}
+    ~MetalRenderGraph();
+
+    // The graph has to stay alive until the next compile(); its passes'
+    // callbacks run in execute().
+    void compile(const RenderGraph& graph);
+    // Binds an imported texture; the drawable changes every frame.
+    void setImport(RenderGraph::Resource resource, MTL::Texture* texture) { textures[resource] = texture; }
+    // Encodes every live pass into commandBuffer.
+    void execute(MTL::CommandBuffer* commandBuffer);
+
+    // For passes that sample a texture an earlier pass rendered.
+    MTL::Texture* texture(RenderGraph::Resource resource) const { return textures[resource]; }
+    const RenderGraph::Plan& plan() const { return compiled; }
+    const Stats& stats() const { return counters; }
+
+private:
+    MTL::TextureDescriptor* newTextureDescriptor(const RenderGraph::TextureDescription& description) const;
+    void releaseTextures();
+
+    MTL::Device* metalDevice;
+    const RenderGraph* graph{nullptr};
+    RenderGraph::Plan compiled{};
+    MTL::Heap* heap{nullptr};
+    // Per resource. Transient textures are owned; imported ones are not.
+    std::vector<MTL::Texture*> textures;
+    // Per planned pass.
+    std::vector<MTL::RenderPassDescriptor*> renderPassDescriptors;
+    Stats counters{};
+};
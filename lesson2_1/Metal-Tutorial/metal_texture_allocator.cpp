@@ -0,0 +1,59 @@
+//
+//  metal_texture_allocator.cpp
+//  Metal-Guide
+//
+
+#include "metal_texture_allocator.hpp"
+
+#include <utility>
+
+MetalTextureAllocator::MetalTextureAllocator(MTL::Device* metalDevice, const TextureOptions& options)
+    : device(metalDevice), options(options) {
+    this->options.mipmapped = true;
+}
+
+MetalTextureAllocator::~MetalTextureAllocator() {
+    for (Slot& slot : slots) {
+        delete slot.texture;
+        delete slot.loading;
+    }
+}
+
+TextureDescription MetalTextureAllocator::describe(const char* filepath) const {
+    TextureCache::Description description = Texture::describe(filepath, options);
+    return {description.width, description.height, description.levelCount, description.bytesPerPixel};
+}
+
+void MetalTextureAllocator::setSource(uint32_t id, std::string filepath) {
+    if (id >= slots.size()) {
+        slots.resize(id + 1);
+    }
+    delete slots[id].texture;
+    delete slots[id].loading;
+    slots[id] = Slot{std::move(filepath), nullptr, nullptr};
+}
+
+MTL::Texture* MetalTextureAllocator::texture(uint32_t id) {
+    Slot& slot = slots[id];
+    if (slot.loading && (!options.uploads || options.uploads->isSubmitted(slot.loading->uploadToken))) {
+        delete slot.texture;
+        slot.texture = std::exchange(slot.loading, nullptr);
+    }
+    return slot.texture ? slot.texture->texture : nullptr;
+}
+
+bool MetalTextureAllocator::makeResident(uint32_t id, uint32_t firstLevel) {
+    Slot& slot = slots[id];
+    TextureOptions levelOptions = options;
+    levelOptions.firstLevel = firstLevel;
+    delete slot.loading;
+    slot.loading = new Texture(slot.filepath.c_str(), device, levelOptions);
+    return true;
+}
+
+void MetalTextureAllocator::evict(uint32_t id) {
+    delete slots[id].texture;
+    delete slots[id].loading;
+    slots[id].texture = nullptr;
+    slots[id].loading = nullptr;
+}
@@ -0,0 +1,46 @@
+//
+//  metal_texture_allocator.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Metal/Metal.hpp>
+
+#include "texture.hpp"
+#include "texture_residency.hpp"
+
+// TextureResidency backend that loads Textures from files. Every load asks
+// for the full mip chain through the texture cache, so dropping or
+// restoring levels is a cache hit rather than a decode. With an upload
+// queue in the options, a reloaded texture keeps showing the previous one
+// until its upload has been submitted.
+class MetalTextureAllocator : public TextureAllocator {
+public:
+    MetalTextureAllocator(MTL::Device* metalDevice, const TextureOptions& options);
+    ~MetalTextureAllocator() override;
+
+    TextureDescription describe(const char* filepath) const;
+    // Tells the allocator where texture id is loaded from.
+    void setSource(uint32_t id, std::string filepath);
+    // Null while the texture is not resident or still uploading.
+    MTL::Texture* texture(uint32_t id);
+
+    bool makeResident(uint32_t id, uint32_t firstLevel) override;
+    void evict(uint32_t id) override;
+
+private:
+    struct Slot {
+        std::string filepath;
+        Texture* texture{nullptr};
+        // Replacement whose upload is still queued.
+        Texture* loading{nullptr};
+    };
+
+    MTL::Device* device;
+    TextureOptions options;
+    std::vector<Slot> slots;
+};
@@ -0,0 +1,54 @@
+//
+//  metal_tile_cache.cpp
+//  Metal-Guide
+//
+
+#include "metal_tile_cache.hpp"
+
+#include <bit>
+
+MetalTileCache::MetalTileCache(MTL::Device* metalDevice, const TiledImage& image, uint32_t cacheTilesX,
+                               uint32_t cacheTilesY)
+    : image(image) {
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setWidth(cacheTilesX * image.pageSize());
+    textureDescriptor->setHeight(cacheTilesY * image.pageSize());
+    cacheTexture = metalDevice->newTexture(textureDescriptor);
+
+    // Sized to powers of two so level L of the texture is never smaller
+    // than the tile grid of virtual level L.
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Uint);
+    textureDescriptor->setWidth(std::bit_ceil(image.tilesX(0)));
+    textureDescriptor->setHeight(std::bit_ceil(image.tilesY(0)));
+    textureDescriptor->setMipmapLevelCount(image.info().levelCount);
+    indirectionTexture = metalDevice->newTexture(textureDescriptor);
+    textureDescriptor->release();
+}
+
+MetalTileCache::~MetalTileCache() {
+    cacheTexture->release();
+    indirectionTexture->release();
+}
+
+void MetalTileCache::uploadTile(uint32_t slotX, uint32_t slotY, const uint8_t* pixels) {
+    const uint32_t pageSize = image.pageSize();
+    MTL::Region region = MTL::Region(slotX * pageSize, slotY * pageSize, 0, pageSize, pageSize, 1);
+    cacheTexture->replaceRegion(region, 0, pixels, pageSize * 4);
+}
+
+void MetalTileCache::uploadIndirection(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                                       const uint32_t* entries, uint32_t rowLength) {
+    MTL::Region region = MTL::Region(x, y, 0, width, height, 1);
+    indirectionTexture->replaceRegion(region, level, entries, rowLength * 4);
+}
+
+VirtualTextureParams MetalTileCache::params() const {
+    VirtualTextureParams params;
+    params.size = simd::uint2{image.info().width, image.info().height};
+    params.tileSize = image.info().tileSize;
+    params.border = image.info().border;
+    params.levelCount = image.info().levelCount;
+    params.cacheSize = simd::float2{float(cacheTexture->width()), float(cacheTexture->height())};
+    return params;
+}
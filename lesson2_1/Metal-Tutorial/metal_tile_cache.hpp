@@ -0,0 +1,33 @@
+//
+//  metal_tile_cache.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "vertex_data.hpp"
+#include "virtual_texture.hpp"
+
+// VirtualTexture backend holding the physical tile cache (RGBA8Unorm, one
+// page per slot, no mips) and the indirection texture (RGBA8Uint, one mip
+// level per virtual level) that cube.metal's sampleVirtualTexture reads.
+class MetalTileCache : public TileCacheBackend {
+public:
+    MetalTileCache(MTL::Device* metalDevice, const TiledImage& image, uint32_t cacheTilesX, uint32_t cacheTilesY);
+    ~MetalTileCache() override;
+
+    void uploadTile(uint32_t slotX, uint32_t slotY, const uint8_t* pixels) override;
+    void uploadIndirection(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                           const uint32_t* entries, uint32_t rowLength) override;
+
+    // Shader constants for sampleVirtualTexture.
+    VirtualTextureParams params() const;
+
+    MTL::Texture* cacheTexture;
+    MTL::Texture* indirectionTexture;
+
+private:
+    const TiledImage& image;
+};
@@ -0,0 +1,65 @@
+//
+//  metal_upload_backend.cpp
+//  Metal-Guide
+//
+
+#include "metal_upload_backend.hpp"
+
+MetalUploadBackend::MetalUploadBackend(MTL::Device* metalDevice, MTL::CommandQueue* commandQueue, size_t stagingBytes)
+    : commandQueue(commandQueue) {
+    stagingBuffer = metalDevice->newBuffer(stagingBytes, MTL::ResourceStorageModeShared);
+}
+
+MetalUploadBackend::~MetalUploadBackend() {
+    if (lastSubmitted) {
+        lastSubmitted->waitUntilCompleted();
+        lastSubmitted->release();
+    }
+    stagingBuffer->release();
+}
+
+void MetalUploadBackend::copyToTexture(const UploadCopy& copy) {
+    if (!commandBuffer) {
+        commandBuffer = commandQueue->commandBuffer()->retain();
+        blitEncoder = commandBuffer->blitCommandEncoder();
+    }
+    blitEncoder->copyFromBuffer(stagingBuffer, copy.stagingOffset, copy.bytesPerRow, copy.bytesPerRow * copy.height,
+                                MTL::Size(copy.width, copy.height, 1), static_cast<MTL::Texture*>(copy.texture),
+                                0, copy.level, MTL::Origin(copy.x, copy.y, 0));
+}
+
+uint64_t MetalUploadBackend::submit() {
+    const uint64_t fence = ++submitted;
+    if (!commandBuffer) {
+        // Nothing was copied; the fence is done as soon as it exists.
+        markCompleted(fence);
+        return fence;
+    }
+    blitEncoder->endEncoding();
+    commandBuffer->addCompletedHandler([this, fence](MTL::CommandBuffer*) { markCompleted(fence); });
+    commandBuffer->commit();
+    if (lastSubmitted) {
+        lastSubmitted->release();
+    }
+    lastSubmitted = commandBuffer;
+    commandBuffer = nullptr;
+    blitEncoder = nullptr;
+    return fence;
+}
+
+void MetalUploadBackend::waitForFence(uint64_t fence) {
+    // Command buffers on one queue complete in order, so the last one
+    // submitted finishing covers every earlier fence.
+    if (fence <= submitted && completedFence() < fence && lastSubmitted) {
+        lastSubmitted->waitUntilCompleted();
+        // Completion handlers may still be on their way.
+        markCompleted(submitted);
+    }
+}
+
+void MetalUploadBackend::markCompleted(uint64_t fence) {
+    // Handlers and waits can race; the fence only ever moves forward.
+    uint64_t current = completed.load(std::memory_order_relaxed);
+    while (current < fence && !completed.compare_exchange_weak(current, fence, std::memory_order_release)) {
+    }
+}
@@ -0,0 +1,40 @@
+//
+//  metal_upload_backend.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <atomic>
+
+#include <Metal/Metal.hpp>
+
+#include "upload_queue.hpp"
+
+// UploadQueue backend: stages into a shared MTL::Buffer and copies with a
+// blit encoder on the render queue, one command buffer per submit. Work
+// committed to the same queue afterwards sees the copied data.
+class MetalUploadBackend : public UploadBackend {
+public:
+    MetalUploadBackend(MTL::Device* metalDevice, MTL::CommandQueue* commandQueue, size_t stagingBytes);
+    ~MetalUploadBackend() override;
+
+    uint8_t* stagingMemory() override { return static_cast<uint8_t*>(stagingBuffer->contents()); }
+    size_t stagingSize() const override { return stagingBuffer->length(); }
+    void copyToTexture(const UploadCopy& copy) override;
+    uint64_t submit() override;
+    uint64_t completedFence() override { return completed.load(std::memory_order_acquire); }
+    void waitForFence(uint64_t fence) override;
+
+private:
+    void markCompleted(uint64_t fence);
+
+    MTL::CommandQueue* commandQueue;
+    MTL::Buffer* stagingBuffer;
+    MTL::CommandBuffer* commandBuffer{nullptr};
+    MTL::BlitCommandEncoder* blitEncoder{nullptr};
+    // The last submitted command buffer, kept to wait on.
+    MTL::CommandBuffer* lastSubmitted{nullptr};
+    uint64_t submitted{0};
+    std::atomic<uint64_t> completed{0};
+};
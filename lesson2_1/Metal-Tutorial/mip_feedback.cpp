@@ -0,0 +1,197 @@
+//
+//  mip_feedback.cpp
+//  Metal-Guide
+//
+
+#include "mip_feedback.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "thread_pool.hpp"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Keep clang from fusing the scalar multiply-adds, which would round
+// differently from the SIMD paths.
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+
+namespace MipFeedback {
+
+namespace {
+
+// Per-view constants. A sphere is inside a side plane when
+// |x| * planeCos - depth * planeSin <= radius.
+struct Frustum {
+    float m[16];
+    float nearZ, farZ;
+    float xCos, xSin;
+    float yCos, ySin;
+    // World-space size of one pixel at depth 1.
+    float pixelScale;
+};
+
+Frustum makeFrustum(const View& view) {
+    Frustum frustum;
+    memcpy(frustum.m, view.viewMatrix, sizeof(frustum.m));
+    frustum.nearZ = view.nearZ;
+    frustum.farZ = view.farZ;
+    const float tanY = std::tan(view.fovY * 0.5f);
+    const float tanX = tanY * view.aspect;
+    frustum.xCos = 1.0f / std::sqrt(1.0f + tanX * tanX);
+    frustum.xSin = tanX * frustum.xCos;
+    frustum.yCos = 1.0f / std::sqrt(1.0f + tanY * tanY);
+    frustum.ySin = tanY * frustum.yCos;
+    frustum.pixelScale = 2.0f * tanY / view.viewportHeight;
+    return frustum;
+}
+
+// floor(log2(x)) for x >= 1, read straight from the float's exponent.
+inline uint32_t floorLog2(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, 4);
+    return (bits >> 23) - 127;
+}
+
+inline uint8_t levelFor(const Frustum& f, float cx, float cy, float cz, float radius, float density) {
+    // Same operation order as the SIMD paths, so results match exactly.
+    const float vx = f.m[12] + f.m[0] * cx + f.m[4] * cy + f.m[8] * cz;
+    const float vy = f.m[13] + f.m[1] * cx + f.m[5] * cy + f.m[9] * cz;
+    const float depth = -f.m[14] + -f.m[2] * cx + -f.m[6] * cy + -f.m[10] * cz;
+
+    const bool visible = depth + radius > f.nearZ && depth - radius < f.farZ &&
+                         std::abs(vx) * f.xCos - depth * f.xSin <= radius &&
+                         std::abs(vy) * f.yCos - depth * f.ySin <= radius;
+    if (!visible) {
+        return kNotVisible;
+    }
+    const float nearest = std::max(depth - radius, f.nearZ);
+    return uint8_t(floorLog2(std::max(density * nearest * f.pixelScale, 1.0f)));
+}
+
+void computeRange(const Frustum& f, const Objects& objects, uint8_t* levels, size_t begin, size_t end) {
+    size_t i = begin;
+#if defined(__ARM_NEON)
+    const float32x4_t m0 = vdupq_n_f32(f.m[0]), m4 = vdupq_n_f32(f.m[4]), m8 = vdupq_n_f32(f.m[8]), m12 = vdupq_n_f32(f.m[12]);
+    const float32x4_t m1 = vdupq_n_f32(f.m[1]), m5 = vdupq_n_f32(f.m[5]), m9 = vdupq_n_f32(f.m[9]), m13 = vdupq_n_f32(f.m[13]);
+    const float32x4_t m2 = vdupq_n_f32(-f.m[2]), m6 = vdupq_n_f32(-f.m[6]), m10 = vdupq_n_f32(-f.m[10]), m14 = vdupq_n_f32(-f.m[14]);
+    const float32x4_t nearZ = vdupq_n_f32(f.nearZ), farZ = vdupq_n_f32(f.farZ);
+    const float32x4_t xCos = vdupq_n_f32(f.xCos), xSin = vdupq_n_f32(f.xSin);
+    const float32x4_t yCos = vdupq_n_f32(f.yCos), ySin = vdupq_n_f32(f.ySin);
+    const float32x4_t pixelScale = vdupq_n_f32(f.pixelScale), one = vdupq_n_f32(1.0f);
+    const uint32x4_t bias = vdupq_n_u32(127), hidden = vdupq_n_u32(kNotVisible);
+    for (; i + 4 <= end; i += 4) {
+        const float32x4_t cx = vld1q_f32(objects.centerX + i);
+        const float32x4_t cy = vld1q_f32(objects.centerY + i);
+        const float32x4_t cz = vld1q_f32(objects.centerZ + i);
+        const float32x4_t radius = vld1q_f32(objects.radius + i);
+        const float32x4_t vx = vmlaq_f32(vmlaq_f32(vmlaq_f32(m12, m0, cx), m4, cy), m8, cz);
+        const float32x4_t vy = vmlaq_f32(vmlaq_f32(vmlaq_f32(m13, m1, cx), m5, cy), m9, cz);
+        const float32x4_t depth = vmlaq_f32(vmlaq_f32(vmlaq_f32(m14, m2, cx), m6, cy), m10, cz);
+
+        uint32x4_t visible = vcgtq_f32(vaddq_f32(depth, radius), nearZ);
+        visible = vandq_u32(visible, vcltq_f32(vsubq_f32(depth, radius), farZ));
+        visible = vandq_u32(visible, vcleq_f32(vmlsq_f32(vmulq_f32(vabsq_f32(vx), xCos), depth, xSin), radius));
+        visible = vandq_u32(visible, vcleq_f32(vmlsq_f32(vmulq_f32(vabsq_f32(vy), yCos), depth, ySin), radius));
+
+        const float32x4_t nearest = vmaxq_f32(vsubq_f32(depth, radius), nearZ);
+        const float32x4_t ratio = vmaxq_f32(vmulq_f32(vmulq_f32(vld1q_f32(objects.texelDensity + i), nearest), pixelScale), one);
+        const uint32x4_t level = vsubq_u32(vshrq_n_u32(vreinterpretq_u32_f32(ratio), 23), bias);
+        const uint16x4_t narrow = vmovn_u32(vbslq_u32(visible, level, hidden));
+        const uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+        const uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+        memcpy(levels + i, &packed, 4);
+    }
+#elif defined(__SSE2__)
+    const __m128 m0 = _mm_set1_ps(f.m[0]), m4 = _mm_set1_ps(f.m[4]), m8 = _mm_set1_ps(f.m[8]), m12 = _mm_set1_ps(f.m[12]);
+    const __m128 m1 = _mm_set1_ps(f.m[1]), m5 = _mm_set1_ps(f.m[5]), m9 = _mm_set1_ps(f.m[9]), m13 = _mm_set1_ps(f.m[13]);
+    const __m128 m2 = _mm_set1_ps(-f.m[2]), m6 = _mm_set1_ps(-f.m[6]), m10 = _mm_set1_ps(-f.m[10]), m14 = _mm_set1_ps(-f.m[14]);
+    const __m128 nearZ = _mm_set1_ps(f.nearZ), farZ = _mm_set1_ps(f.farZ);
+    const __m128 xCos = _mm_set1_ps(f.xCos), xSin = _mm_set1_ps(f.xSin);
+    const __m128 yCos = _mm_set1_ps(f.yCos), ySin = _mm_set1_ps(f.ySin);
+    const __m128 pixelScale = _mm_set1_ps(f.pixelScale), one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128i bias = _mm_set1_epi32(127), hidden = _mm_set1_epi32(kNotVisible);
+    for (; i + 4 <= end; i += 4) {
+        const __m128 cx = _mm_loadu_ps(objects.centerX + i);
+        const __m128 cy = _mm_loadu_ps(objects.centerY + i);
+        const __m128 cz = _mm_loadu_ps(objects.centerZ + i);
+        const __m128 radius = _mm_loadu_ps(objects.radius + i);
+        const __m128 vx = _mm_add_ps(_mm_add_ps(_mm_add_ps(m12, _mm_mul_ps(m0, cx)), _mm_mul_ps(m4, cy)), _mm_mul_ps(m8, cz));
+        const __m128 vy = _mm_add_ps(_mm_add_ps(_mm_add_ps(m13, _mm_mul_ps(m1, cx)), _mm_mul_ps(m5, cy)), _mm_mul_ps(m9, cz));
+        const __m128 depth = _mm_add_ps(_mm_add_ps(_mm_add_ps(m14, _mm_mul_ps(m2, cx)), _mm_mul_ps(m6, cy)), _mm_mul_ps(m10, cz));
+
+        __m128 visible = _mm_cmpgt_ps(_mm_add_ps(depth, radius), nearZ);
+        visible = _mm_and_ps(visible, _mm_cmplt_ps(_mm_sub_ps(depth, radius), farZ));
+        visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(_mm_mul_ps(_mm_andnot_ps(signMask, vx), xCos), _mm_mul_ps(depth, xSin)), radius));
+        visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(_mm_mul_ps(_mm_andnot_ps(signMask, vy), yCos), _mm_mul_ps(depth, ySin)), radius));
+
+        const __m128 nearest = _mm_max_ps(_mm_sub_ps(depth, radius), nearZ);
+        const __m128 ratio = _mm_max_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(objects.texelDensity + i), nearest), pixelScale), one);
+        const __m128i level = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(ratio), 23), bias);
+        const __m128i mask = _mm_castps_si128(visible);
+        __m128i packed = _mm_or_si128(_mm_and_si128(mask, level), _mm_andnot_si128(mask, hidden));
+        packed = _mm_packs_epi32(packed, packed);
+        packed = _mm_packus_epi16(packed, packed);
+        const int bytes = _mm_cvtsi128_si32(packed);
+        memcpy(levels + i, &bytes, 4);
+    }
+#endif
+    for (; i < end; ++i) {
+        levels[i] = levelFor(f, objects.centerX[i], objects.centerY[i], objects.centerZ[i],
+                             objects.radius[i], objects.texelDensity[i]);
+    }
+}
+
+}
+
+namespace Scalar {
+
+void computeLevels(const View& view, const Objects& objects, uint8_t* levels) {
+    const Frustum frustum = makeFrustum(view);
+    for (size_t i = 0; i < objects.count; ++i) {
+        levels[i] = levelFor(frustum, objects.centerX[i], objects.centerY[i], objects.centerZ[i],
+                             objects.radius[i], objects.texelDensity[i]);
+    }
+}
+
+}
+
+void computeLevels(const View& view, const Objects& objects, uint8_t* levels) {
+    computeRange(makeFrustum(view), objects, levels, 0, objects.count);
+}
+
+void computeLevelsParallel(const View& view, const Objects& objects, uint8_t* levels) {
+    const Frustum frustum = makeFrustum(view);
+    // Chunks stay multiples of 4 so only the last one has a scalar tail.
+    ThreadPool::shared().parallelFor((objects.count + 3) / 4, 1024, [&](size_t begin, size_t end) {
+        computeRange(frustum, objects, levels, begin * 4, std::min(end * 4, objects.count));
+    });
+}
+
+void reduceToTextures(const uint8_t* levels, const uint32_t* textureIndices, size_t count,
+                      uint8_t* textureLevels, size_t textureCount) {
+    std::fill(textureLevels, textureLevels + textureCount, kNotVisible);
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t& level = textureLevels[textureIndices[i]];
+        level = std::min(level, levels[i]);
+    }
+}
+
+void requestLevels(TextureResidency& residency, const TextureHandle* textures, const uint8_t* textureLevels,
+                   size_t textureCount) {
+    for (size_t i = 0; i < textureCount; ++i) {
+        if (textureLevels[i] != kNotVisible) {
+            residency.use(textures[i].id(), textureLevels[i]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,63 @@
+//
+//  mip_feedback.hpp
+//  Metal-Guide
+//
+//  Works out on the CPU which mip level each textured object needs, from its
+//  bounding sphere, the camera and the texture's texel density, so texture
+//  streaming can load only those levels.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "texture_residency.hpp"
+
+namespace MipFeedback {
+
+// Level reported for objects outside the view frustum.
+constexpr uint8_t kNotVisible = 0xff;
+
+// Camera as set up in EngineCore::writeTransforms.
+struct View {
+    float viewMatrix[16];  // column-major, world -> view, camera looking down -z
+    float fovY;            // radians
+    float aspect;
+    float nearZ;
+    float farZ;
+    float viewportHeight;  // pixels
+};
+
+// Objects in structure-of-arrays form. texelDensity is texels per world
+// unit at level 0 (texture width / world size of one UV repeat).
+struct Objects {
+    const float* centerX;
+    const float* centerY;
+    const float* centerZ;
+    const float* radius;
+    const float* texelDensity;
+    size_t count;
+};
+
+// Writes the finest level each object can be sampled at without
+// minification beyond 1 texel per pixel, measured at the sphere's nearest
+// point, or kNotVisible. Levels are not clamped to the texture's chain.
+void computeLevels(const View& view, const Objects& objects, uint8_t* levels);
+// Same, split across ThreadPool::shared().
+void computeLevelsParallel(const View& view, const Objects& objects, uint8_t* levels);
+
+// Minimum level per texture over the objects that use it; textures no
+// visible object uses get kNotVisible.
+void reduceToTextures(const uint8_t* levels, const uint32_t* textureIndices, size_t count,
+                      uint8_t* textureLevels, size_t textureCount);
+
+// Asks residency to stream in the levels each visible texture needs.
+void requestLevels(TextureResidency& residency, const TextureHandle* textures, const uint8_t* textureLevels,
+                   size_t textureCount);
+
+namespace Scalar {
+void computeLevels(const View& view, const Objects& objects, uint8_t* levels);
+}
+
+}
@@ -9,9 +9,15 @@
 #include <format>
 #include <iostream>
 
-#include "AAPLMathUtilities.h"
 #include "GLFWBridge.h"
 
+static constexpr uint64_t kTextureBudgetBytes = uint64_t(256) << 20;
+
+// Pipelines that compiled last run, compiled ahead of their first draw.
+static std::string pipelineCachePath() {
+    return TextureCache::defaultDirectory() + "/pipelines.mgpc";
+}
+
 static void printTime() {
     static auto last = std::chrono::system_clock::now();
     auto now = std::chrono::system_clock::now();
@@ -31,13 +37,9 @@ void MTLEngine::init(std::string_view pic) {
     initDevice();
     initWindow();
     
-    createCube(pic);
-    createBuffers();
     createDefaultLibrary();
-    createCommandQueue();
-    createRenderPipeline();
-    createDepthAndMSAATextures();
-    createRenderPassDescriptor();
+    createCore();
+    createTexture(pic);
 }
 
 void MTLEngine::run() {
@@ -46,6 +48,7 @@ void MTLEngine::run() {
         printTime();
         auto a = std::chrono::system_clock::now();
         //pPool = NS::AutoreleasePool::alloc()->init();
+        applyPendingResize();
         auto b = std::chrono::system_clock::now();
         metalDrawable = metalLayer->nextDrawable();
         auto c = std::chrono::system_clock::now();
@@ -67,12 +70,13 @@ void MTLEngine::run() {
 void MTLEngine::cleanup() {
     std::cout << "cleanup()" << std::endl;
     glfwTerminate();
-    transformationBuffer->release();
-    msaaRenderTargetTexture->release();
-    depthTexture->release();
-    renderPassDescriptor->release();
+    core->pipelines().save(pipelineCachePath());
+    grassTexture = TextureHandle();
+    delete textureResidency;
+    delete textureAllocator;
+    delete core;
+    metalDefaultLibrary->release();
     metalDevice->release();
-    delete grassTexture;
 }
 
 void MTLEngine::initDevice() {
@@ -86,19 +90,26 @@ void MTLEngine::frameBufferSizeCallback(GLFWwindow *window, int width, int heigh
 
 void MTLEngine::resizeFrameBuffer(int width, int height) {
     //std::cout << __FUNCTION__ << " " << width << "x" << height << std::endl;
-    metalLayer->setDrawableSize(CGSizeMake(width, height));
-    // Deallocate the textures if they have been created
-    if (msaaRenderTargetTexture) {
-        msaaRenderTargetTexture->release();
-        msaaRenderTargetTexture = nullptr;
-    }
-    if (depthTexture) {
-        depthTexture->release();
-        depthTexture = nullptr;
+    // A window drag reports many sizes per frame; only the last one matters.
+    pendingWidth = width;
+    pendingHeight = height;
+    resizePending = true;
+    ++resizeEvents;
+}
+
+void MTLEngine::applyPendingResize() {
+    if (!resizePending) {
+        return;
     }
-    createDepthAndMSAATextures();
-    metalDrawable = metalLayer->nextDrawable();
-    updateRenderPassDescriptor();
+    resizePending = false;
+    ++resizesApplied;
+    metalLayer->setDrawableSize(CGSizeMake(pendingWidth, pendingHeight));
+    core->resize(pendingWidth, pendingHeight);
+    const MetalRenderGraph::Stats& stats = core->renderGraph().stats();
+    std::cout << "resize " << pendingWidth << "x" << pendingHeight << ": " << resizeEvents << " events, "
+              << resizesApplied << " applied; render graph heap " << (stats.heapBytes >> 20) << " MB, "
+              << stats.heapAllocations << " allocated, attachments " << (stats.planBytes >> 20) << " MB, "
+              << (stats.unaliasedBytes >> 20) << " MB without aliasing" << std::endl;
 }
 
 void MTLEngine::initWindow() {
@@ -124,68 +135,6 @@ void MTLEngine::initWindow() {
     metalDrawable = metalLayer->nextDrawable();
 }
 
-void MTLEngine::createCube(std::string_view pic) {
-    // Cube for use in a right-handed coordinate system with triangle faces
-    // specified with a Counter-Clockwise winding order.
-    VertexData cubeVertices[] = {
-        // Front face
-        {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
-        {{0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}},
-        {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}},
-        {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
-        
-        // Back face
-        {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-        {{-0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}},
-        {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}},
-        {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-
-        // Top face
-        {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}},
-        {{0.5, 0.5, 0.5, 1.0}, {1.0, 0.0}},
-        {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}},
-        {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}},
-
-        // Bottom face
-        {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-        {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}},
-        {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, -0.5, 0.5, 1.0}, {0.0, 1.0}},
-        {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-
-        // Left face
-        {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-        {{-0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}},
-        {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
-        {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}},
-        {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
-
-        // Right face
-        {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
-        {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}},
-        {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
-        {{0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}},
-        {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
-    };
-
-    
-    cubeVertexBuffer = metalDevice->newBuffer(&cubeVertices, sizeof(cubeVertices), MTL::ResourceStorageModeShared);
-    grassTexture = new Texture(pic.data(), metalDevice);
-}
-
-void MTLEngine::createBuffers() {
-    transformationBuffer = metalDevice->newBuffer(sizeof(TransformationData), MTL::ResourceStorageModeShared);
-}
-
 void MTLEngine::createDefaultLibrary() {
     metalDefaultLibrary = metalDevice->newDefaultLibrary();
     if(!metalDefaultLibrary){
@@ -194,151 +143,46 @@ void MTLEngine::createDefaultLibrary() {
     }
 }
 
-void MTLEngine::createCommandQueue() {
-    metalCommandQueue = metalDevice->newCommandQueue();
-}
-
-void MTLEngine::createRenderPipeline() {
-    MTL::Function* vertexShader = metalDefaultLibrary->newFunction(NS::String::string("vertexShader", NS::ASCIIStringEncoding));
-    assert(vertexShader);
-    MTL::Function* fragmentShader = metalDefaultLibrary->newFunction(NS::String::string("fragmentShader", NS::ASCIIStringEncoding));
-    assert(fragmentShader);
-    
-    MTL::RenderPipelineDescriptor* renderPipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-    assert(renderPipelineDescriptor);
-    renderPipelineDescriptor->setVertexFunction(vertexShader);
-    renderPipelineDescriptor->setFragmentFunction(fragmentShader);
-    MTL::PixelFormat pixelFormat = (MTL::PixelFormat)metalLayer->pixelFormat();
-    renderPipelineDescriptor->colorAttachments()->object(0)->setPixelFormat(pixelFormat);
-    renderPipelineDescriptor->setSampleCount(sampleCount);
-    renderPipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-    
-    NS::Error* error;
-    metalRenderPSO = metalDevice->newRenderPipelineState(renderPipelineDescriptor, &error);
-    
-    if (metalRenderPSO == nil) {
-        std::cout << "Error creating render pipeline state: " << error << std::endl;
-        std::exit(0);
-    }
-    
-    MTL::DepthStencilDescriptor* depthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
-    depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLessEqual);
-    depthStencilDescriptor->setDepthWriteEnabled(true);
-    depthStencilState = metalDevice->newDepthStencilState(depthStencilDescriptor);
-    
-    renderPipelineDescriptor->release();
-    vertexShader->release();
-    fragmentShader->release();
-}
-
-void MTLEngine::createDepthAndMSAATextures() {
-    MTL::TextureDescriptor* msaaTextureDescriptor = MTL::TextureDescriptor::alloc()->init();
-    msaaTextureDescriptor->setTextureType(MTL::TextureType2DMultisample);
-    msaaTextureDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+void MTLEngine::createCore() {
     const auto layerSize = metalLayer->drawableSize();
-    msaaTextureDescriptor->setWidth(layerSize.width);
-    msaaTextureDescriptor->setHeight(layerSize.height);
-    msaaTextureDescriptor->setSampleCount(sampleCount);
-    msaaTextureDescriptor->setUsage(MTL::TextureUsageRenderTarget);
-
-    msaaRenderTargetTexture = metalDevice->newTexture(msaaTextureDescriptor);
-
-    MTL::TextureDescriptor* depthTextureDescriptor = MTL::TextureDescriptor::alloc()->init();
-    depthTextureDescriptor->setTextureType(MTL::TextureType2DMultisample);
-    depthTextureDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
-    depthTextureDescriptor->setWidth(layerSize.width);
-    depthTextureDescriptor->setHeight(layerSize.height);
-    depthTextureDescriptor->setUsage(MTL::TextureUsageRenderTarget);
-    depthTextureDescriptor->setSampleCount(sampleCount);
-
-    depthTexture = metalDevice->newTexture(depthTextureDescriptor);
-
-    msaaTextureDescriptor->release();
-    depthTextureDescriptor->release();
+    EngineCore::Options options;
+    options.colorFormat = uint32_t(metalLayer->pixelFormat());
+    core = new EngineCore(metalDevice, metalDefaultLibrary, int(layerSize.width), int(layerSize.height), options);
+    core->pipelines().prewarm(pipelineCachePath());
 }
 
-void MTLEngine::createRenderPassDescriptor() {
-    renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
-    
-    MTL::RenderPassColorAttachmentDescriptor* colorAttachment = renderPassDescriptor->colorAttachments()->object(0);
-    MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = renderPassDescriptor->depthAttachment();
-
-    colorAttachment->setTexture(msaaRenderTargetTexture);
-    colorAttachment->setResolveTexture(metalDrawable->texture());
-    colorAttachment->setLoadAction(MTL::LoadActionClear);
-    colorAttachment->setClearColor(MTL::ClearColor(41.0f/255.0f, 42.0f/255.0f, 48.0f/255.0f, 1.0));
-    colorAttachment->setStoreAction(MTL::StoreActionMultisampleResolve);
-    
-    depthAttachment->setTexture(depthTexture);
-    depthAttachment->setLoadAction(MTL::LoadActionClear);
-    depthAttachment->setStoreAction(MTL::StoreActionDontCare);
-    depthAttachment->setClearDepth(1.0);
+void MTLEngine::createTexture(std::string_view pic) {
+    TextureOptions textureOptions;
+    textureOptions.cache = &textureCache;
+    textureOptions.uploads = &core->uploads();
+    textureAllocator = new MetalTextureAllocator(metalDevice, textureOptions);
+    textureResidency = new TextureResidency(*textureAllocator, kTextureBudgetBytes);
+    TextureDescription grassDescription = textureAllocator->describe(pic.data());
+    grassTexture = textureResidency->add(grassDescription);
+    grassTexelDensity = float(grassDescription.width);
+    textureAllocator->setSource(grassTexture.id(), std::string(pic));
+    core->setTextureSource(this);
 }
 
-void MTLEngine::updateRenderPassDescriptor() {
-    renderPassDescriptor->colorAttachments()->object(0)->setTexture(msaaRenderTargetTexture);
-    renderPassDescriptor->colorAttachments()->object(0)->setResolveTexture(metalDrawable->texture());
-    renderPassDescriptor->depthAttachment()->setTexture(depthTexture);
+MTL::Texture* MTLEngine::texture(uint8_t level) {
+    // Nothing until the texture's first upload has gone out.
+    textureResidency->use(grassTexture.id(), level);
+    return textureAllocator->texture(grassTexture.id());
 }
 
 void MTLEngine::draw() {
+    textureResidency->beginFrame();
+    core->update();
+    if (core->pipelineFailed()) {
+        std::cout << "Error creating render pipeline state: " << core->pipelineError() << std::endl;
+        std::exit(0);
+    }
     sendRenderCommand();
 }
 
 void MTLEngine::sendRenderCommand() {
-    metalCommandBuffer = metalCommandQueue->commandBuffer();
-    
-    updateRenderPassDescriptor();
-    MTL::RenderCommandEncoder* renderCommandEncoder = metalCommandBuffer->renderCommandEncoder(renderPassDescriptor);
-    encodeRenderCommand(renderCommandEncoder);
-    renderCommandEncoder->endEncoding();
-
+    MTL::CommandBuffer* metalCommandBuffer = core->encode(metalDrawable->texture(), glfwGetTime());
     metalCommandBuffer->presentDrawable(metalDrawable);
     metalCommandBuffer->commit();
     metalCommandBuffer->waitUntilCompleted();
 }
-
-void MTLEngine::encodeRenderCommand(MTL::RenderCommandEncoder* renderCommandEncoder) {
-    // Moves the Cube 1 unit down the negative Z-axis
-    matrix_float4x4 translationMatrix = matrix4x4_translation(0, 0.0,-1.0);
-    
-    float angleInDegrees = glfwGetTime()/2.0 * 45;
-    float angleInRadians = angleInDegrees * M_PI / 180.0f;
-    matrix_float4x4 rotationMatrix = matrix4x4_rotation(angleInRadians, 0.0, 1.0, 0.0);
-
-    matrix_float4x4 modelMatrix = simd_mul(translationMatrix, rotationMatrix);
-
-    simd::float3 R = simd::float3 {1, 0, 0}; // Unit-Right
-    simd::float3 U = simd::float3 {0, 1, 0}; // Unit-Up
-    simd::float3 F = simd::float3 {0, 0,-1}; // Unit-Forward
-    simd::float3 P = simd::float3 {0, 0, 1}; // Camera Position in World Space
-    
-    matrix_float4x4 viewMatrix = matrix_make_rows(R.x, R.y, R.z, dot(-R, P),
-                                                  U.x, U.y, U.z, dot(-U, P),
-                                                 -F.x,-F.y,-F.z, dot( F, P),
-                                                  0, 0, 0, 1);
-
-    const auto layerSize = metalLayer->drawableSize();
-    float aspectRatio = (layerSize.width / layerSize.height);
-    float fov = 90 * (M_PI / 180.0f);
-    float nearZ = 0.1f;
-    float farZ = 100.0f;
-    
-    matrix_float4x4 perspectiveMatrix = matrix_perspective_right_hand(fov, aspectRatio, nearZ, farZ);
-
-    TransformationData transformationData = { modelMatrix, viewMatrix, perspectiveMatrix };
-    memcpy(transformationBuffer->contents(), &transformationData, sizeof(transformationData));
-    
-    renderCommandEncoder->setFrontFacingWinding(MTL::WindingCounterClockwise);
-    renderCommandEncoder->setCullMode(MTL::CullModeBack);
-    //renderCommandEncoder->setTriangleFillMode(MTL::TriangleFillModeLines);
-    renderCommandEncoder->setRenderPipelineState(metalRenderPSO);
-    renderCommandEncoder->setDepthStencilState(depthStencilState);
-    renderCommandEncoder->setVertexBuffer(cubeVertexBuffer, 0, 0);
-    renderCommandEncoder->setVertexBuffer(transformationBuffer, 0, 1);
-    MTL::PrimitiveType typeTriangle = MTL::PrimitiveTypeTriangle;
-    NS::UInteger vertexStart = 0;
-    NS::UInteger vertexCount = 36;
-    renderCommandEncoder->setFragmentTexture(grassTexture->texture, 0);
-    renderCommandEncoder->drawPrimitives(typeTriangle, vertexStart, vertexCount);
-}
@@ -15,14 +15,16 @@
 #include <QuartzCore/CAMetalLayer.hpp>
 #include <QuartzCore/QuartzCore.hpp>
 
-#include <simd/simd.h>
-
-#include "vertex_data.hpp"
+#include "engine_core.hpp"
 #include "texture.hpp"
+#include "metal_texture_allocator.hpp"
+#include "texture_residency.hpp"
 #include "stb/stb_image.h"
 
 
-class MTLEngine {
+// The window around EngineCore: GLFW, the layer and its drawables, and
+// the grass texture, streamed in at the mip level the cube needs.
+class MTLEngine : private EngineCore::TextureSource {
 public:
     void init(std::string_view pic);
     void run();
@@ -32,23 +34,20 @@ private:
     void initDevice();
     void initWindow();
     
-    void createCube(std::string_view pic);
-    void createBuffers();
     void createDefaultLibrary();
-    void createCommandQueue();
-    void createRenderPipeline();
-    void createDepthAndMSAATextures();
-    void createRenderPassDescriptor();
-
-    // Upon resizing, update Depth and MSAA Textures.
-    void updateRenderPassDescriptor();
+    void createCore();
+    void createTexture(std::string_view pic);
     
-    void encodeRenderCommand(MTL::RenderCommandEncoder* renderEncoder);
     void sendRenderCommand();
     void draw();
     
+    float texelDensity() const override { return grassTexelDensity; }
+    MTL::Texture* texture(uint8_t level) override;
+    
     static void frameBufferSizeCallback(GLFWwindow *window, int width, int height);
     void resizeFrameBuffer(int width, int height);
+    // Applies the last size resizeFrameBuffer() saw, once per frame.
+    void applyPendingResize();
     
     NS::AutoreleasePool* pPool;
     
@@ -58,17 +57,17 @@ private:
     CA::MetalDrawable* metalDrawable;
     
     MTL::Library* metalDefaultLibrary;
-    MTL::CommandQueue* metalCommandQueue;
-    MTL::CommandBuffer* metalCommandBuffer;
-    MTL::RenderPipelineState* metalRenderPSO;
-    MTL::Buffer* cubeVertexBuffer;
-    MTL::Buffer* transformationBuffer;
-    
-    MTL::DepthStencilState* depthStencilState;
-    MTL::RenderPassDescriptor* renderPassDescriptor;
-    MTL::Texture* msaaRenderTargetTexture{nullptr};
-    MTL::Texture* depthTexture;
-    int sampleCount{4};
+    EngineCore* core;
+    bool resizePending{false};
+    int pendingWidth{0};
+    int pendingHeight{0};
+    uint64_t resizeEvents{0};
+    uint64_t resizesApplied{0};
 
-    Texture* grassTexture;
+    TextureCache textureCache;
+    MetalTextureAllocator* textureAllocator;
+    TextureResidency* textureResidency;
+    TextureHandle grassTexture;
+    // Texels per world unit: each cube face maps the whole texture onto 1 unit.
+    float grassTexelDensity;
 };
@@ -0,0 +1,358 @@
+//
+//  pipeline_cache.cpp
+//  Metal-Guide
+//
+
+#include "pipeline_cache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <unistd.h>
+
+#include "texture_cache.hpp"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4350474d;  // "MGPC"
+constexpr uint32_t kVersion = 1;
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& value) {
+    put(out, uint32_t(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : in(data), end(data + size) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (size_t(end - in) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, in, sizeof(value));
+        in += sizeof(value);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t size;
+        if (!get(size) || size_t(end - in) < size) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(in), size);
+        in += size;
+        return true;
+    }
+
+    // The next size bytes as a reader of their own.
+    bool take(size_t size, Reader& part) {
+        if (size_t(end - in) < size) {
+            return false;
+        }
+        part = Reader(in, size);
+        in += size;
+        return true;
+    }
+
+    bool atEnd() const { return in == end; }
+
+private:
+    const uint8_t* in;
+    const uint8_t* end;
+};
+
+// The bytes key() hashes and save() writes. Fields a pipeline does not use
+// are left out, so descriptions that differ only there share a key.
+void serialize(const PipelineDescription& description, std::vector<uint8_t>& out) {
+    putString(out, description.vertexFunction);
+    putString(out, description.fragmentFunction);
+    for (uint32_t i = 0; i < PipelineDescription::kMaxColorAttachments; ++i) {
+        put(out, description.colorFormats[i]);
+        if (!description.colorFormats[i]) {
+            continue;
+        }
+        const BlendState& blend = description.blend[i];
+        put(out, uint8_t(blend.enabled));
+        if (blend.enabled) {
+            for (uint8_t value : {blend.sourceRGB, blend.destinationRGB, blend.rgbOperation, blend.sourceAlpha,
+                                  blend.destinationAlpha, blend.alphaOperation}) {
+                put(out, value);
+            }
+        }
+        put(out, blend.writeMask);
+    }
+    put(out, description.depthFormat);
+    put(out, description.stencilFormat);
+    put(out, description.sampleCount);
+}
+
+bool deserialize(Reader& in, PipelineDescription& description) {
+    bool valid = in.getString(description.vertexFunction) && in.getString(description.fragmentFunction);
+    for (uint32_t i = 0; valid && i < PipelineDescription::kMaxColorAttachments; ++i) {
+        valid = in.get(description.colorFormats[i]);
+        if (!valid || !description.colorFormats[i]) {
+            continue;
+        }
+        BlendState& blend = description.blend[i];
+        uint8_t enabled = 0;
+        valid = in.get(enabled);
+        blend.enabled = enabled;
+        if (valid && blend.enabled) {
+            valid = in.get(blend.sourceRGB) && in.get(blend.destinationRGB) && in.get(blend.rgbOperation) &&
+                    in.get(blend.sourceAlpha) && in.get(blend.destinationAlpha) && in.get(blend.alphaOperation);
+        }
+        valid = valid && in.get(blend.writeMask);
+    }
+    return valid && in.get(description.depthFormat) && in.get(description.stencilFormat) &&
+           in.get(description.sampleCount);
+}
+
+}
+
+PipelineCache::PipelineCache(PipelineCompiler& compiler, uint32_t maxInFlight, ThreadPool& pool)
+    : compiler(compiler), maxInFlight(std::max(maxInFlight, 1u)), pool(pool) {}
+
+PipelineCache::~PipelineCache() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        compilesDone.wait(lock, [this] { return running == 0; });
+    }
+    collect();
+    for (auto& [key, cached] : entries) {
+        if (cached.pipeline) {
+            compiler.release(cached.pipeline);
+        }
+    }
+}
+
+PipelineCache::Key PipelineCache::key(const PipelineDescription& description) {
+    std::vector<uint8_t> bytes;
+    serialize(description, bytes);
+    return TextureCache::hash(bytes.data(), bytes.size());
+}
+
+PipelineCache::Entry& PipelineCache::entry(Key key, const PipelineDescription& description) {
+    auto [found, inserted] = entries.try_emplace(key);
+    if (inserted) {
+        found->second.description = description;
+    }
+    return found->second;
+}
+
+void PipelineCache::enqueue(Key key, Entry& queued, bool urgent) {
+    queued.state = State::Queued;
+    queued.urgent = urgent;
+    (urgent ? urgentQueue : backgroundQueue).push_back(key);
+}
+
+void* PipelineCache::get(const PipelineDescription& description) {
+    const Key pipelineKey = key(description);
+    entry(pipelineKey, description);
+    return get(pipelineKey);
+}
+
+void* PipelineCache::get(Key key) {
+    auto found = entries.find(key);
+    assert(found != entries.end());
+    Entry& wanted = found->second;
+    ++counters.requests;
+    if (wanted.state == State::Ready) {
+        ++counters.hits;
+        return wanted.pipeline;
+    }
+    want(key, wanted);
+    ++counters.fallbacks;
+    return fallback;
+}
+
+PipelineCache::Key PipelineCache::request(const PipelineDescription& description) {
+    const Key pipelineKey = key(description);
+    want(pipelineKey, entry(pipelineKey, description));
+    return pipelineKey;
+}
+
+void PipelineCache::want(Key key, Entry& wanted) {
+    switch (wanted.state) {
+    case State::Missing:
+        enqueue(key, wanted, true);
+        break;
+    case State::Queued:
+        // If it is waiting behind prewarming, a second entry in the urgent
+        // queue moves it up. Whichever entry comes second is skipped.
+        ++counters.deduplicated;
+        if (!wanted.urgent) {
+            wanted.urgent = true;
+            urgentQueue.push_back(key);
+        }
+        break;
+    case State::Compiling:
+        ++counters.deduplicated;
+        break;
+    case State::Ready:
+    case State::Failed:
+        break;
+    }
+}
+
+void PipelineCache::update() {
+    collect();
+    for (std::deque<Key>* queue : {&urgentQueue, &backgroundQueue}) {
+        while (inFlight < maxInFlight && !queue->empty()) {
+            const Key next = queue->front();
+            queue->pop_front();
+            Entry& queued = entries.at(next);
+            if (queued.state != State::Queued) {
+                continue;
+            }
+            queued.state = State::Compiling;
+            ++inFlight;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++running;
+            }
+            // Entries are never erased before the destructor, which waits
+            // for the workers, so they can read the description in place.
+            const PipelineDescription* description = &queued.description;
+            if (pool.threadCount() > 1) {
+                pool.submit([this, next, description] { compile(next, *description); });
+            } else {
+                compile(next, *description);
+            }
+        }
+    }
+    // Picks up compiles that ran inline.
+    collect();
+}
+
+void PipelineCache::finish() {
+    for (;;) {
+        update();
+        if (inFlight == 0 && urgentQueue.empty() && backgroundQueue.empty()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        compilesDone.wait(lock, [this] { return running == 0; });
+    }
+}
+
+void PipelineCache::collect() {
+    std::vector<Compiled> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.swap(compiled);
+    }
+    for (Compiled& result : finished) {
+        Entry& done = entries.at(result.key);
+        --inFlight;
+        ++counters.compiles;
+        done.pipeline = result.pipeline;
+        if (result.pipeline) {
+            done.state = State::Ready;
+        } else {
+            ++counters.failures;
+            done.state = State::Failed;
+            done.error = std::move(result.error);
+        }
+    }
+}
+
+void PipelineCache::compile(Key key, const PipelineDescription& description) {
+    std::string message;
+    void* pipeline = compiler.compile(description, message);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    compiled.push_back({key, pipeline, std::move(message)});
+    if (--running == 0) {
+        compilesDone.notify_all();
+    }
+}
+
+PipelineCache::State PipelineCache::state(Key key) const {
+    auto found = entries.find(key);
+    return found == entries.end() ? State::Missing : found->second.state;
+}
+
+const std::string& PipelineCache::error(Key key) const {
+    static const std::string none;
+    auto found = entries.find(key);
+    return found == entries.end() ? none : found->second.error;
+}
+
+bool PipelineCache::save(const std::string& path) const {
+    std::vector<Key> keys;
+    for (const auto& [key, cached] : entries) {
+        if (cached.state == State::Ready) {
+            keys.push_back(key);
+        }
+    }
+    // In key order, so the same pipelines always write the same file.
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint8_t> bytes, record;
+    put(bytes, kMagic);
+    put(bytes, kVersion);
+    put(bytes, uint32_t(keys.size()));
+    for (Key key : keys) {
+        record.clear();
+        serialize(entries.at(key).description, record);
+        put(bytes, uint32_t(record.size()));
+        bytes.insert(bytes.end(), record.begin(), record.end());
+    }
+
+    // As in TextureCache::store(), other processes never read a partial file.
+    const std::string temporaryPath = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+        if (!out) {
+            out.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t PipelineCache::prewarm(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    const std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    Reader in(bytes.data(), bytes.size());
+    uint32_t magic = 0, version = 0, count = 0;
+    if (!in.get(magic) || !in.get(version) || !in.get(count) || magic != kMagic || version != kVersion) {
+        return 0;
+    }
+
+    size_t queued = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t size = 0;
+        Reader record(nullptr, 0);
+        PipelineDescription description;
+        if (!in.get(size) || !in.take(size, record) || !deserialize(record, description) || !record.atEnd()) {
+            break;
+        }
+        const Key pipelineKey = key(description);
+        Entry& wanted = entry(pipelineKey, description);
+        if (wanted.state == State::Missing) {
+            enqueue(pipelineKey, wanted, false);
+            ++counters.prewarmed;
+            ++queued;
+        }
+    }
+    return queued;
+}
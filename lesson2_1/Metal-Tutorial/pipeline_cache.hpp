@@ -0,0 +1,163 @@
+//
+//  pipeline_cache.hpp
+//  Metal-Guide
+//
+//  Render pipeline states compiled on demand, off the render thread. A
+//  pipeline is described by value and keyed by a hash of that
+//  description, so asking for the same pipeline twice compiles it once.
+//  Misses are queued and compiled on the thread pool. Until a pipeline is
+//  ready, get() returns the fallback pipeline, or null if there is none,
+//  and the caller can draw with that or skip the draw. Requests from get()
+//  go before those from prewarm(). save() writes the descriptions of every
+//  pipeline that compiled, and prewarm() queues them on the next launch so
+//  they are usually ready before they are first drawn.
+//
+//  Like TextureResidency, the cache only does the bookkeeping and a
+//  PipelineCompiler does the compiling. Apart from the compiler, which
+//  runs on the pool's workers, use it from the render thread.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Blending for one colour attachment. The values are Metal's
+// MTL::BlendFactor, MTL::BlendOperation and MTL::ColorWriteMask.
+struct BlendState {
+    bool enabled{false};
+    uint8_t sourceRGB{1};          // one
+    uint8_t destinationRGB{0};     // zero
+    uint8_t rgbOperation{0};       // add
+    uint8_t sourceAlpha{1};
+    uint8_t destinationAlpha{0};
+    uint8_t alphaOperation{0};
+    uint8_t writeMask{0xf};        // all
+};
+
+struct PipelineDescription {
+    static constexpr uint32_t kMaxColorAttachments = 8;
+
+    std::string vertexFunction;
+    std::string fragmentFunction;    // empty for none
+    // MTL::PixelFormat values; 0 leaves an attachment unused.
+    uint32_t colorFormats[kMaxColorAttachments]{};
+    BlendState blend[kMaxColorAttachments];
+    uint32_t depthFormat{0};
+    uint32_t stencilFormat{0};
+    uint32_t sampleCount{1};
+};
+
+class PipelineCompiler {
+public:
+    virtual ~PipelineCompiler() = default;
+    // Called on the pool's workers, possibly several at once. Returns the
+    // pipeline (backend-defined, e.g. an MTL::RenderPipelineState*), or
+    // null with a message in error.
+    virtual void* compile(const PipelineDescription& description, std::string& error) = 0;
+    virtual void release(void* pipeline) = 0;
+};
+
+class PipelineCache {
+public:
+    using Key = uint64_t;
+
+    enum class State { Missing, Queued, Compiling, Ready, Failed };
+
+    struct Stats {
+        uint64_t requests;      // get() calls
+        uint64_t hits;          // get() calls that found the pipeline ready
+        uint64_t fallbacks;     // get() calls answered with the fallback
+        uint64_t deduplicated;  // requests for a pipeline already queued or compiling
+        uint64_t compiles;      // compiles finished, including failures
+        uint64_t failures;
+        uint64_t prewarmed;     // descriptions queued by prewarm()
+    };
+
+    // At most maxInFlight compiles run at once on the pool.
+    explicit PipelineCache(PipelineCompiler& compiler, uint32_t maxInFlight = 2,
+                           ThreadPool& pool = ThreadPool::shared());
+    // Waits for running compiles and releases every pipeline.
+    ~PipelineCache();
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // Hash of the fields the description uses: blending only for colour
+    // attachments in use, and factors only where blending is on.
+    static Key key(const PipelineDescription& description);
+
+    // Returned by get() while a pipeline is not ready. Not owned.
+    void setFallback(void* pipeline) { fallback = pipeline; }
+
+    // The pipeline if it is ready, else the fallback. A miss is queued
+    // ahead of prewarming.
+    void* get(const PipelineDescription& description);
+    // The same for a description already given to get() or request(),
+    // without hashing it again.
+    void* get(Key key);
+    // Queues the pipeline without waiting for it, e.g. at load time.
+    Key request(const PipelineDescription& description);
+
+    // Takes in finished compiles and starts queued ones.
+    void update();
+    // Blocks until nothing is queued or compiling.
+    void finish();
+
+    State state(Key key) const;
+    // Why a failed pipeline did not compile.
+    const std::string& error(Key key) const;
+
+    // Writes the descriptions of the pipelines that compiled.
+    bool save(const std::string& path) const;
+    // Queues the descriptions save() wrote, behind anything from get().
+    // Returns how many it queued; a missing or stale file queues none.
+    size_t prewarm(const std::string& path);
+
+    const Stats& stats() const { return counters; }
+
+private:
+    struct Entry {
+        PipelineDescription description;
+        State state{State::Missing};
+        bool urgent{false};
+        void* pipeline{nullptr};
+        std::string error;
+    };
+
+    struct Compiled {
+        Key key;
+        void* pipeline;
+        std::string error;
+    };
+
+    Entry& entry(Key key, const PipelineDescription& description);
+    void enqueue(Key key, Entry& entry, bool urgent);
+    // Queues a pipeline that is missing, or moves it ahead of prewarming.
+    void want(Key key, Entry& wanted);
+    void collect();
+    void compile(Key key, const PipelineDescription& description);
+
+    PipelineCompiler& compiler;
+    uint32_t maxInFlight;
+    ThreadPool& pool;
+    void* fallback{nullptr};
+
+    std::unordered_map<Key, Entry> entries;
+    std::deque<Key> urgentQueue;
+    std::deque<Key> backgroundQueue;
+    uint32_t inFlight{0};
+    Stats counters{};
+
+    // Shared with the compiling workers.
+    std::mutex mutex;
+    std::condition_variable compilesDone;
+    std::vector<Compiled> compiled;
+    uint32_t running{0};
+};
@@ -0,0 +1,567 @@
+//
+//  pixel_convert.cpp
+//  Metal-Guide
+//
+
+#include "pixel_convert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_CONVERT_X86 1
+#endif
+
+namespace PixelConvert {
+
+namespace {
+
+// Exact round(x * a / 255) for x, a in [0, 255].
+inline uint8_t mulDiv255(uint32_t x, uint32_t a) {
+    uint32_t t = x * a + 128;
+    return uint8_t((t + (t >> 8)) >> 8);
+}
+
+const std::array<float, 256>& srgbToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t{};
+        for (int i = 0; i < 256; ++i) {
+            double c = i / 255.0;
+            t[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+    return table;
+}
+
+// 14-bit linear input keeps the table within half a code of the exact curve.
+constexpr int kLinearTableBits = 14;
+constexpr int kLinearTableSize = 1 << kLinearTableBits;
+
+// Three bytes of padding: the AVX2 kernel gathers 32 bits at each index.
+const std::array<uint8_t, kLinearTableSize + 3>& linearToSrgbTable() {
+    static const std::array<uint8_t, kLinearTableSize + 3> table = [] {
+        std::array<uint8_t, kLinearTableSize + 3> t{};
+        for (int i = 0; i < kLinearTableSize; ++i) {
+            double l = double(i) / (kLinearTableSize - 1);
+            double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            t[i] = uint8_t(std::lround(std::clamp(s, 0.0, 1.0) * 255.0));
+        }
+        return t;
+    }();
+    return table;
+}
+
+const std::array<uint16_t, 256>& unormToHalfTable() {
+    static const std::array<uint16_t, 256> table = [] {
+        std::array<uint16_t, 256> t{};
+        for (int i = 0; i < 256; ++i) {
+            t[i] = halfFromFloat(float(i) * (1.0f / 255.0f));
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Clamps to [0, 1] with NaN going to 0; std::clamp would pass NaN through
+// to the float-to-integer conversions below, which is undefined.
+inline float clampUnit(float value) {
+    return value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+}
+
+inline uint8_t linearToSrgbByte(float value) {
+    return linearToSrgbTable()[size_t(clampUnit(value) * (kLinearTableSize - 1) + 0.5f)];
+}
+
+#if defined(PIXEL_CONVERT_X86)
+
+// Builds target the baseline x86, so the SSSE3, AVX2 and F16C kernels are
+// compiled for their instruction sets one by one and picked at run time.
+// Each handles whole blocks and returns how many pixels (or values) it did;
+// the caller finishes the rest with the scalar version.
+struct CpuFeatures {
+    bool ssse3;
+    bool avx2;
+    bool f16c;
+};
+
+const CpuFeatures& cpu() {
+    static const CpuFeatures features = [] {
+        __builtin_cpu_init();
+        return CpuFeatures{bool(__builtin_cpu_supports("ssse3")), bool(__builtin_cpu_supports("avx2")),
+                           bool(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))};
+    }();
+    return features;
+}
+
+// 16 pixels = 48 source bytes, read as four overlapping 16-byte loads.
+// The last load is moved back by four bytes so nothing past the 48 is read.
+__attribute__((target("ssse3")))
+size_t rgbToRgbaSsse3(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i expandTail = _mm_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    const __m128i opaque = _mm_set1_epi32(int(0xff000000));
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16, src += 48, dst += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)src);
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 12));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + 24));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + 32));
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_shuffle_epi8(a, expand), opaque));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_shuffle_epi8(b, expand), opaque));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_shuffle_epi8(c, expand), opaque));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_or_si128(_mm_shuffle_epi8(d, expandTail), opaque));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t rgbToRgbaAvx2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i expandTail = _mm_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    const __m256i expand2 = _mm256_setr_m128i(expand, expand);
+    const __m256i expandLast = _mm256_setr_m128i(expand, expandTail);
+    const __m256i opaque = _mm256_set1_epi32(int(0xff000000));
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16, src += 48, dst += 64) {
+        __m256i lo = _mm256_setr_m128i(_mm_loadu_si128((const __m128i*)src),
+                                       _mm_loadu_si128((const __m128i*)(src + 12)));
+        __m256i hi = _mm256_setr_m128i(_mm_loadu_si128((const __m128i*)(src + 24)),
+                                       _mm_loadu_si128((const __m128i*)(src + 32)));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(_mm256_shuffle_epi8(lo, expand2), opaque));
+        _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_or_si256(_mm256_shuffle_epi8(hi, expandLast), opaque));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t swapRedBlueSsse3(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4, src += 16, dst += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(p, swap));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t swapRedBlueAvx2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8, src += 32, dst += 32) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)src);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_shuffle_epi8(p, swap));
+    }
+    return i;
+}
+
+// Two pixels per 16-bit half; alpha is multiplied by 255 so it comes out unchanged.
+__attribute__((target("ssse3")))
+size_t premultiplyAlphaSsse3(uint8_t* rgba, size_t pixels) {
+    const __m128i alphaLo = _mm_setr_epi8(3, -1, 3, -1, 3, -1, -1, -1, 7, -1, 7, -1, 7, -1, -1, -1);
+    const __m128i alphaHi = _mm_setr_epi8(11, -1, 11, -1, 11, -1, -1, -1, 15, -1, 15, -1, 15, -1, -1, -1);
+    const __m128i keepAlpha = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4, rgba += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i*)rgba);
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), _mm_or_si128(_mm_shuffle_epi8(p, alphaLo), keepAlpha));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), _mm_or_si128(_mm_shuffle_epi8(p, alphaHi), keepAlpha));
+        lo = _mm_add_epi16(lo, bias);
+        hi = _mm_add_epi16(hi, bias);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i*)rgba, _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+// Computes float(x) * (1 / 255) and rounds to half exactly like the table.
+__attribute__((target("avx2,f16c")))
+size_t rgba8ToRgba16fF16c(const uint8_t* src, uint16_t* dst, size_t pixels) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2, src += 8, dst += 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i*)src);
+        __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), scale);
+        _mm_storeu_si128((__m128i*)dst, _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+// The sRGB curves are table lookups, done with gathers two pixels at a
+// time; alpha is computed in its lane and blended in.
+__attribute__((target("avx2")))
+size_t srgbToLinearAvx2(const uint8_t* src, float* dst, size_t pixels) {
+    const float* table = srgbToLinearTable().data();
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2, src += 8, dst += 8) {
+        __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+        __m256 linear = _mm256_i32gather_ps(table, bytes, 4);
+        __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), scale);
+        _mm256_storeu_ps(dst, _mm256_blend_ps(linear, alpha, 0x88));
+    }
+    return i;
+}
+
+// max_ps returns its second operand for NaN, so NaN clamps to 0 as in
+// clampUnit.
+__attribute__((target("avx2")))
+size_t linearToSrgbAvx2(const float* src, uint8_t* dst, size_t pixels) {
+    const uint8_t* table = linearToSrgbTable().data();
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    const __m256 tableScale = _mm256_set1_ps(float(kLinearTableSize - 1)), alphaScale = _mm256_set1_ps(255.0f);
+    const __m256i lowBytes = _mm256_set1_epi32(0xff);
+    const __m256i packBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i packLanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2, src += 8, dst += 8) {
+        __m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), zero), one);
+        __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, tableScale), half));
+        __m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, alphaScale), half));
+        __m256i srgb = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, index, 1), lowBytes);
+        __m256i packed = _mm256_shuffle_epi8(_mm256_blend_epi32(srgb, alpha, 0x88), packBytes);
+        _mm_storel_epi64((__m128i*)dst, _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(packed, packLanes)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2,f16c")))
+size_t floatToHalfF16c(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), halves);
+    }
+    return i;
+}
+
+#endif
+
+}
+
+uint16_t halfFromFloat(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    if (bits >= 0x47800000) {
+        // Too large for a half, infinity or NaN.
+        return uint16_t(sign | (bits > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (bits < 0x38800000) {
+        // Subnormal half or zero: let an FP add do the rounding shift.
+        const uint32_t magicBits = 126u << 23;
+        float magic;
+        std::memcpy(&magic, &magicBits, 4);
+        float f;
+        std::memcpy(&f, &bits, 4);
+        f += magic;
+        std::memcpy(&bits, &f, 4);
+        return uint16_t(sign | (bits - magicBits));
+    }
+    const uint32_t mantissaOdd = (bits >> 13) & 1;
+    bits += (uint32_t(15 - 127) << 23) + 0xfff + mantissaOdd;
+    return uint16_t(sign | (bits >> 13));
+}
+
+float floatFromHalf(uint16_t value) {
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1f;
+    const uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        float f = float(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    float f;
+    std::memcpy(&f, &bits, 4);
+    return f;
+}
+
+namespace Scalar {
+
+void rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, src += 3, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 255;
+    }
+}
+
+void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, src += 4, dst += 4) {
+        uint8_t r = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = r;
+        dst[3] = src[3];
+    }
+}
+
+void premultiplyAlpha(uint8_t* rgba, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, rgba += 4) {
+        uint32_t a = rgba[3];
+        rgba[0] = mulDiv255(rgba[0], a);
+        rgba[1] = mulDiv255(rgba[1], a);
+        rgba[2] = mulDiv255(rgba[2], a);
+    }
+}
+
+void rgba8ToRgba16f(const uint8_t* src, uint16_t* dst, size_t pixels) {
+    const auto& table = unormToHalfTable();
+    for (size_t i = 0; i < pixels * 4; ++i) {
+        dst[i] = table[src[i]];
+    }
+}
+
+void srgbToLinear(const uint8_t* src, float* dst, size_t pixels) {
+    const auto& table = srgbToLinearTable();
+    for (size_t i = 0; i < pixels; ++i, src += 4, dst += 4) {
+        dst[0] = table[src[0]];
+        dst[1] = table[src[1]];
+        dst[2] = table[src[2]];
+        dst[3] = src[3] * (1.0f / 255.0f);
+    }
+}
+
+void linearToSrgb(const float* src, uint8_t* dst, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, src += 4, dst += 4) {
+        dst[0] = linearToSrgbByte(src[0]);
+        dst[1] = linearToSrgbByte(src[1]);
+        dst[2] = linearToSrgbByte(src[2]);
+        dst[3] = uint8_t(clampUnit(src[3]) * 255.0f + 0.5f);
+    }
+}
+
+void floatToHalf(const float* src, uint16_t* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = halfFromFloat(src[i]);
+    }
+}
+
+void rgb32fToRgba16f(const float* src, uint16_t* dst, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, src += 3, dst += 4) {
+        dst[0] = halfFromFloat(src[0]);
+        dst[1] = halfFromFloat(src[1]);
+        dst[2] = halfFromFloat(src[2]);
+        dst[3] = 0x3c00;
+    }
+}
+
+void flipVertically(uint8_t* image, size_t bytesPerRow, size_t rows) {
+    for (size_t y = 0; y < rows / 2; ++y) {
+        uint8_t* top = image + y * bytesPerRow;
+        uint8_t* bottom = image + (rows - 1 - y) * bytesPerRow;
+        for (size_t i = 0; i < bytesPerRow; ++i) {
+            std::swap(top[i], bottom[i]);
+        }
+    }
+}
+
+}
+
+const char* instructionSets() {
+#if defined(__ARM_NEON)
+    return "NEON";
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().avx2) {
+        return cpu().f16c ? "AVX2, F16C" : "AVX2, SSSE3";
+    }
+    return cpu().ssse3 ? "SSSE3" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+void rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x16_t opaque = vdupq_n_u8(255);
+    for (; i + 16 <= pixels; i += 16, src += 48, dst += 64) {
+        uint8x16x3_t rgb = vld3q_u8(src);
+        uint8x16x4_t rgba = {{rgb.val[0], rgb.val[1], rgb.val[2], opaque}};
+        vst4q_u8(dst, rgba);
+    }
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().avx2) {
+        i = rgbToRgbaAvx2(src, dst, pixels);
+    } else if (cpu().ssse3) {
+        i = rgbToRgbaSsse3(src, dst, pixels);
+    }
+    src += 3 * i;
+    dst += 4 * i;
+#endif
+    Scalar::rgbToRgba(src, dst, pixels - i);
+}
+
+void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 16 <= pixels; i += 16, src += 64, dst += 64) {
+        uint8x16x4_t p = vld4q_u8(src);
+        std::swap(p.val[0], p.val[2]);
+        vst4q_u8(dst, p);
+    }
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().avx2) {
+        i = swapRedBlueAvx2(src, dst, pixels);
+    } else if (cpu().ssse3) {
+        i = swapRedBlueSsse3(src, dst, pixels);
+    }
+    src += 4 * i;
+    dst += 4 * i;
+#endif
+    Scalar::swapRedBlue(src, dst, pixels - i);
+}
+
+void premultiplyAlpha(uint8_t* rgba, size_t pixels) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 8 <= pixels; i += 8, rgba += 32) {
+        uint8x8x4_t p = vld4_u8(rgba);
+        for (int c = 0; c < 3; ++c) {
+            uint16x8_t x = vmull_u8(p.val[c], p.val[3]);
+            p.val[c] = vraddhn_u16(x, vrshrq_n_u16(x, 8));
+        }
+        vst4_u8(rgba, p);
+    }
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().ssse3) {
+        i = premultiplyAlphaSsse3(rgba, pixels);
+        rgba += 4 * i;
+    }
+#endif
+    Scalar::premultiplyAlpha(rgba, pixels - i);
+}
+
+// NEON has no gather, so on ARM the sRGB curves stay scalar table lookups.
+void srgbToLinear(const uint8_t* src, float* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(PIXEL_CONVERT_X86)
+    if (cpu().avx2) {
+        i = srgbToLinearAvx2(src, dst, pixels);
+    }
+#endif
+    Scalar::srgbToLinear(src + 4 * i, dst + 4 * i, pixels - i);
+}
+
+void linearToSrgb(const float* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(PIXEL_CONVERT_X86)
+    if (cpu().avx2) {
+        i = linearToSrgbAvx2(src, dst, pixels);
+    }
+#endif
+    Scalar::linearToSrgb(src + 4 * i, dst + 4 * i, pixels - i);
+}
+
+void rgba8ToRgba16f(const uint8_t* src, uint16_t* dst, size_t pixels) {
+    size_t i = 0;
+    // Both paths compute float(x) * (1 / 255) and round to half exactly like the table.
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t scale = vdupq_n_f32(1.0f / 255.0f);
+    for (; i + 4 <= pixels; i += 4, src += 16, dst += 16) {
+        uint8x16_t bytes = vld1q_u8(src);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+        float32x4_t f0 = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), scale);
+        float32x4_t f1 = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), scale);
+        float32x4_t f2 = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), scale);
+        float32x4_t f3 = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), scale);
+        vst1q_u16(dst, vcombine_u16(vreinterpret_u16_f16(vcvt_f16_f32(f0)), vreinterpret_u16_f16(vcvt_f16_f32(f1))));
+        vst1q_u16(dst + 8, vcombine_u16(vreinterpret_u16_f16(vcvt_f16_f32(f2)), vreinterpret_u16_f16(vcvt_f16_f32(f3))));
+    }
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().f16c) {
+        i = rgba8ToRgba16fF16c(src, dst, pixels);
+        src += 4 * i;
+        dst += 4 * i;
+    }
+#endif
+    Scalar::rgba8ToRgba16f(src, dst, pixels - i);
+}
+
+void floatToHalf(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 8 <= count; i += 8) {
+        float16x4_t lo = vcvt_f16_f32(vld1q_f32(src + i));
+        float16x4_t hi = vcvt_f16_f32(vld1q_f32(src + i + 4));
+        vst1q_u16(dst + i, vcombine_u16(vreinterpret_u16_f16(lo), vreinterpret_u16_f16(hi)));
+    }
+#elif defined(PIXEL_CONVERT_X86)
+    if (cpu().f16c) {
+        i = floatToHalfF16c(src, dst, count);
+    }
+#endif
+    Scalar::floatToHalf(src + i, dst + i, count - i);
+}
+
+void rgb32fToRgba16f(const float* src, uint16_t* dst, size_t pixels) {
+    const uint16_t one = 0x3c00;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    size_t i = 0;
+    const uint16x4_t alpha = vdup_n_u16(one);
+    for (; i + 4 <= pixels; i += 4, src += 12, dst += 16) {
+        float32x4x3_t rgb = vld3q_f32(src);
+        uint16x4x4_t rgba = {{vreinterpret_u16_f16(vcvt_f16_f32(rgb.val[0])),
+                              vreinterpret_u16_f16(vcvt_f16_f32(rgb.val[1])),
+                              vreinterpret_u16_f16(vcvt_f16_f32(rgb.val[2])),
+                              alpha}};
+        vst4_u16(dst, rgba);
+    }
+    pixels -= i;
+#endif
+    // Convert a block of RGB values in bulk, then interleave alpha.
+    uint16_t halves[3 * 256];
+    while (pixels > 0) {
+        size_t n = std::min<size_t>(pixels, 256);
+        floatToHalf(src, halves, n * 3);
+        for (size_t p = 0; p < n; ++p) {
+            dst[p * 4 + 0] = halves[p * 3 + 0];
+            dst[p * 4 + 1] = halves[p * 3 + 1];
+            dst[p * 4 + 2] = halves[p * 3 + 2];
+            dst[p * 4 + 3] = one;
+        }
+        src += n * 3;
+        dst += n * 4;
+        pixels -= n;
+    }
+}
+
+// Swapping is bound by memory bandwidth: through an L1-sized scratch
+// buffer, the library's memcpy keeps up with a hand-written AVX2 swap.
+void swapRows(uint8_t* a, uint8_t* b, size_t bytes) {
+    uint8_t scratch[4096];
+    for (size_t offset = 0; offset < bytes; offset += sizeof(scratch)) {
+        size_t n = std::min(sizeof(scratch), bytes - offset);
+        std::memcpy(scratch, a + offset, n);
+        std::memcpy(a + offset, b + offset, n);
+        std::memcpy(b + offset, scratch, n);
+    }
+}
+
+void flipVertically(uint8_t* image, size_t bytesPerRow, size_t rows) {
+    for (size_t y = 0; y < rows / 2; ++y) {
+        swapRows(image + y * bytesPerRow, image + (rows - 1 - y) * bytesPerRow, bytesPerRow);
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+//
+//  pixel_convert.hpp
+//  Metal-Guide
+//
+//  Pixel-format conversion kernels for texture uploads. Each kernel works on
+//  a run of pixels, so callers can split an image by rows across
+//  ThreadPool::parallelFor. NEON paths are picked at compile time; on x86
+//  the AVX2, F16C and SSSE3 paths are built alongside the baseline code and
+//  picked at run time from what the CPU supports. The Scalar namespace
+//  holds the reference versions, which also handle the tails.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace PixelConvert {
+
+// RGB8 -> RGBA8 with alpha = 255.
+void rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels);
+// RGBA8 <-> BGRA8. src may equal dst.
+void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels);
+// RGBA8 in place, rounding c * a / 255 to nearest.
+void premultiplyAlpha(uint8_t* rgba, size_t pixels);
+// sRGB-encoded RGBA8 -> linear RGBA32F; alpha is only normalized.
+void srgbToLinear(const uint8_t* src, float* dst, size_t pixels);
+// Linear RGBA32F -> sRGB-encoded RGBA8, inputs clamped to [0, 1] and NaN
+// written as 0.
+void linearToSrgb(const float* src, uint8_t* dst, size_t pixels);
+// Normalized RGBA8 -> RGBA16F.
+void rgba8ToRgba16f(const uint8_t* src, uint16_t* dst, size_t pixels);
+// Float -> half for a run of values.
+void floatToHalf(const float* src, uint16_t* dst, size_t count);
+// RGB32F -> RGBA16F with alpha = 1.
+void rgb32fToRgba16f(const float* src, uint16_t* dst, size_t pixels);
+// Swaps rows top to bottom in place.
+void flipVertically(uint8_t* image, size_t bytesPerRow, size_t rows);
+// Swaps two non-overlapping rows, so a flip can be split across threads.
+void swapRows(uint8_t* a, uint8_t* b, size_t bytes);
+
+// IEEE binary16 conversion, round to nearest even.
+uint16_t halfFromFloat(float value);
+float floatFromHalf(uint16_t value);
+
+// The instruction sets the kernels use on this CPU, for logs and benchmarks.
+const char* instructionSets();
+
+namespace Scalar {
+void rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels);
+void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels);
+void premultiplyAlpha(uint8_t* rgba, size_t pixels);
+void rgba8ToRgba16f(const uint8_t* src, uint16_t* dst, size_t pixels);
+void srgbToLinear(const uint8_t* src, float* dst, size_t pixels);
+void linearToSrgb(const float* src, uint8_t* dst, size_t pixels);
+void floatToHalf(const float* src, uint16_t* dst, size_t count);
+void rgb32fToRgba16f(const float* src, uint16_t* dst, size_t pixels);
+void flipVertically(uint8_t* image, size_t bytesPerRow, size_t rows);
+}
+
+}
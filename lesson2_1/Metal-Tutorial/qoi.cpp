@@ -0,0 +1,215 @@
+//
+//  qoi.cpp
+//  Metal-Guide
+//
+
+#include "qoi.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Qoi {
+
+namespace {
+
+constexpr uint8_t kOpIndex = 0x00;
+constexpr uint8_t kOpDiff  = 0x40;
+constexpr uint8_t kOpLuma  = 0x80;
+constexpr uint8_t kOpRun   = 0xc0;
+constexpr uint8_t kOpRgb   = 0xfe;
+constexpr uint8_t kOpRgba  = 0xff;
+constexpr uint8_t kMask2   = 0xc0;
+
+constexpr uint8_t kPadding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+constexpr uint32_t kMaxPixels = 400000000;
+
+// Pixels are kept as RGBA bytes packed into a little-endian word, which is
+// also their layout in memory, so a pixel store is a single 32-bit write.
+inline uint8_t red(uint32_t p)   { return uint8_t(p); }
+inline uint8_t green(uint32_t p) { return uint8_t(p >> 8); }
+inline uint8_t blue(uint32_t p)  { return uint8_t(p >> 16); }
+inline uint8_t alpha(uint32_t p) { return uint8_t(p >> 24); }
+
+inline uint32_t pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 | uint32_t(a) << 24;
+}
+
+inline uint32_t hash(uint32_t p) {
+    return (red(p) * 3 + green(p) * 5 + blue(p) * 7 + alpha(p) * 11) % 64;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+inline void write32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+}
+
+bool isQoi(const uint8_t* data, size_t size) {
+    return size >= kHeaderSize && std::memcmp(data, "qoif", 4) == 0;
+}
+
+bool Decoder::open(const uint8_t* data, size_t size) {
+    if (!isQoi(data, size) || size < kHeaderSize + sizeof(kPadding)) {
+        return false;
+    }
+    desc.width = read32(data + 4);
+    desc.height = read32(data + 8);
+    desc.channels = data[12];
+    desc.colorspace = data[13];
+    if (desc.width == 0 || desc.height == 0 || desc.channels < 3 || desc.channels > 4 ||
+        desc.colorspace > 1 || desc.height >= kMaxPixels / desc.width) {
+        return false;
+    }
+
+    bytes = data;
+    chunksEnd = size - sizeof(kPadding);
+    position = kHeaderSize;
+    rowsDecoded = 0;
+    std::fill(std::begin(index), std::end(index), 0u);
+    pixel = pack(0, 0, 0, 255);
+    run = 0;
+    return true;
+}
+
+bool Decoder::decodeRows(uint8_t* dst, size_t bytesPerRow, uint32_t rowCount, bool flipVertically) {
+    if (!bytes || rowCount > desc.height - rowsDecoded) {
+        return false;
+    }
+
+    for (uint32_t row = 0; row < rowCount; ++row) {
+        uint8_t* out = dst + bytesPerRow * (flipVertically ? rowCount - 1 - row : row);
+        uint32_t x = 0;
+        while (x < desc.width) {
+            if (run > 0) {
+                // Runs are the common case for flat texture regions; fill them in one go.
+                uint32_t n = std::min<uint32_t>(uint32_t(run), desc.width - x);
+                for (uint32_t i = 0; i < n; ++i) {
+                    std::memcpy(out + 4 * (x + i), &pixel, 4);
+                }
+                x += n;
+                run -= int(n);
+                continue;
+            }
+            if (position >= chunksEnd) {
+                return false;
+            }
+
+            uint8_t b1 = bytes[position++];
+            if (b1 == kOpRgb) {
+                if (position + 3 > chunksEnd) {
+                    return false;
+                }
+                pixel = pack(bytes[position], bytes[position + 1], bytes[position + 2], alpha(pixel));
+                position += 3;
+            } else if (b1 == kOpRgba) {
+                if (position + 4 > chunksEnd) {
+                    return false;
+                }
+                pixel = pack(bytes[position], bytes[position + 1], bytes[position + 2], bytes[position + 3]);
+                position += 4;
+            } else if ((b1 & kMask2) == kOpIndex) {
+                pixel = index[b1];
+            } else if ((b1 & kMask2) == kOpDiff) {
+                pixel = pack(uint8_t(red(pixel) + ((b1 >> 4) & 0x03) - 2),
+                             uint8_t(green(pixel) + ((b1 >> 2) & 0x03) - 2),
+                             uint8_t(blue(pixel) + (b1 & 0x03) - 2),
+                             alpha(pixel));
+            } else if ((b1 & kMask2) == kOpLuma) {
+                if (position >= chunksEnd) {
+                    return false;
+                }
+                uint8_t b2 = bytes[position++];
+                int vg = (b1 & 0x3f) - 32;
+                pixel = pack(uint8_t(red(pixel) + vg - 8 + ((b2 >> 4) & 0x0f)),
+                             uint8_t(green(pixel) + vg),
+                             uint8_t(blue(pixel) + vg - 8 + (b2 & 0x0f)),
+                             alpha(pixel));
+            } else {
+                // kOpRun: this pixel plus (b1 & 0x3f) repeats
+                run = b1 & 0x3f;
+            }
+
+            index[hash(pixel)] = pixel;
+            std::memcpy(out + 4 * x, &pixel, 4);
+            ++x;
+        }
+    }
+    rowsDecoded += rowCount;
+    return true;
+}
+
+std::vector<uint8_t> encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t channels, uint8_t colorspace) {
+    std::vector<uint8_t> out;
+    if (!pixels || width == 0 || height == 0 || channels < 3 || channels > 4 ||
+        colorspace > 1 || height >= kMaxPixels / width) {
+        return out;
+    }
+
+    const size_t pixelCount = size_t(width) * height;
+    out.reserve(kHeaderSize + pixelCount * (channels + 1) / 2 + sizeof(kPadding));
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    write32(out, width);
+    write32(out, height);
+    out.push_back(channels);
+    out.push_back(colorspace);
+
+    uint32_t index[64] = {};
+    uint32_t previous = pack(0, 0, 0, 255);
+    int run = 0;
+
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const uint8_t* p = pixels + i * channels;
+        uint32_t current = pack(p[0], p[1], p[2], channels == 4 ? p[3] : 255);
+
+        if (current == previous) {
+            ++run;
+            if (run == 62 || i + 1 == pixelCount) {
+                out.push_back(uint8_t(kOpRun | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(uint8_t(kOpRun | (run - 1)));
+            run = 0;
+        }
+
+        uint32_t slot = hash(current);
+        if (index[slot] == current) {
+            out.push_back(uint8_t(kOpIndex | slot));
+        } else {
+            index[slot] = current;
+            if (alpha(current) == alpha(previous)) {
+                int8_t vr = int8_t(red(current) - red(previous));
+                int8_t vg = int8_t(green(current) - green(previous));
+                int8_t vb = int8_t(blue(current) - blue(previous));
+                int8_t vgr = int8_t(vr - vg);
+                int8_t vgb = int8_t(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out.push_back(uint8_t(kOpDiff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    out.push_back(uint8_t(kOpLuma | (vg + 32)));
+                    out.push_back(uint8_t((vgr + 8) << 4 | (vgb + 8)));
+                } else {
+                    out.insert(out.end(), {kOpRgb, red(current), green(current), blue(current)});
+                }
+            } else {
+                out.insert(out.end(), {kOpRgba, red(current), green(current), blue(current), alpha(current)});
+            }
+        }
+        previous = current;
+    }
+
+    out.insert(out.end(), std::begin(kPadding), std::end(kPadding));
+    return out;
+}
+
+}
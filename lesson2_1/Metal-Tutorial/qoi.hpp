@@ -0,0 +1,55 @@
+//
+//  qoi.hpp
+//  Metal-Guide
+//
+//  Encoder and streaming decoder for the QOI lossless image format
+//  (https://qoiformat.org). QOI trades file size for decode speed, which
+//  makes it a good fit for development assets that are loaded over and over.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Qoi {
+
+struct Header {
+    uint32_t width;
+    uint32_t height;
+    uint8_t channels;    // 3 = RGB, 4 = RGBA
+    uint8_t colorspace;  // 0 = sRGB with linear alpha, 1 = all channels linear
+};
+
+constexpr size_t kHeaderSize = 14;
+
+bool isQoi(const uint8_t* data, size_t size);
+
+// Decodes incrementally, so the caller can hand it chunks of an upload
+// buffer instead of staging the whole image first. Output is always RGBA8.
+class Decoder {
+public:
+    bool open(const uint8_t* data, size_t size);
+    const Header& header() const { return desc; }
+
+    // Decodes the next rowCount rows. With flipVertically the first decoded
+    // row lands at the bottom of the rowCount-row window starting at dst.
+    bool decodeRows(uint8_t* dst, size_t bytesPerRow, uint32_t rowCount, bool flipVertically = false);
+    bool finished() const { return rowsDecoded == desc.height; }
+
+private:
+    const uint8_t* bytes{nullptr};
+    size_t chunksEnd{0};
+    size_t position{0};
+    Header desc{};
+    uint32_t rowsDecoded{0};
+    uint32_t index[64]{};
+    uint32_t pixel{0};
+    int run{0};
+};
+
+// Encodes tightly packed RGB or RGBA pixels. Returns an empty vector on invalid input.
+std::vector<uint8_t> encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t channels, uint8_t colorspace = 0);
+
+}
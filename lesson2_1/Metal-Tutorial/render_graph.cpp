@@ -0,0 +1,246 @@
+//
+//  render_graph.cpp
+//  Metal-Guide
+//
+
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+// How a pass touches a texture. An attachment that is not cleared reads
+// what was there before; a cleared one or a resolve target replaces it.
+enum class Use : uint8_t { None, Input, Overwrite };
+
+Use useIn(const RenderGraph::Pass& pass, RenderGraph::Resource resource) {
+    Use use = Use::None;
+    auto attachment = [&](const RenderGraph::Attachment& a) {
+        if (a.texture == resource) {
+            use = a.clear ? (use == Use::None ? Use::Overwrite : use) : Use::Input;
+        }
+        if (a.resolve == resource && use == Use::None) {
+            use = Use::Overwrite;
+        }
+    };
+    for (const RenderGraph::Attachment& color : pass.colors) {
+        attachment(color);
+    }
+    if (pass.hasDepth) {
+        attachment(pass.depth);
+    }
+    if (std::find(pass.reads.begin(), pass.reads.end(), resource) != pass.reads.end()) {
+        use = Use::Input;
+    }
+    return use;
+}
+
+template <typename Function>
+void forEachWrite(const RenderGraph::Pass& pass, Function&& function) {
+    for (const RenderGraph::Attachment& color : pass.colors) {
+        function(color.texture);
+        if (color.resolve != RenderGraph::kNoResource) {
+            function(color.resolve);
+        }
+    }
+    if (pass.hasDepth) {
+        function(pass.depth.texture);
+    }
+}
+
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::color(Resource texture, Resource resolve) {
+    Attachment attachment;
+    attachment.texture = texture;
+    attachment.resolve = resolve;
+    graph.passList[pass].colors.push_back(attachment);
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::clearColor(Resource texture, const float value[4], Resource resolve) {
+    color(texture, resolve);
+    Attachment& attachment = graph.passList[pass].colors.back();
+    attachment.clear = true;
+    std::copy(value, value + 4, attachment.clearValue);
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depth(Resource texture) {
+    Pass& target = graph.passList[pass];
+    target.hasDepth = true;
+    target.depth = Attachment();
+    target.depth.texture = texture;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::clearDepth(Resource texture, float value) {
+    depth(texture);
+    graph.passList[pass].depth.clear = true;
+    graph.passList[pass].depth.clearValue[0] = value;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(Resource texture) {
+    graph.passList[pass].reads.push_back(texture);
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect() {
+    graph.passList[pass].sideEffect = true;
+    return *this;
+}
+
+RenderGraph::Resource RenderGraph::createTexture(std::string name, const TextureDescription& description) {
+    textureList.push_back({std::move(name), false, description});
+    return Resource(textureList.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importTexture(std::string name) {
+    textureList.push_back({std::move(name), true, {}});
+    return Resource(textureList.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(std::string name, Execute execute) {
+    Pass pass;
+    pass.name = std::move(name);
+    pass.execute = std::move(execute);
+    passList.push_back(std::move(pass));
+    return PassBuilder(*this, uint32_t(passList.size() - 1));
+}
+
+RenderGraph::Plan RenderGraph::compile(const SizeQuery& sizeOf) const {
+    Plan plan{};
+
+    // Culling, from the last pass back: a pass is live if it has side
+    // effects or writes something still wanted. Imported textures are
+    // wanted at the end of the frame.
+    std::vector<bool> wanted(textureList.size()), live(passList.size());
+    for (size_t r = 0; r < textureList.size(); ++r) {
+        wanted[r] = textureList[r].imported;
+    }
+    for (size_t p = passList.size(); p-- > 0;) {
+        const Pass& pass = passList[p];
+        bool writesWanted = false;
+        forEachWrite(pass, [&](Resource r) { writesWanted |= wanted[r]; });
+        live[p] = pass.sideEffect || writesWanted;
+        if (!live[p]) {
+            continue;
+        }
+        // What this pass replaces is no longer wanted from earlier passes;
+        // what it reads is.
+        for (Resource r = 0; r < textureList.size(); ++r) {
+            const Use use = useIn(pass, r);
+            if (use == Use::Overwrite) {
+                wanted[r] = false;
+            } else if (use == Use::Input) {
+                wanted[r] = true;
+            }
+        }
+    }
+    std::vector<uint32_t> livePasses;
+    for (uint32_t p = 0; p < passList.size(); ++p) {
+        (live[p] ? livePasses : plan.culledPasses).push_back(p);
+    }
+
+    // Whether a texture's contents are used after live pass i: by the
+    // next pass that touches it, or by whoever imported it.
+    auto usedAfter = [&](Resource r, size_t i) {
+        for (size_t j = i + 1; j < livePasses.size(); ++j) {
+            const Use use = useIn(passList[livePasses[j]], r);
+            if (use != Use::None) {
+                return use == Use::Input;
+            }
+        }
+        return textureList[r].imported;
+    };
+    std::vector<bool> written(textureList.size());
+    auto planAttachment = [&](const Attachment& attachment, size_t i) {
+        PlannedAttachment planned{attachment, LoadAction::DontCare, StoreAction::DontCare};
+        const Resource r = attachment.texture;
+        if (attachment.clear) {
+            planned.load = LoadAction::Clear;
+        } else if (written[r] || textureList[r].imported) {
+            planned.load = LoadAction::Load;
+        }
+        const bool store = usedAfter(r, i);
+        if (attachment.resolve != kNoResource) {
+            planned.store = store ? StoreAction::StoreAndMultisampleResolve : StoreAction::MultisampleResolve;
+        } else {
+            planned.store = store ? StoreAction::Store : StoreAction::DontCare;
+        }
+        return planned;
+    };
+    for (size_t i = 0; i < livePasses.size(); ++i) {
+        const Pass& pass = passList[livePasses[i]];
+        PlannedPass planned{livePasses[i], {}, pass.hasDepth, {}};
+        for (const Attachment& color : pass.colors) {
+            planned.colors.push_back(planAttachment(color, i));
+        }
+        if (pass.hasDepth) {
+            planned.depth = planAttachment(pass.depth, i);
+        }
+        forEachWrite(pass, [&](Resource r) { written[r] = true; });
+        plan.passes.push_back(std::move(planned));
+    }
+
+    // Lifetimes of the transient textures the live passes use.
+    for (Resource r = 0; r < textureList.size(); ++r) {
+        if (textureList[r].imported) {
+            continue;
+        }
+        PlannedTexture texture{r, UINT32_MAX, 0, 0, 0};
+        for (uint32_t i = 0; i < livePasses.size(); ++i) {
+            if (useIn(passList[livePasses[i]], r) != Use::None) {
+                texture.firstPass = std::min(texture.firstPass, i);
+                texture.lastPass = i;
+            }
+        }
+        if (texture.firstPass != UINT32_MAX) {
+            plan.textures.push_back(texture);
+        }
+    }
+
+    // Placement, largest first: each texture goes at the lowest offset
+    // that does not overlap a placed texture whose lifetime overlaps its own.
+    std::vector<SizeAndAlign> sizes;
+    for (PlannedTexture& texture : plan.textures) {
+        sizes.push_back(sizeOf(textureList[texture.resource].description));
+        texture.size = sizes.back().size;
+        plan.unaliasedSize = alignUp(plan.unaliasedSize, sizes.back().align) + texture.size;
+    }
+    std::vector<size_t> order(plan.textures.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return plan.textures[a].size > plan.textures[b].size; });
+    std::vector<size_t> placed;
+    for (size_t index : order) {
+        PlannedTexture& texture = plan.textures[index];
+        std::vector<std::pair<uint64_t, uint64_t>> taken;  // [begin, end) of overlapping lifetimes
+        for (size_t other : placed) {
+            const PlannedTexture& o = plan.textures[other];
+            if (o.firstPass <= texture.lastPass && texture.firstPass <= o.lastPass) {
+                taken.push_back({o.offset, o.offset + o.size});
+            }
+        }
+        std::sort(taken.begin(), taken.end());
+        uint64_t offset = 0;
+        for (const auto& [begin, end] : taken) {
+            if (offset + texture.size <= begin) {
+                break;
+            }
+            offset = std::max(offset, alignUp(end, sizes[index].align));
+        }
+        texture.offset = offset;
+        plan.heapSize = std::max(plan.heapSize, offset + texture.size);
+        placed.push_back(index);
+    }
+    return plan;
+}
@@ -0,0 +1,143 @@
+//
+//  render_graph.hpp
+//  Metal-Guide
+//
+//  Describes a frame as passes and the textures they read and write. The
+//  engine no longer manages each attachment by hand; compile() works out
+//  the rest:
+//  - Passes whose results nothing uses are culled.
+//  - Each transient texture gets a lifetime, from its first to its last
+//    live pass.
+//  - Transient textures get offsets in one shared heap. Textures whose
+//    lifetimes do not overlap may share memory.
+//  - Each attachment gets its load and store actions. A texture is only
+//    loaded if something earlier wrote it, and only stored if something
+//    later uses it.
+//  The graph and its compiler are backend-independent; texture sizes come
+//  from a callback, and MetalRenderGraph turns the plan into a heap and
+//  render passes. Not thread-safe.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class RenderGraph {
+public:
+    using Resource = uint32_t;
+    static constexpr Resource kNoResource = UINT32_MAX;
+
+    // Same values as MTL::LoadAction and MTL::StoreAction.
+    enum class LoadAction : uint8_t { DontCare, Load, Clear };
+    enum class StoreAction : uint8_t { DontCare, Store, MultisampleResolve, StoreAndMultisampleResolve };
+
+    struct TextureDescription {
+        uint32_t pixelFormat;  // backend-defined, e.g. an MTL::PixelFormat
+        uint32_t width;
+        uint32_t height;
+        uint32_t sampleCount;
+    };
+
+    struct SizeAndAlign {
+        uint64_t size;
+        uint64_t align;
+    };
+    using SizeQuery = std::function<SizeAndAlign(const TextureDescription&)>;
+
+    // Receives the pass's encoder, backend-defined, e.g. an MTL::RenderCommandEncoder*.
+    using Execute = std::function<void(void* encoder)>;
+
+    struct Attachment {
+        Resource texture{kNoResource};
+        Resource resolve{kNoResource};  // multisample resolve target
+        bool clear{false};
+        float clearValue[4]{};          // colour, or depth in [0]
+    };
+
+    class PassBuilder {
+    public:
+        // Colour attachment. Without a clear it is loaded if anything has
+        // written it before, and undefined otherwise.
+        PassBuilder& color(Resource texture, Resource resolve = kNoResource);
+        PassBuilder& clearColor(Resource texture, const float value[4], Resource resolve = kNoResource);
+        PassBuilder& depth(Resource texture);
+        PassBuilder& clearDepth(Resource texture, float value);
+        // Texture sampled by the pass.
+        PassBuilder& read(Resource texture);
+        // Keeps the pass even if nothing reads what it writes.
+        PassBuilder& sideEffect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+        RenderGraph& graph;
+        uint32_t pass;
+    };
+
+    // A texture that lives only within the frame, placed by the graph.
+    Resource createTexture(std::string name, const TextureDescription& description);
+    // A texture from outside the graph, e.g. the drawable. Its contents are
+    // kept: it is loaded before its first write and stored after its last.
+    Resource importTexture(std::string name);
+    // Passes run in the order they are added.
+    PassBuilder addPass(std::string name, Execute execute);
+
+    // One pass of a plan, with its attachments' actions filled in.
+    struct PlannedAttachment {
+        Attachment attachment;
+        LoadAction load;
+        StoreAction store;
+    };
+
+    struct PlannedPass {
+        uint32_t pass;  // index into the graph's passes
+        std::vector<PlannedAttachment> colors;
+        bool hasDepth;
+        PlannedAttachment depth;
+    };
+
+    struct PlannedTexture {
+        Resource resource;
+        uint32_t firstPass;  // index into Plan::passes
+        uint32_t lastPass;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Plan {
+        std::vector<PlannedPass> passes;
+        std::vector<PlannedTexture> textures;  // live transient textures
+        std::vector<uint32_t> culledPasses;
+        uint64_t heapSize;       // with aliasing
+        uint64_t unaliasedSize;  // if every transient texture had its own memory
+    };
+
+    Plan compile(const SizeQuery& sizeOf) const;
+
+    struct Texture {
+        std::string name;
+        bool imported;
+        TextureDescription description;
+    };
+
+    struct Pass {
+        std::string name;
+        Execute execute;
+        std::vector<Attachment> colors;
+        bool hasDepth{false};
+        Attachment depth;
+        std::vector<Resource> reads;
+        bool sideEffect{false};
+    };
+
+    const std::vector<Texture>& textures() const { return textureList; }
+    const std::vector<Pass>& passes() const { return passList; }
+
+private:
+    std::vector<Texture> textureList;
+    std::vector<Pass> passList;
+};
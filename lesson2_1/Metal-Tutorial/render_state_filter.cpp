@@ -0,0 +1,153 @@
+//
+//  render_state_filter.cpp
+//  Metal-Guide
+//
+
+#include "render_state_filter.hpp"
+
+uint64_t StateFilteredEncoder::Stats::totalIssued() const {
+    uint64_t total = 0;
+    for (uint64_t count : issued) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t StateFilteredEncoder::Stats::totalSkipped() const {
+    uint64_t total = 0;
+    for (uint64_t count : skipped) {
+        total += count;
+    }
+    return total;
+}
+
+const char* StateFilteredEncoder::callName(Call call) {
+    static const char* const names[] = {
+        "setRenderPipelineState", "setDepthStencilState", "setFrontFacingWinding", "setCullMode",
+        "setTriangleFillMode", "setVertexBuffer", "setVertexBufferOffset", "setFragmentBuffer", "setFragmentTexture",
+    };
+    return names[size_t(call)];
+}
+
+void StateFilteredEncoder::reset() {
+    pipelineState = kUnknown;
+    depthStencilState = kUnknown;
+    winding = 0;
+    cullMode = 0;
+    fillMode = 0;
+    vertexBuffers.fill({kUnknown, 0});
+    fragmentBuffers.fill({kUnknown, 0});
+    fragmentTextures.fill(kUnknown);
+}
+
+void StateFilteredEncoder::invalidate() {
+    reset();
+    winding = kUnknown;
+    cullMode = kUnknown;
+    fillMode = kUnknown;
+}
+
+bool StateFilteredEncoder::changes(uintptr_t& bound, uintptr_t value, Call call) {
+    if (bound == value) {
+        ++counters.skipped[size_t(call)];
+        return false;
+    }
+    bound = value;
+    ++counters.issued[size_t(call)];
+    return true;
+}
+
+void StateFilteredEncoder::setRenderPipelineState(const void* state) {
+    if (changes(pipelineState, reinterpret_cast<uintptr_t>(state), Call::SetRenderPipelineState)) {
+        backend.setRenderPipelineState(state);
+    }
+}
+
+void StateFilteredEncoder::setDepthStencilState(const void* state) {
+    if (changes(depthStencilState, reinterpret_cast<uintptr_t>(state), Call::SetDepthStencilState)) {
+        backend.setDepthStencilState(state);
+    }
+}
+
+void StateFilteredEncoder::setFrontFacingWinding(uint32_t value) {
+    if (changes(winding, value, Call::SetFrontFacingWinding)) {
+        backend.setFrontFacingWinding(value);
+    }
+}
+
+void StateFilteredEncoder::setCullMode(uint32_t value) {
+    if (changes(cullMode, value, Call::SetCullMode)) {
+        backend.setCullMode(value);
+    }
+}
+
+void StateFilteredEncoder::setTriangleFillMode(uint32_t value) {
+    if (changes(fillMode, value, Call::SetTriangleFillMode)) {
+        backend.setTriangleFillMode(value);
+    }
+}
+
+void StateFilteredEncoder::setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) {
+    if (index >= kBufferSlots) {
+        ++counters.issued[size_t(Call::SetVertexBuffer)];
+        backend.setVertexBuffer(buffer, offset, index);
+        return;
+    }
+    BufferBinding& bound = vertexBuffers[index];
+    const uintptr_t handle = reinterpret_cast<uintptr_t>(buffer);
+    if (bound.buffer == handle && bound.offset == offset) {
+        ++counters.skipped[size_t(Call::SetVertexBuffer)];
+    } else if (bound.buffer == handle) {
+        // Only the offset changes.
+        ++counters.issued[size_t(Call::SetVertexBufferOffset)];
+        bound.offset = offset;
+        backend.setVertexBufferOffset(offset, index);
+    } else {
+        ++counters.issued[size_t(Call::SetVertexBuffer)];
+        bound = {handle, offset};
+        backend.setVertexBuffer(buffer, offset, index);
+    }
+}
+
+void StateFilteredEncoder::setVertexBufferOffset(uint64_t offset, uint32_t index) {
+    if (index < kBufferSlots) {
+        BufferBinding& bound = vertexBuffers[index];
+        if (bound.buffer != kUnknown && bound.offset == offset) {
+            ++counters.skipped[size_t(Call::SetVertexBufferOffset)];
+            return;
+        }
+        bound.offset = offset;
+    }
+    ++counters.issued[size_t(Call::SetVertexBufferOffset)];
+    backend.setVertexBufferOffset(offset, index);
+}
+
+void StateFilteredEncoder::setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) {
+    if (index < kBufferSlots) {
+        BufferBinding& bound = fragmentBuffers[index];
+        const uintptr_t handle = reinterpret_cast<uintptr_t>(buffer);
+        if (bound.buffer == handle && bound.offset == offset) {
+            ++counters.skipped[size_t(Call::SetFragmentBuffer)];
+            return;
+        }
+        bound = {handle, offset};
+    }
+    ++counters.issued[size_t(Call::SetFragmentBuffer)];
+    backend.setFragmentBuffer(buffer, offset, index);
+}
+
+void StateFilteredEncoder::setFragmentTexture(const void* texture, uint32_t index) {
+    if (index >= kTextureSlots) {
+        ++counters.issued[size_t(Call::SetFragmentTexture)];
+        backend.setFragmentTexture(texture, index);
+        return;
+    }
+    if (changes(fragmentTextures[index], reinterpret_cast<uintptr_t>(texture), Call::SetFragmentTexture)) {
+        backend.setFragmentTexture(texture, index);
+    }
+}
+
+void StateFilteredEncoder::drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) {
+    ++counters.draws;
+    backend.drawPrimitives(primitiveType, vertexStart, vertexCount);
+}
@@ -0,0 +1,118 @@
+//
+//  render_state_filter.hpp
+//  Metal-Guide
+//
+//  Drops render encoder calls that would set state to what is already
+//  bound. Once a frame has many draws, most per-draw state calls repeat
+//  the previous draw's; each one still costs a call into Metal, and
+//  redundant calls add up to a large part of the CPU's encoding time.
+//  StateFilteredEncoder remembers what it has bound per slot and only
+//  forwards changes to a RenderEncoderBackend. Rebinding a buffer that is
+//  already bound at a new offset is forwarded as the cheaper
+//  setVertexBufferOffset(). Counters show how many calls of each kind
+//  were issued and how many were skipped.
+//
+//  Bound objects are compared by address. That is safe for as long as
+//  one encoder lives, because the command buffer retains what its
+//  encoders bind. Call reset() for each new encoder. Use from one thread.
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Receives the calls that change state. Handles and enum values are
+// backend-defined, e.g. an MTL::RenderPipelineState* and MTL::CullMode.
+class RenderEncoderBackend {
+public:
+    virtual ~RenderEncoderBackend() = default;
+    virtual void setRenderPipelineState(const void* state) = 0;
+    virtual void setDepthStencilState(const void* state) = 0;
+    virtual void setFrontFacingWinding(uint32_t winding) = 0;
+    virtual void setCullMode(uint32_t cullMode) = 0;
+    virtual void setTriangleFillMode(uint32_t fillMode) = 0;
+    virtual void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) = 0;
+    virtual void setVertexBufferOffset(uint64_t offset, uint32_t index) = 0;
+    virtual void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) = 0;
+    virtual void setFragmentTexture(const void* texture, uint32_t index) = 0;
+    virtual void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) = 0;
+};
+
+class StateFilteredEncoder {
+public:
+    enum class Call : uint8_t {
+        SetRenderPipelineState,
+        SetDepthStencilState,
+        SetFrontFacingWinding,
+        SetCullMode,
+        SetTriangleFillMode,
+        SetVertexBuffer,
+        SetVertexBufferOffset,
+        SetFragmentBuffer,
+        SetFragmentTexture,
+        Count
+    };
+
+    struct Stats {
+        std::array<uint64_t, size_t(Call::Count)> issued;
+        std::array<uint64_t, size_t(Call::Count)> skipped;
+        uint64_t draws;
+
+        uint64_t totalIssued() const;
+        uint64_t totalSkipped() const;
+    };
+
+    // Slots tracked per stage; calls for higher slots are always forwarded.
+    static constexpr uint32_t kBufferSlots = 31;
+    static constexpr uint32_t kTextureSlots = 32;
+
+    explicit StateFilteredEncoder(RenderEncoderBackend& backend) : backend(backend) { reset(); }
+
+    // Forgets what is bound: a new encoder starts from Metal's defaults,
+    // which are 0 for winding, cull mode and fill mode, and from nothing
+    // bound. The counters keep counting.
+    void reset();
+    // Forgets what is bound, defaults included, for when the encoder's
+    // state is not known, e.g. in a recording that is replayed after
+    // another one.
+    void invalidate();
+
+    void setRenderPipelineState(const void* state);
+    void setDepthStencilState(const void* state);
+    void setFrontFacingWinding(uint32_t winding);
+    void setCullMode(uint32_t cullMode);
+    void setTriangleFillMode(uint32_t fillMode);
+    void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index);
+    void setVertexBufferOffset(uint64_t offset, uint32_t index);
+    void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index);
+    void setFragmentTexture(const void* texture, uint32_t index);
+    void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount);
+
+    const Stats& stats() const { return counters; }
+    static const char* callName(Call call);
+
+private:
+    // A handle no real object has, for "unknown".
+    static constexpr uintptr_t kUnknown = ~uintptr_t(0);
+
+    struct BufferBinding {
+        uintptr_t buffer;
+        uint64_t offset;
+    };
+
+    // Counts the call and says whether to forward it.
+    bool changes(uintptr_t& bound, uintptr_t value, Call call);
+
+    RenderEncoderBackend& backend;
+    Stats counters{};
+    uintptr_t pipelineState;
+    uintptr_t depthStencilState;
+    uintptr_t winding;
+    uintptr_t cullMode;
+    uintptr_t fillMode;
+    std::array<BufferBinding, kBufferSlots> vertexBuffers;
+    std::array<BufferBinding, kBufferSlots> fragmentBuffers;
+    std::array<uintptr_t, kTextureSlots> fragmentTextures;
+};
@@ -0,0 +1,117 @@
+//
+//  render_target_pool.cpp
+//  Metal-Guide
+//
+
+#include "render_target_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+RenderTargetPool::RenderTargetPool(RenderTargetAllocator& allocator, uint32_t retainFrames)
+    : allocator(allocator), retainFrames(retainFrames) {}
+
+RenderTargetPool::~RenderTargetPool() {
+    assert(counters.liveBytes == 0 && "release every target before destroying the pool");
+    trim();
+}
+
+uint32_t RenderTargetPool::sizeClass(uint32_t size) {
+    size = std::max(size, 1u);
+    const uint32_t step = size <= 256 ? 64 : std::bit_floor(size) / 4;
+    return (size + step - 1) / step * step;
+}
+
+uint64_t RenderTargetPool::bytes(const RenderTargetDescription& description) {
+    return uint64_t(description.width) * description.height * description.sampleCount * description.bytesPerSample;
+}
+
+RenderTargetDescription RenderTargetPool::classOf(const RenderTargetDescription& description) {
+    RenderTargetDescription sized = description;
+    sized.width = sizeClass(description.width);
+    sized.height = sizeClass(description.height);
+    return sized;
+}
+
+RenderTargetPool::Key RenderTargetPool::keyOf(const RenderTargetDescription& description) {
+    return {description.pixelFormat, description.width, description.height, description.sampleCount};
+}
+
+void RenderTargetPool::beginFrame() {
+    ++frame;
+    for (auto it = freeLists.begin(); it != freeLists.end();) {
+        std::vector<Pooled>& pooled = it->second;
+        // Oldest first: stop at the first target that is still recent.
+        size_t expired = 0;
+        while (expired < pooled.size() && frame - pooled[expired].releasedFrame > retainFrames) {
+            free(pooled[expired]);
+            ++expired;
+        }
+        pooled.erase(pooled.begin(), pooled.begin() + expired);
+        it = pooled.empty() ? freeLists.erase(it) : std::next(it);
+    }
+}
+
+RenderTarget RenderTargetPool::acquire(const RenderTargetDescription& description) {
+    ++counters.acquires;
+    RenderTarget target{nullptr, classOf(description)};
+    const uint64_t targetBytes = bytes(target.description);
+    auto found = freeLists.find(keyOf(target.description));
+    if (found != freeLists.end()) {
+        // The most recently released one is the likeliest to still be warm.
+        target.texture = found->second.back().texture;
+        found->second.pop_back();
+        if (found->second.empty()) {
+            freeLists.erase(found);
+        }
+        ++counters.reuses;
+        counters.pooledBytes -= targetBytes;
+        counters.liveBytes += targetBytes;
+        return target;
+    }
+    target.texture = allocator.allocate(target.description);
+    if (!target.texture) {
+        return RenderTarget();
+    }
+    ++counters.allocations;
+    counters.liveBytes += targetBytes;
+    counters.peakBytes = std::max(counters.peakBytes, counters.liveBytes + counters.pooledBytes);
+    return target;
+}
+
+void RenderTargetPool::release(RenderTarget& target) {
+    if (!target) {
+        return;
+    }
+    const uint64_t targetBytes = bytes(target.description);
+    counters.liveBytes -= targetBytes;
+    counters.pooledBytes += targetBytes;
+    freeLists[keyOf(target.description)].push_back({target.texture, targetBytes, frame});
+    target = RenderTarget();
+}
+
+bool RenderTargetPool::update(RenderTarget& target, const RenderTargetDescription& description) {
+    if (target && keyOf(target.description) == keyOf(classOf(description))) {
+        ++counters.kept;
+        return true;
+    }
+    release(target);
+    target = acquire(description);
+    return false;
+}
+
+void RenderTargetPool::trim() {
+    for (const auto& entry : freeLists) {
+        for (const Pooled& pooled : entry.second) {
+            free(pooled);
+        }
+    }
+    freeLists.clear();
+}
+
+void RenderTargetPool::free(const Pooled& pooled) {
+    counters.pooledBytes -= pooled.bytes;
+    allocator.free(pooled.texture);
+    ++counters.frees;
+}
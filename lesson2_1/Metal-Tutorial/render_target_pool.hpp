@@ -0,0 +1,108 @@
+//
+//  render_target_pool.hpp
+//  Metal-Guide
+//
+//  Reuses render target allocations across window resizes. Targets are
+//  allocated at their size class: each dimension is rounded up by at most
+//  about a quarter, so the many sizes a window drag passes through share a
+//  few allocations. A released target goes back to a free list keyed by
+//  (format, size class, sample count), and is freed only after sitting
+//  unused for a number of frames. As with TextureResidency, the pool only
+//  does bookkeeping and a RenderTargetAllocator creates the textures. Not
+//  thread-safe: use it from the render thread, and only release targets
+//  the GPU is done with.
+//
+//  The engine's attachments now live in MetalRenderGraph's heap, so the
+//  pool is not built into the app; tools/rtpoolsim.cpp runs it against a
+//  fake allocator.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+struct RenderTargetDescription {
+    uint32_t pixelFormat;  // backend-defined, e.g. an MTL::PixelFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t sampleCount;
+    uint32_t bytesPerSample;
+};
+
+class RenderTargetAllocator {
+public:
+    virtual ~RenderTargetAllocator() = default;
+    // Creates a target of exactly description's size; nullptr on failure.
+    virtual void* allocate(const RenderTargetDescription& description) = 0;
+    virtual void free(void* texture) = 0;
+};
+
+struct RenderTarget {
+    void* texture{nullptr};  // backend-defined, e.g. an MTL::Texture*
+    // The allocation, at the size class of the size it was acquired for.
+    RenderTargetDescription description{};
+
+    explicit operator bool() const { return texture != nullptr; }
+};
+
+class RenderTargetPool {
+public:
+    struct Stats {
+        uint64_t acquires;
+        uint64_t reuses;       // acquires served from the free list
+        uint64_t kept;         // update() calls whose size stayed in its class
+        uint64_t allocations;
+        uint64_t frees;
+        uint64_t liveBytes;    // held by acquired targets
+        uint64_t pooledBytes;  // held by released targets waiting for reuse
+        uint64_t peakBytes;    // of live plus pooled
+    };
+
+    // Released targets unused for retainFrames frames are freed.
+    explicit RenderTargetPool(RenderTargetAllocator& allocator, uint32_t retainFrames = 120);
+    ~RenderTargetPool();
+
+    void beginFrame();
+
+    // A target at least description's size. Returns an empty target if the
+    // allocator fails.
+    RenderTarget acquire(const RenderTargetDescription& description);
+    void release(RenderTarget& target);
+    // Makes target fit description, keeping it when it is already of the
+    // right size class and swapping it for another one otherwise. Returns
+    // false if the target changed, i.e. views of it need updating.
+    bool update(RenderTarget& target, const RenderTargetDescription& description);
+
+    // Frees every released target now.
+    void trim();
+
+    const Stats& stats() const { return counters; }
+
+    // Rounds a dimension up to its size class: multiples of 64 up to 256,
+    // then of a quarter of the largest power of two not above it.
+    static uint32_t sizeClass(uint32_t size);
+    static uint64_t bytes(const RenderTargetDescription& description);
+
+private:
+    using Key = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>;  // format, width, height, samples
+
+    struct Pooled {
+        void* texture;
+        uint64_t bytes;
+        uint64_t releasedFrame;
+    };
+
+    static RenderTargetDescription classOf(const RenderTargetDescription& description);
+    static Key keyOf(const RenderTargetDescription& description);
+    void free(const Pooled& pooled);
+
+    RenderTargetAllocator& allocator;
+    uint32_t retainFrames;
+    uint64_t frame{0};
+    Stats counters{};
+    // Released targets per key, most recently released last.
+    std::map<Key, std::vector<Pooled>> freeLists;
+};
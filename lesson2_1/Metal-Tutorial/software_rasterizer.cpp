@@ -0,0 +1,464 @@
+//
+//  software_rasterizer.cpp
+//  Metal-Guide
+//
+
+#include "software_rasterizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Vertices are snapped to 1/256 pixel, like GPU rasterizers do, so edges
+// shared by two triangles are evaluated identically by both.
+constexpr float kSubpixels = 256.0f;
+// Triangles reaching further than this many half-viewports outside the view
+// are clipped, which keeps snapped coordinates well within float precision.
+constexpr float kGuardBand = 4.0f;
+// Triangles per setup chunk, at least.
+constexpr size_t kMinChunkTriangles = 256;
+
+// Standard 4x MSAA sample positions within a pixel.
+constexpr float kSampleX[4] = {0.375f, 0.875f, 0.125f, 0.625f};
+constexpr float kSampleY[4] = {0.125f, 0.375f, 0.625f, 0.875f};
+
+// One value per MSAA sample.
+#if defined(__ARM_NEON)
+using Lanes = float32x4_t;
+using Mask = uint32x4_t;
+inline Lanes splat(float v) { return vdupq_n_f32(v); }
+inline Lanes load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, Lanes v) { vst1q_f32(p, v); }
+inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+inline Lanes multiply(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+inline Mask greater(Lanes a, Lanes b) { return vcgtq_f32(a, b); }
+inline Mask greaterEqual(Lanes a, Lanes b) { return vcgeq_f32(a, b); }
+inline Mask lessEqual(Lanes a, Lanes b) { return vcleq_f32(a, b); }
+inline Mask both(Mask a, Mask b) { return vandq_u32(a, b); }
+inline Lanes select(Mask m, Lanes a, Lanes b) { return vbslq_f32(m, a, b); }
+inline int bits(Mask m) {
+    const uint32x4_t weights = {1, 2, 4, 8};
+    return int(vaddvq_u32(vandq_u32(m, weights)));
+}
+#elif defined(__SSE2__)
+using Lanes = __m128;
+using Mask = __m128;
+inline Lanes splat(float v) { return _mm_set1_ps(v); }
+inline Lanes load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Mask greater(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+inline Mask greaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+inline Mask lessEqual(Lanes a, Lanes b) { return _mm_cmple_ps(a, b); }
+inline Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+inline Lanes select(Mask m, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline int bits(Mask m) { return _mm_movemask_ps(m); }
+#else
+struct Lanes { float v[4]; };
+struct Mask { bool v[4]; };
+inline Lanes splat(float v) { return {{v, v, v, v}}; }
+inline Lanes load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, Lanes v) { std::copy(v.v, v.v + 4, p); }
+template <typename Op>
+inline Lanes lanewise(Lanes a, Lanes b, Op op) { return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}}; }
+template <typename Op>
+inline Mask compare(Lanes a, Lanes b, Op op) { return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}}; }
+inline Lanes add(Lanes a, Lanes b) { return lanewise(a, b, [](float x, float y) { return x + y; }); }
+inline Lanes multiply(Lanes a, Lanes b) { return lanewise(a, b, [](float x, float y) { return x * y; }); }
+inline Mask greater(Lanes a, Lanes b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+inline Mask greaterEqual(Lanes a, Lanes b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+inline Mask lessEqual(Lanes a, Lanes b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+inline Mask both(Mask a, Mask b) { return {{a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]}}; }
+inline Lanes select(Mask m, Lanes a, Lanes b) {
+    return {{m.v[0] ? a.v[0] : b.v[0], m.v[1] ? a.v[1] : b.v[1], m.v[2] ? a.v[2] : b.v[2], m.v[3] ? a.v[3] : b.v[3]}};
+}
+inline int bits(Mask m) { return int(m.v[0]) | int(m.v[1]) << 1 | int(m.v[2]) << 2 | int(m.v[3]) << 3; }
+#endif
+
+// Column-major a * b.
+void multiplyMatrices(const float a[16], const float b[16], float out[16]) {
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            out[column * 4 + row] = sum;
+        }
+    }
+}
+
+uint32_t packColor(float r, float g, float b, float a) {
+    auto unorm = [](float v) { return uint32_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); };
+    return unorm(r) | unorm(g) << 8 | unorm(b) << 16 | unorm(a) << 24;
+}
+
+// Bilinear with clamp-to-edge addressing, as the fragment shader's sampler.
+uint32_t sampleBilinear(const RasterTexture& texture, float u, float v) {
+    const float fx = u * texture.width - 0.5f, fy = v * texture.height - 0.5f;
+    const float floorX = std::floor(fx), floorY = std::floor(fy);
+    const float ax = fx - floorX, ay = fy - floorY;
+    const int x0 = std::clamp(int(floorX), 0, texture.width - 1), x1 = std::clamp(int(floorX) + 1, 0, texture.width - 1);
+    const int y0 = std::clamp(int(floorY), 0, texture.height - 1), y1 = std::clamp(int(floorY) + 1, 0, texture.height - 1);
+    const uint8_t* row0 = texture.pixels + size_t(y0) * texture.bytesPerRow;
+    const uint8_t* row1 = texture.pixels + size_t(y1) * texture.bytesPerRow;
+    const float w00 = (1.0f - ax) * (1.0f - ay), w10 = ax * (1.0f - ay), w01 = (1.0f - ax) * ay, w11 = ax * ay;
+    uint32_t color = 0;
+    for (int c = 0; c < 4; ++c) {
+        const float value = row0[x0 * 4 + c] * w00 + row0[x1 * 4 + c] * w10 + row1[x0 * 4 + c] * w01 +
+                            row1[x1 * 4 + c] * w11;
+        color |= uint32_t(std::min(value + 0.5f, 255.0f)) << (8 * c);
+    }
+    return color;
+}
+
+// Keeps the part of a convex polygon where dot(plane, xyzw) >= 0.
+// Vertices are clip-space x, y, z, w, u, v.
+int clipPolygon(const float (*in)[6], int count, const float plane[4], float (*out)[6]) {
+    int written = 0;
+    for (int i = 0; i < count; ++i) {
+        const float* a = in[i];
+        const float* b = in[(i + 1) % count];
+        const float da = plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2] + plane[3] * a[3];
+        const float db = plane[0] * b[0] + plane[1] * b[1] + plane[2] * b[2] + plane[3] * b[3];
+        if (da >= 0.0f) {
+            std::copy(a, a + 6, out[written++]);
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            const float t = da / (da - db);
+            for (int k = 0; k < 6; ++k) {
+                out[written][k] = a[k] + (b[k] - a[k]) * t;
+            }
+            ++written;
+        }
+    }
+    return written;
+}
+
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, ThreadPool& pool) : pool(pool) {
+    resize(width, height);
+}
+
+void SoftwareRasterizer::resize(int width, int height) {
+    assert(width > 0 && height > 0);
+    targetWidth = width;
+    targetHeight = height;
+    tilesX = (width + kTileSize - 1) / kTileSize;
+    tilesY = (height + kTileSize - 1) / kTileSize;
+    colorSamples.assign(size_t(width) * height * kSampleCount, 0);
+    depthSamples.assign(size_t(width) * height * kSampleCount, 1.0f);
+    resolved.assign(size_t(width) * height * 4, 0);
+}
+
+void SoftwareRasterizer::beginFrame(const float color[4], float depth) {
+    clearColor = packColor(color[0], color[1], color[2], color[3]);
+    clearDepth = depth;
+    draws.clear();
+    triangleCount = 0;
+}
+
+void SoftwareRasterizer::draw(const RasterVertex* vertices, size_t vertexCount, const RasterTransforms& transforms,
+                              const RasterTexture& texture, RasterCullMode cullMode) {
+    Draw draw{vertices, vertexCount / 3, triangleCount, {}, texture, cullMode};
+    float viewModel[16];
+    multiplyMatrices(transforms.viewMatrix, transforms.modelMatrix, viewModel);
+    multiplyMatrices(transforms.perspectiveMatrix, viewModel, draw.mvp);
+    triangleCount += draw.triangleCount;
+    draws.push_back(draw);
+}
+
+void SoftwareRasterizer::endFrame() {
+    const size_t tileCount = size_t(tilesX) * tilesY;
+    const size_t chunkCount = std::clamp<size_t>(triangleCount / kMinChunkTriangles, 1, size_t(pool.threadCount()) * 4);
+    if (chunks.size() < chunkCount) {
+        chunks.resize(chunkCount);
+    }
+    activeChunks = chunkCount;
+    const size_t chunkTriangles = (triangleCount + chunkCount - 1) / chunkCount;
+    pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Chunk& chunk = chunks[i];
+            chunk.triangles.clear();
+            chunk.bins.resize(tileCount);
+            for (auto& bin : chunk.bins) {
+                bin.clear();
+            }
+            chunk.stats = {};
+            setupChunk(chunk, std::min(i * chunkTriangles, triangleCount), std::min((i + 1) * chunkTriangles, triangleCount));
+        }
+    });
+
+    std::vector<Stats> tileStats(tileCount);
+    pool.parallelFor(tileCount, 1, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            tileStats[tile] = {};
+            renderTile(int(tile), tileStats[tile]);
+        }
+    });
+
+    counters = {};
+    for (size_t i = 0; i < chunkCount; ++i) {
+        counters.triangles += chunks[i].stats.triangles;
+        counters.culled += chunks[i].stats.culled;
+        counters.clipped += chunks[i].stats.clipped;
+        counters.binEntries += chunks[i].stats.binEntries;
+    }
+    for (const Stats& stats : tileStats) {
+        counters.shadedPixels += stats.shadedPixels;
+        counters.samplesWritten += stats.samplesWritten;
+    }
+}
+
+void SoftwareRasterizer::setupChunk(Chunk& chunk, size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+    // Draws are in triangle order; find the one holding begin.
+    size_t drawIndex = size_t(std::upper_bound(draws.begin(), draws.end(), begin, [](size_t t, const Draw& d) {
+        return t < d.firstTriangle;
+    }) - draws.begin()) - 1;
+
+    for (size_t t = begin; t < end; ++t) {
+        while (t >= draws[drawIndex].firstTriangle + draws[drawIndex].triangleCount) {
+            ++drawIndex;
+        }
+        const Draw& draw = draws[drawIndex];
+        const RasterVertex* vertices = draw.vertices + (t - draw.firstTriangle) * 3;
+        ++chunk.stats.triangles;
+
+        float clip[3][6];
+        for (int i = 0; i < 3; ++i) {
+            const float* p = vertices[i].position;
+            for (int row = 0; row < 4; ++row) {
+                clip[i][row] = draw.mvp[row] * p[0] + draw.mvp[4 + row] * p[1] + draw.mvp[8 + row] * p[2] +
+                               draw.mvp[12 + row] * p[3];
+            }
+            clip[i][4] = vertices[i].textureCoordinate[0];
+            clip[i][5] = vertices[i].textureCoordinate[1];
+        }
+
+        // Entirely outside one of the view planes.
+        int outside[6] = {};
+        bool needsClip = false;
+        for (int i = 0; i < 3; ++i) {
+            const float x = clip[i][0], y = clip[i][1], z = clip[i][2], w = clip[i][3];
+            outside[0] += x < -w;
+            outside[1] += x > w;
+            outside[2] += y < -w;
+            outside[3] += y > w;
+            outside[4] += z < 0.0f;
+            outside[5] += z > w;
+            needsClip |= z < 0.0f || std::abs(x) > kGuardBand * w || std::abs(y) > kGuardBand * w;
+        }
+        if (std::find(outside, outside + 6, 3) != outside + 6) {
+            ++chunk.stats.culled;
+            continue;
+        }
+        if (!needsClip) {
+            emitTriangle(chunk, clip, uint32_t(drawIndex));
+            continue;
+        }
+
+        ++chunk.stats.clipped;
+        static const float planes[5][4] = {
+            {0.0f, 0.0f, 1.0f, 0.0f},
+            {-1.0f, 0.0f, 0.0f, kGuardBand},
+            {1.0f, 0.0f, 0.0f, kGuardBand},
+            {0.0f, -1.0f, 0.0f, kGuardBand},
+            {0.0f, 1.0f, 0.0f, kGuardBand},
+        };
+        float polygon[2][9][6];
+        int count = 3;
+        std::copy(&clip[0][0], &clip[0][0] + 18, &polygon[0][0][0]);
+        int current = 0;
+        for (const auto& plane : planes) {
+            count = clipPolygon(polygon[current], count, plane, polygon[current ^ 1]);
+            current ^= 1;
+            if (count < 3) {
+                break;
+            }
+        }
+        for (int i = 1; i + 1 < count; ++i) {
+            float fan[3][6];
+            std::copy(polygon[current][0], polygon[current][0] + 6, fan[0]);
+            std::copy(polygon[current][i], polygon[current][i] + 6, fan[1]);
+            std::copy(polygon[current][i + 1], polygon[current][i + 1] + 6, fan[2]);
+            emitTriangle(chunk, fan, uint32_t(drawIndex));
+        }
+    }
+}
+
+void SoftwareRasterizer::emitTriangle(Chunk& chunk, const float clip[3][6], uint32_t drawIndex) {
+    Triangle triangle;
+    for (int i = 0; i < 3; ++i) {
+        const float invW = 1.0f / clip[i][3];
+        const float x = (clip[i][0] * invW * 0.5f + 0.5f) * targetWidth;
+        const float y = (0.5f - clip[i][1] * invW * 0.5f) * targetHeight;
+        triangle.x[i] = std::round(x * kSubpixels) / kSubpixels;
+        triangle.y[i] = std::round(y * kSubpixels) / kSubpixels;
+        triangle.z[i] = clip[i][2] * invW;
+        triangle.invW[i] = invW;
+        triangle.uOverW[i] = clip[i][4] * invW;
+        triangle.vOverW[i] = clip[i][5] * invW;
+    }
+
+    // Counter-clockwise in normalized device coordinates (y up) is
+    // clockwise on screen (y down), where this area is then negative.
+    const float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                       (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+    const bool frontFacing = area < 0.0f;
+    if (!frontFacing && !(area > 0.0f && draws[drawIndex].cullMode == RasterCullMode::None)) {
+        ++chunk.stats.culled;
+        return;
+    }
+    // Every edge function must be positive inside; back faces already are.
+    if (frontFacing) {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+        std::swap(triangle.z[1], triangle.z[2]);
+        std::swap(triangle.invW[1], triangle.invW[2]);
+        std::swap(triangle.uOverW[1], triangle.uOverW[2]);
+        std::swap(triangle.vOverW[1], triangle.vOverW[2]);
+    }
+    triangle.inverseArea = 1.0f / std::abs(area);
+
+    for (int i = 0; i < 3; ++i) {
+        const int a = (i + 1) % 3, b = (i + 2) % 3;
+        triangle.edgeA[i] = triangle.y[a] - triangle.y[b];
+        triangle.edgeB[i] = triangle.x[b] - triangle.x[a];
+        triangle.edgeC[i] = triangle.x[a] * triangle.y[b] - triangle.x[b] * triangle.y[a];
+        const bool topLeft = triangle.edgeA[i] > 0.0f || (triangle.edgeA[i] == 0.0f && triangle.edgeB[i] > 0.0f);
+        // E > -denorm_min is E >= 0.
+        triangle.edgeBias[i] = topLeft ? -std::numeric_limits<float>::denorm_min() : 0.0f;
+    }
+
+    triangle.minX = std::max(int(std::floor(std::min({triangle.x[0], triangle.x[1], triangle.x[2]}))), 0);
+    triangle.minY = std::max(int(std::floor(std::min({triangle.y[0], triangle.y[1], triangle.y[2]}))), 0);
+    triangle.maxX = std::min(int(std::ceil(std::max({triangle.x[0], triangle.x[1], triangle.x[2]}))) - 1, targetWidth - 1);
+    triangle.maxY = std::min(int(std::ceil(std::max({triangle.y[0], triangle.y[1], triangle.y[2]}))) - 1, targetHeight - 1);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        ++chunk.stats.culled;
+        return;
+    }
+    triangle.draw = drawIndex;
+
+    const uint32_t index = uint32_t(chunk.triangles.size());
+    chunk.triangles.push_back(triangle);
+    for (int ty = triangle.minY / kTileSize; ty <= triangle.maxY / kTileSize; ++ty) {
+        for (int tx = triangle.minX / kTileSize; tx <= triangle.maxX / kTileSize; ++tx) {
+            chunk.bins[size_t(ty) * tilesX + tx].push_back(index);
+            ++chunk.stats.binEntries;
+        }
+    }
+}
+
+void SoftwareRasterizer::renderTile(int tile, Stats& stats) {
+    const int tileX0 = (tile % tilesX) * kTileSize, tileY0 = (tile / tilesX) * kTileSize;
+    const int tileX1 = std::min(tileX0 + kTileSize, targetWidth) - 1;
+    const int tileY1 = std::min(tileY0 + kTileSize, targetHeight) - 1;
+
+    // Load action: clear.
+    for (int y = tileY0; y <= tileY1; ++y) {
+        const size_t first = (size_t(y) * targetWidth + tileX0) * kSampleCount;
+        const size_t count = size_t(tileX1 - tileX0 + 1) * kSampleCount;
+        std::fill_n(&colorSamples[first], count, clearColor);
+        std::fill_n(&depthSamples[first], count, clearDepth);
+    }
+
+    const Lanes sampleX = load(kSampleX), sampleY = load(kSampleY);
+    const Lanes zero = splat(0.0f), one = splat(1.0f);
+    for (size_t c = 0; c < activeChunks; ++c) {
+        const Chunk& chunk = chunks[c];
+        for (uint32_t index : chunk.bins[tile]) {
+            const Triangle& t = chunk.triangles[index];
+            const RasterTexture& texture = draws[t.draw].texture;
+            const int x0 = std::max(t.minX, tileX0), x1 = std::min(t.maxX, tileX1);
+            const int y0 = std::max(t.minY, tileY0), y1 = std::min(t.maxY, tileY1);
+            Lanes edgeA[3], edgeBias[3];
+            for (int e = 0; e < 3; ++e) {
+                edgeA[e] = splat(t.edgeA[e]);
+                edgeBias[e] = splat(t.edgeBias[e]);
+            }
+            const Lanes inverseArea = splat(t.inverseArea);
+            const Lanes z0 = splat(t.z[0]), dz1 = splat(t.z[1] - t.z[0]), dz2 = splat(t.z[2] - t.z[0]);
+
+            for (int y = y0; y <= y1; ++y) {
+                const Lanes sy = add(splat(float(y)), sampleY);
+                Lanes rowTerm[3];
+                for (int e = 0; e < 3; ++e) {
+                    rowTerm[e] = add(multiply(splat(t.edgeB[e]), sy), splat(t.edgeC[e]));
+                }
+                for (int x = x0; x <= x1; ++x) {
+                    const Lanes sx = add(splat(float(x)), sampleX);
+                    const Lanes e0 = add(multiply(edgeA[0], sx), rowTerm[0]);
+                    const Lanes e1 = add(multiply(edgeA[1], sx), rowTerm[1]);
+                    const Lanes e2 = add(multiply(edgeA[2], sx), rowTerm[2]);
+                    const Mask covered = both(both(greater(e0, edgeBias[0]), greater(e1, edgeBias[1])),
+                                              greater(e2, edgeBias[2]));
+                    if (bits(covered) == 0) {
+                        continue;
+                    }
+
+                    // Depth is affine in screen space.
+                    const Lanes z = add(z0, add(multiply(multiply(e1, inverseArea), dz1),
+                                                multiply(multiply(e2, inverseArea), dz2)));
+                    float* depth = &depthSamples[(size_t(y) * targetWidth + x) * kSampleCount];
+                    const Lanes stored = load(depth);
+                    const Mask passed = both(both(covered, lessEqual(z, stored)),
+                                             both(greaterEqual(z, zero), lessEqual(z, one)));
+                    const int passedBits = bits(passed);
+                    if (passedBits == 0) {
+                        continue;
+                    }
+                    store(depth, select(passed, z, stored));
+
+                    // One fragment shader invocation per pixel, at its centre.
+                    const float cx = x + 0.5f, cy = y + 0.5f;
+                    const float l1 = (t.edgeA[1] * cx + t.edgeB[1] * cy + t.edgeC[1]) * t.inverseArea;
+                    const float l2 = (t.edgeA[2] * cx + t.edgeB[2] * cy + t.edgeC[2]) * t.inverseArea;
+                    const float l0 = 1.0f - l1 - l2;
+                    const float w = 1.0f / (l0 * t.invW[0] + l1 * t.invW[1] + l2 * t.invW[2]);
+                    const float u = (l0 * t.uOverW[0] + l1 * t.uOverW[1] + l2 * t.uOverW[2]) * w;
+                    const float v = (l0 * t.vOverW[0] + l1 * t.vOverW[1] + l2 * t.vOverW[2]) * w;
+                    const uint32_t color = sampleBilinear(texture, u, v);
+                    ++stats.shadedPixels;
+
+                    uint32_t* samples = &colorSamples[(size_t(y) * targetWidth + x) * kSampleCount];
+                    for (int s = 0; s < kSampleCount; ++s) {
+                        if (passedBits & (1 << s)) {
+                            samples[s] = color;
+                            ++stats.samplesWritten;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Store action: multisample resolve.
+    for (int y = tileY0; y <= tileY1; ++y) {
+        for (int x = tileX0; x <= tileX1; ++x) {
+            const uint32_t* samples = &colorSamples[(size_t(y) * targetWidth + x) * kSampleCount];
+            uint8_t* out = &resolved[(size_t(y) * targetWidth + x) * 4];
+            for (int c = 0; c < 4; ++c) {
+                uint32_t sum = 2;
+                for (int s = 0; s < kSampleCount; ++s) {
+                    sum += (samples[s] >> (8 * c)) & 0xff;
+                }
+                out[c] = uint8_t(sum / kSampleCount);
+            }
+        }
+    }
+}
@@ -0,0 +1,143 @@
+//
+//  software_rasterizer.hpp
+//  Metal-Guide
+//
+//  CPU version of the render pass MTLEngine encodes, for running and timing
+//  the renderer without a Metal device. It reproduces:
+//  - the MVP transform from cube.metal's vertex shader
+//  - back-face culling with counter-clockwise front faces, or none
+//  - a LessEqual Depth32Float test
+//  - 4x MSAA with the standard sample positions and a box resolve
+//  - the fragment shader's bilinear, clamp-to-edge texture lookup
+//
+//  Triangles are set up in parallel and binned into screen tiles. Each tile
+//  is then cleared, rasterized and resolved on one thread, in submission
+//  order, so the image does not depend on the thread count. Per-pixel work
+//  tests all four samples at once with NEON or SSE2.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Same layout as VertexData in vertex_data.hpp, so a cube vertex buffer can
+// be passed as is.
+struct RasterVertex {
+    alignas(16) float position[4];
+    float textureCoordinate[2];
+};
+
+// Same layout as TransformationData: column-major 4x4 matrices.
+struct RasterTransforms {
+    float modelMatrix[16];
+    float viewMatrix[16];
+    float perspectiveMatrix[16];
+};
+
+// RGBA8 texels, row 0 at v = 0.
+struct RasterTexture {
+    const uint8_t* pixels;
+    int width;
+    int height;
+    size_t bytesPerRow;
+};
+
+// MTL::CullMode's None and Back, with counter-clockwise front faces.
+enum class RasterCullMode {
+    None,
+    Back,
+};
+
+class SoftwareRasterizer {
+public:
+    struct Stats {
+        uint64_t triangles;      // submitted
+        uint64_t culled;         // back-facing, degenerate or outside the view
+        uint64_t clipped;        // crossed the near plane or the guard band
+        uint64_t binEntries;     // triangle-tile pairs
+        uint64_t shadedPixels;   // fragment shader invocations
+        uint64_t samplesWritten; // samples that passed the depth test
+    };
+
+    explicit SoftwareRasterizer(int width, int height, ThreadPool& pool = ThreadPool::shared());
+
+    void resize(int width, int height);
+
+    // Starts a pass with the given clear colour (RGBA, 0-1) and depth.
+    void beginFrame(const float clearColor[4], float clearDepth = 1.0f);
+    // Records drawPrimitives(Triangle, 0, vertexCount). vertices, transforms
+    // and the texture's pixels must stay valid until endFrame().
+    void draw(const RasterVertex* vertices, size_t vertexCount, const RasterTransforms& transforms,
+              const RasterTexture& texture, RasterCullMode cullMode = RasterCullMode::Back);
+    // Renders everything recorded since beginFrame() and resolves it.
+    void endFrame();
+
+    // Resolved RGBA8 image, row 0 at the top.
+    const uint8_t* pixels() const { return resolved.data(); }
+    int width() const { return targetWidth; }
+    int height() const { return targetHeight; }
+    const Stats& stats() const { return counters; }
+
+    static constexpr int kSampleCount = 4;
+    static constexpr int kTileSize = 64;
+
+private:
+    struct Draw {
+        const RasterVertex* vertices;
+        size_t triangleCount;
+        size_t firstTriangle;  // across all draws of the frame
+        float mvp[16];
+        RasterTexture texture;
+        RasterCullMode cullMode;
+    };
+
+    // A screen-space triangle ready for rasterization. Edge i is opposite
+    // vertex i, and is positive inside the triangle.
+    struct Triangle {
+        float x[3], y[3];
+        float z[3];
+        float invW[3];
+        float uOverW[3], vOverW[3];
+        float edgeA[3], edgeB[3], edgeC[3];
+        // Samples exactly on an edge belong to the triangle only if it is a
+        // top or left edge; others compare against this instead of zero.
+        float edgeBias[3];
+        float inverseArea;
+        int minX, minY, maxX, maxY;
+        uint32_t draw;
+    };
+
+    // Triangles set up by one chunk of the setup pass, and the tiles each
+    // one touches. Chunks are visited in order, so triangles stay in
+    // submission order within every tile.
+    struct Chunk {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+        Stats stats;
+    };
+
+    void setupChunk(Chunk& chunk, size_t begin, size_t end);
+    void emitTriangle(Chunk& chunk, const float clip[3][6], uint32_t drawIndex);
+    void renderTile(int tile, Stats& stats);
+
+    ThreadPool& pool;
+    int targetWidth{0};
+    int targetHeight{0};
+    int tilesX{0};
+    int tilesY{0};
+    uint32_t clearColor{0};
+    float clearDepth{1.0f};
+    std::vector<Draw> draws;
+    size_t triangleCount{0};
+    std::vector<Chunk> chunks;
+    size_t activeChunks{0};  // chunks used this frame; the rest keep their memory
+    // Samples of a pixel are stored next to each other.
+    std::vector<uint32_t> colorSamples;
+    std::vector<float> depthSamples;
+    std::vector<uint8_t> resolved;
+    Stats counters{};
+};
@@ -1,28 +1,335 @@
-#include "Texture.hpp"
+#include "texture.hpp"
 
-Texture::Texture(const char* filepath, MTL::Device* metalDevice) {
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "pixel_convert.hpp"
+#include "qoi.hpp"
+#include "stb/stb_image_pool.h"
+#include "thread_pool.hpp"
+
+namespace {
+
+// Bump whenever decoding changes what ends up in the texture, so stale
+// cache entries stop matching.
+constexpr uint64_t kPipelineVersion = 1;
+
+uint64_t cacheKey(const MappedFile& file, const TextureOptions& options) {
+    struct {
+        uint64_t version;
+        int32_t hdrDownscale;
+        int32_t maxDimension;
+        uint64_t maxBytes;
+        int32_t resizeFilter;
+        int32_t mipmapped;
+    } settings = {kPipelineVersion, options.hdrDownscale, options.maxDimension, options.maxBytes,
+                  int32_t(options.resizeFilter), options.mipmapped};
+    return TextureCache::hash(&settings, sizeof(settings), TextureCache::hash(file.data, file.size));
+}
+
+uint32_t levelCountFor(const TextureOptions& options, int width, int height) {
+    return options.mipmapped ? std::bit_width(uint32_t(std::max(width, height))) : 1;
+}
+
+// HDR images meet the size budget by raising the luminance-weighted reduction.
+int hdrDownscaleFor(const TextureOptions& options, int width, int height) {
+    int fittedWidth, fittedHeight;
+    ImageResize::fitWithin(width, height, options.maxDimension, options.maxBytes, 8, fittedWidth, fittedHeight);
+    return std::max({1, options.hdrDownscale,
+                     (width + fittedWidth - 1) / fittedWidth,
+                     (height + fittedHeight - 1) / fittedHeight});
+}
+
+// stb_image decodes a JPEG's restart intervals through this.
+void stbParallelFor(int count, void (*task)(void* user, int index), void* user) {
+    ThreadPool::shared().parallelFor(size_t(count), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            task(user, int(i));
+        }
+    });
+}
+
+}
+
+Texture::Texture(const char* filepath, MTL::Device* metalDevice, const TextureOptions& options) {
     device = metalDevice;
+    uploads = options.uploads;
 
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* image = stbi_load(filepath, &width, &height, &channels, STBI_rgb_alpha);
-    assert(image != NULL);
+    MappedFile file(filepath);
+    assert(file.isOpen());
+
+    // QOI decodes about as fast as a cache hit can be read, so it skips the
+    // cache whenever it can stream straight into the texture. An upload
+    // queue does its own chunking instead.
+    if (Qoi::isQoi(file.data, file.size) && !options.mipmapped && options.firstLevel == 0 && !uploads &&
+        loadQoiStreaming(file, options)) {
+        return;
+    }
+
+    uint64_t key = 0;
+    if (options.cache) {
+        key = cacheKey(file, options);
+        if (std::shared_ptr<TextureCache::Entry> entry = options.cache->find(key)) {
+            // The mapping stays open until the upload is done with it.
+            upload(entry->description(), entry->level(0), options.firstLevel, [entry] {});
+            return;
+        }
+    }
+
+    TextureCache::Description description;
+    uint8_t* pixels = stbi_is_hdr_from_memory(file.data, int(file.size))
+        ? decodeHdr(file, options, description)
+        : decodeRgba8(file, options, description);
+    if (options.cache) {
+        options.cache->store(key, description, pixels);
+    }
+    upload(description, pixels, options.firstLevel, [pixels] { StbImagePool::release(pixels); });
+}
+
+Texture::~Texture() {
+    if (uploads) {
+        uploads->cancel(texture);
+    }
+    texture->release();
+}
+
+TextureCache::Description Texture::describe(const char* filepath, const TextureOptions& options) {
+    MappedFile file(filepath);
+    assert(file.isOpen());
+
+    TextureCache::Description description{uint32_t(MTL::PixelFormatRGBA8Unorm), 4, 0, 0, 0, 1};
+    int imageWidth = 0, imageHeight = 0, imageChannels = 0;
+    Qoi::Decoder decoder;
+    if (decoder.open(file.data, file.size)) {
+        imageWidth = decoder.header().width;
+        imageHeight = decoder.header().height;
+        imageChannels = decoder.header().channels;
+    } else {
+        [[maybe_unused]] int ok = stbi_info_from_memory(file.data, int(file.size), &imageWidth, &imageHeight, &imageChannels);
+        assert(ok);
+    }
+    description.channels = imageChannels;
 
+    if (stbi_is_hdr_from_memory(file.data, int(file.size))) {
+        int downscale = hdrDownscaleFor(options, imageWidth, imageHeight);
+        description.pixelFormat = uint32_t(MTL::PixelFormatRGBA16Float);
+        description.bytesPerPixel = 8;
+        description.width = std::max(1, imageWidth / downscale);
+        description.height = std::max(1, imageHeight / downscale);
+        return description;
+    }
+
+    int fittedWidth, fittedHeight;
+    ImageResize::fitWithin(imageWidth, imageHeight, options.maxDimension, options.maxBytes, 4, fittedWidth, fittedHeight);
+    description.width = fittedWidth;
+    description.height = fittedHeight;
+    description.levelCount = levelCountFor(options, fittedWidth, fittedHeight);
+    return description;
+}
+
+void Texture::createTexture(MTL::PixelFormat pixelFormat, NS::UInteger levelCount) {
     MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
-    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setPixelFormat(pixelFormat);
     textureDescriptor->setWidth(width);
     textureDescriptor->setHeight(height);
+    textureDescriptor->setMipmapLevelCount(levelCount);
 
     texture = device->newTexture(textureDescriptor);
+    textureDescriptor->release();
+}
 
-    MTL::Region region = MTL::Region(0, 0, 0, width, height, 1);
-    NS::UInteger bytesPerRow = 4 * width;
+void Texture::upload(const TextureCache::Description& description, const uint8_t* pixels, uint32_t firstLevel,
+                     std::function<void()> release) {
+    firstLevel = std::min(firstLevel, description.levelCount - 1);
+    width = std::max(description.width >> firstLevel, 1u);
+    height = std::max(description.height >> firstLevel, 1u);
+    channels = description.channels;
+    createTexture(MTL::PixelFormat(description.pixelFormat), description.levelCount - firstLevel);
 
-    texture->replaceRegion(region, 0, image, bytesPerRow);
+    for (uint32_t level = firstLevel; level < description.levelCount; ++level) {
+        NS::UInteger levelWidth = std::max(description.width >> level, 1u);
+        NS::UInteger levelHeight = std::max(description.height >> level, 1u);
+        const uint8_t* levelPixels = pixels + TextureCache::levelOffset(description, level);
+        if (uploads) {
+            // Requests are staged in order, so the last level's release
+            // comes after every level has been copied.
+            uploadToken = uploads->enqueue(texture, level - firstLevel, 0, 0, uint32_t(levelWidth), uint32_t(levelHeight),
+                                           description.bytesPerPixel, levelPixels, description.bytesPerPixel * levelWidth,
+                                           level + 1 == description.levelCount ? std::move(release) : nullptr);
+        } else {
+            MTL::Region region = MTL::Region(0, 0, 0, levelWidth, levelHeight, 1);
+            texture->replaceRegion(region, level - firstLevel, levelPixels, description.bytesPerPixel * levelWidth);
+        }
+    }
+    if (!uploads) {
+        release();
+    }
+}
 
-    textureDescriptor->release();
+uint8_t* Texture::decodeRgba8(const MappedFile& file, const TextureOptions& options, TextureCache::Description& description) {
+    // Level 0 at source size, RGBA, rows flipped. stb allocates from
+    // StbImagePool too, so every buffer here is released the same way.
+    int imageWidth = 0, imageHeight = 0, imageChannels = 0;
+    uint8_t* image = nullptr;
+    if (Qoi::isQoi(file.data, file.size)) {
+        Qoi::Decoder decoder;
+        [[maybe_unused]] bool opened = decoder.open(file.data, file.size);
+        assert(opened);
+        imageWidth = decoder.header().width;
+        imageHeight = decoder.header().height;
+        imageChannels = decoder.header().channels;
+        image = static_cast<uint8_t*>(StbImagePool::allocate(size_t(imageWidth) * imageHeight * 4));
+        [[maybe_unused]] bool decoded = decoder.decodeRows(image, 4 * imageWidth, imageHeight, true);
+        assert(decoded);
+    } else {
+        // stb expands RGB to RGBA one channel at a time; ask for the file's own
+        // layout and let PixelConvert do the expansion instead.
+        int fileChannels = 0;
+        stbi_info_from_memory(file.data, int(file.size), &imageWidth, &imageHeight, &fileChannels);
+        int requestedChannels = (fileChannels == 3) ? STBI_rgb : STBI_rgb_alpha;
+        static std::once_flag parallelStb;
+        std::call_once(parallelStb, [] { stbi_set_parallel_for(stbParallelFor); });
+        uint8_t* decoded = stbi_load_from_memory(file.data, int(file.size), &imageWidth, &imageHeight, &imageChannels, requestedChannels);
+        assert(decoded != NULL);
+
+        const size_t bytesPerRow = 4 * size_t(imageWidth);
+        if (requestedChannels == STBI_rgb) {
+            image = static_cast<uint8_t*>(StbImagePool::allocate(bytesPerRow * imageHeight));
+            // Each row is expanded straight into its vertically flipped position.
+            ThreadPool::shared().parallelFor(imageHeight, 32, [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y) {
+                    PixelConvert::rgbToRgba(decoded + y * 3 * imageWidth, image + (imageHeight - 1 - y) * bytesPerRow, imageWidth);
+                }
+            });
+            stbi_image_free(decoded);
+        } else {
+            image = decoded;
+            // Row pairs swap independently, so the flip splits across the pool.
+            ThreadPool::shared().parallelFor(imageHeight / 2, 32, [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y) {
+                    PixelConvert::swapRows(image + y * bytesPerRow, image + (imageHeight - 1 - y) * bytesPerRow, bytesPerRow);
+                }
+            });
+        }
+    }
+
+    int fittedWidth, fittedHeight;
+    ImageResize::fitWithin(imageWidth, imageHeight, options.maxDimension, options.maxBytes, 4, fittedWidth, fittedHeight);
+    uint32_t levelCount = levelCountFor(options, fittedWidth, fittedHeight);
+    description = {uint32_t(MTL::PixelFormatRGBA8Unorm), 4, uint32_t(fittedWidth), uint32_t(fittedHeight),
+                   uint32_t(imageChannels), levelCount};
+
+    const bool resized = fittedWidth != imageWidth || fittedHeight != imageHeight;
+    if (!resized && levelCount == 1) {
+        return image;
+    }
+
+    uint8_t* pixels = static_cast<uint8_t*>(StbImagePool::allocate(TextureCache::dataSize(description)));
+    if (resized) {
+        ImageResize::resizeRgba8(image, imageWidth, imageHeight, 4 * imageWidth,
+                                 pixels, fittedWidth, fittedHeight, 4 * fittedWidth, options.resizeFilter);
+    } else {
+        memcpy(pixels, image, size_t(imageWidth) * imageHeight * 4);
+    }
+    StbImagePool::release(image);
+
+    // Each level is filtered from the one above it.
+    for (uint32_t level = 1; level < levelCount; ++level) {
+        int srcWidth = std::max(fittedWidth >> (level - 1), 1), srcHeight = std::max(fittedHeight >> (level - 1), 1);
+        int dstWidth = std::max(fittedWidth >> level, 1), dstHeight = std::max(fittedHeight >> level, 1);
+        ImageResize::resizeRgba8(pixels + TextureCache::levelOffset(description, level - 1), srcWidth, srcHeight, 4 * srcWidth,
+                                 pixels + TextureCache::levelOffset(description, level), dstWidth, dstHeight, 4 * dstWidth,
+                                 options.resizeFilter);
+    }
+    return pixels;
+}
+
+uint8_t* Texture::decodeHdr(const MappedFile& file, const TextureOptions& options, TextureCache::Description& description) {
+    int sourceWidth = 0, sourceHeight = 0, sourceChannels = 0;
+    float* image = stbi_loadf_from_memory(file.data, int(file.size), &sourceWidth, &sourceHeight, &sourceChannels, STBI_rgb);
+    assert(image != NULL);
+
+    const int downscale = hdrDownscaleFor(options, sourceWidth, sourceHeight);
+    const int hdrWidth = std::max(1, sourceWidth / downscale);
+    const int hdrHeight = std::max(1, sourceHeight / downscale);
+
+    // RGBA16Float halves the upload of RGBA32Float and is filterable everywhere.
+    // HDR textures are not mipmapped.
+    description = {uint32_t(MTL::PixelFormatRGBA16Float), 8, uint32_t(hdrWidth), uint32_t(hdrHeight),
+                   uint32_t(sourceChannels), 1};
+    uint16_t* pixels = static_cast<uint16_t*>(StbImagePool::allocate(TextureCache::dataSize(description)));
+    ThreadPool::shared().parallelFor(hdrHeight, 16, [&](size_t begin, size_t end) {
+        std::vector<float> reduced(downscale > 1 ? 3 * hdrWidth : 0);
+        for (size_t y = begin; y < end; ++y) {
+            const float* row = image + y * 3 * sourceWidth;
+            if (downscale > 1) {
+                int y0 = int(y) * downscale;
+                int y1 = std::min(y0 + downscale, sourceHeight);
+                for (int x = 0; x < hdrWidth; ++x) {
+                    int x0 = x * downscale;
+                    int x1 = std::min(x0 + downscale, sourceWidth);
+                    float sum[3] = {0.0f, 0.0f, 0.0f};
+                    float weightSum = 0.0f;
+                    for (int sy = y0; sy < y1; ++sy) {
+                        const float* texel = image + (size_t(sy) * sourceWidth + x0) * 3;
+                        for (int sx = x0; sx < x1; ++sx, texel += 3) {
+                            float luminance = 0.2126f * texel[0] + 0.7152f * texel[1] + 0.0722f * texel[2];
+                            float weight = 1.0f / (1.0f + std::max(luminance, 0.0f));
+                            sum[0] += texel[0] * weight;
+                            sum[1] += texel[1] * weight;
+                            sum[2] += texel[2] * weight;
+                            weightSum += weight;
+                        }
+                    }
+                    for (int c = 0; c < 3; ++c) {
+                        reduced[x * 3 + c] = sum[c] / weightSum;
+                    }
+                }
+                row = reduced.data();
+            }
+            PixelConvert::rgb32fToRgba16f(row, pixels + (hdrHeight - 1 - y) * 4 * hdrWidth, hdrWidth);
+        }
+    });
     stbi_image_free(image);
+    return reinterpret_cast<uint8_t*>(pixels);
 }
 
-Texture::~Texture() {
-    texture->release();
+bool Texture::loadQoiStreaming(const MappedFile& file, const TextureOptions& options) {
+    Qoi::Decoder decoder;
+    if (!decoder.open(file.data, file.size)) {
+        return false;
+    }
+    width = decoder.header().width;
+    height = decoder.header().height;
+    channels = decoder.header().channels;
+
+    // Resampling needs the whole image.
+    int fittedWidth, fittedHeight;
+    ImageResize::fitWithin(width, height, options.maxDimension, options.maxBytes, 4, fittedWidth, fittedHeight);
+    if (fittedWidth != width || fittedHeight != height) {
+        return false;
+    }
+
+    createTexture();
+
+    // Rows are flipped like the stb path, so the first band decoded fills
+    // the bottom of the texture.
+    constexpr int kBandRows = 64;
+    NS::UInteger bytesPerRow = 4 * width;
+    std::vector<uint8_t> band(bytesPerRow * std::min(kBandRows, height));
+    for (int decodedRows = 0; decodedRows < height; ) {
+        int rows = std::min(kBandRows, height - decodedRows);
+        [[maybe_unused]] bool decoded = decoder.decodeRows(band.data(), bytesPerRow, rows, true);
+        assert(decoded);
+        MTL::Region region = MTL::Region(0, height - decodedRows - rows, 0, width, rows, 1);
+        texture->replaceRegion(region, 0, band.data(), bytesPerRow);
+        decodedRows += rows;
+    }
+    return true;
 }
@@ -1,13 +1,62 @@
 #pragma once
+#include <functional>
+
 #include <Metal/Metal.hpp>
 #include <stb/stb_image.h>
+
+#include "image_resize.hpp"
+#include "texture_cache.hpp"
+#include "upload_queue.hpp"
+
+struct TextureOptions {
+    // Radiance (.hdr) images are box-reduced by this factor on load, with
+    // each texel weighted by 1 / (1 + luminance) so isolated bright
+    // texels don't bloom into whole blocks.
+    int hdrDownscale = 1;
+    // Larger images are resampled down to fit before upload; 0 disables
+    // a limit.
+    int maxDimension = 0;
+    size_t maxBytes = 0;
+    ImageResize::Filter resizeFilter = ImageResize::Filter::Lanczos3;
+    // Builds the full mip chain on the CPU (RGBA8 images only).
+    bool mipmapped = false;
+    // When set, decoded results are stored in and served from this cache.
+    TextureCache* cache = nullptr;
+    // Leaves out the largest levels, e.g. when the residency budget is tight.
+    uint32_t firstLevel = 0;
+    // When set, pixels are handed to this queue and copied over the next
+    // frames instead of with replaceRegion in the constructor.
+    UploadQueue* uploads = nullptr;
+};
+
 class Texture {
 public:
-    Texture(const char* filepath, MTL::Device* metalDevice);
+    Texture(const char* filepath, MTL::Device* metalDevice, const TextureOptions& options = {});
     ~Texture();
+
+    // Size, format and level count the texture will have, from the file
+    // header alone (firstLevel is ignored).
+    static TextureCache::Description describe(const char* filepath, const TextureOptions& options = {});
+
     MTL::Texture* texture;
     int width, height, channels;
+    // Last upload request when loaded through an UploadQueue; the contents
+    // are usable once the queue reports it submitted.
+    UploadToken uploadToken;
 
 private:
+    void createTexture(MTL::PixelFormat pixelFormat = MTL::PixelFormatRGBA8Unorm, NS::UInteger levelCount = 1);
+    // Calls release once pixels are no longer needed.
+    void upload(const TextureCache::Description& description, const uint8_t* pixels, uint32_t firstLevel,
+                std::function<void()> release);
+    // Decoders return every level packed as described, allocated from StbImagePool.
+    uint8_t* decodeRgba8(const MappedFile& file, const TextureOptions& options, TextureCache::Description& description);
+    // Float images become RGBA16Float.
+    uint8_t* decodeHdr(const MappedFile& file, const TextureOptions& options, TextureCache::Description& description);
+    // Decodes QOI band by band straight into the texture. Returns false,
+    // without creating the texture, when the image must be resampled.
+    bool loadQoiStreaming(const MappedFile& file, const TextureOptions& options);
+
     MTL::Device* device;
+    UploadQueue* uploads;
 };
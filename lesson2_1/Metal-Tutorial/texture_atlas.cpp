@@ -0,0 +1,74 @@
+//
+//  texture_atlas.cpp
+//  Metal-Guide
+//
+
+#include "texture_atlas.hpp"
+
+#include <cstring>
+
+#include "pixel_convert.hpp"
+#include "stb/stb_image.h"
+
+TextureAtlas::TextureAtlas(MTL::Device* metalDevice, int width, int height, int padding)
+    : packer(width, height), padding(padding) {
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setWidth(width);
+    textureDescriptor->setHeight(height);
+
+    texture = metalDevice->newTexture(textureDescriptor);
+    textureDescriptor->release();
+}
+
+TextureAtlas::~TextureAtlas() {
+    texture->release();
+}
+
+bool TextureAtlas::add(const uint8_t* pixels, int width, int height, AtlasRegion& region) {
+    const int paddedWidth = width + 2 * padding;
+    const int paddedHeight = height + 2 * padding;
+    int x, y;
+    if (!packer.insert(paddedWidth, paddedHeight, x, y)) {
+        return false;
+    }
+
+    // Stage the sprite with its edge texels replicated into the gutter, and
+    // upload just that rectangle.
+    const size_t paddedBytesPerRow = size_t(paddedWidth) * 4;
+    staging.resize(paddedBytesPerRow * paddedHeight);
+    for (int row = 0; row < height; ++row) {
+        const uint8_t* src = pixels + size_t(row) * width * 4;
+        uint8_t* dst = &staging[(row + padding) * paddedBytesPerRow];
+        for (int i = 0; i < padding; ++i) {
+            memcpy(dst + i * 4, src, 4);
+            memcpy(dst + (padding + width + i) * 4, src + (width - 1) * 4, 4);
+        }
+        memcpy(dst + padding * 4, src, size_t(width) * 4);
+    }
+    for (int i = 0; i < padding; ++i) {
+        memcpy(&staging[i * paddedBytesPerRow], &staging[padding * paddedBytesPerRow], paddedBytesPerRow);
+        memcpy(&staging[(padding + height + i) * paddedBytesPerRow],
+               &staging[(padding + height - 1) * paddedBytesPerRow], paddedBytesPerRow);
+    }
+
+    MTL::Region uploadRegion = MTL::Region(x, y, 0, paddedWidth, paddedHeight, 1);
+    texture->replaceRegion(uploadRegion, 0, staging.data(), paddedBytesPerRow);
+
+    region = {{float(x + padding) / packer.width(), float(y + padding) / packer.height()},
+              {float(width) / packer.width(), float(height) / packer.height()}};
+    spriteArea += uint64_t(width) * height;
+    return true;
+}
+
+bool TextureAtlas::addFile(const char* filepath, AtlasRegion& region) {
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(filepath, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        return false;
+    }
+    PixelConvert::flipVertically(pixels, 4 * width, height);
+    bool added = add(pixels, width, height, region);
+    stbi_image_free(pixels);
+    return added;
+}
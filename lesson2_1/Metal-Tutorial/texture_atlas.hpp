@@ -0,0 +1,62 @@
+//
+//  texture_atlas.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Metal/Metal.hpp>
+
+#include "atlas_packer.hpp"
+
+// Where a sprite ended up: atlas UV = offset + sprite UV * scale.
+struct AtlasRegion {
+    float offset[2];
+    float scale[2];
+};
+
+// Rewrites sprite-space texture coordinates to point into the atlas. Works
+// on VertexData and on anything else with a two-component
+// textureCoordinate.
+template <typename Vertex>
+void remapTextureCoordinates(Vertex* vertices, size_t count, const AtlasRegion& region) {
+    for (size_t i = 0; i < count; ++i) {
+        for (int axis = 0; axis < 2; ++axis) {
+            vertices[i].textureCoordinate[axis] =
+                region.offset[axis] + vertices[i].textureCoordinate[axis] * region.scale[axis];
+        }
+    }
+}
+
+// RGBA8 atlas that many small images share, so draws using any of them can
+// be batched under one setFragmentTexture. Images can be added at any time;
+// each add uploads only its own rectangle.
+class TextureAtlas {
+public:
+    // padding texels of replicated edge pixels surround every sprite, so
+    // bilinear filtering never samples a neighbour. The atlas has a single
+    // mip level; minified sprites would need mips built per sprite.
+    TextureAtlas(MTL::Device* metalDevice, int width, int height, int padding = 4);
+    ~TextureAtlas();
+
+    // Copies an RGBA8 image (rows in texture order) into the atlas.
+    // Returns false when it no longer fits.
+    bool add(const uint8_t* pixels, int width, int height, AtlasRegion& region);
+    // Loads an image file the same way Texture does, then adds it.
+    bool addFile(const char* filepath, AtlasRegion& region);
+
+    double occupancy() const { return double(spriteArea) / (double(packer.width()) * packer.height()); }
+
+    MTL::Texture* texture;
+
+private:
+    AtlasPacker packer;
+    int padding;
+    uint64_t spriteArea{0};
+    // The padded sprite being uploaded, reused across adds.
+    std::vector<uint8_t> staging;
+};
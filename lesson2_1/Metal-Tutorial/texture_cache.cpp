@@ -0,0 +1,243 @@
+//
+//  texture_cache.cpp
+//  Metal-Guide
+//
+
+#include "texture_cache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4354474d;  // "MGTC"
+constexpr uint32_t kVersion = 1;
+constexpr const char* kExtension = ".mgtc";
+
+// Padded to 64 bytes so level data starts cache-line (and SIMD) aligned.
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    TextureCache::Description description;
+    uint64_t dataSize;
+    uint8_t reserved[64 - 48];
+};
+static_assert(sizeof(FileHeader) == 64);
+
+constexpr uint64_t kPrime1 = 11400714785074694791ull;
+constexpr uint64_t kPrime2 = 14029467366897019727ull;
+constexpr uint64_t kPrime3 = 1609587929392839161ull;
+constexpr uint64_t kPrime4 = 9650029242287828579ull;
+constexpr uint64_t kPrime5 = 2870177450012600261ull;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    return rotl(acc, 31) * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= mixRound(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+}
+
+size_t TextureCache::levelOffset(const Description& description, uint32_t level) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; ++i) {
+        size_t width = std::max(description.width >> i, 1u);
+        size_t height = std::max(description.height >> i, 1u);
+        offset += width * height * description.bytesPerPixel;
+    }
+    return offset;
+}
+
+TextureCache::TextureCache(std::string directory, uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+}
+
+std::string TextureCache::defaultDirectory() {
+#ifdef __APPLE__
+    const char* home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/Library/Caches/metal-guide";
+#else
+    if (const char* cacheHome = getenv("XDG_CACHE_HOME")) {
+        return std::string(cacheHome) + "/metal-guide";
+    }
+    const char* home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/metal-guide";
+#endif
+}
+
+uint64_t TextureCache::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = mixRound(v1, read64(p));
+            v2 = mixRound(v2, read64(p + 8));
+            v3 = mixRound(v3, read64(p + 16));
+            v4 = mixRound(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + kPrime5;
+    }
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= mixRound(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string TextureCache::pathFor(uint64_t key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory + "/" + name + kExtension;
+}
+
+std::unique_ptr<TextureCache::Entry> TextureCache::find(uint64_t key) {
+    const std::string path = pathFor(key);
+    std::unique_ptr<Entry> entry(new Entry(path));
+
+    FileHeader header;
+    bool valid = entry->file.isOpen() && entry->file.size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, entry->file.data, sizeof(header));
+        valid = header.magic == kMagic && header.version == kVersion && header.key == key &&
+                header.description.levelCount > 0 &&
+                header.dataSize == dataSize(header.description) &&
+                entry->file.size == sizeof(header) + header.dataSize;
+    }
+    if (!valid) {
+        ++missCount;
+        return nullptr;
+    }
+
+    entry->desc = header.description;
+    entry->pixels = entry->file.data + sizeof(header);
+    // The modification time doubles as the LRU timestamp.
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    ++hitCount;
+    return entry;
+}
+
+bool TextureCache::store(uint64_t key, const Description& description, const uint8_t* pixels) {
+    FileHeader header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.key = key;
+    header.description = description;
+    header.dataSize = dataSize(description);
+
+    // Write under a private name and rename into place, so readers in other
+    // processes never map a partial entry.
+    const std::string path = pathFor(key);
+    const std::string temporaryPath = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(pixels), std::streamsize(header.dataSize));
+        if (!out) {
+            out.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    trim();
+    return true;
+}
+
+void TextureCache::trim() {
+    struct File {
+        std::filesystem::file_time_type lastUse;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+    std::vector<File> files;
+    uint64_t totalBytes = 0;
+
+    std::error_code error;
+    for (const auto& item : std::filesystem::directory_iterator(directory, error)) {
+        if (item.path().extension() != kExtension) {
+            continue;
+        }
+        std::error_code itemError;
+        uint64_t size = item.file_size(itemError);
+        auto lastUse = item.last_write_time(itemError);
+        if (itemError) {
+            continue;
+        }
+        files.push_back({lastUse, size, item.path()});
+        totalBytes += size;
+    }
+    if (totalBytes <= maxBytes) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.lastUse < b.lastUse; });
+    for (const File& file : files) {
+        if (totalBytes <= maxBytes) {
+            break;
+        }
+        if (std::filesystem::remove(file.path, error)) {
+            totalBytes -= file.size;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+//
+//  texture_cache.hpp
+//  Metal-Guide
+//
+//  Persistent cache of decoded textures. Each entry is one file holding a
+//  small header followed by every mip level exactly as it is uploaded, so a
+//  hit is an mmap with no decoding or conversion. Entries are keyed by a
+//  hash of the source file's bytes and the load options.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mapped_file.hpp"
+
+class TextureCache {
+public:
+    struct Description {
+        uint32_t pixelFormat;    // MTL::PixelFormat value
+        uint32_t bytesPerPixel;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;       // channel count of the source image
+        uint32_t levelCount;
+    };
+
+    // Bytes of all levels, each tightly packed, level 0 first.
+    static size_t levelOffset(const Description& description, uint32_t level);
+    static size_t dataSize(const Description& description) { return levelOffset(description, description.levelCount); }
+
+    // A cache hit, served straight from the mapped entry.
+    class Entry {
+    public:
+        const Description& description() const { return desc; }
+        const uint8_t* level(uint32_t index) const { return pixels + levelOffset(desc, index); }
+
+    private:
+        friend class TextureCache;
+        explicit Entry(const std::string& path) : file(path.c_str()) {}
+
+        MappedFile file;
+        Description desc{};
+        const uint8_t* pixels{nullptr};
+    };
+
+    // Least recently used entries are deleted once the directory holds more
+    // than maxBytes.
+    explicit TextureCache(std::string directory = defaultDirectory(), uint64_t maxBytes = uint64_t(2) << 30);
+
+    // ~/Library/Caches/metal-guide on macOS, $XDG_CACHE_HOME/metal-guide elsewhere.
+    static std::string defaultDirectory();
+
+    // XXH64 of the given bytes.
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+
+    std::unique_ptr<Entry> find(uint64_t key);
+    bool store(uint64_t key, const Description& description, const uint8_t* pixels);
+    void trim();
+
+    uint64_t hits() const { return hitCount; }
+    uint64_t misses() const { return missCount; }
+
+private:
+    std::string pathFor(uint64_t key) const;
+
+    std::string directory;
+    uint64_t maxBytes;
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+};
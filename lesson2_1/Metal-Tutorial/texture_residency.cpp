@@ -0,0 +1,164 @@
+//
+//  texture_residency.cpp
+//  Metal-Guide
+//
+
+#include "texture_residency.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+TextureHandle::TextureHandle(const TextureHandle& other) : owner(other.owner), textureId(other.textureId) {
+    if (owner) {
+        owner->retain(textureId);
+    }
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) noexcept
+    : owner(std::exchange(other.owner, nullptr)), textureId(other.textureId) {}
+
+TextureHandle& TextureHandle::operator=(TextureHandle other) noexcept {
+    std::swap(owner, other.owner);
+    std::swap(textureId, other.textureId);
+    return *this;
+}
+
+TextureHandle::~TextureHandle() {
+    if (owner) {
+        owner->release(textureId);
+    }
+}
+
+TextureResidency::TextureResidency(TextureAllocator& allocator, uint64_t budgetBytes)
+    : allocator(allocator), budgetBytes(budgetBytes) {}
+
+TextureResidency::~TextureResidency() {
+    for (uint32_t id : lru) {
+        allocator.evict(id);
+    }
+}
+
+uint64_t TextureResidency::levelBytes(const TextureDescription& description, uint32_t level) {
+    uint64_t width = std::max(description.width >> level, 1u);
+    uint64_t height = std::max(description.height >> level, 1u);
+    return width * height * description.bytesPerPixel;
+}
+
+uint64_t TextureResidency::bytesFrom(const TextureDescription& description, uint32_t firstLevel) {
+    uint64_t bytes = 0;
+    for (uint32_t level = firstLevel; level < description.levelCount; ++level) {
+        bytes += levelBytes(description, level);
+    }
+    return bytes;
+}
+
+TextureHandle TextureResidency::add(const TextureDescription& description) {
+    assert(description.levelCount > 0);
+    uint32_t id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = uint32_t(records.size());
+        records.emplace_back();
+    }
+    records[id] = Record{description, 1, description.levelCount, 0, lru.end()};
+    return TextureHandle(this, id);
+}
+
+void TextureResidency::release(uint32_t id) {
+    Record& record = records[id];
+    assert(record.refCount > 0);
+    if (--record.refCount == 0) {
+        evict(record, id);
+        freeIds.push_back(id);
+    }
+}
+
+bool TextureResidency::use(uint32_t id, uint32_t level) {
+    Record& record = records[id];
+    level = std::min(level, record.description.levelCount - 1);
+    record.lastUsedFrame = frame;
+
+    if (record.firstResidentLevel <= level) {
+        ++counters.hits;
+        lru.splice(lru.begin(), lru, record.lruPosition);
+        return true;
+    }
+    if (!allocator.makeResident(id, level)) {
+        return false;
+    }
+    counters.loadedBytes += bytesFrom(record.description, level) - bytesFrom(record.description, record.firstResidentLevel);
+    ++counters.loads;
+    makeResident(record, id, level);
+    enforceBudget();
+    return true;
+}
+
+void TextureResidency::setBudget(uint64_t bytes) {
+    budgetBytes = bytes;
+    enforceBudget();
+}
+
+void TextureResidency::makeResident(Record& record, uint32_t id, uint32_t firstLevel) {
+    counters.residentBytes -= bytesFrom(record.description, record.firstResidentLevel);
+    counters.residentBytes += bytesFrom(record.description, firstLevel);
+    counters.peakBytes = std::max(counters.peakBytes, counters.residentBytes);
+
+    if (record.lruPosition == lru.end()) {
+        lru.push_front(id);
+        record.lruPosition = lru.begin();
+    } else {
+        lru.splice(lru.begin(), lru, record.lruPosition);
+    }
+    record.firstResidentLevel = firstLevel;
+}
+
+void TextureResidency::evict(Record& record, uint32_t id) {
+    if (record.lruPosition == lru.end()) {
+        return;
+    }
+    allocator.evict(id);
+    counters.residentBytes -= bytesFrom(record.description, record.firstResidentLevel);
+    lru.erase(record.lruPosition);
+    record.lruPosition = lru.end();
+    record.firstResidentLevel = record.description.levelCount;
+}
+
+void TextureResidency::enforceBudget() {
+    // Shed the least recently used texture's largest levels first, so it
+    // stays drawable at lower resolution for as long as possible before it
+    // goes entirely. Each reload costs a whole new texture, so the levels
+    // to keep are worked out first and the allocator is called once.
+    auto victim = lru.end();
+    while (counters.residentBytes > budgetBytes && victim != lru.begin()) {
+        --victim;
+        const uint32_t id = *victim;
+        Record& record = records[id];
+        if (record.lastUsedFrame == frame) {
+            continue;
+        }
+
+        const uint32_t lastLevel = record.description.levelCount - 1;
+        uint32_t firstLevel = record.firstResidentLevel;
+        uint64_t residentBytes = counters.residentBytes;
+        while (residentBytes > budgetBytes && firstLevel < lastLevel) {
+            residentBytes -= levelBytes(record.description, firstLevel);
+            ++firstLevel;
+        }
+        // Down to its last level and still over budget, the texture goes
+        // without being reloaded first.
+        if (residentBytes <= budgetBytes && firstLevel > record.firstResidentLevel &&
+            allocator.makeResident(id, firstLevel)) {
+            counters.mipEvictions += firstLevel - record.firstResidentLevel;
+            counters.residentBytes = residentBytes;
+            record.firstResidentLevel = firstLevel;
+        }
+        if (counters.residentBytes > budgetBytes) {
+            ++victim;
+            evict(record, id);
+            ++counters.textureEvictions;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+//
+//  texture_residency.hpp
+//  Metal-Guide
+//
+//  Keeps textures within a GPU memory budget. The policy only does
+//  bookkeeping; a TextureAllocator does the actual loading, so the same
+//  policy runs against Metal or against a fake allocator in simulations.
+//  Not thread-safe: use it from the render thread.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+struct TextureDescription {
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t bytesPerPixel;
+};
+
+class TextureAllocator {
+public:
+    virtual ~TextureAllocator() = default;
+    // Makes levels firstLevel..levelCount-1 of texture id resident,
+    // replacing whatever was resident before.
+    virtual bool makeResident(uint32_t id, uint32_t firstLevel) = 0;
+    // Frees everything texture id has resident.
+    virtual void evict(uint32_t id) = 0;
+};
+
+class TextureResidency;
+
+// Reference-counted texture registration; the texture is evicted and its id
+// recycled when the last handle goes away.
+class TextureHandle {
+public:
+    TextureHandle() = default;
+    TextureHandle(const TextureHandle& other);
+    TextureHandle(TextureHandle&& other) noexcept;
+    TextureHandle& operator=(TextureHandle other) noexcept;
+    ~TextureHandle();
+
+    uint32_t id() const { return textureId; }
+    explicit operator bool() const { return owner != nullptr; }
+
+private:
+    friend class TextureResidency;
+    TextureHandle(TextureResidency* owner, uint32_t id) : owner(owner), textureId(id) {}
+
+    TextureResidency* owner{nullptr};
+    uint32_t textureId{0};
+};
+
+class TextureResidency {
+public:
+    struct Stats {
+        uint64_t residentBytes;
+        uint64_t peakBytes;
+        uint64_t loadedBytes;
+        uint64_t hits;
+        uint64_t loads;
+        uint64_t mipEvictions;
+        uint64_t textureEvictions;
+    };
+
+    TextureResidency(TextureAllocator& allocator, uint64_t budgetBytes);
+    ~TextureResidency();
+
+    // Registers a texture without loading anything.
+    TextureHandle add(const TextureDescription& description);
+
+    // Textures used in the current frame are never evicted, even if that
+    // means going over budget.
+    void beginFrame() { ++frame; }
+
+    // Marks the texture as used and makes sure levels from `level` down are
+    // resident, loading them if needed. Returns false if loading failed.
+    bool use(uint32_t id, uint32_t level = 0);
+
+    void setBudget(uint64_t bytes);
+    uint64_t budget() const { return budgetBytes; }
+    const Stats& stats() const { return counters; }
+
+    // First resident level of a texture; levelCount when nothing is resident.
+    uint32_t firstResidentLevel(uint32_t id) const { return records[id].firstResidentLevel; }
+
+    static uint64_t levelBytes(const TextureDescription& description, uint32_t level);
+    static uint64_t bytesFrom(const TextureDescription& description, uint32_t firstLevel);
+
+private:
+    friend class TextureHandle;
+
+    struct Record {
+        TextureDescription description;
+        uint32_t refCount;
+        uint32_t firstResidentLevel;
+        uint64_t lastUsedFrame;
+        std::list<uint32_t>::iterator lruPosition;
+    };
+
+    void retain(uint32_t id) { ++records[id].refCount; }
+    void release(uint32_t id);
+    void makeResident(Record& record, uint32_t id, uint32_t firstLevel);
+    void evict(Record& record, uint32_t id);
+    void enforceBudget();
+
+    TextureAllocator& allocator;
+    uint64_t budgetBytes;
+    uint64_t frame{0};
+    Stats counters{};
+    std::vector<Record> records;
+    std::vector<uint32_t> freeIds;
+    // Resident textures, most recently used first.
+    std::list<uint32_t> lru;
+};
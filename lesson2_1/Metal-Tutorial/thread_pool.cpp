@@ -0,0 +1,100 @@
+//
+//  thread_pool.cpp
+//  Metal-Guide
+//
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    // The caller of parallelFor is one of the threads.
+    unsigned workerCount = std::max(threadCount, 1u) - 1;
+    workers.reserve(workerCount);
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    grainSize = std::max<size_t>(grainSize, 1);
+    const size_t chunkCount = std::min<size_t>(std::max<size_t>(count / grainSize, 1), size_t(threadCount()) * 4);
+    if (chunkCount <= 1 || workers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    struct Job {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto job = std::make_shared<Job>();
+
+    // Helpers hold the job alive; one that starts after all chunks are taken just returns.
+    // Chunk boundaries are chunk * count / chunkCount, so no chunk is empty or past the end.
+    auto runChunks = [job, count, chunkCount, &fn] {
+        for (size_t chunk; (chunk = job->next.fetch_add(1)) < chunkCount; ) {
+            fn(chunk * count / chunkCount, (chunk + 1) * count / chunkCount);
+            if (job->done.fetch_add(1) + 1 == chunkCount) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min<size_t>(workers.size(), chunkCount - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(runChunks);
+    }
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&] { return job->done.load() == chunkCount; });
+}
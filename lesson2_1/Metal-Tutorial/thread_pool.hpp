@@ -0,0 +1,43 @@
+//
+//  thread_pool.hpp
+//  Metal-Guide
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel CPU work (image rows,
+// tiles, draw partitions). parallelFor blocks until all chunks are done;
+// the calling thread works on chunks too, so nested calls cannot deadlock.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& shared();
+
+    // Calls fn(begin, end) over [0, count) in chunks of at least grainSize items.
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn);
+    // Queues a fire-and-forget task.
+    void submit(std::function<void()> task);
+
+    unsigned threadCount() const { return unsigned(workers.size()) + 1; }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping{false};
+};
@@ -0,0 +1,179 @@
+//
+//  tiled_image.cpp
+//  Metal-Guide
+//
+
+#include "tiled_image.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "image_resize.hpp"
+#include "qoi.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x5456474d;  // "MGVT"
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    TiledImage::Info info;
+    uint32_t tileCount;
+};
+static_assert(sizeof(FileHeader) == 32);
+
+// Copies the page for tile (x, y), border included, clamping reads to the level.
+void extractPage(const uint8_t* level, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t border,
+                 uint32_t x, uint32_t y, uint8_t* page) {
+    const uint32_t pageSize = tileSize + 2 * border;
+    const int64_t left = int64_t(x) * tileSize - border;
+    const int64_t top = int64_t(y) * tileSize - border;
+    for (uint32_t row = 0; row < pageSize; ++row) {
+        const int64_t sourceY = std::clamp<int64_t>(top + row, 0, height - 1);
+        const uint32_t* sourceRow = reinterpret_cast<const uint32_t*>(level + size_t(sourceY) * width * 4);
+        uint32_t* pageRow = reinterpret_cast<uint32_t*>(page + size_t(row) * pageSize * 4);
+        for (uint32_t column = 0; column < pageSize; ++column) {
+            pageRow[column] = sourceRow[std::clamp<int64_t>(left + column, 0, width - 1)];
+        }
+    }
+}
+
+}
+
+TiledImage::TiledImage(const char* filepath) : file(filepath) {
+    FileHeader header;
+    if (!file.isOpen() || file.size < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, file.data, sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion || header.info.tileSize == 0 ||
+        header.info.tileSize % 2 != 0 || header.info.width == 0 || header.info.height == 0 ||
+        header.info.levelCount != levelCountFor(header.info.width, header.info.height, header.info.tileSize)) {
+        return;
+    }
+    desc = header.info;
+
+    uint32_t tileCount = 0;
+    for (uint32_t level = 0; level < desc.levelCount; ++level) {
+        levelStart[level] = tileCount;
+        tileCount += tilesX(level) * tilesY(level);
+    }
+    const size_t dataStart = sizeof(header) + size_t(tileCount) * sizeof(IndexEntry);
+    if (header.tileCount != tileCount || file.size < dataStart) {
+        return;
+    }
+    const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(file.data + sizeof(header));
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        if (entries[i].offset < dataStart || entries[i].offset > file.size ||
+            entries[i].size > file.size - entries[i].offset) {
+            return;
+        }
+    }
+    index = entries;
+}
+
+uint32_t TiledImage::levelWidth(uint32_t level) const {
+    return std::max(desc.width >> level, 1u);
+}
+
+uint32_t TiledImage::levelHeight(uint32_t level) const {
+    return std::max(desc.height >> level, 1u);
+}
+
+uint32_t TiledImage::levelCountFor(uint32_t width, uint32_t height, uint32_t tileSize) {
+    uint32_t levelCount = 1;
+    while (std::max(width, height) > tileSize) {
+        width = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+        ++levelCount;
+    }
+    return levelCount;
+}
+
+const TiledImage::IndexEntry* TiledImage::entry(uint32_t level, uint32_t x, uint32_t y) const {
+    return index + levelStart[level] + y * tilesX(level) + x;
+}
+
+size_t TiledImage::tileBytes(uint32_t level, uint32_t x, uint32_t y) const {
+    return size_t(entry(level, x, y)->size);
+}
+
+bool TiledImage::decodeTile(uint32_t level, uint32_t x, uint32_t y, uint8_t* dst) const {
+    if (level >= desc.levelCount || x >= tilesX(level) || y >= tilesY(level)) {
+        return false;
+    }
+    const IndexEntry* tile = entry(level, x, y);
+    Qoi::Decoder decoder;
+    if (!decoder.open(file.data + tile->offset, size_t(tile->size)) ||
+        decoder.header().width != pageSize() || decoder.header().height != pageSize()) {
+        return false;
+    }
+    return decoder.decodeRows(dst, size_t(pageSize()) * 4, pageSize());
+}
+
+bool TiledImage::write(const char* filepath, const uint8_t* pixels, uint32_t width, uint32_t height,
+                       uint32_t tileSize, uint32_t border) {
+    if (width == 0 || height == 0 || tileSize == 0 || tileSize % 2 != 0) {
+        return false;
+    }
+    FileHeader header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.info = {width, height, tileSize, border, levelCountFor(width, height, tileSize)};
+
+    // Each level is filtered from the one above it, as Texture does.
+    std::vector<std::vector<uint8_t>> levels(header.info.levelCount);
+    levels[0].assign(pixels, pixels + size_t(width) * height * 4);
+    for (uint32_t level = 1; level < header.info.levelCount; ++level) {
+        int srcWidth = std::max(int(width >> (level - 1)), 1), srcHeight = std::max(int(height >> (level - 1)), 1);
+        int dstWidth = std::max(int(width >> level), 1), dstHeight = std::max(int(height >> level), 1);
+        levels[level].resize(size_t(dstWidth) * dstHeight * 4);
+        ImageResize::resizeRgba8(levels[level - 1].data(), srcWidth, srcHeight, 4 * size_t(srcWidth),
+                                 levels[level].data(), dstWidth, dstHeight, 4 * size_t(dstWidth));
+    }
+
+    std::vector<std::vector<uint8_t>> tiles;
+    const uint32_t pageSize = tileSize + 2 * border;
+    for (uint32_t level = 0; level < header.info.levelCount; ++level) {
+        const uint32_t levelWidth = std::max(width >> level, 1u), levelHeight = std::max(height >> level, 1u);
+        const uint32_t columns = (levelWidth + tileSize - 1) / tileSize;
+        const uint32_t rows = (levelHeight + tileSize - 1) / tileSize;
+        const size_t first = tiles.size();
+        tiles.resize(first + size_t(columns) * rows);
+        ThreadPool::shared().parallelFor(size_t(columns) * rows, 4, [&](size_t begin, size_t end) {
+            std::vector<uint8_t> page(size_t(pageSize) * pageSize * 4);
+            for (size_t i = begin; i < end; ++i) {
+                extractPage(levels[level].data(), levelWidth, levelHeight, tileSize, border,
+                            uint32_t(i % columns), uint32_t(i / columns), page.data());
+                tiles[first + i] = Qoi::encode(page.data(), pageSize, pageSize, 4);
+            }
+        });
+    }
+    header.tileCount = uint32_t(tiles.size());
+
+    std::vector<IndexEntry> entries(tiles.size());
+    uint64_t offset = sizeof(header) + entries.size() * sizeof(IndexEntry);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        entries[i] = {offset, tiles[i].size()};
+        offset += tiles[i].size();
+    }
+
+    std::ofstream out(filepath, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(IndexEntry)));
+    for (const auto& tile : tiles) {
+        out.write(reinterpret_cast<const char*>(tile.data()), std::streamsize(tile.size()));
+    }
+    if (!out) {
+        out.close();
+        std::remove(filepath);
+        return false;
+    }
+    return true;
+}
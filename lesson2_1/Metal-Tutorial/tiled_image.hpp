@@ -0,0 +1,70 @@
+//
+//  tiled_image.hpp
+//  Metal-Guide
+//
+//  Source format for virtual textures: every mip level cut into square
+//  tiles, each stored as its own QOI image so any tile decodes on its own.
+//  Tiles carry a border copied from their neighbours (clamped at the image
+//  edge), which lets bilinear filtering in the tile cache read across page
+//  boundaries without seams.
+//
+//  Layout: a 32-byte header, then one index entry per tile, level 0 first
+//  and row-major within a level, then the QOI data.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mapped_file.hpp"
+
+class TiledImage {
+public:
+    struct Info {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tileSize;    // texels of the level each tile covers
+        uint32_t border;      // extra texels on every side of a tile
+        uint32_t levelCount;  // down to the first level that fits in one tile
+    };
+
+    explicit TiledImage(const char* filepath);
+
+    bool isOpen() const { return index != nullptr; }
+    const Info& info() const { return desc; }
+
+    uint32_t levelWidth(uint32_t level) const;
+    uint32_t levelHeight(uint32_t level) const;
+    uint32_t tilesX(uint32_t level) const { return (levelWidth(level) + desc.tileSize - 1) / desc.tileSize; }
+    uint32_t tilesY(uint32_t level) const { return (levelHeight(level) + desc.tileSize - 1) / desc.tileSize; }
+    // Side of a decoded tile, border included.
+    uint32_t pageSize() const { return desc.tileSize + 2 * desc.border; }
+    // Compressed size of one tile.
+    size_t tileBytes(uint32_t level, uint32_t x, uint32_t y) const;
+
+    // Decodes tile (x, y) of a level as pageSize() x pageSize() RGBA8 pixels,
+    // tightly packed. Safe to call from several threads at once.
+    bool decodeTile(uint32_t level, uint32_t x, uint32_t y, uint8_t* dst) const;
+
+    // Builds the mip chain of an RGBA8 image (rows in upload order) and
+    // writes it tiled. tileSize must be even so tiles halve cleanly.
+    static bool write(const char* filepath, const uint8_t* pixels, uint32_t width, uint32_t height,
+                      uint32_t tileSize = 128, uint32_t border = 4);
+
+    static uint32_t levelCountFor(uint32_t width, uint32_t height, uint32_t tileSize);
+
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    const IndexEntry* entry(uint32_t level, uint32_t x, uint32_t y) const;
+
+    MappedFile file;
+    Info desc{};
+    const IndexEntry* index{nullptr};
+    // First index entry of each level.
+    uint32_t levelStart[32]{};
+};
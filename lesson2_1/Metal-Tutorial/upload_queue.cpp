@@ -0,0 +1,208 @@
+//
+//  upload_queue.cpp
+//  Metal-Guide
+//
+
+#include "upload_queue.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+// Satisfies the buffer-offset alignment of texture copies for every
+// uncompressed pixel format.
+constexpr size_t kStagingAlignment = 16;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+size_t StagingRing::available(size_t alignment) const {
+    if (usedBytes == 0) {
+        return capacity;
+    }
+    const size_t aligned = alignUp(head, alignment);
+    if (head > tail) {
+        // Free space runs from head to the end and from the start to tail.
+        return std::max(aligned < capacity ? capacity - aligned : 0, tail);
+    }
+    return aligned < tail ? tail - aligned : 0;
+}
+
+bool StagingRing::allocate(size_t size, size_t alignment, size_t& offset) {
+    if (usedBytes == 0) {
+        head = tail = 0;
+    }
+    const size_t aligned = alignUp(head, alignment);
+    size_t bytes;
+    if (head > tail || usedBytes == 0) {
+        if (aligned + size <= capacity) {
+            offset = aligned;
+            bytes = aligned - head + size;
+        } else if (size <= tail) {
+            // Skip the rest of the ring and start again at the beginning.
+            offset = 0;
+            bytes = capacity - head + size;
+        } else {
+            return false;
+        }
+    } else if (aligned + size <= tail) {
+        offset = aligned;
+        bytes = aligned - head + size;
+    } else {
+        return false;
+    }
+    head = offset + size;
+    usedBytes += bytes;
+    openBytes += bytes;
+    return true;
+}
+
+void StagingRing::close(uint64_t fence) {
+    if (openBytes > 0) {
+        spans.push_back({fence, head, openBytes});
+        openBytes = 0;
+    }
+}
+
+void StagingRing::retire(uint64_t completedFence) {
+    while (!spans.empty() && spans.front().fence <= completedFence) {
+        tail = spans.front().end;
+        usedBytes -= spans.front().bytes;
+        spans.pop_front();
+    }
+}
+
+UploadQueue::UploadQueue(UploadBackend& backend) : backend(backend), staging(backend.stagingSize()) {}
+
+UploadQueue::~UploadQueue() {
+    for (Request& request : pending) {
+        if (request.release) {
+            request.release();
+        }
+    }
+    if (lastFence > 0) {
+        backend.waitForFence(lastFence);
+    }
+}
+
+UploadToken UploadQueue::enqueue(void* texture, uint32_t level, uint32_t x, uint32_t y, uint32_t width,
+                                 uint32_t height, uint32_t bytesPerPixel, const uint8_t* pixels, size_t bytesPerRow,
+                                 std::function<void()> release) {
+    assert(width > 0 && height > 0);
+    assert(size_t(width) * bytesPerPixel <= staging.size());
+    UploadCopy region{texture, level, x, y, width, height, 0, 0};
+    pending.push_back({nextToken, region, bytesPerPixel, pixels, bytesPerRow, 0, std::move(release)});
+    queuedBytes += size_t(width) * height * bytesPerPixel;
+    return {nextToken++};
+}
+
+void UploadQueue::cancel(void* texture) {
+    for (auto it = pending.begin(); it != pending.end(); ) {
+        if (it->region.texture != texture) {
+            ++it;
+            continue;
+        }
+        queuedBytes -= size_t(it->region.width) * (it->region.height - it->rowsDone) * it->bytesPerPixel;
+        if (it->release) {
+            it->release();
+        }
+        it = pending.erase(it);
+    }
+}
+
+void UploadQueue::beginFrame() {
+    const uint64_t completed = backend.completedFence();
+    staging.retire(completed);
+    while (!inFlight.empty() && inFlight.front().fence <= completed) {
+        completedToken = inFlight.front().lastToken;
+        inFlight.pop_front();
+    }
+}
+
+void UploadQueue::flush(size_t byteBudget) {
+    size_t spent = 0;
+    uint64_t lastToken = 0;
+    bool copied = false;
+    while (!pending.empty()) {
+        Request& request = pending.front();
+        const size_t rowBytes = size_t(request.region.width) * request.bytesPerPixel;
+        size_t budgetRows = spent < byteBudget ? (byteBudget - spent) / rowBytes : 0;
+        if (!copied) {
+            budgetRows = std::max<size_t>(budgetRows, 1);
+        }
+        const size_t ringRows = staging.available(kStagingAlignment) / rowBytes;
+        const uint32_t rows = uint32_t(std::min<size_t>({request.region.height - request.rowsDone, budgetRows, ringRows}));
+        if (rows == 0) {
+            if (ringRows == 0) {
+                ++counters.ringStalls;
+            }
+            break;
+        }
+
+        size_t offset;
+        [[maybe_unused]] bool allocated = staging.allocate(rows * rowBytes, kStagingAlignment, offset);
+        assert(allocated);
+        uint8_t* dst = backend.stagingMemory() + offset;
+        const uint8_t* src = request.pixels + request.rowsDone * request.bytesPerRow;
+        if (request.bytesPerRow == rowBytes) {
+            memcpy(dst, src, rows * rowBytes);
+        } else {
+            for (uint32_t row = 0; row < rows; ++row) {
+                memcpy(dst + row * rowBytes, src + row * request.bytesPerRow, rowBytes);
+            }
+        }
+
+        UploadCopy copy = request.region;
+        copy.y += request.rowsDone;
+        copy.height = rows;
+        copy.stagingOffset = offset;
+        copy.bytesPerRow = rowBytes;
+        backend.copyToTexture(copy);
+        ++counters.copies;
+        copied = true;
+        spent += rows * rowBytes;
+        queuedBytes -= rows * rowBytes;
+
+        request.rowsDone += rows;
+        if (request.rowsDone == request.region.height) {
+            if (request.release) {
+                request.release();
+            }
+            lastToken = request.token;
+            pending.pop_front();
+        }
+    }
+    if (!copied) {
+        return;
+    }
+
+    lastFence = backend.submit();
+    staging.close(lastFence);
+    ++counters.submits;
+    counters.bytesUploaded += spent;
+    counters.maxFrameBytes = std::max<uint64_t>(counters.maxFrameBytes, spent);
+    if (lastToken > 0) {
+        submittedToken = lastToken;
+        inFlight.push_back({lastFence, lastToken});
+    }
+}
+
+void UploadQueue::finish() {
+    while (!pending.empty()) {
+        flush(SIZE_MAX);
+        if (!pending.empty()) {
+            // The ring is full of copies still in flight.
+            backend.waitForFence(lastFence);
+            beginFrame();
+        }
+    }
+    if (lastFence > 0) {
+        backend.waitForFence(lastFence);
+    }
+    beginFrame();
+}
@@ -0,0 +1,154 @@
+//
+//  upload_queue.hpp
+//  Metal-Guide
+//
+//  Moves texture uploads off the thread that decodes them. enqueue() only
+//  records the request; each frame, flush() copies up to a byte budget of
+//  pending rows into a staging ring and has the backend copy them into
+//  their textures, so a large texture arrives over several frames instead
+//  of stalling one. The ring and scheduling are backend-independent; an
+//  UploadBackend supplies the staging memory, the copies and the fences.
+//  Use it from one thread.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// One copy from the staging memory into a texture region.
+struct UploadCopy {
+    void* texture;       // backend-defined, e.g. an MTL::Texture*
+    uint32_t level;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    size_t stagingOffset;
+    size_t bytesPerRow;
+};
+
+class UploadBackend {
+public:
+    virtual ~UploadBackend() = default;
+    // CPU-visible memory the staging ring lives in.
+    virtual uint8_t* stagingMemory() = 0;
+    virtual size_t stagingSize() const = 0;
+    // Records a copy; it runs once the copies are submitted.
+    virtual void copyToTexture(const UploadCopy& copy) = 0;
+    // Submits the copies recorded since the last submit and returns their
+    // fence. Fences start at 1 and go up by one per submit.
+    virtual uint64_t submit() = 0;
+    // Highest fence whose copies have finished.
+    virtual uint64_t completedFence() = 0;
+    virtual void waitForFence(uint64_t fence) = 0;
+};
+
+// Ring allocator over the staging memory. Space is handed out in order and
+// comes back when the fence it was used under completes.
+class StagingRing {
+public:
+    explicit StagingRing(size_t capacity) : capacity(capacity) {}
+
+    // Largest block allocate() would currently succeed with.
+    size_t available(size_t alignment) const;
+    bool allocate(size_t size, size_t alignment, size_t& offset);
+    // Everything allocated since the last close() is freed once fence completes.
+    void close(uint64_t fence);
+    void retire(uint64_t completedFence);
+
+    size_t size() const { return capacity; }
+    size_t used() const { return usedBytes; }
+
+private:
+    struct Span {
+        uint64_t fence;
+        size_t end;
+        size_t bytes;  // including padding skipped at the end of the ring
+    };
+
+    size_t capacity;
+    size_t head{0};
+    size_t tail{0};
+    size_t usedBytes{0};
+    size_t openBytes{0};
+    std::deque<Span> spans;
+};
+
+// Tokens are handed out in enqueue order, and requests finish in that
+// order too, so a token is one number compared against a high-water mark.
+struct UploadToken {
+    uint64_t value{0};
+};
+
+class UploadQueue {
+public:
+    struct Stats {
+        uint64_t bytesUploaded;
+        uint64_t copies;
+        uint64_t submits;
+        uint64_t maxFrameBytes;
+        uint64_t ringStalls;  // flushes cut short by a full ring
+    };
+
+    explicit UploadQueue(UploadBackend& backend);
+    ~UploadQueue();
+
+    // Queues an upload of width x height pixels into one texture level.
+    // pixels must stay valid until release is called, which happens as soon
+    // as the last row has been copied into the staging ring.
+    UploadToken enqueue(void* texture, uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                        uint32_t bytesPerPixel, const uint8_t* pixels, size_t bytesPerRow,
+                        std::function<void()> release = {});
+
+    // Drops every request for texture that has not been fully copied yet,
+    // e.g. because the texture is being destroyed.
+    void cancel(void* texture);
+
+    // Retires finished copies. Call once per frame before flush().
+    void beginFrame();
+    // Stages and submits up to byteBudget bytes of pending rows. At least
+    // one row goes out per call, however small the budget.
+    void flush(size_t byteBudget);
+    // Flushes everything and waits for the device.
+    void finish();
+
+    // All copies of the request have been submitted, so work submitted
+    // after them on the same device queue sees the data.
+    bool isSubmitted(UploadToken token) const { return token.value <= submittedToken; }
+    // All copies of the request have finished on the device.
+    bool isComplete(UploadToken token) const { return token.value <= completedToken; }
+
+    size_t pendingBytes() const { return queuedBytes; }
+    const StagingRing& ring() const { return staging; }
+    const Stats& stats() const { return counters; }
+
+private:
+    struct Request {
+        uint64_t token;
+        UploadCopy region;
+        uint32_t bytesPerPixel;
+        const uint8_t* pixels;
+        size_t bytesPerRow;
+        uint32_t rowsDone;
+        std::function<void()> release;
+    };
+
+    struct Submission {
+        uint64_t fence;
+        uint64_t lastToken;  // requests up to here are fully in this or earlier submits
+    };
+
+    UploadBackend& backend;
+    StagingRing staging;
+    std::deque<Request> pending;
+    std::deque<Submission> inFlight;
+    uint64_t nextToken{1};
+    uint64_t submittedToken{0};
+    uint64_t completedToken{0};
+    uint64_t lastFence{0};
+    size_t queuedBytes{0};
+    Stats counters{};
+};
@@ -13,3 +13,12 @@ struct TransformationData {
     float4x4 viewMatrix;
     float4x4 perspectiveMatrix;
 };
+
+// Constants for sampleVirtualTexture in cube.metal.
+struct VirtualTextureParams {
+    uint2 size;               // level 0 texels
+    unsigned int tileSize;
+    unsigned int border;
+    unsigned int levelCount;
+    float2 cacheSize;         // tile cache texels
+};
@@ -0,0 +1,251 @@
+//
+//  virtual_texture.cpp
+//  Metal-Guide
+//
+
+#include "virtual_texture.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+VirtualTexture::VirtualTexture(const TiledImage& image, TileCacheBackend& backend, uint32_t cacheTilesX,
+                               uint32_t cacheTilesY, uint32_t maxInFlight, ThreadPool& pool)
+    : image(image), backend(backend), pool(pool), cacheTilesX(cacheTilesX), cacheTilesY(cacheTilesY),
+      maxInFlight(std::max(maxInFlight, 1u)) {
+    assert(image.isOpen());
+    assert(cacheTilesX * cacheTilesY >= 2 && cacheTilesX <= 255 && cacheTilesY <= 255);
+    assert(image.tilesX(0) <= 0x2000 && image.tilesY(0) <= 0x2000);
+
+    const uint32_t levelCount = image.info().levelCount;
+    pages.resize(levelCount);
+    indirection.resize(levelCount);
+    dirty.assign(levelCount, {UINT32_MAX, UINT32_MAX, 0, 0});
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        pages[level].resize(size_t(image.tilesX(level)) * image.tilesY(level));
+        indirection[level].resize(pages[level].size());
+    }
+
+    // Slot 0 holds the coarsest level for good; every other slot starts out
+    // free at the cold end of the LRU list.
+    slots.resize(size_t(cacheTilesX) * cacheTilesY);
+    slots[0].lruPosition = lru.end();
+    for (uint32_t i = 1; i < slots.size(); ++i) {
+        slots[i].lruPosition = lru.insert(lru.end(), i);
+    }
+    const uint32_t coarsest = levelCount - 1;
+    std::vector<uint8_t> pixels(size_t(image.pageSize()) * image.pageSize() * 4);
+    [[maybe_unused]] bool decodedCoarsest = image.decodeTile(coarsest, 0, 0, pixels.data());
+    assert(decodedCoarsest);
+    backend.uploadTile(0, 0, pixels.data());
+    slots[0].page = pageKey(coarsest, 0, 0);
+    page(coarsest, 0, 0) = Page{PageState::Resident, 0, 0};
+    refreshIndirection(coarsest, 0, 0);
+    uploadIndirection();
+}
+
+VirtualTexture::~VirtualTexture() {
+    waitForDecodes();
+}
+
+uint32_t VirtualTexture::indirectionWidth() const {
+    return std::bit_ceil(image.tilesX(0));
+}
+
+uint32_t VirtualTexture::indirectionHeight() const {
+    return std::bit_ceil(image.tilesY(0));
+}
+
+bool VirtualTexture::isResident(uint32_t level, uint32_t x, uint32_t y) const {
+    return pages[level][y * image.tilesX(level) + x].state == PageState::Resident;
+}
+
+void VirtualTexture::request(uint32_t level, uint32_t x, uint32_t y) {
+    assert(level < pages.size() && x < image.tilesX(level) && y < image.tilesY(level));
+    ++counters.requests;
+    Page& requested = page(level, x, y);
+    if (requested.state == PageState::Resident) {
+        ++counters.hits;
+        Slot& slot = slots[requested.slot];
+        slot.lastUsedFrame = frame;
+        if (slot.lruPosition != lru.end()) {
+            lru.splice(lru.begin(), lru, slot.lruPosition);
+        }
+        return;
+    }
+    if (requested.requestedFrame != frame) {
+        requested.requestedFrame = frame;
+        if (requested.state == PageState::Missing) {
+            missing.push_back(pageKey(level, x, y));
+        }
+    }
+}
+
+void VirtualTexture::update(uint32_t maxUploads) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (DecodedTile& tile : decoded) {
+            ready.push_back(std::move(tile));
+        }
+        decoded.clear();
+    }
+
+    // Map finished tiles, oldest first; the rest wait for the next frame.
+    const size_t mapCount = std::min<size_t>(ready.size(), maxUploads);
+    for (size_t i = 0; i < mapCount; ++i) {
+        DecodedTile& tile = ready[i];
+        --inFlight;
+        ++counters.decodes;
+        counters.decodedBytes += image.tileBytes(keyLevel(tile.page), keyX(tile.page), keyY(tile.page));
+        if (tile.pixels.empty()) {
+            ++counters.failed;
+            page(keyLevel(tile.page), keyX(tile.page), keyY(tile.page)).state = PageState::Missing;
+        } else {
+            map(tile.page, tile.pixels.data());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < mapCount; ++i) {
+            freeBuffers.push_back(std::move(ready[i].pixels));
+        }
+    }
+    ready.erase(ready.begin(), ready.begin() + ptrdiff_t(mapCount));
+
+    // Coarse pages cover more of the screen and back up everything finer,
+    // so they go first. Pages left over are requested again next frame if
+    // they are still wanted.
+    std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return keyLevel(a) > keyLevel(b); });
+    for (uint32_t key : missing) {
+        if (inFlight >= maxInFlight) {
+            break;
+        }
+        Page& wanted = page(keyLevel(key), keyX(key), keyY(key));
+        if (wanted.state != PageState::Missing) {
+            continue;
+        }
+        wanted.state = PageState::Decoding;
+        ++inFlight;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++running;
+        }
+        if (pool.threadCount() > 1) {
+            pool.submit([this, key] { decode(key); });
+        } else {
+            decode(key);
+        }
+    }
+    missing.clear();
+
+    uploadIndirection();
+}
+
+void VirtualTexture::waitForDecodes() {
+    std::unique_lock<std::mutex> lock(mutex);
+    decodesDone.wait(lock, [this] { return running == 0; });
+}
+
+void VirtualTexture::decode(uint32_t key) {
+    std::vector<uint8_t> pixels;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!freeBuffers.empty()) {
+            pixels = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    pixels.resize(size_t(image.pageSize()) * image.pageSize() * 4);
+    if (!image.decodeTile(keyLevel(key), keyX(key), keyY(key), pixels.data())) {
+        pixels.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded.push_back({key, std::move(pixels)});
+    if (--running == 0) {
+        decodesDone.notify_all();
+    }
+}
+
+void VirtualTexture::map(uint32_t key, const uint8_t* pixels) {
+    const uint32_t level = keyLevel(key), x = keyX(key), y = keyY(key);
+    Page& mapped = page(level, x, y);
+
+    const uint32_t slotIndex = lru.back();
+    Slot& slot = slots[slotIndex];
+    if (slot.page != kNoPage && slot.lastUsedFrame == frame) {
+        // Every slot is drawn from this frame; the cache is too small for
+        // the view, so the tile waits to be requested again.
+        ++counters.dropped;
+        mapped.state = PageState::Missing;
+        return;
+    }
+
+    const uint32_t evicted = slot.page;
+    if (evicted != kNoPage) {
+        ++counters.evictions;
+        page(keyLevel(evicted), keyX(evicted), keyY(evicted)).state = PageState::Missing;
+    }
+    slot.page = key;
+    slot.lastUsedFrame = mapped.requestedFrame;
+    lru.splice(lru.begin(), lru, slot.lruPosition);
+    backend.uploadTile(slotIndex % cacheTilesX, slotIndex / cacheTilesX, pixels);
+    ++counters.uploads;
+
+    mapped.state = PageState::Resident;
+    mapped.slot = slotIndex;
+    if (evicted != kNoPage) {
+        refreshIndirection(keyLevel(evicted), keyX(evicted), keyY(evicted));
+    }
+    refreshIndirection(level, x, y);
+}
+
+void VirtualTexture::refreshIndirection(uint32_t level, uint32_t x, uint32_t y) {
+    // Walk the page's subtree coarse to fine, so each entry can fall back to
+    // its parent's already updated one. Parents of the last row and column
+    // are clamped, so a page on the edge also covers whatever lies beyond.
+    const bool lastColumn = x + 1 == image.tilesX(level), lastRow = y + 1 == image.tilesY(level);
+    for (uint32_t finer = level + 1; finer-- > 0; ) {
+        const uint32_t shift = level - finer;
+        const uint32_t columns = image.tilesX(finer), rows = image.tilesY(finer);
+        const uint32_t x0 = x << shift, y0 = y << shift;
+        const uint32_t x1 = lastColumn ? columns : std::min((x + 1) << shift, columns);
+        const uint32_t y1 = lastRow ? rows : std::min((y + 1) << shift, rows);
+        if (x0 >= x1 || y0 >= y1) {
+            break;
+        }
+
+        const bool coarsest = finer + 1 == pages.size();
+        const uint32_t parentColumns = coarsest ? 0 : image.tilesX(finer + 1);
+        const uint32_t parentRows = coarsest ? 0 : image.tilesY(finer + 1);
+        for (uint32_t ty = y0; ty < y1; ++ty) {
+            for (uint32_t tx = x0; tx < x1; ++tx) {
+                const Page& current = pages[finer][ty * columns + tx];
+                uint32_t& value = indirection[finer][ty * columns + tx];
+                if (current.state == PageState::Resident) {
+                    value = encodeEntry(current.slot % cacheTilesX, current.slot / cacheTilesX, finer);
+                } else {
+                    assert(!coarsest);
+                    value = indirection[finer + 1][std::min(ty / 2, parentRows - 1) * parentColumns +
+                                                   std::min(tx / 2, parentColumns - 1)];
+                }
+            }
+        }
+
+        auto& rect = dirty[finer];
+        rect = {std::min(rect[0], x0), std::min(rect[1], y0), std::max(rect[2], x1), std::max(rect[3], y1)};
+    }
+}
+
+void VirtualTexture::uploadIndirection() {
+    for (uint32_t level = 0; level < dirty.size(); ++level) {
+        auto& rect = dirty[level];
+        if (rect[0] >= rect[2]) {
+            continue;
+        }
+        const uint32_t columns = image.tilesX(level);
+        backend.uploadIndirection(level, rect[0], rect[1], rect[2] - rect[0], rect[3] - rect[1],
+                                  indirection[level].data() + size_t(rect[1]) * columns + rect[0], columns);
+        rect = {UINT32_MAX, UINT32_MAX, 0, 0};
+    }
+}
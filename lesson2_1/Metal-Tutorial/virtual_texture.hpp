@@ -0,0 +1,161 @@
+//
+//  virtual_texture.hpp
+//  Metal-Guide
+//
+//  CPU side of sparse virtual texturing. A TiledImage far larger than any
+//  one texture is paged into a fixed physical tile cache on demand: the
+//  renderer requests the pages it sees each frame, workers decode missing
+//  ones in the background, and update() maps finished tiles into the least
+//  recently used cache slots. An indirection table tells the shader where
+//  each page lives, falling back to the nearest resident coarser page, so
+//  sampling always hits something. Like TextureResidency, the policy only
+//  does bookkeeping and a backend does the uploads. Apart from the decode
+//  workers, use it from the render thread.
+//
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "tiled_image.hpp"
+
+class TileCacheBackend {
+public:
+    virtual ~TileCacheBackend() = default;
+    // Copies a decoded page (pageSize x pageSize RGBA8, tightly packed)
+    // into cache slot (slotX, slotY).
+    virtual void uploadTile(uint32_t slotX, uint32_t slotY, const uint8_t* pixels) = 0;
+    // Copies a width x height rectangle of one indirection level; entries
+    // has rowLength entries per row.
+    virtual void uploadIndirection(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                                   const uint32_t* entries, uint32_t rowLength) = 0;
+};
+
+class VirtualTexture {
+public:
+    struct Stats {
+        uint64_t requests;
+        uint64_t hits;
+        uint64_t decodes;
+        uint64_t decodedBytes;   // compressed bytes read
+        uint64_t uploads;
+        uint64_t evictions;
+        uint64_t dropped;        // decoded but every slot was in use this frame
+        uint64_t failed;
+    };
+
+    // The cache holds cacheTilesX x cacheTilesY pages; at most 255 per side
+    // so a slot fits the indirection format. The single-tile coarsest level
+    // is loaded up front and never evicted. At most maxInFlight decodes run
+    // at once on the pool.
+    VirtualTexture(const TiledImage& image, TileCacheBackend& backend, uint32_t cacheTilesX, uint32_t cacheTilesY,
+                   uint32_t maxInFlight = 32, ThreadPool& pool = ThreadPool::shared());
+    ~VirtualTexture();
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    // Pages used in the current frame are never evicted.
+    void beginFrame() { ++frame; }
+
+    // Marks a page as needed this frame. Resident pages are kept alive;
+    // missing ones are queued for decoding on the next update().
+    void request(uint32_t level, uint32_t x, uint32_t y);
+
+    // Maps up to maxUploads decoded tiles into the cache, starts decodes for
+    // this frame's missing pages (coarsest first) and uploads the changed
+    // parts of the indirection table.
+    void update(uint32_t maxUploads = 16);
+
+    // Blocks until no decode is running; their tiles are mapped by the next
+    // update().
+    void waitForDecodes();
+
+    // Indirection entry, as uploaded: slot x in bits 0-7, slot y in bits
+    // 8-15, the level of the page actually mapped in bits 16-23 and 0xff in
+    // bits 24-31, i.e. an RGBA8Uint texel. Level L of the indirection
+    // texture has one texel per tile of level L.
+    uint32_t entry(uint32_t level, uint32_t x, uint32_t y) const { return indirection[level][y * image.tilesX(level) + x]; }
+    const std::vector<uint32_t>& indirectionLevel(uint32_t level) const { return indirection[level]; }
+    // Indirection texture size at level 0: every level's tiles then fit in
+    // the texture's own mip level of the same index.
+    uint32_t indirectionWidth() const;
+    uint32_t indirectionHeight() const;
+
+    bool isResident(uint32_t level, uint32_t x, uint32_t y) const;
+    // Page in a cache slot, or kNoPage.
+    uint32_t pageInSlot(uint32_t slotX, uint32_t slotY) const { return slots[slotY * cacheTilesX + slotX].page; }
+    uint32_t pendingDecodes() const { return inFlight; }
+    const Stats& stats() const { return counters; }
+
+    static constexpr uint32_t kNoPage = 0xffffffff;
+    // Pages are keyed by level, x and y packed into one word.
+    static uint32_t pageKey(uint32_t level, uint32_t x, uint32_t y) { return level << 26 | y << 13 | x; }
+    static uint32_t keyLevel(uint32_t key) { return key >> 26; }
+    static uint32_t keyX(uint32_t key) { return key & 0x1fff; }
+    static uint32_t keyY(uint32_t key) { return (key >> 13) & 0x1fff; }
+    static uint32_t encodeEntry(uint32_t slotX, uint32_t slotY, uint32_t level) {
+        return slotX | slotY << 8 | level << 16 | 0xffu << 24;
+    }
+
+private:
+    enum class PageState : uint8_t { Missing, Decoding, Resident };
+
+    struct Page {
+        PageState state{PageState::Missing};
+        uint32_t slot{0};
+        uint64_t requestedFrame{0};
+    };
+
+    struct Slot {
+        uint32_t page{kNoPage};
+        uint64_t lastUsedFrame{0};
+        std::list<uint32_t>::iterator lruPosition;
+    };
+
+    struct DecodedTile {
+        uint32_t page;
+        std::vector<uint8_t> pixels;  // empty when decoding failed
+    };
+
+    Page& page(uint32_t level, uint32_t x, uint32_t y) { return pages[level][y * image.tilesX(level) + x]; }
+    void decode(uint32_t key);
+    void map(uint32_t key, const uint8_t* pixels);
+    // Recomputes the entries of page (level, x, y) and of every finer page
+    // it covers, and marks them for upload.
+    void refreshIndirection(uint32_t level, uint32_t x, uint32_t y);
+    void uploadIndirection();
+
+    const TiledImage& image;
+    TileCacheBackend& backend;
+    ThreadPool& pool;
+    uint32_t cacheTilesX;
+    uint32_t cacheTilesY;
+    uint32_t maxInFlight;
+    uint64_t frame{1};
+    Stats counters{};
+
+    std::vector<std::vector<Page>> pages;
+    std::vector<std::vector<uint32_t>> indirection;
+    // Changed rectangle of each indirection level: x0, y0, x1, y1.
+    std::vector<std::array<uint32_t, 4>> dirty;
+    std::vector<Slot> slots;
+    // Evictable slots, most recently used first.
+    std::list<uint32_t> lru;
+    std::vector<uint32_t> missing;
+
+    // Shared with the decode workers.
+    std::mutex mutex;
+    std::condition_variable decodesDone;
+    std::vector<DecodedTile> decoded;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    uint32_t running{0};
+
+    uint32_t inFlight{0};
+    std::vector<DecodedTile> ready;
+};
@@ -1,2 +1,17 @@
+#include "stb_image_pool.h"
+
+#define STBI_MALLOC(sz)           StbImagePool::allocate(sz)
+#define STBI_REALLOC(p,newsz)     StbImagePool::reallocate(p,newsz)
+#define STBI_FREE(p)              StbImagePool::release(p)
+
+// stb only picks up its NEON IDCT, YCbCr and upsampling kernels when asked
+// to; like the SSE2 ones they match the scalar decoder bit for bit.
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define STBI_NEON
+#endif
+
+// 11-bit Huffman lookahead resolves most AC run/size codes in one lookup.
+#define STBI_JPEG_FAST_BITS 11
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
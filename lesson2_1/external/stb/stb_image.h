@@ -524,6 +524,14 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// hand independent pieces of a decode to a thread pool. func must call
+// task(user, i) once for every i in [0, count) and return when all are
+// done; the calls may run in parallel. baseline JPEGs decoded from memory
+// use it to decode their restart intervals in parallel. NULL (the
+// default) decodes everything on the calling thread.
+typedef void stbi_parallel_for_func(int count, void (*task)(void *user, int index), void *user);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *func);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -1933,7 +1941,10 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+#ifndef STBI_JPEG_FAST_BITS
+#define STBI_JPEG_FAST_BITS 9
+#endif
+#define FAST_BITS   STBI_JPEG_FAST_BITS  // larger handles more cases; smaller stomps less cache
 
 typedef struct
 {
@@ -2946,9 +2957,139 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+static stbi_parallel_for_func *stbi__parallel_for = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *func)
+{
+   stbi__parallel_for = func;
+}
+
+// decode count baseline MCUs starting at MCU first, in scan order. for a
+// single-component scan every block is an MCU.
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   int m;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int ha = z->img_comp[n].ha;
+      for (m = first; m < first + count; ++m) {
+         int i = m % w, j = m / w;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+      }
+   } else {
+      int k,x,y;
+      for (m = first; m < first + count; ++m) {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **starts;    // first byte of each interval; starts[intervals] is the end of the scan
+   int intervals, mcus, tasks;
+   stbi_uc failed[64];  // per task, so no two threads write the same byte
+} stbi__jpeg_intervals;
+
+static void stbi__jpeg_decode_interval_task(void *user, int index)
+{
+   stbi__jpeg_intervals *work = (stbi__jpeg_intervals *) user;
+   int first = index * work->intervals / work->tasks;
+   int last = (index+1) * work->intervals / work->tasks;
+   int interval;
+   // a private copy of the decoder state and input; the huffman tables are
+   // only read, and each interval writes its own blocks of the planes
+   stbi__jpeg *j = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   stbi__context s = *work->z->s;
+   if (!j) { work->failed[index] = 1; return; }
+   *j = *work->z;
+   j->s = &s;
+   for (interval = first; interval < last && !work->failed[index]; ++interval) {
+      int mcu = interval * j->restart_interval;
+      s.img_buffer = work->starts[interval];
+      s.img_buffer_end = work->starts[interval+1];
+      stbi__jpeg_reset(j);
+      if (!stbi__jpeg_decode_mcus(j, mcu, work->mcus - mcu < j->restart_interval ? work->mcus - mcu : j->restart_interval))
+         work->failed[index] = 1;
+   }
+   STBI_FREE(j);
+}
+
+// decode a baseline scan's restart intervals in parallel. the entropy-coded
+// data is scanned for RSTn markers first; if there are not exactly as many
+// as the intervals need, returns -1 without consuming anything and the
+// caller decodes serially.
+static int stbi__jpeg_decode_intervals_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_intervals work;
+   stbi_uc *p = z->s->img_buffer, *end = z->s->img_buffer_end;
+   int found = 1, i;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      work.mcus = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      work.mcus = z->img_mcu_x * z->img_mcu_y;
+   }
+   work.intervals = (work.mcus + z->restart_interval - 1) / z->restart_interval;
+   if (work.intervals < 2) return -1;
+   work.starts = (stbi_uc **) stbi__malloc_mad2(work.intervals + 1, sizeof(stbi_uc *), 0);
+   if (!work.starts) return -1;
+   work.starts[0] = p;
+   for (;;) {
+      p = (stbi_uc *) memchr(p, 0xff, end - p);
+      if (!p || p + 1 >= end) { STBI_FREE(work.starts); return -1; }
+      if (p[1] == 0x00 || p[1] == 0xff) {
+         // a stuffed 0xff00 or fill bytes never start a marker
+         p += p[1] == 0x00 ? 2 : 1;
+         continue;
+      }
+      if (!STBI__RESTART(p[1])) break;
+      if (found == work.intervals) { STBI_FREE(work.starts); return -1; }
+      work.starts[found++] = p + 2;
+      p += 2;
+   }
+   if (found != work.intervals) { STBI_FREE(work.starts); return -1; }
+   work.starts[work.intervals] = p;
+
+   work.z = z;
+   work.tasks = work.intervals < 64 ? work.intervals : 64;
+   memset(work.failed, 0, sizeof(work.failed));
+   stbi__parallel_for(work.tasks, stbi__jpeg_decode_interval_task, &work);
+   STBI_FREE(work.starts);
+   for (i=0; i < work.tasks; ++i)
+      if (work.failed[i]) return stbi__err("bad restart interval", "Corrupt JPEG");
+
+   // continue after the marker that ends the scan, as the serial path does
+   stbi__jpeg_reset(z);
+   z->marker = p[1];
+   z->s->img_buffer = p + 2;
+   return 1;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
+   if (!z->progressive && z->restart_interval && stbi__parallel_for && !z->s->read_from_callbacks) {
+      int result = stbi__jpeg_decode_intervals_parallel(z);
+      if (result >= 0) return result;
+   }
    if (!z->progressive) {
       if (z->scan_n == 1) {
          int i,j;
@@ -4174,12 +4315,23 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
+// 64-bit targets keep a wide bit buffer that is refilled several bytes at a time
+#if (defined(STBI__X64_TARGET) || defined(__aarch64__) || defined(_M_ARM64)) && \
+    (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define STBI__ZWIDE
+#define STBI__ZPAIR_BITS  11 // two literals whose codes fit in this many bits decode in one lookup
+#define STBI__ZPAIR_MASK  ((1 << STBI__ZPAIR_BITS) - 1)
+typedef unsigned long long stbi__zbits;
+#else
+typedef stbi__uint32 stbi__zbits;
+#endif
+
 typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
    int hit_zeof_once;
-   stbi__uint32 code_buffer;
+   stbi__zbits code_buffer;
 
    char *zout;
    char *zout_start;
@@ -4187,6 +4339,9 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifdef STBI__ZWIDE
+   stbi__uint32 zpair[1 << STBI__ZPAIR_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4201,8 +4356,20 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+#ifdef STBI__ZWIDE
+   if (z->zbuffer_end - z->zbuffer >= 8 && z->code_buffer < ((stbi__zbits) 1 << z->num_bits)) {
+      // bytes land little-endian in the buffer, matching deflate's LSB-first packing
+      int n = (63 - z->num_bits) >> 3;
+      stbi__zbits v;
+      memcpy(&v, z->zbuffer, 8);
+      z->code_buffer |= (v & (((stbi__zbits) 1 << (8*n)) - 1)) << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += 8*n;
+      return;
+   }
+#endif
    do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
+      if (z->code_buffer >= ((stbi__zbits) 1 << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
         return;
       }
@@ -4226,7 +4393,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4306,11 +4473,51 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+#ifdef STBI__ZWIDE
+// For every STBI__ZPAIR_BITS-bit window that starts with two literal codes,
+// records both literals (low 16 bits) and their total code length (above).
+// Windows that don't are 0.
+static void stbi__zbuild_pairs(stbi__zbuf *a)
+{
+   int i;
+   for (i=0; i < (1 << STBI__ZPAIR_BITS); ++i) {
+      int first = a->z_length.fast[i & STBI__ZFAST_MASK], second, s;
+      a->zpair[i] = 0;
+      if (!first || (first & 511) >= 256) continue;
+      s = first >> 9;
+      second = a->z_length.fast[(i >> s) & STBI__ZFAST_MASK];
+      if (!second || (second & 511) >= 256 || s + (second >> 9) > STBI__ZPAIR_BITS) continue;
+      a->zpair[i] = (stbi__uint32) ((first & 255) | (second & 255) << 8 | (s + (second >> 9)) << 16);
+   }
+}
+#endif
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+#ifdef STBI__ZWIDE
+   stbi__zbuild_pairs(a);
+#endif
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+#ifdef STBI__ZWIDE
+      if (a->num_bits < 16 + STBI__ZPAIR_BITS && a->zbuffer_end - a->zbuffer >= 8)
+         stbi__fill_bits(a);
+      // with this many bits buffered, decoding the two literals one at a time
+      // would not refill or hit the end of the stream in between either
+      if (a->num_bits >= 16 + STBI__ZPAIR_BITS && a->zout_end - zout >= 2) {
+         stbi__uint32 pair = a->zpair[a->code_buffer & STBI__ZPAIR_MASK];
+         if (pair) {
+            zout[0] = (char) (pair & 255);
+            zout[1] = (char) ((pair >> 8) & 255);
+            zout += 2;
+            a->code_buffer >>= pair >> 16;
+            a->num_bits -= (int) (pair >> 16);
+            continue;
+         }
+      }
+#endif
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4349,6 +4556,18 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          if (dist == 1) { // run of one byte; common in images.
             stbi_uc v = *p;
             if (len) { do *zout++ = v; while (--len); }
+         } else if (dist >= 16 && a->zout_end - zout >= len + 16) {
+            // non-overlapping 16-byte chunks; may write up to 15 bytes past len, which
+            // the check above guarantees is still inside the output buffer. Shorter
+            // distances stay bytewise: a chunk would load bytes the previous chunk
+            // has only partly stored, which stalls store forwarding.
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 16);
+               zout += 16;
+               p += 16;
+            } while (zout < end);
+            zout = end;
          } else {
             if (len) { do *zout++ = *p++; while (--len); }
          }
@@ -4414,7 +4633,7 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
@@ -4426,9 +4645,16 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   // a wide bit buffer may already hold the first bytes of the stored data
+   while (a->num_bits > 0 && len > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4669,6 +4895,106 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// Sub/Avg/Paeth unfiltering for 3- and 4-byte pixels. The dependency on the
+// previous pixel keeps this sequential, but one vector op now handles all
+// channels of a pixel. Pixels are moved as 4-byte words, so the loops stop
+// before the last 3-byte pixel of a row and return where the scalar code
+// should pick up.
+stbi_inline static stbi__uint32 stbi__png_load4(const stbi_uc *p)
+{
+   stbi__uint32 v;
+   memcpy(&v, p, 4);
+   return v;
+}
+
+stbi_inline static void stbi__png_store4(stbi_uc *p, stbi__uint32 v)
+{
+   memcpy(p, &v, 4);
+}
+
+static int stbi__png_unfilter_simd(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int filter_bytes, int nk)
+{
+   int k = filter_bytes;
+   if ((filter_bytes != 3 && filter_bytes != 4) || k + 4 > nk)
+      return k;
+
+#ifdef STBI_SSE2
+   {
+      __m128i zero = _mm_setzero_si128();
+      __m128i a = _mm_cvtsi32_si128((int) stbi__png_load4(cur));
+      if (filter == STBI__F_sub) {
+         for (; k + 4 <= nk; k += filter_bytes) {
+            a = _mm_add_epi8(a, _mm_cvtsi32_si128((int) stbi__png_load4(raw + k)));
+            stbi__png_store4(cur + k, (stbi__uint32) _mm_cvtsi128_si32(a));
+         }
+      } else if (filter == STBI__F_avg) {
+         __m128i one = _mm_set1_epi8(1);
+         for (; k + 4 <= nk; k += filter_bytes) {
+            __m128i b = _mm_cvtsi32_si128((int) stbi__png_load4(prior + k));
+            // pavgb rounds up; the PNG average rounds down
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(avg, _mm_cvtsi32_si128((int) stbi__png_load4(raw + k)));
+            stbi__png_store4(cur + k, (stbi__uint32) _mm_cvtsi128_si32(a));
+         }
+      } else if (filter == STBI__F_paeth) {
+         __m128i a16 = _mm_unpacklo_epi8(a, zero);
+         __m128i c16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) stbi__png_load4(prior)), zero);
+         for (; k + 4 <= nk; k += filter_bytes) {
+            __m128i b16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) stbi__png_load4(prior + k)), zero);
+            // same branch-free formulation as stbi__paeth, in 16-bit lanes
+            __m128i thresh = _mm_sub_epi16(_mm_add_epi16(c16, _mm_add_epi16(c16, c16)), _mm_add_epi16(a16, b16));
+            __m128i lo = _mm_min_epi16(a16, b16);
+            __m128i hi = _mm_max_epi16(a16, b16);
+            __m128i use_c = _mm_cmpgt_epi16(hi, thresh);
+            __m128i t0 = _mm_or_si128(_mm_and_si128(use_c, c16), _mm_andnot_si128(use_c, lo));
+            __m128i use_t0 = _mm_cmpgt_epi16(thresh, lo);
+            __m128i pred = _mm_or_si128(_mm_and_si128(use_t0, t0), _mm_andnot_si128(use_t0, hi));
+            a = _mm_add_epi8(_mm_packus_epi16(pred, pred), _mm_cvtsi32_si128((int) stbi__png_load4(raw + k)));
+            stbi__png_store4(cur + k, (stbi__uint32) _mm_cvtsi128_si32(a));
+            a16 = _mm_unpacklo_epi8(a, zero);
+            c16 = b16;
+         }
+      }
+   }
+#else
+   {
+      uint8x8_t a = vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(cur)));
+      if (filter == STBI__F_sub) {
+         for (; k + 4 <= nk; k += filter_bytes) {
+            a = vadd_u8(a, vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(raw + k))));
+            stbi__png_store4(cur + k, vget_lane_u32(vreinterpret_u32_u8(a), 0));
+         }
+      } else if (filter == STBI__F_avg) {
+         for (; k + 4 <= nk; k += filter_bytes) {
+            uint8x8_t b = vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(prior + k)));
+            a = vadd_u8(vhadd_u8(a, b), vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(raw + k))));
+            stbi__png_store4(cur + k, vget_lane_u32(vreinterpret_u32_u8(a), 0));
+         }
+      } else if (filter == STBI__F_paeth) {
+         int16x8_t a16 = vreinterpretq_s16_u16(vmovl_u8(a));
+         int16x8_t c16 = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(prior)))));
+         for (; k + 4 <= nk; k += filter_bytes) {
+            int16x8_t b16 = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(prior + k)))));
+            // same branch-free formulation as stbi__paeth, in 16-bit lanes
+            int16x8_t thresh = vsubq_s16(vmulq_n_s16(c16, 3), vaddq_s16(a16, b16));
+            int16x8_t lo = vminq_s16(a16, b16);
+            int16x8_t hi = vmaxq_s16(a16, b16);
+            int16x8_t t0 = vbslq_s16(vcgtq_s16(hi, thresh), c16, lo);
+            int16x8_t pred = vbslq_s16(vcgtq_s16(thresh, lo), t0, hi);
+            a = vadd_u8(vmovn_u16(vreinterpretq_u16_s16(pred)), vreinterpret_u8_u32(vdup_n_u32(stbi__png_load4(raw + k))));
+            stbi__png_store4(cur + k, vget_lane_u32(vreinterpret_u32_u8(a), 0));
+            a16 = vreinterpretq_s16_u16(vmovl_u8(a));
+            c16 = b16;
+         }
+      }
+   }
+#endif
+   return k;
+}
+#endif
+
+
 // adds an extra all-255 alpha channel
 // dest == src is legal
 // img_n must be 1 or 3
@@ -4758,7 +5084,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          break;
       case STBI__F_sub:
          memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
+         k = filter_bytes;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+         k = stbi__png_unfilter_simd(filter, cur, prior, raw, filter_bytes, nk);
+#endif
+         for (; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
          break;
       case STBI__F_up:
@@ -4768,13 +5098,19 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       case STBI__F_avg:
          for (k = 0; k < filter_bytes; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+         k = stbi__png_unfilter_simd(filter, cur, prior, raw, filter_bytes, nk);
+#endif
+         for (; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
          break;
       case STBI__F_paeth:
          for (k = 0; k < filter_bytes; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+         k = stbi__png_unfilter_simd(filter, cur, prior, raw, filter_bytes, nk);
+#endif
+         for (; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
          break;
       case STBI__F_avg_first:
@@ -0,0 +1,228 @@
+//
+//  stb_image_pool.cpp
+//  Metal-Guide
+//
+
+#include "stb_image_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace StbImagePool {
+
+namespace {
+
+// Four classes per power of two from 64 bytes up to 512 MB; anything
+// larger goes straight to malloc.
+constexpr int kMinShift = 6;
+constexpr int kMaxShift = 29;
+constexpr int kClassCount = 1 + (kMaxShift - kMinShift) * 4;
+constexpr uint32_t kUnpooled = 0xffffffff;
+
+// Sits in front of every block so that free and realloc know its class.
+struct alignas(16) BlockHeader {
+    uint32_t sizeClass;
+    uint64_t size;
+};
+
+std::atomic<uint64_t> currentBytes{0};
+std::atomic<uint64_t> peakBytes{0};
+std::atomic<uint64_t> systemBytes{0};
+std::atomic<uint64_t> reusedBytes{0};
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> reuseCount{0};
+std::atomic<size_t> cacheLimit{256u << 20};
+
+size_t classSize(uint32_t sizeClass) {
+    if (sizeClass == 0) {
+        return size_t(1) << kMinShift;
+    }
+    size_t base = size_t(1) << (kMinShift + (sizeClass - 1) / 4);
+    return base + (base >> 2) * ((sizeClass - 1) % 4 + 1);
+}
+
+uint32_t classIndex(size_t size) {
+    if (size <= (size_t(1) << kMinShift)) {
+        return 0;
+    }
+    int shift = 63 - __builtin_clzll(uint64_t(size - 1));
+    if (shift >= kMaxShift) {
+        return kUnpooled;
+    }
+    size_t base = size_t(1) << shift;
+    size_t step = base >> 2;
+    size_t k = (size - base + step - 1) / step;
+    return uint32_t((shift - kMinShift) * 4 + k);
+}
+
+// Freed blocks of one class, linked through their first payload bytes
+// (every class holds at least 64). One cache is shared by all threads, so
+// a buffer freed on another thread, e.g. after its upload completes, is
+// reused like any other, and the limit bounds the process as a whole.
+struct FreeList {
+    std::mutex mutex;
+    BlockHeader* head{nullptr};
+};
+
+struct Cache {
+    FreeList lists[kClassCount];
+    std::atomic<size_t> cachedBytes{0};
+
+    BlockHeader* pop(uint32_t sizeClass) {
+        FreeList& list = lists[sizeClass];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        BlockHeader* block = list.head;
+        if (block) {
+            list.head = next(block);
+            cachedBytes.fetch_sub(classSize(sizeClass), std::memory_order_relaxed);
+        }
+        return block;
+    }
+
+    bool push(BlockHeader* block) {
+        const size_t capacity = classSize(block->sizeClass);
+        if (cachedBytes.fetch_add(capacity, std::memory_order_relaxed) + capacity >
+            cacheLimit.load(std::memory_order_relaxed)) {
+            cachedBytes.fetch_sub(capacity, std::memory_order_relaxed);
+            return false;
+        }
+        FreeList& list = lists[block->sizeClass];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        next(block) = list.head;
+        list.head = block;
+        return true;
+    }
+
+    void trim() {
+        for (FreeList& list : lists) {
+            BlockHeader* block;
+            {
+                std::lock_guard<std::mutex> lock(list.mutex);
+                block = list.head;
+                list.head = nullptr;
+            }
+            while (block) {
+                BlockHeader* following = next(block);
+                cachedBytes.fetch_sub(classSize(block->sizeClass), std::memory_order_relaxed);
+                std::free(block);
+                block = following;
+            }
+        }
+    }
+
+    static BlockHeader*& next(BlockHeader* block) { return *reinterpret_cast<BlockHeader**>(block + 1); }
+};
+
+// Never destroyed, so images freed during static destruction are still safe.
+Cache& cache() {
+    static Cache* shared = new Cache;
+    return *shared;
+}
+
+void trackAllocation(uint64_t size) {
+    uint64_t now = currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (now > peak && !peakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+void* allocate(size_t size) {
+    uint32_t sizeClass = classIndex(size);
+    BlockHeader* block = nullptr;
+
+    if (sizeClass != kUnpooled) {
+        block = cache().pop(sizeClass);
+        if (block) {
+            reusedBytes.fetch_add(size, std::memory_order_relaxed);
+            reuseCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (!block) {
+        size_t capacity = sizeClass == kUnpooled ? size : classSize(sizeClass);
+        block = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + capacity));
+        if (!block) {
+            return nullptr;
+        }
+        systemBytes.fetch_add(capacity, std::memory_order_relaxed);
+    }
+
+    block->sizeClass = sizeClass;
+    block->size = size;
+    trackAllocation(size);
+    return block + 1;
+}
+
+void release(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    BlockHeader* block = static_cast<BlockHeader*>(ptr) - 1;
+    currentBytes.fetch_sub(block->size, std::memory_order_relaxed);
+
+    if (block->sizeClass == kUnpooled || !cache().push(block)) {
+        std::free(block);
+    }
+}
+
+void* reallocate(void* ptr, size_t newSize) {
+    if (!ptr) {
+        return allocate(newSize);
+    }
+    BlockHeader* block = static_cast<BlockHeader*>(ptr) - 1;
+
+    // Growing within the same class (stb's zlib and PNG paths do this a lot)
+    // only needs the bookkeeping updated.
+    if (block->sizeClass != kUnpooled && newSize <= classSize(block->sizeClass)) {
+        if (newSize > block->size) {
+            trackAllocation(newSize - block->size);
+            allocationCount.fetch_sub(1, std::memory_order_relaxed);
+        } else {
+            currentBytes.fetch_sub(block->size - newSize, std::memory_order_relaxed);
+        }
+        block->size = newSize;
+        return ptr;
+    }
+
+    void* grown = allocate(newSize);
+    if (!grown) {
+        return nullptr;
+    }
+    std::memcpy(grown, ptr, std::min<size_t>(block->size, newSize));
+    release(ptr);
+    return grown;
+}
+
+Stats stats() {
+    return Stats{
+        currentBytes.load(std::memory_order_relaxed),
+        peakBytes.load(std::memory_order_relaxed),
+        systemBytes.load(std::memory_order_relaxed),
+        reusedBytes.load(std::memory_order_relaxed),
+        allocationCount.load(std::memory_order_relaxed),
+        reuseCount.load(std::memory_order_relaxed),
+    };
+}
+
+void resetStats() {
+    peakBytes.store(currentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    systemBytes.store(0, std::memory_order_relaxed);
+    reusedBytes.store(0, std::memory_order_relaxed);
+    allocationCount.store(0, std::memory_order_relaxed);
+    reuseCount.store(0, std::memory_order_relaxed);
+}
+
+void setCacheLimit(size_t bytes) {
+    cacheLimit.store(bytes, std::memory_order_relaxed);
+}
+
+void trimCache() {
+    cache().trim();
+}
+
+}
@@ -0,0 +1,40 @@
+//
+//  stb_image_pool.h
+//  Metal-Guide
+//
+//  Size-class pool behind STBI_MALLOC/STBI_REALLOC/STBI_FREE. Decoding many
+//  images back to back reuses the same scratch and output buffers instead
+//  of going back to the system allocator every time. Freed blocks go to a
+//  cache shared by all threads, locked per size class, so a block may be
+//  freed on any thread and is reused wherever the next decode runs.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace StbImagePool {
+
+struct Stats {
+    uint64_t currentBytes;  // bytes handed out and not yet freed
+    uint64_t peakBytes;     // high-water mark of currentBytes
+    uint64_t systemBytes;   // bytes requested from the system allocator
+    uint64_t reusedBytes;   // bytes served from the cache
+    uint64_t allocations;
+    uint64_t reuses;
+};
+
+void* allocate(size_t size);
+void* reallocate(void* ptr, size_t newSize);
+void release(void* ptr);
+
+Stats stats();
+void resetStats();
+
+// Upper bound on the bytes kept cached for reuse (default 256 MB).
+void setCacheLimit(size_t bytes);
+// Returns every cached block to the system.
+void trimCache();
+
+}
@@ -0,0 +1,142 @@
+//
+//  Foundation.hpp
+//  Metal-Guide
+//
+//  Null stand-in for metal-cpp's Foundation: reference-counted objects,
+//  autorelease pools, strings and errors. See NullMetal.hpp.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../NullMetal.hpp"
+
+#ifndef nil
+#define nil nullptr
+#endif
+
+namespace NS {
+
+using UInteger = unsigned long;
+using Integer = long;
+
+enum StringEncoding : UInteger {
+    ASCIIStringEncoding = 1,
+    UTF8StringEncoding = 4,
+};
+
+class Object {
+public:
+    Object(const Object&) = delete;
+    Object& operator=(const Object&) = delete;
+
+    void release() {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    UInteger retainCount() const { return references.load(std::memory_order_relaxed); }
+    // Not part of metal-cpp: identifies the object in the command log.
+    uint32_t nullId() const { return identifier; }
+
+protected:
+    Object() : identifier(NullMetal::newObjectId()) { NullMetal::liveObjects.fetch_add(1, std::memory_order_relaxed); }
+    virtual ~Object() { NullMetal::liveObjects.fetch_sub(1, std::memory_order_relaxed); }
+
+    void retainObject() { references.fetch_add(1, std::memory_order_relaxed); }
+    void autoreleaseObject();
+
+private:
+    std::atomic<UInteger> references{1};
+    uint32_t identifier;
+};
+
+// Gives retain() and autorelease() the caller's type, as in metal-cpp.
+template <class Class, class Base = Object>
+class Referencing : public Base {
+public:
+    Class* retain() {
+        this->retainObject();
+        return static_cast<Class*>(this);
+    }
+    Class* autorelease() {
+        this->autoreleaseObject();
+        return static_cast<Class*>(this);
+    }
+};
+
+// Objects autoreleased while a pool is the innermost one on this thread are
+// released when the pool is. Outside any pool they are never released, as
+// Objective-C would leak them.
+class AutoreleasePool : public Referencing<AutoreleasePool> {
+public:
+    static AutoreleasePool* alloc() { return new AutoreleasePool(); }
+    AutoreleasePool* init() {
+        stack().push_back(this);
+        return this;
+    }
+
+    void addObject(Object* object) { objects.push_back(object); }
+
+    void drain() {
+        std::vector<Object*> pending;
+        pending.swap(objects);
+        for (Object* object : pending) {
+            object->release();
+        }
+    }
+
+    static AutoreleasePool* current() { return stack().empty() ? nullptr : stack().back(); }
+
+private:
+    ~AutoreleasePool() override {
+        drain();
+        if (!stack().empty() && stack().back() == this) {
+            stack().pop_back();
+        }
+    }
+
+    static std::vector<AutoreleasePool*>& stack() {
+        static thread_local std::vector<AutoreleasePool*> pools;
+        return pools;
+    }
+
+    std::vector<Object*> objects;
+};
+
+inline void Object::autoreleaseObject() {
+    if (AutoreleasePool* pool = AutoreleasePool::current()) {
+        pool->addObject(this);
+    }
+}
+
+class String : public Referencing<String> {
+public:
+    static String* string(const char* cString, StringEncoding) { return (new String(cString))->autorelease(); }
+
+    const char* utf8String() const { return value.c_str(); }
+    UInteger length() const { return value.size(); }
+
+private:
+    explicit String(const char* cString) : value(cString ? cString : "") {}
+
+    std::string value;
+};
+
+class Error : public Referencing<Error> {
+public:
+    static Error* error(const char* description) { return (new Error(description))->autorelease(); }
+
+    String* localizedDescription() const { return String::string(message.c_str(), UTF8StringEncoding); }
+
+private:
+    explicit Error(const char* description) : message(description) {}
+
+    std::string message;
+};
+
+}
@@ -0,0 +1,657 @@
+//
+//  Metal.hpp
+//  Metal-Guide
+//
+//  Null stand-in for the part of metal-cpp's Metal that MTLEngine and the
+//  texture code use. See NullMetal.hpp.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../Foundation/Foundation.hpp"
+
+namespace CA {
+class MetalLayer;
+}
+
+namespace MTL {
+
+using NullMetal::Call;
+
+inline void logCall(Call call, const NS::Object* object) {
+    NullMetal::commandLog().record(call, object->nullId());
+}
+
+enum PixelFormat : NS::UInteger {
+    PixelFormatInvalid = 0,
+    PixelFormatRGBA8Unorm = 70,
+    PixelFormatRGBA8Uint = 73,
+    PixelFormatBGRA8Unorm = 80,
+    PixelFormatRGBA16Float = 115,
+    PixelFormatDepth32Float = 252,
+};
+
+enum TextureType : NS::UInteger {
+    TextureType2D = 2,
+    TextureType2DMultisample = 4,
+};
+
+enum StorageMode : NS::UInteger {
+    StorageModeShared = 0,
+    StorageModeManaged = 1,
+    StorageModePrivate = 2,
+    StorageModeMemoryless = 3,
+};
+
+enum HeapType : NS::UInteger {
+    HeapTypeAutomatic = 0,
+    HeapTypePlacement = 2,
+};
+
+enum HazardTrackingMode : NS::UInteger {
+    HazardTrackingModeDefault = 0,
+    HazardTrackingModeUntracked = 1,
+    HazardTrackingModeTracked = 2,
+};
+
+using TextureUsage = NS::UInteger;
+static const TextureUsage TextureUsageShaderRead = 1;
+static const TextureUsage TextureUsageShaderWrite = 2;
+static const TextureUsage TextureUsageRenderTarget = 4;
+
+using ResourceOptions = NS::UInteger;
+static const ResourceOptions ResourceStorageModeShared = 0;
+static const ResourceOptions ResourceStorageModeManaged = 16;
+static const ResourceOptions ResourceStorageModePrivate = 32;
+static const ResourceOptions ResourceStorageModeMemoryless = 48;
+
+enum LoadAction : NS::UInteger {
+    LoadActionDontCare = 0,
+    LoadActionLoad = 1,
+    LoadActionClear = 2,
+};
+
+enum StoreAction : NS::UInteger {
+    StoreActionDontCare = 0,
+    StoreActionStore = 1,
+    StoreActionMultisampleResolve = 2,
+    StoreActionStoreAndMultisampleResolve = 3,
+};
+
+enum CompareFunction : NS::UInteger {
+    CompareFunctionNever = 0,
+    CompareFunctionLess = 1,
+    CompareFunctionEqual = 2,
+    CompareFunctionLessEqual = 3,
+    CompareFunctionGreater = 4,
+    CompareFunctionNotEqual = 5,
+    CompareFunctionGreaterEqual = 6,
+    CompareFunctionAlways = 7,
+};
+
+enum Winding : NS::UInteger {
+    WindingClockwise = 0,
+    WindingCounterClockwise = 1,
+};
+
+enum CullMode : NS::UInteger {
+    CullModeNone = 0,
+    CullModeFront = 1,
+    CullModeBack = 2,
+};
+
+enum TriangleFillMode : NS::UInteger {
+    TriangleFillModeFill = 0,
+    TriangleFillModeLines = 1,
+};
+
+enum BlendFactor : NS::UInteger {
+    BlendFactorZero = 0,
+    BlendFactorOne = 1,
+    BlendFactorSourceAlpha = 4,
+    BlendFactorOneMinusSourceAlpha = 5,
+};
+
+enum BlendOperation : NS::UInteger {
+    BlendOperationAdd = 0,
+};
+
+enum ColorWriteMask : NS::UInteger {
+    ColorWriteMaskNone = 0,
+    ColorWriteMaskAll = 0xf,
+};
+
+enum PrimitiveType : NS::UInteger {
+    PrimitiveTypePoint = 0,
+    PrimitiveTypeLine = 1,
+    PrimitiveTypeLineStrip = 2,
+    PrimitiveTypeTriangle = 3,
+    PrimitiveTypeTriangleStrip = 4,
+};
+
+struct Origin {
+    Origin() = default;
+    Origin(NS::UInteger x, NS::UInteger y, NS::UInteger z) : x(x), y(y), z(z) {}
+    NS::UInteger x{0}, y{0}, z{0};
+};
+
+struct Size {
+    Size() = default;
+    Size(NS::UInteger width, NS::UInteger height, NS::UInteger depth) : width(width), height(height), depth(depth) {}
+    NS::UInteger width{0}, height{0}, depth{0};
+};
+
+struct Region {
+    Region() = default;
+    Region(NS::UInteger x, NS::UInteger y, NS::UInteger width, NS::UInteger height)
+        : origin(x, y, 0), size(width, height, 1) {}
+    Region(NS::UInteger x, NS::UInteger y, NS::UInteger z, NS::UInteger width, NS::UInteger height, NS::UInteger depth)
+        : origin(x, y, z), size(width, height, depth) {}
+    Origin origin;
+    Size size;
+};
+
+struct SizeAndAlign {
+    NS::UInteger size;
+    NS::UInteger align;
+};
+
+struct ClearColor {
+    ClearColor() = default;
+    ClearColor(double red, double green, double blue, double alpha) : red(red), green(green), blue(blue), alpha(alpha) {}
+    double red{0.0}, green{0.0}, blue{0.0}, alpha{1.0};
+};
+
+class Buffer : public NS::Referencing<Buffer> {
+public:
+    void* contents() { return bytes.data(); }
+    NS::UInteger length() const { return bytes.size(); }
+
+private:
+    friend class Device;
+    explicit Buffer(NS::UInteger length) : bytes(length) {}
+
+    std::vector<uint8_t> bytes;
+};
+
+class TextureDescriptor : public NS::Referencing<TextureDescriptor> {
+public:
+    static TextureDescriptor* alloc() { return new TextureDescriptor(); }
+    TextureDescriptor* init() { return this; }
+
+    void setTextureType(TextureType value) { properties.type = value; }
+    void setPixelFormat(PixelFormat value) { properties.format = value; }
+    void setWidth(NS::UInteger value) { properties.width = value; }
+    void setHeight(NS::UInteger value) { properties.height = value; }
+    void setMipmapLevelCount(NS::UInteger value) { properties.levels = value; }
+    void setSampleCount(NS::UInteger value) { properties.samples = value; }
+    void setUsage(TextureUsage value) { properties.usage = value; }
+    void setStorageMode(StorageMode value) { properties.storage = value; }
+
+private:
+    friend class Device;
+    friend class Heap;
+    friend class Texture;
+    friend class CA::MetalLayer;
+
+    struct Properties {
+        TextureType type{TextureType2D};
+        PixelFormat format{PixelFormatRGBA8Unorm};
+        NS::UInteger width{1};
+        NS::UInteger height{1};
+        NS::UInteger levels{1};
+        NS::UInteger samples{1};
+        TextureUsage usage{TextureUsageShaderRead};
+        StorageMode storage{StorageModeManaged};
+    };
+
+    TextureDescriptor() = default;
+
+    Properties properties;
+};
+
+class Texture : public NS::Referencing<Texture> {
+public:
+    NS::UInteger width() const { return properties.width; }
+    NS::UInteger height() const { return properties.height; }
+    NS::UInteger mipmapLevelCount() const { return properties.levels; }
+    NS::UInteger sampleCount() const { return properties.samples; }
+    PixelFormat pixelFormat() const { return properties.format; }
+    TextureType textureType() const { return properties.type; }
+    TextureUsage usage() const { return properties.usage; }
+    StorageMode storageMode() const { return properties.storage; }
+
+    // Each level keeps what replaceRegion writes, so tools can read it back
+    // with getBytes. Blits only log.
+    void replaceRegion(Region region, NS::UInteger level, const void* bytes, NS::UInteger bytesPerRow) {
+        logCall(Call::ReplaceRegion, this);
+        copyRows(region, level, static_cast<uint8_t*>(const_cast<void*>(bytes)), bytesPerRow, true);
+    }
+
+    void getBytes(void* bytes, NS::UInteger bytesPerRow, Region region, NS::UInteger level) {
+        copyRows(region, level, static_cast<uint8_t*>(bytes), bytesPerRow, false);
+    }
+
+private:
+    friend class Device;
+    friend class Heap;
+    friend class CA::MetalLayer;
+    explicit Texture(const TextureDescriptor::Properties& properties) : properties(properties) {}
+
+    void copyRows(Region region, NS::UInteger level, uint8_t* bytes, NS::UInteger bytesPerRow, bool write) {
+        const NS::UInteger bytesPerPixel = properties.format == PixelFormatRGBA16Float ? 8 : 4;
+        const NS::UInteger levelWidth = std::max<NS::UInteger>(properties.width >> level, 1);
+        const NS::UInteger levelHeight = std::max<NS::UInteger>(properties.height >> level, 1);
+        const NS::UInteger levelBytesPerRow = levelWidth * bytesPerPixel;
+        if (contents.size() <= level) {
+            contents.resize(properties.levels);
+        }
+        std::vector<uint8_t>& texels = contents[level];
+        if (texels.empty()) {
+            texels.resize(levelBytesPerRow * levelHeight);
+        }
+        for (NS::UInteger row = 0; row < region.size.height; ++row) {
+            uint8_t* texel = &texels[(region.origin.y + row) * levelBytesPerRow + region.origin.x * bytesPerPixel];
+            uint8_t* client = bytes + row * bytesPerRow;
+            std::memcpy(write ? texel : client, write ? client : texel, region.size.width * bytesPerPixel);
+        }
+    }
+
+    TextureDescriptor::Properties properties;
+    // Per level, allocated on first use.
+    std::vector<std::vector<uint8_t>> contents;
+};
+
+class HeapDescriptor : public NS::Referencing<HeapDescriptor> {
+public:
+    static HeapDescriptor* alloc() { return new HeapDescriptor(); }
+    HeapDescriptor* init() { return this; }
+
+    void setType(HeapType value) { type = value; }
+    void setSize(NS::UInteger value) { size = value; }
+    void setStorageMode(StorageMode value) { storage = value; }
+    void setHazardTrackingMode(HazardTrackingMode value) { hazardTracking = value; }
+
+private:
+    friend class Device;
+    HeapDescriptor() = default;
+
+    HeapType type{HeapTypeAutomatic};
+    NS::UInteger size{0};
+    StorageMode storage{StorageModePrivate};
+    HazardTrackingMode hazardTracking{HazardTrackingModeDefault};
+};
+
+class Heap : public NS::Referencing<Heap> {
+public:
+    NS::UInteger size() const { return heapSize; }
+    HeapType type() const { return heapType; }
+
+    // Placement heaps only. Returns nullptr if the texture does not fit.
+    Texture* newTexture(const TextureDescriptor* descriptor, NS::UInteger offset) {
+        logCall(Call::NewTexture, this);
+        const SizeAndAlign sizeAndAlign = textureSizeAndAlign(descriptor);
+        if (heapType != HeapTypePlacement || offset % sizeAndAlign.align || offset + sizeAndAlign.size > heapSize) {
+            return nullptr;
+        }
+        return new Texture(descriptor->properties);
+    }
+
+private:
+    friend class Device;
+    Heap(HeapType type, NS::UInteger size) : heapType(type), heapSize(size) {}
+
+    // Sizes follow the 64 KB granularity Metal reports on Apple GPUs.
+    static SizeAndAlign textureSizeAndAlign(const TextureDescriptor* descriptor) {
+        const TextureDescriptor::Properties& properties = descriptor->properties;
+        const NS::UInteger bytesPerPixel = properties.format == PixelFormatRGBA16Float ? 8 : 4;
+        const NS::UInteger alignment = NS::UInteger(64) << 10;
+        const NS::UInteger bytes = properties.width * properties.height * properties.samples * bytesPerPixel;
+        return {(bytes + alignment - 1) / alignment * alignment, alignment};
+    }
+
+    HeapType heapType;
+    NS::UInteger heapSize;
+};
+
+class Function : public NS::Referencing<Function> {
+public:
+    NS::String* name() const { return NS::String::string(functionName.c_str(), NS::UTF8StringEncoding); }
+
+private:
+    friend class Library;
+    explicit Function(const char* name) : functionName(name) {}
+
+    std::string functionName;
+};
+
+// The null library has no compiled shaders; any function name resolves.
+class Library : public NS::Referencing<Library> {
+public:
+    Function* newFunction(const NS::String* functionName) {
+        logCall(Call::NewFunction, this);
+        return new Function(functionName->utf8String());
+    }
+
+private:
+    friend class Device;
+    Library() = default;
+};
+
+class RenderPipelineColorAttachmentDescriptor {
+public:
+    void setPixelFormat(PixelFormat value) { format = value; }
+    PixelFormat pixelFormat() const { return format; }
+    void setBlendingEnabled(bool value) { blending = value; }
+    void setSourceRGBBlendFactor(BlendFactor value) { sourceRGB = value; }
+    void setDestinationRGBBlendFactor(BlendFactor value) { destinationRGB = value; }
+    void setRgbBlendOperation(BlendOperation value) { rgbOperation = value; }
+    void setSourceAlphaBlendFactor(BlendFactor value) { sourceAlpha = value; }
+    void setDestinationAlphaBlendFactor(BlendFactor value) { destinationAlpha = value; }
+    void setAlphaBlendOperation(BlendOperation value) { alphaOperation = value; }
+    void setWriteMask(ColorWriteMask value) { writeMask = value; }
+
+private:
+    PixelFormat format{PixelFormatInvalid};
+    bool blending{false};
+    BlendFactor sourceRGB{BlendFactorOne};
+    BlendFactor destinationRGB{BlendFactorZero};
+    BlendOperation rgbOperation{BlendOperationAdd};
+    BlendFactor sourceAlpha{BlendFactorOne};
+    BlendFactor destinationAlpha{BlendFactorZero};
+    BlendOperation alphaOperation{BlendOperationAdd};
+    ColorWriteMask writeMask{ColorWriteMaskAll};
+};
+
+class RenderPipelineColorAttachmentDescriptorArray {
+public:
+    RenderPipelineColorAttachmentDescriptor* object(NS::UInteger index) { return &attachments[index]; }
+
+private:
+    RenderPipelineColorAttachmentDescriptor attachments[8];
+};
+
+class RenderPipelineDescriptor : public NS::Referencing<RenderPipelineDescriptor> {
+public:
+    static RenderPipelineDescriptor* alloc() { return new RenderPipelineDescriptor(); }
+    RenderPipelineDescriptor* init() { return this; }
+
+    void setVertexFunction(Function* function) { vertexFunction = function; }
+    void setFragmentFunction(Function* function) { fragmentFunction = function; }
+    RenderPipelineColorAttachmentDescriptorArray* colorAttachments() { return &colors; }
+    void setSampleCount(NS::UInteger value) { samples = value; }
+    void setDepthAttachmentPixelFormat(PixelFormat value) { depthFormat = value; }
+    void setStencilAttachmentPixelFormat(PixelFormat value) { stencilFormat = value; }
+
+private:
+    friend class Device;
+    RenderPipelineDescriptor() = default;
+
+    Function* vertexFunction{nullptr};
+    Function* fragmentFunction{nullptr};
+    RenderPipelineColorAttachmentDescriptorArray colors;
+    NS::UInteger samples{1};
+    PixelFormat depthFormat{PixelFormatInvalid};
+    PixelFormat stencilFormat{PixelFormatInvalid};
+};
+
+class RenderPipelineState : public NS::Referencing<RenderPipelineState> {
+private:
+    friend class Device;
+    RenderPipelineState() = default;
+};
+
+class DepthStencilDescriptor : public NS::Referencing<DepthStencilDescriptor> {
+public:
+    static DepthStencilDescriptor* alloc() { return new DepthStencilDescriptor(); }
+    DepthStencilDescriptor* init() { return this; }
+
+    void setDepthCompareFunction(CompareFunction value) { compare = value; }
+    void setDepthWriteEnabled(bool value) { writeEnabled = value; }
+
+private:
+    DepthStencilDescriptor() = default;
+
+    CompareFunction compare{CompareFunctionAlways};
+    bool writeEnabled{false};
+};
+
+class DepthStencilState : public NS::Referencing<DepthStencilState> {
+private:
+    friend class Device;
+    DepthStencilState() = default;
+};
+
+// Attachments do not retain their textures here; keep them alive while
+// the descriptor refers to them.
+class RenderPassAttachmentDescriptor {
+public:
+    void setTexture(Texture* value) { attachmentTexture = value; }
+    Texture* texture() const { return attachmentTexture; }
+    void setResolveTexture(Texture* value) { resolve = value; }
+    Texture* resolveTexture() const { return resolve; }
+    void setLoadAction(LoadAction value) { load = value; }
+    LoadAction loadAction() const { return load; }
+    void setStoreAction(StoreAction value) { store = value; }
+    StoreAction storeAction() const { return store; }
+
+private:
+    Texture* attachmentTexture{nullptr};
+    Texture* resolve{nullptr};
+    LoadAction load{LoadActionDontCare};
+    StoreAction store{StoreActionDontCare};
+};
+
+class RenderPassColorAttachmentDescriptor : public RenderPassAttachmentDescriptor {
+public:
+    void setClearColor(ClearColor value) { color = value; }
+    ClearColor clearColor() const { return color; }
+
+private:
+    ClearColor color{0.0, 0.0, 0.0, 1.0};
+};
+
+class RenderPassDepthAttachmentDescriptor : public RenderPassAttachmentDescriptor {
+public:
+    void setClearDepth(double value) { depth = value; }
+    double clearDepth() const { return depth; }
+
+private:
+    double depth{1.0};
+};
+
+class RenderPassColorAttachmentDescriptorArray {
+public:
+    RenderPassColorAttachmentDescriptor* object(NS::UInteger index) { return &attachments[index]; }
+
+private:
+    RenderPassColorAttachmentDescriptor attachments[8];
+};
+
+class RenderPassDescriptor : public NS::Referencing<RenderPassDescriptor> {
+public:
+    static RenderPassDescriptor* alloc() { return new RenderPassDescriptor(); }
+    static RenderPassDescriptor* renderPassDescriptor() { return alloc()->autorelease(); }
+    RenderPassDescriptor* init() { return this; }
+
+    RenderPassColorAttachmentDescriptorArray* colorAttachments() { return &colors; }
+    RenderPassDepthAttachmentDescriptor* depthAttachment() { return &depth; }
+    NS::UInteger renderTargetWidth() const { return targetWidth; }
+    void setRenderTargetWidth(NS::UInteger width) { targetWidth = width; }
+    NS::UInteger renderTargetHeight() const { return targetHeight; }
+    void setRenderTargetHeight(NS::UInteger height) { targetHeight = height; }
+
+private:
+    RenderPassDescriptor() = default;
+
+    RenderPassColorAttachmentDescriptorArray colors;
+    RenderPassDepthAttachmentDescriptor depth;
+    NS::UInteger targetWidth{0};
+    NS::UInteger targetHeight{0};
+};
+
+class Drawable : public NS::Referencing<Drawable> {
+};
+
+class RenderCommandEncoder : public NS::Referencing<RenderCommandEncoder> {
+public:
+    void setRenderPipelineState(const RenderPipelineState*) { logCall(Call::SetRenderPipelineState, this); }
+    void setDepthStencilState(const DepthStencilState*) { logCall(Call::SetDepthStencilState, this); }
+    void setFrontFacingWinding(Winding) { logCall(Call::SetFrontFacingWinding, this); }
+    void setCullMode(CullMode) { logCall(Call::SetCullMode, this); }
+    void setTriangleFillMode(TriangleFillMode) { logCall(Call::SetTriangleFillMode, this); }
+    void setVertexBuffer(const Buffer*, NS::UInteger, NS::UInteger) { logCall(Call::SetVertexBuffer, this); }
+    void setVertexBufferOffset(NS::UInteger, NS::UInteger) { logCall(Call::SetVertexBufferOffset, this); }
+    void setFragmentBuffer(const Buffer*, NS::UInteger, NS::UInteger) { logCall(Call::SetFragmentBuffer, this); }
+    void setFragmentTexture(const Texture*, NS::UInteger) { logCall(Call::SetFragmentTexture, this); }
+    void drawPrimitives(PrimitiveType, NS::UInteger, NS::UInteger) { logCall(Call::DrawPrimitives, this); }
+    void endEncoding() { logCall(Call::EndEncoding, this); }
+
+private:
+    friend class CommandBuffer;
+    RenderCommandEncoder() = default;
+};
+
+class BlitCommandEncoder : public NS::Referencing<BlitCommandEncoder> {
+public:
+    void copyFromBuffer(const Buffer*, NS::UInteger, NS::UInteger, NS::UInteger, Size, const Texture*, NS::UInteger,
+                        NS::UInteger, Origin) {
+        logCall(Call::CopyFromBuffer, this);
+    }
+    void endEncoding() { logCall(Call::EndEncoding, this); }
+
+private:
+    friend class CommandBuffer;
+    BlitCommandEncoder() = default;
+};
+
+class CommandBuffer;
+using CommandBufferHandler = std::function<void(CommandBuffer*)>;
+
+// Completes as soon as it is committed: completion handlers run inside
+// commit() and waitUntilCompleted() returns at once.
+class CommandBuffer : public NS::Referencing<CommandBuffer> {
+public:
+    RenderCommandEncoder* renderCommandEncoder(const RenderPassDescriptor*) {
+        logCall(Call::RenderCommandEncoder, this);
+        return (new RenderCommandEncoder())->autorelease();
+    }
+
+    BlitCommandEncoder* blitCommandEncoder() {
+        logCall(Call::BlitCommandEncoder, this);
+        return (new BlitCommandEncoder())->autorelease();
+    }
+
+    void presentDrawable(Drawable*) { logCall(Call::PresentDrawable, this); }
+
+    void addCompletedHandler(const CommandBufferHandler& handler) {
+        logCall(Call::AddCompletedHandler, this);
+        completedHandlers.push_back(handler);
+    }
+
+    void commit() {
+        logCall(Call::Commit, this);
+        std::vector<CommandBufferHandler> handlers;
+        handlers.swap(completedHandlers);
+        for (const CommandBufferHandler& handler : handlers) {
+            handler(this);
+        }
+    }
+
+    void waitUntilCompleted() { logCall(Call::WaitUntilCompleted, this); }
+
+private:
+    friend class CommandQueue;
+    CommandBuffer() = default;
+
+    std::vector<CommandBufferHandler> completedHandlers;
+};
+
+class CommandQueue : public NS::Referencing<CommandQueue> {
+public:
+    CommandBuffer* commandBuffer() {
+        logCall(Call::CommandBuffer, this);
+        return (new CommandBuffer())->autorelease();
+    }
+
+private:
+    friend class Device;
+    CommandQueue() = default;
+};
+
+class Device : public NS::Referencing<Device> {
+public:
+    NS::String* name() const { return NS::String::string("Null Device", NS::UTF8StringEncoding); }
+
+    Buffer* newBuffer(NS::UInteger length, ResourceOptions) {
+        logCall(Call::NewBuffer, this);
+        return new Buffer(length);
+    }
+
+    Buffer* newBuffer(const void* pointer, NS::UInteger length, ResourceOptions) {
+        logCall(Call::NewBuffer, this);
+        Buffer* buffer = new Buffer(length);
+        std::memcpy(buffer->contents(), pointer, length);
+        return buffer;
+    }
+
+    Texture* newTexture(const TextureDescriptor* descriptor) {
+        logCall(Call::NewTexture, this);
+        return new Texture(descriptor->properties);
+    }
+
+    SizeAndAlign heapTextureSizeAndAlign(const TextureDescriptor* descriptor) const {
+        return Heap::textureSizeAndAlign(descriptor);
+    }
+
+    Heap* newHeap(const HeapDescriptor* descriptor) {
+        logCall(Call::NewHeap, this);
+        return new Heap(descriptor->type, descriptor->size);
+    }
+
+    CommandQueue* newCommandQueue() {
+        logCall(Call::NewCommandQueue, this);
+        return new CommandQueue();
+    }
+
+    Library* newDefaultLibrary() {
+        logCall(Call::NewLibrary, this);
+        return new Library();
+    }
+
+    // Fails like Metal does when the descriptor has no vertex function.
+    RenderPipelineState* newRenderPipelineState(const RenderPipelineDescriptor* descriptor, NS::Error** error) {
+        logCall(Call::NewRenderPipelineState, this);
+        if (!descriptor->vertexFunction) {
+            if (error) {
+                *error = NS::Error::error("Vertex function is not set.");
+            }
+            return nullptr;
+        }
+        if (error) {
+            *error = nullptr;
+        }
+        return new RenderPipelineState();
+    }
+
+    DepthStencilState* newDepthStencilState(const DepthStencilDescriptor*) {
+        logCall(Call::NewDepthStencilState, this);
+        return new DepthStencilState();
+    }
+
+private:
+    friend Device* CreateSystemDefaultDevice();
+    Device() = default;
+};
+
+inline Device* CreateSystemDefaultDevice() {
+    return new Device();
+}
+
+}
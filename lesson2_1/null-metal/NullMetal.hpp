@@ -0,0 +1,162 @@
+//
+//  NullMetal.hpp
+//  Metal-Guide
+//
+//  Null implementation of the metal-cpp subset MTLEngine uses, for
+//  measuring the CPU side of setup and encoding where there is no Metal
+//  device. Put this directory ahead of metal-cpp on the include path and
+//  <Foundation/Foundation.hpp>, <Metal/Metal.hpp> and
+//  <QuartzCore/QuartzCore.hpp> resolve to headers with the same classes
+//  and signatures. Objects are reference counted like the real ones and
+//  buffers have real contents. Textures hold only what replaceRegion
+//  writes, nothing is drawn, and a committed command buffer completes at
+//  once.
+//
+//  Device, queue, command buffer and encoder calls are appended to a
+//  command log with a timestamp, so a benchmark can count calls per frame
+//  and see where encoding time goes. Descriptor setters are not logged;
+//  they stay on the CPU in Metal too.
+//
+
+#pragma once
+
+// Lets code that builds against either implementation tell them apart.
+#define NULL_METAL 1
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace NullMetal {
+
+enum class Call : uint8_t {
+    NewBuffer,
+    NewTexture,
+    NewHeap,
+    NewCommandQueue,
+    NewLibrary,
+    NewFunction,
+    NewRenderPipelineState,
+    NewDepthStencilState,
+    NextDrawable,
+    CommandBuffer,
+    RenderCommandEncoder,
+    BlitCommandEncoder,
+    SetRenderPipelineState,
+    SetDepthStencilState,
+    SetFrontFacingWinding,
+    SetCullMode,
+    SetTriangleFillMode,
+    SetVertexBuffer,
+    SetVertexBufferOffset,
+    SetFragmentBuffer,
+    SetFragmentTexture,
+    DrawPrimitives,
+    CopyFromBuffer,
+    ReplaceRegion,
+    EndEncoding,
+    PresentDrawable,
+    AddCompletedHandler,
+    Commit,
+    WaitUntilCompleted,
+    Count
+};
+
+inline const char* callName(Call call) {
+    static const char* const names[] = {
+        "newBuffer", "newTexture", "newHeap", "newCommandQueue", "newLibrary", "newFunction", "newRenderPipelineState",
+        "newDepthStencilState", "nextDrawable", "commandBuffer", "renderCommandEncoder", "blitCommandEncoder",
+        "setRenderPipelineState", "setDepthStencilState", "setFrontFacingWinding", "setCullMode",
+        "setTriangleFillMode", "setVertexBuffer", "setVertexBufferOffset", "setFragmentBuffer",
+        "setFragmentTexture", "drawPrimitives", "copyFromBuffer", "replaceRegion", "endEncoding",
+        "presentDrawable", "addCompletedHandler", "commit", "waitUntilCompleted",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == size_t(Call::Count));
+    return call < Call::Count ? names[size_t(call)] : "?";
+}
+
+// 16 bytes per call.
+struct Entry {
+    uint64_t nanoseconds;  // since the log was last reset
+    uint32_t object;       // id of the receiver, see NS::Object::nullId()
+    Call call;
+};
+
+class CommandLog {
+public:
+    CommandLog() { reset(); }
+
+    // Calls are only recorded while enabled, so the same loop can be timed
+    // with and without the cost of logging.
+    void setEnabled(bool value) { isEnabled.store(value, std::memory_order_relaxed); }
+    bool enabled() const { return isEnabled.load(std::memory_order_relaxed); }
+
+    void record(Call call, uint32_t object) {
+        if (!enabled()) {
+            return;
+        }
+        const uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded.push_back({now - epoch, object, call});
+        ++counts[size_t(call)];
+    }
+
+    // Hands over the entries recorded since the last take() or reset().
+    // Counts keep accumulating.
+    std::vector<Entry> take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Entry> entries;
+        entries.swap(recorded);
+        return entries;
+    }
+
+    uint64_t count(Call call) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counts[size_t(call)];
+    }
+
+    uint64_t totalCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t total = 0;
+        for (uint64_t count : counts) {
+            total += count;
+        }
+        return total;
+    }
+
+    // Drops entries and counts and restarts the clock.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded.clear();
+        counts.fill(0);
+        epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    std::atomic<bool> isEnabled{true};
+    mutable std::mutex mutex;
+    std::vector<Entry> recorded;
+    std::array<uint64_t, size_t(Call::Count)> counts{};
+    uint64_t epoch;
+};
+
+inline CommandLog& commandLog() {
+    static CommandLog log;
+    return log;
+}
+
+// Objects constructed and not yet freed, for spotting leaks and double
+// releases in code run against the null device.
+inline std::atomic<int64_t> liveObjects{0};
+
+inline uint32_t newObjectId() {
+    static std::atomic<uint32_t> next{0};
+    return next.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+}
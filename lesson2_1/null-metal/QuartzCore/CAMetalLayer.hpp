@@ -0,0 +1,101 @@
+//
+//  CAMetalLayer.hpp
+//  Metal-Guide
+//
+//  Null stand-in for CA::MetalLayer and CA::MetalDrawable. The layer cycles
+//  through three drawable textures of its current size, like a real
+//  swapchain, and never blocks. See NullMetal.hpp.
+//
+
+#pragma once
+
+#include "../Metal/Metal.hpp"
+
+using CGFloat = double;
+
+struct CGSize {
+    CGFloat width;
+    CGFloat height;
+};
+
+inline CGSize CGSizeMake(CGFloat width, CGFloat height) {
+    return CGSize{width, height};
+}
+
+namespace CA {
+
+class MetalDrawable : public NS::Referencing<MetalDrawable, MTL::Drawable> {
+public:
+    MTL::Texture* texture() const { return drawableTexture; }
+
+private:
+    friend class MetalLayer;
+    explicit MetalDrawable(MTL::Texture* texture) : drawableTexture(texture->retain()) {}
+    ~MetalDrawable() override { drawableTexture->release(); }
+
+    MTL::Texture* drawableTexture;
+};
+
+class MetalLayer : public NS::Referencing<MetalLayer> {
+public:
+    static MetalLayer* layer() { return (new MetalLayer())->autorelease(); }
+
+    void setDevice(MTL::Device* value) { layerDevice = value; }
+    MTL::Device* device() const { return layerDevice; }
+
+    void setPixelFormat(MTL::PixelFormat value) {
+        if (value != format) {
+            format = value;
+            releaseTextures();
+        }
+    }
+    MTL::PixelFormat pixelFormat() const { return format; }
+
+    void setDrawableSize(CGSize value) {
+        if (value.width != size.width || value.height != size.height) {
+            size = value;
+            releaseTextures();
+        }
+    }
+    CGSize drawableSize() const { return size; }
+
+    MetalDrawable* nextDrawable() {
+        MTL::logCall(MTL::Call::NextDrawable, this);
+        MTL::Texture*& texture = textures[next];
+        next = (next + 1) % kDrawableCount;
+        if (!texture) {
+            MTL::TextureDescriptor::Properties properties;
+            properties.format = format;
+            properties.width = NS::UInteger(size.width);
+            properties.height = NS::UInteger(size.height);
+            properties.usage = MTL::TextureUsageRenderTarget;
+            properties.storage = MTL::StorageModePrivate;
+            texture = new MTL::Texture(properties);
+        }
+        return (new MetalDrawable(texture))->autorelease();
+    }
+
+private:
+    static constexpr int kDrawableCount = 3;
+
+    MetalLayer() = default;
+    ~MetalLayer() override { releaseTextures(); }
+
+    // Drawables already handed out keep their texture alive.
+    void releaseTextures() {
+        for (MTL::Texture*& texture : textures) {
+            if (texture) {
+                texture->release();
+                texture = nullptr;
+            }
+        }
+    }
+
+    MTL::Device* layerDevice{nullptr};
+    MTL::PixelFormat format{MTL::PixelFormatBGRA8Unorm};
+    CGSize size{1.0, 1.0};
+    MTL::Texture* textures[kDrawableCount]{};
+    int next{0};
+};
+
+}
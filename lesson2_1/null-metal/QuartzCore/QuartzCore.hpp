@@ -0,0 +1,10 @@
+//
+//  QuartzCore.hpp
+//  Metal-Guide
+//
+//  Null stand-in for metal-cpp's QuartzCore. See NullMetal.hpp.
+//
+
+#pragma once
+
+#include "CAMetalLayer.hpp"
@@ -0,0 +1,164 @@
+//
+//  atlasbench.cpp
+//  Metal-Guide
+//
+//  Packs 10k random sprites with AtlasPacker, opening a new page whenever
+//  one fills up, and reports packing time and occupancy. Sprites are packed
+//  in arrival order (as TextureAtlas sees them when textures stream in) and
+//  sorted tallest first (a batch build). Before that it adds sprites to a
+//  TextureAtlas on the null Metal device in null-metal/ and checks:
+//  - Every sprite reads back from the atlas texture where its region says.
+//  - The gutter around it repeats the nearest edge texel.
+//  - remapTextureCoordinates maps a sprite's corners onto its region.
+//  Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Inull-metal -Iexternal -IMetal-Tutorial tools/atlasbench.cpp
+//        Metal-Tutorial/atlas_packer.cpp Metal-Tutorial/texture_atlas.cpp
+//        Metal-Tutorial/pixel_convert.cpp external/stb/stb_image.cpp
+//        external/stb/stb_image_pool.cpp -o atlasbench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "atlas_packer.hpp"
+#include "bench_util.hpp"
+#include "texture_atlas.hpp"
+
+struct Size {
+    int width;
+    int height;
+};
+
+// Sprite texels are unique per sprite, so a texel landing in the wrong place
+// does not match by accident.
+static uint32_t spriteTexel(int sprite, int x, int y) {
+    return uint32_t(sprite) << 24 | uint32_t(y) << 12 | uint32_t(x);
+}
+
+static bool checkAtlas() {
+    constexpr int kAtlasSize = 256;
+    constexpr int kPadding = 3;
+    MTL::Device* device = MTL::CreateSystemDefaultDevice();
+    TextureAtlas atlas(device, kAtlasSize, kAtlasSize, kPadding);
+
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> side(1, 40);
+    struct Added {
+        int width;
+        int height;
+        AtlasRegion region;
+    };
+    std::vector<Added> added;
+    for (int sprite = 0; sprite < 24; ++sprite) {
+        const int width = side(random), height = side(random);
+        std::vector<uint32_t> pixels(size_t(width) * height);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                pixels[size_t(y) * width + x] = spriteTexel(sprite, x, y);
+            }
+        }
+        AtlasRegion region;
+        if (!atlas.add(reinterpret_cast<const uint8_t*>(pixels.data()), width, height, region)) {
+            break;
+        }
+        added.push_back({width, height, region});
+    }
+
+    std::vector<uint32_t> atlasPixels(size_t(kAtlasSize) * kAtlasSize);
+    atlas.texture->getBytes(atlasPixels.data(), kAtlasSize * 4, MTL::Region(0, 0, kAtlasSize, kAtlasSize), 0);
+
+    bool passed = check(added.size() > 8, "enough sprites fit to check");
+    bool placed = true, gutter = true, remapped = true;
+    for (size_t sprite = 0; sprite < added.size(); ++sprite) {
+        const Added& a = added[sprite];
+        const float left = a.region.offset[0] * kAtlasSize, bottom = a.region.offset[1] * kAtlasSize;
+        placed &= a.region.scale[0] * kAtlasSize == a.width && a.region.scale[1] * kAtlasSize == a.height &&
+                  left == std::floor(left) && bottom == std::floor(bottom);
+        // The sprite and its gutter: every texel there holds the sprite texel
+        // nearest to it.
+        for (int y = -kPadding; y < a.height + kPadding; ++y) {
+            for (int x = -kPadding; x < a.width + kPadding; ++x) {
+                const uint32_t texel = atlasPixels[size_t(bottom + y) * kAtlasSize + size_t(left + x)];
+                const uint32_t expected =
+                    spriteTexel(int(sprite), std::clamp(x, 0, a.width - 1), std::clamp(y, 0, a.height - 1));
+                const bool inside = x >= 0 && y >= 0 && x < a.width && y < a.height;
+                (inside ? placed : gutter) &= texel == expected;
+            }
+        }
+
+        struct Vertex {
+            float position[4];
+            float textureCoordinate[2];
+        };
+        Vertex corners[2] = {{{}, {0.0f, 0.0f}}, {{}, {1.0f, 1.0f}}};
+        remapTextureCoordinates(corners, 2, a.region);
+        remapped &= corners[0].textureCoordinate[0] == a.region.offset[0] &&
+                    corners[0].textureCoordinate[1] == a.region.offset[1] &&
+                    std::fabs(corners[1].textureCoordinate[0] * kAtlasSize - (left + a.width)) < 1e-3f &&
+                    std::fabs(corners[1].textureCoordinate[1] * kAtlasSize - (bottom + a.height)) < 1e-3f;
+    }
+    passed &= check(placed, "sprites read back at their regions");
+    passed &= check(gutter, "gutters repeat the nearest edge texel");
+    passed &= check(remapped, "remapTextureCoordinates maps corners onto the region");
+    device->release();
+    return passed;
+}
+
+static void pack(const char* name, const std::vector<Size>& sprites, int atlasSize, int padding) {
+    std::vector<AtlasPacker> pages;
+    pages.emplace_back(atlasSize, atlasSize);
+    uint64_t spriteArea = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const Size& sprite : sprites) {
+        int x, y;
+        if (!pages.back().insert(sprite.width + 2 * padding, sprite.height + 2 * padding, x, y)) {
+            pages.emplace_back(atlasSize, atlasSize);
+            pages.back().insert(sprite.width + 2 * padding, sprite.height + 2 * padding, x, y);
+        }
+        spriteArea += uint64_t(sprite.width) * sprite.height;
+    }
+    double seconds = secondsSince(start);
+
+    // Measure against the area actually used: every page but the last is
+    // full, and the last one only up to its skyline.
+    double usedArea = double(atlasSize) * atlasSize * (pages.size() - 1) + double(atlasSize) * pages.back().usedHeight();
+    double paddedArea = 0.0;
+    for (const AtlasPacker& page : pages) {
+        paddedArea += page.occupancy() * double(atlasSize) * atlasSize;
+    }
+    std::cout << name << ": " << seconds * 1e3 << " ms (" << sprites.size() / seconds / 1e6 << " M sprites/s), "
+              << pages.size() << " page(s), occupancy " << 100.0 * paddedArea / usedArea << "% with padding, "
+              << 100.0 * spriteArea / usedArea << "% sprite texels" << std::endl;
+}
+
+int main() {
+    constexpr int kSpriteCount = 10000;
+    constexpr int kAtlasSize = 4096;
+    constexpr int kPadding = 4;
+
+    const bool passed = checkAtlas();
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> side(8, 64);
+    std::vector<Size> sprites(kSpriteCount);
+    for (Size& sprite : sprites) {
+        sprite = {side(random), side(random)};
+    }
+    std::vector<Size> blocks(kSpriteCount, Size{16, 16});
+
+    std::cout << kSpriteCount << " sprites, " << kAtlasSize << "^2 pages, " << kPadding << " texel padding" << std::endl;
+    pack("random, arrival order", sprites, kAtlasSize, kPadding);
+    std::sort(sprites.begin(), sprites.end(), [](Size a, Size b) { return a.height > b.height; });
+    pack("random, tallest first", sprites, kAtlasSize, kPadding);
+    pack("16x16 blocks", blocks, kAtlasSize, kPadding);
+    pack("16x16 blocks, no padding", blocks, kAtlasSize, 0);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
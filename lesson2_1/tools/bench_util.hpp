@@ -0,0 +1,53 @@
+//
+//  bench_util.hpp
+//  Metal-Guide
+//
+//  Checks and timers shared by the programs in tools/. Header-only, so the
+//  build lines in each tool need nothing extra.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// Prints what failed and hands the result back, so checks chain with &=.
+inline bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::cout << "FAIL " << what << std::endl;
+    }
+    return condition;
+}
+
+inline bool check(bool condition, const char* what, double value, double expected) {
+    if (!condition) {
+        std::cout << "FAIL " << what << ": " << value << ", expected " << expected << std::endl;
+    }
+    return condition;
+}
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline double microsecondsSince(std::chrono::steady_clock::time_point start) {
+    return secondsSince(start) * 1e6;
+}
+
+inline double nanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return secondsSince(start) * 1e9;
+}
+
+// The fastest of runs calls, in seconds. The minimum is the run least
+// disturbed by the rest of the machine.
+template <typename Function>
+double bestSeconds(int runs, Function&& function) {
+    double best = 1e30;
+    for (int run = 0; run < runs; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, secondsSince(start));
+    }
+    return best;
+}
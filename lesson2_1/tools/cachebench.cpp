@@ -0,0 +1,233 @@
+//
+//  cachebench.cpp
+//  Metal-Guide
+//
+//  Times loading a texture corpus through Texture on the null Metal device
+//  in null-metal/, three ways: without a TextureCache, with an empty cache
+//  that every load fills (cold start), and with the filled cache (warm
+//  start). The null device copies every replaceRegion into the texture, as
+//  Metal does. The corpus is the given files, or synthetic 2048^2 RGB and
+//  RGBA PNGs with every fourth image a 2048x1024 Radiance .hdr. Checks:
+//  - The warm run is served entirely from the cache.
+//  - Every level of a cache hit reads back byte-identical to a fresh decode.
+//  Exits non-zero when a check fails. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Inull-metal -Iexternal -IMetal-Tutorial tools/cachebench.cpp
+//        Metal-Tutorial/texture.cpp Metal-Tutorial/texture_cache.cpp
+//        Metal-Tutorial/mapped_file.cpp Metal-Tutorial/image_resize.cpp
+//        Metal-Tutorial/pixel_convert.cpp Metal-Tutorial/qoi.cpp
+//        Metal-Tutorial/thread_pool.cpp Metal-Tutorial/upload_queue.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -lz -o cachebench
+//
+//  Usage: cachebench [--generate N] [--mipmapped] [--max-dimension N] [files...]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "bench_util.hpp"
+#include "texture.hpp"
+
+namespace fs = std::filesystem;
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.insert(out.end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    putBigEndian(out, uint32_t(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBigEndian(out, uint32_t(crc32(0, out.data() + start, uInt(out.size() - start))));
+}
+
+// A noisy gradient, Sub-filtered and deflated at the default level, so it
+// compresses and decodes about like a photo.
+static std::vector<uint8_t> makePng(int size, int channels, std::mt19937& random) {
+    const size_t rowBytes = size_t(size) * channels;
+    std::vector<uint8_t> filtered;
+    filtered.reserve((rowBytes + 1) * size);
+    std::vector<uint8_t> row(rowBytes);
+    const int phase = int(random() % 256);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                const int gradient = c == 3 ? 255 - y / 16 : (x * (c + 1) + y * (3 - c)) / 16 + phase;
+                row[size_t(x) * channels + c] = uint8_t(gradient + int(random() % 8));
+            }
+        }
+        filtered.push_back(1);
+        for (size_t i = 0; i < rowBytes; ++i) {
+            filtered.push_back(uint8_t(row[i] - (i >= size_t(channels) ? row[i - channels] : 0)));
+        }
+    }
+
+    uLongf compressedSize = compressBound(uLong(filtered.size()));
+    std::vector<uint8_t> compressed(compressedSize);
+    compress2(compressed.data(), &compressedSize, filtered.data(), uLong(filtered.size()), Z_DEFAULT_COMPRESSION);
+    compressed.resize(compressedSize);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    putBigEndian(header, uint32_t(size));
+    putBigEndian(header, uint32_t(size));
+    header.insert(header.end(), {8, uint8_t(channels == 4 ? 6 : 2), 0, 0, 0});
+    putChunk(png, "IHDR", header.data(), header.size());
+    putChunk(png, "IDAT", compressed.data(), compressed.size());
+    putChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+// A sky with a bright sun, as flat (not run-length encoded) RGBE scanlines.
+static std::vector<uint8_t> makeHdr(int width, int height, std::mt19937& random) {
+    const std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " +
+                               std::to_string(width) + "\n";
+    std::vector<uint8_t> hdr(header.begin(), header.end());
+    const int sunX = int(random() % uint32_t(width));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float dx = float(x - sunX), dy = float(y - height / 4);
+            const float sun = 2000.0f * std::exp(-(dx * dx + dy * dy) / 400.0f);
+            const float rgb[3] = {0.3f + sun, 0.5f + sun, 1.0f + float(y) / height + sun};
+            const float v = std::max({rgb[0], rgb[1], rgb[2]});
+            int exponent;
+            const float scale = std::frexp(v, &exponent) * 256.0f / v;
+            hdr.insert(hdr.end(), {uint8_t(rgb[0] * scale), uint8_t(rgb[1] * scale), uint8_t(rgb[2] * scale),
+                                   uint8_t(exponent + 128)});
+        }
+    }
+    return hdr;
+}
+
+static std::vector<std::string> generateCorpus(const fs::path& directory, int count) {
+    fs::create_directories(directory);
+    std::mt19937 random(11);
+    std::vector<std::string> files;
+    for (int i = 0; i < count; ++i) {
+        const bool hdr = i % 4 == 3;
+        const fs::path path = directory / ("image" + std::to_string(i) + (hdr ? ".hdr" : ".png"));
+        const std::vector<uint8_t> bytes = hdr ? makeHdr(2048, 1024, random) : makePng(2048, i % 2 ? 4 : 3, random);
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+        files.push_back(path.string());
+    }
+    return files;
+}
+
+// Loads every file once and returns the time taken.
+static double loadAll(const std::vector<std::string>& files, MTL::Device* device, const TextureOptions& options) {
+    const auto start = std::chrono::steady_clock::now();
+    for (const std::string& file : files) {
+        Texture texture(file.c_str(), device, options);
+    }
+    return secondsSince(start);
+}
+
+// Every level of both textures, read back and compared byte for byte.
+static bool sameTexels(MTL::Texture* a, MTL::Texture* b) {
+    if (a->width() != b->width() || a->height() != b->height() || a->pixelFormat() != b->pixelFormat() ||
+        a->mipmapLevelCount() != b->mipmapLevelCount()) {
+        return false;
+    }
+    const size_t bytesPerPixel = a->pixelFormat() == MTL::PixelFormatRGBA16Float ? 8 : 4;
+    for (NS::UInteger level = 0; level < a->mipmapLevelCount(); ++level) {
+        const NS::UInteger width = std::max<NS::UInteger>(a->width() >> level, 1);
+        const NS::UInteger height = std::max<NS::UInteger>(a->height() >> level, 1);
+        const MTL::Region region(0, 0, width, height);
+        std::vector<uint8_t> texelsA(width * height * bytesPerPixel), texelsB(texelsA.size());
+        a->getBytes(texelsA.data(), width * bytesPerPixel, region, level);
+        b->getBytes(texelsB.data(), width * bytesPerPixel, region, level);
+        if (texelsA != texelsB) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int generateCount = 16;
+    TextureOptions options;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--generate" && i + 1 < argc) {
+            generateCount = std::max(std::atoi(argv[++i]), 1);
+        } else if (argument == "--mipmapped") {
+            options.mipmapped = true;
+        } else if (argument == "--max-dimension" && i + 1 < argc) {
+            options.maxDimension = std::max(std::atoi(argv[++i]), 0);
+        } else if (argument.rfind("--", 0) == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--generate N] [--mipmapped] [--max-dimension N] [files...]"
+                      << std::endl;
+            return 1;
+        } else {
+            files.push_back(argument);
+        }
+    }
+
+    const fs::path scratch = fs::temp_directory_path() / ("cachebench-" + std::to_string(std::random_device()()));
+    if (files.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        files = generateCorpus(scratch / "corpus", generateCount);
+        std::cout << "Generated " << files.size() << " images in " << secondsSince(start) << " s" << std::endl;
+    }
+    uint64_t sourceBytes = 0;
+    for (const std::string& file : files) {
+        sourceBytes += fs::file_size(file);
+    }
+
+    MTL::Device* device = MTL::CreateSystemDefaultDevice();
+    TextureCache cache((scratch / "cache").string());
+    TextureOptions cached = options;
+    cached.cache = &cache;
+
+    // Untimed, so all three runs start with the files in the page cache.
+    loadAll(files, device, options);
+    const double uncachedSeconds = loadAll(files, device, options);
+    const double coldSeconds = loadAll(files, device, cached);
+    const uint64_t coldHits = cache.hits(), coldMisses = cache.misses();
+    const double warmSeconds = loadAll(files, device, cached);
+
+    uint64_t cacheBytes = 0;
+    for (const fs::directory_entry& entry : fs::directory_iterator(scratch / "cache")) {
+        cacheBytes += entry.file_size();
+    }
+    std::cout << files.size() << " images, " << (sourceBytes >> 20) << " MB of files, " << (cacheBytes >> 20)
+              << " MB cached" << (options.mipmapped ? ", mipmapped" : "") << std::endl;
+    std::cout << "uncached: " << uncachedSeconds * 1e3 << " ms" << std::endl;
+    std::cout << "cold:     " << coldSeconds * 1e3 << " ms (" << coldSeconds / uncachedSeconds << "x uncached)"
+              << std::endl;
+    std::cout << "warm:     " << warmSeconds * 1e3 << " ms (" << uncachedSeconds / warmSeconds << "x faster)"
+              << std::endl;
+
+    // QOI files that stream straight into the texture never reach the
+    // cache, and files with the same contents share an entry.
+    bool passed = check(cache.misses() == coldMisses && cache.hits() - coldHits == coldHits + coldMisses,
+                        "warm run served from the cache");
+    bool identical = true;
+    for (const std::string& file : files) {
+        Texture fresh(file.c_str(), device, options);
+        Texture hit(file.c_str(), device, cached);
+        if (!sameTexels(fresh.texture, hit.texture)) {
+            std::cout << file << ": cache hit differs from a fresh decode" << std::endl;
+            identical = false;
+        }
+    }
+    passed &= check(identical, "cache hits byte-identical to fresh decodes");
+
+    device->release();
+    std::error_code error;
+    fs::remove_all(scratch, error);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
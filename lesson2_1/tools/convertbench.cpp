@@ -0,0 +1,179 @@
+//
+//  convertbench.cpp
+//  Metal-Guide
+//
+//  Times each PixelConvert kernel against its Scalar reference on a 4K
+//  image and reports GB/s (bytes read plus written). Each kernel is also
+//  checked to match the reference bit for bit, on the whole image and on
+//  short unaligned runs that end in a tail. Float inputs mostly lie just
+//  outside [0, 1] either side, with NaN, infinities, half subnormals and
+//  values past the half range mixed in. flipVertically flips the image as
+//  3840-texel rows, and the short runs as 23-texel ones. linearToSrgb is checked to
+//  clamp out-of-range, infinite and NaN inputs. The SIMD paths are picked at
+//  run time, so no -m flags are needed. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/convertbench.cpp
+//        Metal-Tutorial/pixel_convert.cpp -o convertbench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "pixel_convert.hpp"
+
+struct Kernel {
+    const char* name;
+    size_t srcBytesPerPixel;
+    size_t dstBytesPerPixel;
+    // (src, dst, pixels); in-place kernels copy src to dst first in both versions.
+    std::function<void(const uint8_t*, uint8_t*, size_t)> simd;
+    std::function<void(const uint8_t*, uint8_t*, size_t)> scalar;
+    bool floatSource{false};
+};
+
+// HDR sources can hold any float. Out-of-range values clamp, and NaN
+// must come out as 0 instead of indexing past the sRGB table.
+static bool checkLinearToSrgbClamps() {
+    const float nan = std::nanf(""), inf = INFINITY;
+    const float src[8] = {nan, -nan, inf, -inf, -1.0f, 2.0f, 1.0f, nan};
+    const uint8_t expected[8] = {0, 0, 255, 0, 0, 255, 255, 0};
+    uint8_t dst[8];
+    PixelConvert::linearToSrgb(src, dst, 2);
+    const bool same = std::equal(dst, dst + 8, expected);
+    if (!same) {
+        std::cout << "linearToSrgb: out-of-range or NaN inputs not clamped" << std::endl;
+    }
+    return same;
+}
+
+// Flips n pixels as rows of the image's width, or of an odd short width
+// for the tail checks; pixels past the last whole row are left alone.
+static void flip(const uint8_t* src, uint8_t* dst, size_t n, bool scalar) {
+    constexpr size_t kWidth = 3840, kShortWidth = 23;
+    const size_t rowPixels = n >= kWidth ? kWidth : kShortWidth;
+    std::memcpy(dst, src, n * 4);
+    if (scalar) {
+        PixelConvert::Scalar::flipVertically(dst, rowPixels * 4, n / rowPixels);
+    } else {
+        PixelConvert::flipVertically(dst, rowPixels * 4, n / rowPixels);
+    }
+}
+
+int main() {
+    constexpr size_t kPixels = size_t(3840) * 2160;
+
+    std::mt19937 random(7);
+    std::vector<uint8_t> source(kPixels * 4 + 64);
+    for (uint8_t& byte : source) {
+        byte = uint8_t(random());
+    }
+    std::uniform_real_distribution<float> unit(-0.25f, 1.25f);
+    const float special[] = {std::nanf(""), INFINITY, -INFINITY, -0.0f, 1e-6f, 7e4f};
+    std::vector<float> floats(kPixels * 4 + 16);
+    for (size_t i = 0; i < floats.size(); ++i) {
+        floats[i] = i % 97 == 0 ? special[i / 97 % std::size(special)] : unit(random);
+    }
+    const uint8_t* floatSource = reinterpret_cast<const uint8_t*>(floats.data());
+
+    const Kernel kernels[] = {
+        {"rgbToRgba", 3, 4,
+         [](const uint8_t* src, uint8_t* dst, size_t n) { PixelConvert::rgbToRgba(src, dst, n); },
+         [](const uint8_t* src, uint8_t* dst, size_t n) { PixelConvert::Scalar::rgbToRgba(src, dst, n); }},
+        {"swapRedBlue", 4, 4,
+         [](const uint8_t* src, uint8_t* dst, size_t n) { PixelConvert::swapRedBlue(src, dst, n); },
+         [](const uint8_t* src, uint8_t* dst, size_t n) { PixelConvert::Scalar::swapRedBlue(src, dst, n); }},
+        {"premultiplyAlpha", 4, 4,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             std::memcpy(dst, src, n * 4);
+             PixelConvert::premultiplyAlpha(dst, n);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             std::memcpy(dst, src, n * 4);
+             PixelConvert::Scalar::premultiplyAlpha(dst, n);
+         }},
+        {"rgba8ToRgba16f", 4, 8,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::rgba8ToRgba16f(src, reinterpret_cast<uint16_t*>(dst), n);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::Scalar::rgba8ToRgba16f(src, reinterpret_cast<uint16_t*>(dst), n);
+         }},
+        {"srgbToLinear", 4, 16,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::srgbToLinear(src, reinterpret_cast<float*>(dst), n);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::Scalar::srgbToLinear(src, reinterpret_cast<float*>(dst), n);
+         }},
+        {"linearToSrgb", 16, 4,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::linearToSrgb(reinterpret_cast<const float*>(src), dst, n);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::Scalar::linearToSrgb(reinterpret_cast<const float*>(src), dst, n);
+         },
+         true},
+        {"floatToHalf (RGBA)", 16, 8,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::floatToHalf(reinterpret_cast<const float*>(src), reinterpret_cast<uint16_t*>(dst), n * 4);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::Scalar::floatToHalf(reinterpret_cast<const float*>(src), reinterpret_cast<uint16_t*>(dst), n * 4);
+         },
+         true},
+        {"rgb32fToRgba16f", 12, 8,
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::rgb32fToRgba16f(reinterpret_cast<const float*>(src), reinterpret_cast<uint16_t*>(dst), n);
+         },
+         [](const uint8_t* src, uint8_t* dst, size_t n) {
+             PixelConvert::Scalar::rgb32fToRgba16f(reinterpret_cast<const float*>(src), reinterpret_cast<uint16_t*>(dst), n);
+         },
+         true},
+        {"flipVertically", 4, 4,
+         [](const uint8_t* src, uint8_t* dst, size_t n) { flip(src, dst, n, false); },
+         [](const uint8_t* src, uint8_t* dst, size_t n) { flip(src, dst, n, true); }},
+    };
+
+    std::cout << "3840x2160, " << PixelConvert::instructionSets() << std::endl;
+    bool passed = checkLinearToSrgbClamps();
+    for (const Kernel& kernel : kernels) {
+        std::vector<uint8_t> simd(kPixels * kernel.dstBytesPerPixel + 64);
+        std::vector<uint8_t> scalar(simd.size());
+
+        const uint8_t* input = kernel.floatSource ? floatSource : source.data();
+        const double simdSeconds = bestSeconds(5, [&] { kernel.simd(input, simd.data(), kPixels); });
+        const double scalarSeconds = bestSeconds(5, [&] { kernel.scalar(input, scalar.data(), kPixels); });
+        const double bytes = double(kPixels) * (kernel.srcBytesPerPixel + kernel.dstBytesPerPixel);
+        std::cout << kernel.name << ": " << bytes / simdSeconds / 1e9 << " GB/s, scalar "
+                  << bytes / scalarSeconds / 1e9 << " GB/s (" << scalarSeconds / simdSeconds << "x)" << std::endl;
+        bool same = simd == scalar;
+
+        // Every run length up to a few blocks, from an odd offset, with
+        // guard bytes after the run that must be left alone.
+        const size_t window = 8 + 70 * kernel.dstBytesPerPixel + 16;
+        for (size_t n = 0; n < 70 && same; ++n) {
+            std::fill(simd.begin(), simd.begin() + window, 0xcd);
+            std::fill(scalar.begin(), scalar.begin() + window, 0xcd);
+            // Floats stay 4-byte aligned but start mid-vector.
+            const uint8_t* offsetInput = kernel.floatSource ? floatSource + 4 : source.data() + 3;
+            kernel.simd(offsetInput, simd.data() + 8, n);
+            kernel.scalar(offsetInput, scalar.data() + 8, n);
+            same = std::equal(simd.begin(), simd.begin() + window, scalar.begin()) &&
+                   simd[8 + n * kernel.dstBytesPerPixel] == 0xcd;
+        }
+        if (!same) {
+            std::cout << kernel.name << ": differs from the scalar reference" << std::endl;
+            passed = false;
+        }
+    }
+
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+//
+//  decodebench.cpp
+//  Metal-Guide
+//
+//  Decodes a corpus of images over and over, first with StbImagePool's
+//  cache turned off (every allocation goes to the system allocator), then
+//  with it on, and reports time per round and the pool's counters. Images
+//  are decoded on the thread pool and freed on the main thread, as texture
+//  uploads free them. Uses the given files, or assets/mc_grass.jpeg plus
+//  synthetic PNGs and BMPs. Also checks that pooled decodes match, that
+//  blocks freed after their thread exits are reused, and that nothing is
+//  left allocated. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/decodebench.cpp
+//        Metal-Tutorial/thread_pool.cpp external/stb/stb_image.cpp
+//        external/stb/stb_image_pool.cpp -o decodebench
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "stb/stb_image.h"
+#include "stb/stb_image_pool.h"
+#include "thread_pool.hpp"
+
+struct File {
+    std::string name;
+    std::vector<uint8_t> bytes;
+};
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.insert(out.end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    putBigEndian(out, uint32_t(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+// An RGBA PNG whose zlib stream uses stored blocks, split into IDAT chunks
+// of 64 KB. stb still inflates it and grows its output buffer as it goes.
+static File syntheticPng(int width, int height) {
+    std::vector<uint8_t> raw;
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        for (int x = 0; x < width; ++x) {
+            raw.insert(raw.end(), {uint8_t(x), uint8_t(y), uint8_t(x ^ y), 255});
+        }
+    }
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    for (size_t offset = 0; offset < raw.size(); offset += 65535) {
+        const uint16_t size = uint16_t(std::min<size_t>(65535, raw.size() - offset));
+        zlib.insert(zlib.end(), {uint8_t(offset + size == raw.size()), uint8_t(size), uint8_t(size >> 8),
+                                 uint8_t(~size), uint8_t(~size >> 8)});
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    putBigEndian(header, uint32_t(width));
+    putBigEndian(header, uint32_t(height));
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    putChunk(png, "IHDR", header);
+    for (size_t offset = 0; offset < zlib.size(); offset += 65536) {
+        putChunk(png, "IDAT", {zlib.begin() + offset, zlib.begin() + std::min(zlib.size(), offset + 65536)});
+    }
+    putChunk(png, "IEND", {});
+    return {"png " + std::to_string(width) + "x" + std::to_string(height), png};
+}
+
+static File syntheticBmp(int width, int height) {
+    const uint32_t rowBytes = (uint32_t(width) * 3 + 3) & ~3u;
+    std::vector<uint8_t> bmp(54 + size_t(rowBytes) * height);
+    auto put32 = [&](size_t at, uint32_t value) { std::memcpy(&bmp[at], &value, 4); };
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    put32(2, uint32_t(bmp.size()));
+    put32(10, 54);
+    put32(14, 40);
+    put32(18, uint32_t(width));
+    put32(22, uint32_t(height));
+    bmp[26] = 1;
+    bmp[28] = 24;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* p = &bmp[54 + size_t(y) * rowBytes + size_t(x) * 3];
+            p[0] = uint8_t(x);
+            p[1] = uint8_t(y);
+            p[2] = uint8_t(x + y);
+        }
+    }
+    return {"bmp " + std::to_string(width) + "x" + std::to_string(height), bmp};
+}
+
+static File readFile(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return {path, {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()}};
+}
+
+struct Decoded {
+    unsigned char* pixels = nullptr;
+    int width = 0, height = 0;
+};
+
+// One round: every file decoded on the pool, every image freed here.
+static std::vector<Decoded> decodeAll(const std::vector<File>& corpus) {
+    std::vector<Decoded> decoded(corpus.size());
+    ThreadPool::shared().parallelFor(corpus.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            int channels;
+            decoded[i].pixels = stbi_load_from_memory(corpus[i].bytes.data(), int(corpus[i].bytes.size()),
+                                                      &decoded[i].width, &decoded[i].height, &channels, STBI_rgb_alpha);
+        }
+    });
+    return decoded;
+}
+
+static void freeAll(std::vector<Decoded>& decoded) {
+    for (Decoded& image : decoded) {
+        stbi_image_free(image.pixels);
+    }
+}
+
+static double run(const char* name, const std::vector<File>& corpus, int rounds, double inputMB) {
+    StbImagePool::resetStats();
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<Decoded> decoded = decodeAll(corpus);
+        freeAll(decoded);
+    }
+    const double seconds = secondsSince(start);
+    const auto stats = StbImagePool::stats();
+    const double mb = 1.0 / (1 << 20);
+    std::cout << name << ": " << seconds / rounds * 1e3 << " ms/round, " << inputMB * rounds / seconds
+              << " MB/s of files; " << stats.allocations << " allocations, " << stats.reuses << " reused ("
+              << stats.reusedBytes * mb << " MB), " << stats.systemBytes * mb << " MB from the system, peak "
+              << stats.peakBytes * mb << " MB" << std::endl;
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<File> corpus;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            corpus.push_back(readFile(argv[i]));
+        }
+    } else {
+        corpus.push_back(readFile("assets/mc_grass.jpeg"));
+        for (int side : {256, 1024, 2048}) {
+            corpus.push_back(syntheticPng(side, side));
+            corpus.push_back(syntheticBmp(side, side));
+        }
+    }
+
+    bool passed = true;
+    double inputMB = 0.0;
+    std::vector<Decoded> reference;
+    StbImagePool::setCacheLimit(0);
+    reference = decodeAll(corpus);
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        if (!reference[i].pixels) {
+            std::cout << corpus[i].name << ": " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        inputMB += corpus[i].bytes.size() / double(1 << 20);
+    }
+    std::cout << corpus.size() << " images, " << inputMB << " MB, " << ThreadPool::shared().threadCount()
+              << " threads" << std::endl;
+
+    const int rounds = 20;
+    const double unpooled = run("system allocator", corpus, rounds, inputMB);
+    StbImagePool::setCacheLimit(size_t(256) << 20);
+    const double pooled = run("pooled", corpus, rounds, inputMB);
+    std::cout << "speedup " << unpooled / pooled << "x" << std::endl;
+    passed &= check(StbImagePool::stats().reuses > 0, "pooled rounds reused nothing");
+
+    // Pooled decodes must give the same pixels.
+    std::vector<Decoded> pooledImages = decodeAll(corpus);
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        const size_t size = size_t(reference[i].width) * reference[i].height * 4;
+        passed &= check(pooledImages[i].width == reference[i].width && pooledImages[i].height == reference[i].height &&
+                            std::memcmp(pooledImages[i].pixels, reference[i].pixels, size) == 0,
+                        "pooled decode differs");
+    }
+    freeAll(pooledImages);
+    freeAll(reference);
+
+    // A block from a thread that has exited is freed here and reused by the next allocation.
+    StbImagePool::trimCache();
+    void* orphan = nullptr;
+    std::thread([&] { orphan = StbImagePool::allocate(1 << 20); }).join();
+    StbImagePool::release(orphan);
+    const uint64_t reuses = StbImagePool::stats().reuses;
+    void* adopted = StbImagePool::allocate(1 << 20);
+    passed &= check(adopted == orphan && StbImagePool::stats().reuses == reuses + 1,
+                    "block freed after its thread exited was not reused");
+    StbImagePool::release(adopted);
+
+    passed &= check(StbImagePool::stats().currentBytes == 0, "bytes still allocated after every image was freed");
+    StbImagePool::trimCache();
+
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+//
+//  drawlistbench.cpp
+//  Metal-Guide
+//
+//  Checks DrawList's sort keys and its radix sort, then times the sort
+//  against std::sort. Checks:
+//  - Keys sort passes in order and opaque draws before transparent ones.
+//    Opaque draws are grouped by pipeline, material and texture, and go
+//    front to back within each group. Transparent draws go back to front.
+//  - decodeKey() gives back what makeKey() packed, and negative depths
+//    sort as 0.
+//  - For random keys, sortKeys() gives the same keys and items as
+//    std::stable_sort, on one thread and on several. That includes keys
+//    that differ in only a few bits, where passes are skipped.
+//  The benchmark sorts the keys of a million random draws. It compares
+//  sortKeys() on the shared pool and on one thread with std::sort of
+//  key and item pairs, and reports the best of a few runs. Build from
+//  lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/drawlistbench.cpp
+//        Metal-Tutorial/draw_list.cpp Metal-Tutorial/thread_pool.cpp -o drawlistbench
+//
+//  Usage: drawlistbench [keys]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "draw_list.hpp"
+
+static DrawList::Draw randomDraw(std::mt19937& random) {
+    std::uniform_real_distribution<float> depth(0.1f, 500.0f);
+    return {uint32_t(random() % 3), uint32_t(random() % 40), uint32_t(random() % 400), uint32_t(random() % 1000),
+            depth(random), random() % 5 == 0};
+}
+
+static bool checkKeyOrder() {
+    std::mt19937 random(3);
+    DrawList list;
+    std::vector<DrawList::Draw> draws;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        draws.push_back(randomDraw(random));
+        list.add(draws.back(), i);
+    }
+    list.sort();
+
+    bool passed = true;
+    for (size_t i = 1; i < list.size() && passed; ++i) {
+        const DrawList::Draw& a = draws[list.item(i - 1)];
+        const DrawList::Draw& b = draws[list.item(i)];
+        passed &= check(a.pass <= b.pass, "passes in order", b.pass, a.pass);
+        if (a.pass != b.pass) {
+            continue;
+        }
+        passed &= check(a.transparent <= b.transparent, "opaque before transparent", b.transparent, a.transparent);
+        if (a.transparent != b.transparent) {
+            continue;
+        }
+        if (a.transparent) {
+            passed &= check(a.depth >= b.depth, "transparent back to front", b.depth, a.depth);
+        } else {
+            const auto stateA = std::make_tuple(a.pipeline, a.material, a.texture);
+            const auto stateB = std::make_tuple(b.pipeline, b.material, b.texture);
+            passed &= check(stateA <= stateB, "opaque grouped by state", i, 0);
+            if (stateA == stateB) {
+                passed &= check(a.depth <= b.depth, "opaque front to back", b.depth, a.depth);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < list.size() && passed; ++i) {
+        const DrawList::Draw& draw = draws[list.item(i)];
+        const DrawList::Draw decoded = DrawList::decodeKey(list.key(i));
+        passed &= check(decoded.pass == draw.pass && decoded.transparent == draw.transparent &&
+                        decoded.pipeline == draw.pipeline && decoded.material == draw.material &&
+                        decoded.texture == draw.texture, "decoded state", i, 0);
+        // 25 bits keep 17 of the mantissa's 23.
+        passed &= check(decoded.depth <= draw.depth && decoded.depth > draw.depth * (1.0f - 1.0f / (1 << 16)),
+                        "decoded depth", decoded.depth, draw.depth);
+        passed &= check(DrawList::makeKey(decoded) == list.key(i), "key of the decoded draw", i, 0);
+    }
+    DrawList::Draw behind{0, 1, 1, 1, -2.0f, false}, atCamera{0, 1, 1, 1, 0.0f, false};
+    passed &= check(DrawList::makeKey(behind) == DrawList::makeKey(atCamera), "negative depth as 0", 1, 0);
+    return passed;
+}
+
+// sortKeys() against std::stable_sort for random keys of the given bytes.
+static bool checkSort(ThreadPool& pool, size_t count, uint64_t keyMask, uint32_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<uint64_t> keys(count);
+    std::vector<uint32_t> items(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = random() & keyMask;
+        items[i] = uint32_t(i);
+    }
+    std::vector<uint32_t> expected = items;
+    std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    std::vector<uint64_t> expectedKeys(count);
+    for (size_t i = 0; i < count; ++i) {
+        expectedKeys[i] = keys[expected[i]];
+    }
+
+    DrawList list(pool);
+    list.sortKeys(keys, items);
+    return check(keys == expectedKeys && items == expected, "radix sort against std::stable_sort", double(count), 0);
+}
+
+static bool checkSorts() {
+    ThreadPool serial(1), parallel(4);
+    bool passed = true;
+    uint32_t seed = 0;
+    for (ThreadPool* pool : {&serial, &parallel}) {
+        for (size_t count : {0, 1, 2, 100, 5000, 100000, 300001}) {
+            passed &= checkSort(*pool, count, ~uint64_t(0), ++seed);
+            passed &= checkSort(*pool, count, 0xff00000000ff0f00ull, ++seed);
+            passed &= checkSort(*pool, count, 0, ++seed);
+        }
+    }
+    return passed;
+}
+
+static void benchmark(size_t count) {
+    std::mt19937 random(17);
+    std::vector<uint64_t> input(count);
+    for (uint64_t& key : input) {
+        key = DrawList::makeKey(randomDraw(random));
+    }
+    std::vector<uint32_t> inputItems(count);
+    std::iota(inputItems.begin(), inputItems.end(), 0);
+
+    const int runs = 5;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    DrawList shared;
+    const double sharedMs = 1e3 * bestSeconds(runs, [&] {
+        keys = input;
+        items = inputItems;
+        shared.sortKeys(keys, items);
+    });
+    ThreadPool one(1);
+    DrawList serial(one);
+    const double serialMs = 1e3 * bestSeconds(runs, [&] {
+        keys = input;
+        items = inputItems;
+        serial.sortKeys(keys, items);
+    });
+    struct Pair {
+        uint64_t key;
+        uint32_t item;
+    };
+    std::vector<Pair> pairs(count);
+    const double stdMs = 1e3 * bestSeconds(runs, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            pairs[i] = {input[i], inputItems[i]};
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) { return a.key < b.key; });
+    });
+    // Copying the input in is part of every timing.
+    const double copyMs = 1e3 * bestSeconds(runs, [&] {
+        keys = input;
+        items = inputItems;
+    });
+
+    std::cout << count << " draw keys, best of " << runs << ", including copying the input (" << copyMs
+              << " ms):" << std::endl;
+    std::cout << "  radix sort, shared pool of " << ThreadPool::shared().threadCount() << ": " << sharedMs << " ms ("
+              << stdMs / sharedMs << "x std::sort)" << std::endl;
+    std::cout << "  radix sort, 1 thread:  " << serialMs << " ms (" << stdMs / serialMs << "x)" << std::endl;
+    std::cout << "  std::sort:             " << stdMs << " ms" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? size_t(atol(argv[1])) : 1000000;
+    bool passed = checkKeyOrder();
+    passed &= checkSorts();
+    benchmark(count);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
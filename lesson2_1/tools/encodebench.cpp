@@ -0,0 +1,287 @@
+//
+//  encodebench.cpp
+//  Metal-Guide
+//
+//  Runs the engine's EngineCore against the null Metal device in
+//  null-metal/, the way MTLEngine drives it, and reports the CPU cost of
+//  encoding: microseconds and device calls per frame, how much of that the
+//  command log itself costs, the time from each logged call to the next
+//  one, and the cost of a window resize. HeadlessEngine below stands in for
+//  MTLEngine's window side: a layer without GLFW, and no pipeline cache
+//  file. Checks:
+//  - The cube's pipeline compiles once, off the render thread.
+//  - A steady frame makes exactly the calls the engine encodes.
+//  - The grass texture upload goes through blit copies before it is drawn.
+//  - The render graph picks the load and store actions mtl_engine.cpp
+//    used to set by hand.
+//  - Every object is freed by cleanup().
+//  Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Inull-metal -IMetal-Tutorial tools/encodebench.cpp
+//        Metal-Tutorial/engine_core.cpp Metal-Tutorial/upload_queue.cpp
+//        Metal-Tutorial/metal_upload_backend.cpp Metal-Tutorial/render_graph.cpp
+//        Metal-Tutorial/metal_render_graph.cpp Metal-Tutorial/render_state_filter.cpp
+//        Metal-Tutorial/command_stream.cpp Metal-Tutorial/draw_list.cpp
+//        Metal-Tutorial/pipeline_cache.cpp Metal-Tutorial/metal_pipeline_compiler.cpp
+//        Metal-Tutorial/mip_feedback.cpp Metal-Tutorial/texture_residency.cpp
+//        Metal-Tutorial/texture_cache.cpp Metal-Tutorial/mapped_file.cpp
+//        Metal-Tutorial/thread_pool.cpp -o encodebench
+//
+//  Usage: encodebench [frames]
+//
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+#include <QuartzCore/QuartzCore.hpp>
+
+#include "bench_util.hpp"
+#include "engine_core.hpp"
+
+using NullMetal::Call;
+
+static constexpr uint32_t kGrassSize = 2048;
+
+// MTLEngine's window side around the EngineCore it draws with: a layer in
+// place of the GLFW window, its drawables, and resizes applied once per
+// frame. The grass texture is one level streamed through the core's
+// upload queue, as Texture does.
+class HeadlessEngine : private EngineCore::TextureSource {
+public:
+    void init(int width, int height);
+    // One turn of MTLEngine::run(): any pending resize, a drawable, draw(),
+    // and the frame's autorelease pool. Returns the microseconds spent in
+    // draw().
+    double frame(double time);
+    void resizeFrameBuffer(int width, int height);
+    void applyPendingResize();
+    void cleanup();
+
+    bool grassDrawable() const { return core->uploads().isSubmitted(grassToken); }
+    PipelineCache& pipelines() { return core->pipelines(); }
+    const RenderGraph::Plan& renderGraphPlan() const { return core->renderGraph().plan(); }
+
+private:
+    float texelDensity() const override { return float(kGrassSize); }
+    MTL::Texture* texture(uint8_t) override { return grassDrawable() ? grassTexture : nullptr; }
+
+    void draw();
+
+    MTL::Device* metalDevice;
+    CA::MetalLayer* metalLayer;
+    CA::MetalDrawable* metalDrawable;
+    MTL::Library* metalDefaultLibrary;
+    EngineCore* core;
+    bool resizePending{false};
+    int pendingWidth{0};
+    int pendingHeight{0};
+
+    MTL::Texture* grassTexture;
+    std::vector<uint8_t> grassPixels;
+    UploadToken grassToken;
+    double frameTime{0.0};
+};
+
+void HeadlessEngine::init(int width, int height) {
+    metalDevice = MTL::CreateSystemDefaultDevice();
+    metalLayer = CA::MetalLayer::layer()->retain();
+    metalLayer->setDevice(metalDevice);
+    metalLayer->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    metalLayer->setDrawableSize(CGSizeMake(width, height));
+    metalDefaultLibrary = metalDevice->newDefaultLibrary();
+
+    EngineCore::Options options;
+    options.colorFormat = uint32_t(metalLayer->pixelFormat());
+    core = new EngineCore(metalDevice, metalDefaultLibrary, width, height, options);
+
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setWidth(kGrassSize);
+    textureDescriptor->setHeight(kGrassSize);
+    grassTexture = metalDevice->newTexture(textureDescriptor);
+    textureDescriptor->release();
+    grassPixels.assign(size_t(kGrassSize) * kGrassSize * 4, 0x80);
+    grassToken = core->uploads().enqueue(grassTexture, 0, 0, 0, kGrassSize, kGrassSize, 4, grassPixels.data(),
+                                         size_t(kGrassSize) * 4);
+    core->setTextureSource(this);
+}
+
+double HeadlessEngine::frame(double time) {
+    frameTime = time;
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    applyPendingResize();
+    metalDrawable = metalLayer->nextDrawable();
+    const auto start = std::chrono::steady_clock::now();
+    draw();
+    const double microseconds = microsecondsSince(start);
+    pool->release();
+    return microseconds;
+}
+
+void HeadlessEngine::cleanup() {
+    core->uploads().finish();
+    delete core;
+    grassTexture->release();
+    metalDefaultLibrary->release();
+    metalLayer->release();
+    metalDevice->release();
+}
+
+void HeadlessEngine::resizeFrameBuffer(int width, int height) {
+    pendingWidth = width;
+    pendingHeight = height;
+    resizePending = true;
+}
+
+void HeadlessEngine::applyPendingResize() {
+    if (!resizePending) {
+        return;
+    }
+    resizePending = false;
+    metalLayer->setDrawableSize(CGSizeMake(pendingWidth, pendingHeight));
+    core->resize(pendingWidth, pendingHeight);
+}
+
+void HeadlessEngine::draw() {
+    core->update();
+    assert(!core->pipelineFailed());
+    MTL::CommandBuffer* commandBuffer = core->encode(metalDrawable->texture(), frameTime);
+    commandBuffer->presentDrawable(metalDrawable);
+    commandBuffer->commit();
+    commandBuffer->waitUntilCompleted();
+}
+
+static bool checkFrameCalls(const std::vector<NullMetal::Entry>& entries) {
+    const Call expected[] = {
+        Call::NextDrawable, Call::CommandBuffer, Call::RenderCommandEncoder, Call::SetFrontFacingWinding,
+        Call::SetCullMode, Call::SetRenderPipelineState, Call::SetDepthStencilState, Call::SetVertexBuffer,
+        Call::SetVertexBuffer, Call::SetFragmentTexture, Call::DrawPrimitives, Call::EndEncoding,
+        Call::PresentDrawable, Call::Commit, Call::WaitUntilCompleted,
+    };
+    const size_t count = sizeof(expected) / sizeof(expected[0]);
+    bool passed = check(entries.size() == count, "calls in a steady frame", entries.size(), count);
+    for (size_t i = 0; passed && i < count; ++i) {
+        if (entries[i].call != expected[i]) {
+            std::cout << "FAIL call " << i << " is " << NullMetal::callName(entries[i].call) << ", expected "
+                      << NullMetal::callName(expected[i]) << std::endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    const int frames = argc > 1 ? std::max(atoi(argv[1]), 100) : 20000;
+    NullMetal::CommandLog& log = NullMetal::commandLog();
+    bool passed = true;
+
+    HeadlessEngine engine;
+    log.reset();
+    // The engine has no pool around init() and cleanup(); here they get one
+    // so that what they autorelease is freed and leaks stand out.
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    auto start = std::chrono::steady_clock::now();
+    engine.init(800, 600);
+    const double setupMicroseconds = microsecondsSince(start);
+    pool->release();
+    const uint64_t setupCalls = log.totalCount();
+    log.take();
+
+    // The cube's pipeline compiles on the pool; here it is waited for, so
+    // that the frames below are the same on any thread count.
+    engine.pipelines().finish();
+    const PipelineCache::Stats& pipelineStats = engine.pipelines().stats();
+    passed &= check(pipelineStats.compiles == 1 && pipelineStats.failures == 0, "cube pipeline compiles",
+                    double(pipelineStats.compiles), 1);
+    log.take();
+
+    // The grass texture arrives over two frames before it is drawn.
+    int uploadFrames = 0;
+    while (!engine.grassDrawable() && uploadFrames < 10) {
+        engine.frame(uploadFrames++ / 60.0);
+    }
+    passed &= check(uploadFrames == 2, "frames to upload the grass texture", uploadFrames, 2);
+    // 8 MB a frame is 1024 rows, one copy each frame.
+    passed &= check(log.count(Call::CopyFromBuffer) == 2, "grass texture copies", double(log.count(Call::CopyFromBuffer)), 2);
+    log.take();
+    engine.frame(uploadFrames / 60.0);
+    passed &= checkFrameCalls(log.take());
+
+    // Clear both, resolve the colour into the drawable, and keep neither.
+    const RenderGraph::Plan& plan = engine.renderGraphPlan();
+    const bool actions = plan.passes.size() == 1 && plan.passes[0].colors.size() == 1 && plan.passes[0].hasDepth &&
+                         plan.passes[0].colors[0].load == RenderGraph::LoadAction::Clear &&
+                         plan.passes[0].colors[0].store == RenderGraph::StoreAction::MultisampleResolve &&
+                         plan.passes[0].depth.load == RenderGraph::LoadAction::Clear &&
+                         plan.passes[0].depth.store == RenderGraph::StoreAction::DontCare;
+    passed &= check(actions, "render graph load and store actions", 0, 1);
+
+    // Logged frames, then the same frames with logging off.
+    std::vector<double> encode(frames), encodeUnlogged(frames);
+    std::vector<uint64_t> gapNanoseconds(size_t(Call::Count)), gapCount(size_t(Call::Count));
+    uint64_t calls = 0;
+    for (int i = 0; i < frames; ++i) {
+        encode[i] = engine.frame(i / 60.0);
+        const std::vector<NullMetal::Entry> entries = log.take();
+        calls += entries.size();
+        for (size_t e = 0; e + 1 < entries.size(); ++e) {
+            gapNanoseconds[size_t(entries[e].call)] += entries[e + 1].nanoseconds - entries[e].nanoseconds;
+            ++gapCount[size_t(entries[e].call)];
+        }
+    }
+    log.setEnabled(false);
+    for (int i = 0; i < frames; ++i) {
+        encodeUnlogged[i] = engine.frame(i / 60.0);
+    }
+    log.setEnabled(true);
+
+    const int resizes = 200;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < resizes; ++i) {
+        engine.resizeFrameBuffer(800 + i % 2 * 640, 600 + i % 2 * 480);
+        engine.applyPendingResize();
+    }
+    const double resizeMicroseconds = microsecondsSince(start) / resizes;
+    log.take();
+
+    pool = NS::AutoreleasePool::alloc()->init();
+    engine.cleanup();
+    pool->release();
+    passed &= check(NullMetal::liveObjects.load() == 0, "objects alive after cleanup",
+                    double(NullMetal::liveObjects.load()), 0);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+
+    auto summary = [&](const char* label, std::vector<double>& samples) {
+        double total = 0.0;
+        for (double sample : samples) {
+            total += sample;
+        }
+        std::sort(samples.begin(), samples.end());
+        std::cout << std::fixed << std::setprecision(2) << "  " << label << total / samples.size()
+                  << " us mean, " << samples[samples.size() / 2] << " us median, "
+                  << samples[samples.size() * 99 / 100] << " us p99" << std::endl;
+    };
+    std::cout << std::fixed << std::setprecision(2) << "setup: " << setupMicroseconds << " us, " << setupCalls
+              << " calls" << std::endl;
+    std::cout << frames << " frames, " << double(calls) / frames << " calls and "
+              << double(calls) / frames * sizeof(NullMetal::Entry) << " log bytes per frame" << std::endl;
+    summary("draw(), logged:     ", encode);
+    summary("draw(), not logged: ", encodeUnlogged);
+    std::cout << "resize: " << resizeMicroseconds << " us" << std::endl;
+    std::cout << "time from each call to the next, logged frames:" << std::endl;
+    for (size_t call = 0; call < size_t(Call::Count); ++call) {
+        if (gapCount[call]) {
+            std::cout << "  " << std::left << std::setw(24) << NullMetal::callName(Call(call)) << std::right
+                      << std::setw(8) << double(gapNanoseconds[call]) / gapCount[call] << " ns  ("
+                      << double(gapCount[call]) / frames << " per frame)" << std::endl;
+        }
+    }
+    return passed ? 0 : 1;
+}
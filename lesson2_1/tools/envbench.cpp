@@ -0,0 +1,236 @@
+//
+//  envbench.cpp
+//  Metal-Guide
+//
+//  Checks EnvironmentMap against analytic results and times each step.
+//  Checks:
+//  - A panorama whose texels hold their own direction must come out of the
+//    cubemap conversion with every texel holding its direction.
+//  - Constant and linear radiance have closed-form irradiance
+//    (pi * c and pi + 2 pi / 3 * n.y).
+//  - Prefiltering must leave a constant environment unchanged and put a
+//    horizon-facing texel of a lit upper hemisphere at one half for every
+//    roughness.
+//  Then converts the given .hdr panorama, or a synthetic one, and times the
+//  conversion, the SH projection and the specular chain. Build from
+//  lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/envbench.cpp
+//        Metal-Tutorial/environment_map.cpp Metal-Tutorial/thread_pool.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -o envbench
+//
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "environment_map.hpp"
+#include "thread_pool.hpp"
+#include "stb/stb_image.h"
+
+using EnvironmentMap::Cubemap;
+
+// Panorama texel directions, matching EnvironmentMap's convention.
+static void panoramaDirection(int x, int y, int width, int height, float direction[3]) {
+    const double phi = ((x + 0.5) / width - 0.5) * 2.0 * M_PI;
+    const double theta = (y + 0.5) / height * M_PI;
+    direction[0] = float(std::sin(theta) * std::sin(phi));
+    direction[1] = float(std::cos(theta));
+    direction[2] = float(-std::sin(theta) * std::cos(phi));
+}
+
+static std::vector<float> panorama(int width, int height, const std::function<void(const float*, float*)>& radiance) {
+    std::vector<float> pixels(size_t(width) * height * 4);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float direction[3];
+            panoramaDirection(x, y, width, height, direction);
+            radiance(direction, &pixels[(size_t(y) * width + x) * 4]);
+        }
+    }
+    return pixels;
+}
+
+static Cubemap cubemap(int size, const std::function<void(const float*, float*)>& radiance) {
+    Cubemap result;
+    result.size = size;
+    result.levels.emplace_back(size_t(6) * size * size * 4);
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float direction[3];
+                EnvironmentMap::texelDirection(face, x, y, size, direction);
+                radiance(direction, result.face(0, face) + (size_t(y) * size + x) * 4);
+            }
+        }
+    }
+    return result;
+}
+
+static bool checkConversion() {
+    const int faceSize = 64;
+    std::vector<float> pixels = panorama(1024, 512, [](const float* d, float* rgba) {
+        rgba[0] = d[0]; rgba[1] = d[1]; rgba[2] = d[2]; rgba[3] = 1.0f;
+    });
+    Cubemap converted = EnvironmentMap::fromEquirectangular(pixels.data(), 1024, 512, faceSize);
+    double worst = 0.0, total = 0.0;
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < faceSize; ++y) {
+            for (int x = 0; x < faceSize; ++x) {
+                float expected[3];
+                EnvironmentMap::texelDirection(face, x, y, faceSize, expected);
+                const float* texel = converted.face(0, face) + (size_t(y) * faceSize + x) * 4;
+                const double error = std::sqrt(std::pow(texel[0] - expected[0], 2) +
+                                               std::pow(texel[1] - expected[1], 2) +
+                                               std::pow(texel[2] - expected[2], 2));
+                worst = std::max(worst, error);
+                total += error;
+            }
+        }
+    }
+    const double mean = total / (6.0 * faceSize * faceSize);
+    bool passed = check(mean < 0.002, "conversion mean direction error", mean, 0.0);
+    passed &= check(worst < 0.02, "conversion worst direction error", worst, 0.0);
+    return passed;
+}
+
+static bool checkIrradiance() {
+    bool passed = true;
+    const float c[3] = {1.0f, 2.0f, 3.0f};
+    Cubemap constant = cubemap(32, [&](const float*, float* rgba) {
+        rgba[0] = c[0]; rgba[1] = c[1]; rgba[2] = c[2]; rgba[3] = 1.0f;
+    });
+    auto irradiance = EnvironmentMap::irradianceFromRadiance(EnvironmentMap::projectRadiance(constant));
+    const float directions[4][3] = {{0, 1, 0}, {0, -1, 0}, {1, 0, 0}, {0.6f, 0.0f, -0.8f}};
+    for (const auto& direction : directions) {
+        float rgb[3];
+        EnvironmentMap::evaluate(irradiance, direction, rgb);
+        for (int i = 0; i < 3; ++i) {
+            passed &= check(std::abs(rgb[i] - M_PI * c[i]) < 1e-3 * M_PI * c[i], "constant irradiance", rgb[i], M_PI * c[i]);
+        }
+    }
+
+    // 1 + y lives in bands 0 and 1, so SH9 reproduces its irradiance exactly.
+    Cubemap linear = cubemap(32, [](const float* d, float* rgba) {
+        rgba[0] = rgba[1] = rgba[2] = 1.0f + d[1];
+        rgba[3] = 1.0f;
+    });
+    irradiance = EnvironmentMap::irradianceFromRadiance(EnvironmentMap::projectRadiance(linear));
+    for (const auto& direction : directions) {
+        float rgb[3];
+        EnvironmentMap::evaluate(irradiance, direction, rgb);
+        const double expected = M_PI + 2.0 * M_PI / 3.0 * direction[1];
+        passed &= check(std::abs(rgb[0] - expected) < 2e-3 * M_PI, "linear irradiance", rgb[0], expected);
+    }
+    return passed;
+}
+
+static bool checkPrefilter() {
+    bool passed = true;
+    Cubemap constant = cubemap(32, [](const float*, float* rgba) {
+        rgba[0] = 0.5f; rgba[1] = 1.0f; rgba[2] = 2.0f; rgba[3] = 1.0f;
+    });
+    Cubemap filtered = EnvironmentMap::prefilterSpecular(constant, 5, 64);
+    const float expected[4] = {0.5f, 1.0f, 2.0f, 1.0f};
+    for (int level = 0; level < 5; ++level) {
+        const std::vector<float>& texels = filtered.levels[level];
+        for (size_t i = 0; i < texels.size(); ++i) {
+            if (std::abs(texels[i] - expected[i % 4]) > 1e-4f * expected[i % 4]) {
+                passed &= check(false, "constant prefilter", texels[i], expected[i % 4]);
+                break;
+            }
+        }
+    }
+
+    // Upper hemisphere lit: a texel on the horizon sees half its lobe lit.
+    // The probe sits in the middle of the +X face, where bilinear lookups
+    // stay away from seams.
+    const int size = 64;
+    Cubemap hemisphere = cubemap(size, [](const float* d, float* rgba) {
+        rgba[0] = rgba[1] = rgba[2] = d[1] > 0.0f ? 1.0f : 0.0f;
+        rgba[3] = 1.0f;
+    });
+    filtered = EnvironmentMap::prefilterSpecular(hemisphere, 6, 256);
+    for (int level = 1; level < 6; ++level) {
+        const int levelSize = filtered.levelSize(level);
+        const float* face = filtered.face(level, 0);
+        // Average the two rows straddling the horizon.
+        const int x = levelSize / 2;
+        const float value = 0.5f * (face[(size_t(levelSize / 2 - 1) * levelSize + x) * 4] +
+                                    face[(size_t(levelSize / 2) * levelSize + x) * 4]);
+        passed &= check(std::abs(value - 0.5f) < 0.03f, "horizon prefilter", value, 0.5);
+        // Straight up the whole lobe is lit. The roughest levels read mips
+        // coarse enough to blur the horizon in, which costs a few percent.
+        const float* top = filtered.face(level, 2);
+        const float up = top[(size_t(levelSize / 2) * levelSize + levelSize / 2) * 4];
+        passed &= check(up > 0.85f, "zenith prefilter", up, 1.0);
+    }
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    bool passed = checkConversion();
+    passed &= checkIrradiance();
+    passed &= checkPrefilter();
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+
+    int width = 4096, height = 2048;
+    std::vector<float> pixels;
+    if (argc > 1) {
+        int channels;
+        float* image = stbi_loadf(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+        if (!image) {
+            std::cerr << "Failed to load " << argv[1] << ": " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        pixels.assign(image, image + size_t(width) * height * 4);
+        stbi_image_free(image);
+    } else {
+        // A sky gradient with a small, very bright sun.
+        pixels = panorama(width, height, [](const float* d, float* rgba) {
+            const float sun = d[0] * 0.3f + d[1] * 0.8f - d[2] * 0.52f > 0.999f ? 5000.0f : 0.0f;
+            rgba[0] = 0.3f + 0.2f * d[1] + sun;
+            rgba[1] = 0.5f + 0.3f * d[1] + sun;
+            rgba[2] = 0.9f + 0.4f * d[1] + sun;
+            rgba[3] = 1.0f;
+        });
+    }
+
+    const int faceSize = 512, levelCount = 6, sampleCount = 128;
+    std::cout << width << "x" << height << " panorama, " << faceSize << " faces, "
+              << ThreadPool::shared().threadCount() << " threads" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    Cubemap environment = EnvironmentMap::fromEquirectangular(pixels.data(), width, height, faceSize);
+    double seconds = secondsSince(start);
+    std::cout << "  equirect -> cubemap  " << seconds * 1e3 << " ms, "
+              << 6.0 * faceSize * faceSize / seconds / 1e6 << " Mtexels/s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    auto radiance = EnvironmentMap::projectRadiance(environment);
+    seconds = secondsSince(start);
+    std::cout << "  SH9 projection       " << seconds * 1e3 << " ms, "
+              << 6.0 * faceSize * faceSize / seconds / 1e6 << " Mtexels/s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    Cubemap specular = EnvironmentMap::prefilterSpecular(environment, levelCount, sampleCount);
+    seconds = secondsSince(start);
+    double texels = 0.0;
+    for (int level = 1; level < levelCount; ++level) {
+        texels += 6.0 * specular.levelSize(level) * specular.levelSize(level);
+    }
+    std::cout << "  specular prefilter   " << seconds * 1e3 << " ms for " << levelCount << " levels x "
+              << sampleCount << " samples, " << texels * sampleCount / seconds / 1e6 << " Msamples/s" << std::endl;
+
+    const float up[3] = {0.0f, 1.0f, 0.0f}, down[3] = {0.0f, -1.0f, 0.0f};
+    float upIrradiance[3], downIrradiance[3];
+    auto irradiance = EnvironmentMap::irradianceFromRadiance(radiance);
+    EnvironmentMap::evaluate(irradiance, up, upIrradiance);
+    EnvironmentMap::evaluate(irradiance, down, downIrradiance);
+    std::cout << "  irradiance up (" << upIrradiance[0] << ", " << upIrradiance[1] << ", " << upIrradiance[2]
+              << "), down (" << downIrradiance[0] << ", " << downIrradiance[1] << ", " << downIrradiance[2] << ")"
+              << std::endl;
+    return passed ? 0 : 1;
+}
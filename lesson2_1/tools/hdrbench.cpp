@@ -0,0 +1,190 @@
+//
+//  hdrbench.cpp
+//  Metal-Guide
+//
+//  Times loading 4K and 8K Radiance .hdr images the way Texture::decodeHdr
+//  does: stbi_loadf_from_memory, then each row converted in parallel to
+//  RGBA16Float at its flipped position. The images are synthetic skies,
+//  run-length encoded in memory, or the given .hdr file. The converted
+//  texels are checked against the scalar halfFromFloat, and stb's floats
+//  against the encoded RGBE values. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/hdrbench.cpp
+//        Metal-Tutorial/pixel_convert.cpp Metal-Tutorial/thread_pool.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -o hdrbench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "pixel_convert.hpp"
+#include "stb/stb_image.h"
+#include "thread_pool.hpp"
+
+static void rgbe(const float* rgb, uint8_t* out) {
+    const float v = std::max({rgb[0], rgb[1], rgb[2]});
+    if (v < 1e-32f) {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+    int exponent;
+    const float scale = std::frexp(v, &exponent) * 256.0f / v;
+    for (int c = 0; c < 3; ++c) {
+        out[c] = uint8_t(rgb[c] * scale);
+    }
+    out[3] = uint8_t(exponent + 128);
+}
+
+// The new-style run-length encoding: per scanline, each of the four
+// components as runs (128 + n, byte) and literal dumps (n, bytes...).
+static void encodeComponent(const uint8_t* values, int width, std::vector<uint8_t>& out) {
+    int x = 0;
+    while (x < width) {
+        int run = 1;
+        while (x + run < width && run < 127 && values[x + run] == values[x]) {
+            ++run;
+        }
+        if (run >= 4) {
+            out.push_back(uint8_t(128 + run));
+            out.push_back(values[x]);
+            x += run;
+            continue;
+        }
+        // A dump up to the next run of four or more.
+        int dump = 0;
+        while (x + dump < width && dump < 128) {
+            const int left = width - (x + dump);
+            if (left >= 4 && values[x + dump] == values[x + dump + 1] && values[x + dump] == values[x + dump + 2] &&
+                values[x + dump] == values[x + dump + 3]) {
+                break;
+            }
+            ++dump;
+        }
+        out.push_back(uint8_t(dump));
+        out.insert(out.end(), values + x, values + x + dump);
+        x += dump;
+    }
+}
+
+// A sky gradient with a small, very bright sun.
+static void sky(int x, int y, int width, int height, float* rgb) {
+    const float elevation = 1.0f - float(y) / height;
+    const float dx = float(x - width / 3) / width, dy = float(y - height / 4) / height;
+    const float sun = dx * dx + dy * dy < 1e-4f ? 5000.0f : 0.0f;
+    rgb[0] = 0.3f + 0.2f * elevation + sun;
+    rgb[1] = 0.5f + 0.3f * elevation + sun;
+    rgb[2] = 0.9f * elevation + sun;
+}
+
+static std::vector<uint8_t> syntheticHdr(int width, int height) {
+    const std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " +
+                               std::to_string(width) + "\n";
+    std::vector<uint8_t> file(header.begin(), header.end());
+    std::vector<uint8_t> scanline(size_t(width) * 4), component(width);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float rgb[3];
+            sky(x, y, width, height, rgb);
+            rgbe(rgb, &scanline[size_t(x) * 4]);
+        }
+        file.insert(file.end(), {2, 2, uint8_t(width >> 8), uint8_t(width & 255)});
+        for (int c = 0; c < 4; ++c) {
+            for (int x = 0; x < width; ++x) {
+                component[x] = scanline[size_t(x) * 4 + c];
+            }
+            encodeComponent(component.data(), width, file);
+        }
+    }
+    return file;
+}
+
+static bool run(const char* name, const std::vector<uint8_t>& file, bool synthetic) {
+    const int runs = 3;
+    double bestDecode = 1e9, bestConvert = 1e9;
+    int width = 0, height = 0, channels = 0;
+    float* image = nullptr;
+    std::vector<uint16_t> pixels;
+    for (int attempt = 0; attempt < runs; ++attempt) {
+        stbi_image_free(image);
+        auto start = std::chrono::steady_clock::now();
+        image = stbi_loadf_from_memory(file.data(), int(file.size()), &width, &height, &channels, STBI_rgb);
+        auto decoded = std::chrono::steady_clock::now();
+        if (!image) {
+            std::cout << name << ": " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        pixels.resize(size_t(width) * height * 4);
+        ThreadPool::shared().parallelFor(height, 16, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                PixelConvert::rgb32fToRgba16f(image + y * 3 * width, pixels.data() + (height - 1 - y) * 4 * width, width);
+            }
+        });
+        auto converted = std::chrono::steady_clock::now();
+        bestDecode = std::min(bestDecode, std::chrono::duration<double>(decoded - start).count());
+        bestConvert = std::min(bestConvert, std::chrono::duration<double>(converted - decoded).count());
+    }
+
+    const double mb = 1.0 / (1 << 20);
+    const double texels = double(width) * height;
+    std::cout << name << " (" << width << "x" << height << ", " << file.size() * mb << " MB file): decode "
+              << bestDecode * 1e3 << " ms, convert " << bestConvert * 1e3 << " ms ("
+              << texels * 12 / bestConvert / 1e9 << " GB/s in), "
+              << file.size() * mb / (bestDecode + bestConvert) << " MB/s overall; RGBA16F "
+              << texels * 8 * mb << " MB vs RGBA32F " << texels * 16 * mb << " MB" << std::endl;
+
+    bool passed = true;
+    bool converted = true;
+    for (int y = 0; y < height && converted; ++y) {
+        const uint16_t* row = pixels.data() + size_t(height - 1 - y) * 4 * width;
+        for (int x = 0; x < width && converted; ++x) {
+            const float* texel = image + (size_t(y) * width + x) * 3;
+            converted = row[x * 4 + 0] == PixelConvert::halfFromFloat(texel[0]) &&
+                        row[x * 4 + 1] == PixelConvert::halfFromFloat(texel[1]) &&
+                        row[x * 4 + 2] == PixelConvert::halfFromFloat(texel[2]) && row[x * 4 + 3] == 0x3c00;
+        }
+    }
+    passed &= check(converted, "converted texels differ from halfFromFloat");
+
+    if (synthetic) {
+        // Decode the RGBE by hand on rows through the sun and compare.
+        bool decoded = true;
+        for (int y : {0, height / 4, height - 1}) {
+            for (int x = 0; x < width && decoded; ++x) {
+                float rgb[3];
+                sky(x, y, width, height, rgb);
+                uint8_t encoded[4];
+                rgbe(rgb, encoded);
+                const float scale = encoded[3] ? std::ldexp(1.0f, encoded[3] - (128 + 8)) : 0.0f;
+                const float* texel = image + (size_t(y) * width + x) * 3;
+                for (int c = 0; c < 3; ++c) {
+                    decoded = decoded && texel[c] == encoded[c] * scale;
+                }
+            }
+        }
+        passed &= check(decoded, "stb's floats differ from the encoded RGBE");
+    }
+    stbi_image_free(image);
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << ThreadPool::shared().threadCount() << " threads, " << PixelConvert::instructionSets() << std::endl;
+    bool passed = true;
+    if (argc > 1) {
+        std::ifstream in(argv[1], std::ios::binary);
+        const std::vector<uint8_t> file{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        passed = run(argv[1], file, false);
+    } else {
+        passed &= run("4K", syntheticHdr(4096, 2048), true);
+        passed &= run("8K", syntheticHdr(8192, 4096), true);
+    }
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,454 @@
+//
+//  jpegbench.cpp
+//  Metal-Guide
+//
+//  Times stb_image JPEG decoding at 1080p, 4K and 8K, serially and with
+//  restart intervals decoded in parallel on the thread pool, and reports
+//  MB/s of file and megapixels per second. The JPEGs are synthetic 4:2:0
+//  baseline files with a restart marker after every row of MCUs, encoded
+//  here, or the given files. Also checks that the parallel decode matches
+//  the serial one: in colour and grey, with a last interval cut short, and
+//  with a restart marker missing, which must fall back to the serial path.
+//  Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/jpegbench.cpp
+//        Metal-Tutorial/thread_pool.cpp external/stb/stb_image.cpp
+//        external/stb/stb_image_pool.cpp -o jpegbench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "stb/stb_image.h"
+#include "thread_pool.hpp"
+
+static ThreadPool* pool = &ThreadPool::shared();
+static int parallelCalls = 0;
+
+static void parallelFor(int count, void (*task)(void* user, int index), void* user) {
+    ++parallelCalls;
+    pool->parallelFor(size_t(count), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            task(user, int(i));
+        }
+    });
+}
+
+// A minimal baseline encoder: 4:2:0 YCbCr or greyscale, the example tables
+// from Annex K of the JPEG standard, and a restart marker every
+// restartInterval MCUs.
+class JpegEncoder {
+public:
+    std::vector<uint8_t> encode(const std::vector<uint8_t>& rgb, int width, int height, int components,
+                                int restartInterval) {
+        out.clear();
+        bitBuffer = 0;
+        bitCount = 0;
+        putMarker(0xd8);
+        writeTables(components);
+        writeFrame(width, height, components);
+        putMarker(0xdd);
+        put16(4);
+        put16(uint16_t(restartInterval));
+        writeScanHeader(components);
+
+        const int mcuSize = components == 3 ? 16 : 8;
+        const int mcusX = (width + mcuSize - 1) / mcuSize, mcusY = (height + mcuSize - 1) / mcuSize;
+        int predictions[3] = {0, 0, 0};
+        int restarts = 0;
+        for (int mcu = 0; mcu < mcusX * mcusY; ++mcu) {
+            if (mcu > 0 && mcu % restartInterval == 0) {
+                flushBits();
+                putMarker(uint8_t(0xd0 + restarts++ % 8));
+                std::fill(predictions, predictions + 3, 0);
+            }
+            const int x0 = mcu % mcusX * mcuSize, y0 = mcu / mcusX * mcuSize;
+            float block[64];
+            if (components == 1) {
+                sampleBlock(rgb, width, height, x0, y0, 1, 0, block);
+                encodeBlock(block, luminanceQuant, predictions[0]);
+                continue;
+            }
+            for (int by = 0; by < 2; ++by) {
+                for (int bx = 0; bx < 2; ++bx) {
+                    sampleBlock(rgb, width, height, x0 + bx * 8, y0 + by * 8, 1, 0, block);
+                    encodeBlock(block, luminanceQuant, predictions[0]);
+                }
+            }
+            for (int c = 1; c < 3; ++c) {
+                sampleBlock(rgb, width, height, x0, y0, 2, c, block);
+                encodeBlock(block, chrominanceQuant, predictions[c]);
+            }
+        }
+        flushBits();
+        putMarker(0xd9);
+        return out;
+    }
+
+    JpegEncoder() {
+        // Quality 85 scaling of the Annex K tables.
+        static const uint8_t luminance[64] = {
+            16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56,
+            14, 17, 22, 29, 51, 87, 80, 62, 18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+            49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+        static const uint8_t chrominance[64] = {
+            17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99,
+            47, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+            99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+        for (int i = 0; i < 64; ++i) {
+            luminanceQuant[i] = uint8_t(std::clamp((luminance[i] * 30 + 50) / 100, 1, 255));
+            chrominanceQuant[i] = uint8_t(std::clamp((chrominance[i] * 30 + 50) / 100, 1, 255));
+        }
+        buildCodes(kDcBits, kDcValues, dcCodes, dcLengths);
+        buildCodes(kAcBits, kAcValues, acCodes, acLengths);
+    }
+
+private:
+    static constexpr uint8_t kZigzag[64] = {
+        0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+    static constexpr uint8_t kDcBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    static constexpr uint8_t kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    static constexpr uint8_t kAcBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+    static constexpr uint8_t kAcValues[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+        0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+        0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+        0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+        0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+        0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+    static void buildCodes(const uint8_t* bits, const uint8_t* values, uint16_t* codes, uint8_t* lengths) {
+        uint16_t code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; ++length) {
+            for (int i = 0; i < bits[length - 1]; ++i, ++k) {
+                codes[values[k]] = code++;
+                lengths[values[k]] = uint8_t(length);
+            }
+            code <<= 1;
+        }
+    }
+
+    void put16(uint16_t value) {
+        out.push_back(uint8_t(value >> 8));
+        out.push_back(uint8_t(value));
+    }
+
+    void putMarker(uint8_t marker) {
+        out.push_back(0xff);
+        out.push_back(marker);
+    }
+
+    void writeTables(int components) {
+        putMarker(0xdb);
+        put16(uint16_t(2 + 65 * (components == 3 ? 2 : 1)));
+        for (int table = 0; table < (components == 3 ? 2 : 1); ++table) {
+            out.push_back(uint8_t(table));
+            for (int i = 0; i < 64; ++i) {
+                out.push_back((table ? chrominanceQuant : luminanceQuant)[kZigzag[i]]);
+            }
+        }
+        // One DC and one AC table, shared by every component.
+        putMarker(0xc4);
+        put16(2 + 17 + 12 + 17 + 162);
+        out.push_back(0x00);
+        out.insert(out.end(), kDcBits, kDcBits + 16);
+        out.insert(out.end(), kDcValues, kDcValues + 12);
+        out.push_back(0x10);
+        out.insert(out.end(), kAcBits, kAcBits + 16);
+        out.insert(out.end(), kAcValues, kAcValues + 162);
+    }
+
+    void writeFrame(int width, int height, int components) {
+        putMarker(0xc0);
+        put16(uint16_t(8 + 3 * components));
+        out.push_back(8);
+        put16(uint16_t(height));
+        put16(uint16_t(width));
+        out.push_back(uint8_t(components));
+        for (int c = 0; c < components; ++c) {
+            out.push_back(uint8_t(c + 1));
+            out.push_back(components == 3 && c == 0 ? 0x22 : 0x11);
+            out.push_back(c == 0 ? 0 : 1);
+        }
+    }
+
+    void writeScanHeader(int components) {
+        putMarker(0xda);
+        put16(uint16_t(6 + 2 * components));
+        out.push_back(uint8_t(components));
+        for (int c = 0; c < components; ++c) {
+            out.push_back(uint8_t(c + 1));
+            out.push_back(0x00);
+        }
+        out.insert(out.end(), {0, 63, 0});
+    }
+
+    // Component c of the 8x8 block at (x0, y0), averaging scale x scale
+    // pixels per sample, level shifted by -128. Edges are clamped.
+    static void sampleBlock(const std::vector<uint8_t>& rgb, int width, int height, int x0, int y0, int scale, int c,
+                            float* block) {
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                float sum = 0.0f;
+                for (int j = 0; j < scale; ++j) {
+                    for (int i = 0; i < scale; ++i) {
+                        const int px = std::min(x0 + x * scale + i, width - 1);
+                        const int py = std::min(y0 + y * scale + j, height - 1);
+                        const uint8_t* p = &rgb[(size_t(py) * width + px) * 3];
+                        const float r = p[0], g = p[1], b = p[2];
+                        sum += c == 0 ? 0.299f * r + 0.587f * g + 0.114f * b
+                             : c == 1 ? -0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f
+                                      : 0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f;
+                    }
+                }
+                block[y * 8 + x] = sum / float(scale * scale) - 128.0f;
+            }
+        }
+    }
+
+    void encodeBlock(const float* block, const uint8_t* quant, int& prediction) {
+        static const auto cosines = [] {
+            std::vector<float> table(64);
+            for (int u = 0; u < 8; ++u) {
+                for (int x = 0; x < 8; ++x) {
+                    table[u * 8 + x] = float((u ? 0.5 : std::sqrt(0.125)) * std::cos((2 * x + 1) * u * M_PI / 16));
+                }
+            }
+            return table;
+        }();
+        float rows[64];
+        for (int y = 0; y < 8; ++y) {
+            for (int u = 0; u < 8; ++u) {
+                float sum = 0.0f;
+                for (int x = 0; x < 8; ++x) {
+                    sum += cosines[u * 8 + x] * block[y * 8 + x];
+                }
+                rows[y * 8 + u] = sum;
+            }
+        }
+        int coefficients[64];
+        for (int v = 0; v < 8; ++v) {
+            for (int u = 0; u < 8; ++u) {
+                float sum = 0.0f;
+                for (int y = 0; y < 8; ++y) {
+                    sum += cosines[v * 8 + y] * rows[y * 8 + u];
+                }
+                coefficients[v * 8 + u] = int(std::lround(sum / quant[v * 8 + u]));
+            }
+        }
+
+        const int dc = coefficients[0] - prediction;
+        prediction = coefficients[0];
+        const int dcSize = magnitudeSize(dc);
+        putBits(dcCodes[dcSize], dcLengths[dcSize]);
+        putBits(magnitudeBits(dc, dcSize), dcSize);
+        int run = 0;
+        for (int i = 1; i < 64; ++i) {
+            const int ac = coefficients[kZigzag[i]];
+            if (ac == 0) {
+                ++run;
+                continue;
+            }
+            for (; run >= 16; run -= 16) {
+                putBits(acCodes[0xf0], acLengths[0xf0]);
+            }
+            const int size = magnitudeSize(ac);
+            const int symbol = run << 4 | size;
+            putBits(acCodes[symbol], acLengths[symbol]);
+            putBits(magnitudeBits(ac, size), size);
+            run = 0;
+        }
+        if (run > 0) {
+            putBits(acCodes[0x00], acLengths[0x00]);
+        }
+    }
+
+    static int magnitudeSize(int value) {
+        int size = 0;
+        for (int magnitude = std::abs(value); magnitude; magnitude >>= 1) {
+            ++size;
+        }
+        return size;
+    }
+
+    static uint32_t magnitudeBits(int value, int size) {
+        return uint32_t(value < 0 ? value + (1 << size) - 1 : value);
+    }
+
+    void putBits(uint32_t bits, int count) {
+        bitBuffer = bitBuffer << count | (bits & ((1u << count) - 1));
+        bitCount += count;
+        while (bitCount >= 8) {
+            const uint8_t byte = uint8_t(bitBuffer >> (bitCount - 8));
+            out.push_back(byte);
+            if (byte == 0xff) {
+                out.push_back(0x00);
+            }
+            bitCount -= 8;
+        }
+    }
+
+    // Pads the last byte with ones, as the standard asks before a marker.
+    void flushBits() {
+        if (bitCount > 0) {
+            putBits(0x7f, 8 - bitCount);
+        }
+    }
+
+    std::vector<uint8_t> out;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+    uint8_t luminanceQuant[64];
+    uint8_t chrominanceQuant[64];
+    uint16_t dcCodes[256]{}, acCodes[256]{};
+    uint8_t dcLengths[256]{}, acLengths[256]{};
+};
+
+// Smooth gradients with fine detail, so blocks carry some AC energy.
+static std::vector<uint8_t> syntheticImage(int width, int height) {
+    std::vector<uint8_t> rgb(size_t(width) * height * 3);
+    uint32_t noise = 1;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            noise = noise * 1664525 + 1013904223;
+            uint8_t* p = &rgb[(size_t(y) * width + x) * 3];
+            const float ripple = 40.0f * std::sin(x * 0.05f) * std::cos(y * 0.03f);
+            p[0] = uint8_t(std::clamp(255.0f * x / width + ripple + float(noise >> 28), 0.0f, 255.0f));
+            p[1] = uint8_t(std::clamp(255.0f * y / height - ripple + float(noise >> 28), 0.0f, 255.0f));
+            p[2] = uint8_t(std::clamp(128.0f + ripple * 2.0f + float(noise >> 27), 0.0f, 255.0f));
+        }
+    }
+    return rgb;
+}
+
+struct Decoded {
+    std::vector<uint8_t> pixels;
+    int width = 0, height = 0;
+    bool valid = false;
+};
+
+static Decoded decode(const std::vector<uint8_t>& file) {
+    Decoded result;
+    int channels;
+    uint8_t* pixels = stbi_load_from_memory(file.data(), int(file.size()), &result.width, &result.height, &channels, 0);
+    if (pixels) {
+        result.pixels.assign(pixels, pixels + size_t(result.width) * result.height * channels);
+        result.valid = true;
+        stbi_image_free(pixels);
+    }
+    return result;
+}
+
+static double bestDecodeSeconds(const std::vector<uint8_t>& file, int runs) {
+    return bestSeconds(runs, [&] {
+        int width, height, channels;
+        stbi_image_free(stbi_load_from_memory(file.data(), int(file.size()), &width, &height, &channels, 0));
+    });
+}
+
+static void time(const std::string& name, const std::vector<uint8_t>& file) {
+    int width = 0, height = 0, channels = 0;
+    stbi_info_from_memory(file.data(), int(file.size()), &width, &height, &channels);
+    const double mb = file.size() / double(1 << 20), megapixels = double(width) * height / 1e6;
+    stbi_set_parallel_for(nullptr);
+    const double serial = bestDecodeSeconds(file, 3);
+    stbi_set_parallel_for(parallelFor);
+    const double parallel = bestDecodeSeconds(file, 3);
+    std::cout << name << " (" << width << "x" << height << ", " << mb << " MB): serial " << serial * 1e3 << " ms, "
+              << mb / serial << " MB/s, " << megapixels / serial << " MP/s; parallel " << parallel * 1e3 << " ms, "
+              << mb / parallel << " MB/s, " << megapixels / parallel << " MP/s (" << serial / parallel << "x)"
+              << std::endl;
+}
+
+// The parallel decode must give exactly what the serial one does, on a pool
+// with more threads than intervals per task so that tasks really overlap.
+static bool matchesSerial(const char* what, const std::vector<uint8_t>& file) {
+    ThreadPool wide(4);
+    pool = &wide;
+    stbi_set_parallel_for(nullptr);
+    const Decoded serial = decode(file);
+    stbi_set_parallel_for(parallelFor);
+    const Decoded parallel = decode(file);
+    pool = &ThreadPool::shared();
+    const bool same = serial.valid == parallel.valid && serial.width == parallel.width &&
+                      serial.height == parallel.height && serial.pixels == parallel.pixels;
+    if (!same) {
+        std::cout << what << ": parallel decode differs from serial" << std::endl;
+    }
+    return same;
+}
+
+static double psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    double squaredError = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        const double error = double(a[i]) - b[i];
+        squaredError += error * error;
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / std::max(squaredError / a.size(), 1e-12));
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << ThreadPool::shared().threadCount() << " threads" << std::endl;
+    bool passed = true;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            std::ifstream in(argv[i], std::ios::binary);
+            const std::vector<uint8_t> file{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+            time(argv[i], file);
+            passed &= matchesSerial(argv[i], file);
+        }
+    } else {
+        JpegEncoder encoder;
+        const struct {
+            const char* name;
+            int width, height;
+        } sizes[] = {{"1080p", 1920, 1080}, {"4K", 3840, 2160}, {"8K", 7680, 4320}};
+        for (const auto& size : sizes) {
+            const std::vector<uint8_t> rgb = syntheticImage(size.width, size.height);
+            const std::vector<uint8_t> file = encoder.encode(rgb, size.width, size.height, 3, (size.width + 15) / 16);
+            time(size.name, file);
+            passed &= matchesSerial(size.name, file);
+            const Decoded decoded = decode(file);
+            passed &= check(decoded.valid && psnr(decoded.pixels, rgb) > 30.0, "encoder round trip is off");
+        }
+
+        const std::vector<uint8_t> rgb = syntheticImage(1000, 600);
+        // Greyscale scans have one block per MCU.
+        passed &= matchesSerial("grey", encoder.encode(rgb, 1000, 600, 1, 125));
+        // 63 x 38 MCUs in intervals of 10, so the last one is short.
+        std::vector<uint8_t> file = encoder.encode(rgb, 1000, 600, 3, 10);
+        passed &= matchesSerial("short last interval", file);
+
+        // Drop the third restart marker: the parallel path has to see the
+        // count is off and leave the scan to the serial decoder. What the
+        // decoder leaves of the image after that is undefined, so only the
+        // fallback is checked.
+        size_t markers = 0, at = 0;
+        for (size_t i = 0; i + 1 < file.size(); ++i) {
+            if (file[i] == 0xff && file[i + 1] >= 0xd0 && file[i + 1] <= 0xd7 && ++markers == 3) {
+                at = i;
+                break;
+            }
+        }
+        file.erase(file.begin() + at, file.begin() + at + 2);
+        stbi_set_parallel_for(parallelFor);
+        parallelCalls = 0;
+        passed &= check(decode(file).valid && parallelCalls == 0, "missing restart marker: no serial fallback");
+    }
+
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+//
+//  mipbench.cpp
+//  Metal-Guide
+//
+//  Times MipFeedback level computation for 100k objects scattered around
+//  the camera MTLEngine uses, and checks the SIMD and parallel paths
+//  against the scalar reference. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/mipbench.cpp
+//        Metal-Tutorial/mip_feedback.cpp Metal-Tutorial/texture_residency.cpp
+//        Metal-Tutorial/thread_pool.cpp -o mipbench
+//
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "mip_feedback.hpp"
+
+int main() {
+    constexpr size_t kObjectCount = 100000;
+    constexpr size_t kTextureCount = 1000;
+
+    // Camera at z = 1 looking down -z, as in EngineCore::writeTransforms.
+    MipFeedback::View view{};
+    const float viewMatrix[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -1, 1};
+    std::copy(viewMatrix, viewMatrix + 16, view.viewMatrix);
+    view.fovY = 90.0f * float(M_PI) / 180.0f;
+    view.aspect = 800.0f / 600.0f;
+    view.nearZ = 0.1f;
+    view.farZ = 100.0f;
+    view.viewportHeight = 600.0f;
+
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.1f, 4.0f);
+    std::uniform_int_distribution<int> textureSize(6, 12);
+    std::uniform_int_distribution<uint32_t> texture(0, kTextureCount - 1);
+    std::vector<float> x(kObjectCount), y(kObjectCount), z(kObjectCount), radius(kObjectCount), density(kObjectCount);
+    std::vector<uint32_t> textureIndices(kObjectCount);
+    for (size_t i = 0; i < kObjectCount; ++i) {
+        x[i] = position(random);
+        y[i] = position(random);
+        z[i] = position(random) - 40.0f;
+        radius[i] = size(random);
+        // One UV repeat across the object's diameter.
+        density[i] = float(1 << textureSize(random)) / (2.0f * radius[i]);
+        textureIndices[i] = texture(random);
+    }
+    const MipFeedback::Objects objects{x.data(), y.data(), z.data(), radius.data(), density.data(), kObjectCount};
+
+    std::vector<uint8_t> reference(kObjectCount), simd(kObjectCount), parallel(kObjectCount), textureLevels(kTextureCount);
+    double scalarSeconds = bestSeconds(20, [&] { MipFeedback::Scalar::computeLevels(view, objects, reference.data()); });
+    double simdSeconds = bestSeconds(20, [&] { MipFeedback::computeLevels(view, objects, simd.data()); });
+    double parallelSeconds = bestSeconds(20, [&] { MipFeedback::computeLevelsParallel(view, objects, parallel.data()); });
+    double reduceSeconds = bestSeconds(20, [&] {
+        MipFeedback::reduceToTextures(simd.data(), textureIndices.data(), kObjectCount, textureLevels.data(), kTextureCount);
+    });
+
+    auto report = [](const char* name, double seconds) {
+        std::cout << name << ": " << seconds * 1e6 << " us, " << kObjectCount / seconds / 1e6 << " M objects/s" << std::endl;
+    };
+    report("scalar", scalarSeconds);
+    report("simd", simdSeconds);
+    report("simd, thread pool", parallelSeconds);
+    std::cout << "reduce to " << kTextureCount << " textures: " << reduceSeconds * 1e6 << " us" << std::endl;
+
+    size_t histogram[16] = {}, hidden = 0;
+    for (uint8_t level : reference) {
+        if (level == MipFeedback::kNotVisible) {
+            ++hidden;
+        } else {
+            ++histogram[std::min<int>(level, 15)];
+        }
+    }
+    std::cout << "visible " << kObjectCount - hidden << ", levels:";
+    for (int level = 0; level < 16; ++level) {
+        if (histogram[level]) {
+            std::cout << " " << level << ":" << histogram[level];
+        }
+    }
+    std::cout << std::endl;
+
+    bool passed = simd == reference && parallel == reference;
+    std::cout << (passed ? "SIMD and parallel results match scalar" : "results DIFFER from scalar") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+//
+//  pipelinecachesim.cpp
+//  Metal-Guide
+//
+//  Checks PipelineCache against a mock compiler that takes a couple of
+//  milliseconds per pipeline and records what it compiles, in what order
+//  and how many at once. Checks:
+//  - Keys change with every field a pipeline uses and ignore the rest:
+//    blending on unused attachments, and blend factors where blending is
+//    off.
+//  - However often a pipeline is asked for, it compiles once, and get()
+//    returns the fallback until it is ready.
+//  - Pipelines from get() compile before prewarmed ones, including one
+//    that was already waiting as prewarmed.
+//  - No more than maxInFlight compiles run at once.
+//  - A failed compile keeps its error and is not retried.
+//  - save() and prewarm() round-trip the pipelines that compiled. A
+//    missing, stale or truncated file queues nothing it cannot read.
+//  - Every pipeline is released when the cache is destroyed.
+//  Each check runs on a pool of 1, where compiles run inline in update(),
+//  and on a pool of 4. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/pipelinecachesim.cpp
+//        Metal-Tutorial/pipeline_cache.cpp Metal-Tutorial/texture_cache.cpp
+//        Metal-Tutorial/mapped_file.cpp Metal-Tutorial/thread_pool.cpp -o pipelinecachesim
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "pipeline_cache.hpp"
+
+static constexpr uint32_t kColorFormat = 80, kDepthFormat = 252;  // BGRA8Unorm, Depth32Float
+
+// Compiles anything whose vertex function does not start with "broken".
+class MockCompiler : public PipelineCompiler {
+public:
+    explicit MockCompiler(std::chrono::microseconds delay) : delay(delay) {}
+
+    void* compile(const PipelineDescription& description, std::string& error) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(description.vertexFunction);
+            ++compiles[description.vertexFunction];
+            peakRunning = std::max(peakRunning, ++running);
+        }
+        std::this_thread::sleep_for(delay);
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        if (description.vertexFunction.rfind("broken", 0) == 0) {
+            error = "function " + description.vertexFunction + " does not compile";
+            return nullptr;
+        }
+        void* pipeline = reinterpret_cast<void*>(++nextId);
+        live.insert(pipeline);
+        return pipeline;
+    }
+
+    void release(void* pipeline) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!live.erase(pipeline)) {
+            std::cout << "FAIL released a pipeline that is not live" << std::endl;
+            std::exit(1);
+        }
+    }
+
+    std::mutex mutex;
+    std::vector<std::string> order;
+    std::map<std::string, int> compiles;
+    std::set<void*> live;
+    uint32_t running{0};
+    uint32_t peakRunning{0};
+
+private:
+    std::chrono::microseconds delay;
+    uintptr_t nextId{0};
+};
+
+static void* const kFallback = reinterpret_cast<void*>(~uintptr_t(0));
+
+static PipelineDescription pipeline(const std::string& name) {
+    PipelineDescription description;
+    description.vertexFunction = name;
+    description.fragmentFunction = "fragmentShader";
+    description.colorFormats[0] = kColorFormat;
+    description.depthFormat = kDepthFormat;
+    description.sampleCount = 4;
+    return description;
+}
+
+static bool checkKeys() {
+    const PipelineDescription base = pipeline("vertexShader");
+    const PipelineCache::Key key = PipelineCache::key(base);
+    bool passed = check(PipelineCache::key(pipeline("vertexShader")) == key, "same description, same key", 0, 1);
+
+    auto differs = [&](const char* what, auto&& change) {
+        PipelineDescription changed = base;
+        change(changed);
+        passed &= check(PipelineCache::key(changed) != key, what, 0, 1);
+    };
+    differs("vertex function", [](PipelineDescription& d) { d.vertexFunction = "vertexShader2"; });
+    differs("fragment function", [](PipelineDescription& d) { d.fragmentFunction.clear(); });
+    // The strings are length-prefixed, so moving a character across does not collide.
+    differs("function boundary", [](PipelineDescription& d) {
+        d.vertexFunction = "vertexShaderf";
+        d.fragmentFunction = "ragmentShader";
+    });
+    differs("colour format", [](PipelineDescription& d) { d.colorFormats[0] = 70; });
+    differs("second attachment", [](PipelineDescription& d) { d.colorFormats[1] = kColorFormat; });
+    differs("depth format", [](PipelineDescription& d) { d.depthFormat = 0; });
+    differs("stencil format", [](PipelineDescription& d) { d.stencilFormat = 253; });
+    differs("sample count", [](PipelineDescription& d) { d.sampleCount = 1; });
+    differs("blending", [](PipelineDescription& d) { d.blend[0].enabled = true; });
+    differs("write mask", [](PipelineDescription& d) { d.blend[0].writeMask = 0; });
+    differs("blend factor", [](PipelineDescription& d) {
+        d.blend[0].enabled = true;
+        d.blend[0].destinationRGB = 5;
+    });
+
+    PipelineDescription unused = base;
+    unused.blend[0].destinationRGB = 5;   // blending is off
+    unused.blend[3].enabled = true;       // attachment 3 is unused
+    unused.blend[3].writeMask = 1;
+    passed &= check(PipelineCache::key(unused) == key, "unused blend state ignored", 0, 1);
+    return passed;
+}
+
+static std::filesystem::path tempPath(const char* name) {
+    return std::filesystem::temp_directory_path() / name;
+}
+
+// Queues and runs 30 requests for 6 pipelines, one broken, and saves the
+// ones that compiled.
+static bool checkRequests(ThreadPool& pool, const std::string& savePath) {
+    MockCompiler compiler(std::chrono::microseconds(2000));
+    bool passed = true;
+    {
+        PipelineCache cache(compiler, 2, pool);
+        cache.setFallback(kFallback);
+        std::vector<PipelineCache::Key> keys;
+        for (int round = 0; round < 5; ++round) {
+            for (const char* name : {"a", "b", "c", "d", "e", "broken"}) {
+                void* got = cache.get(pipeline(name));
+                passed &= check(got == kFallback, "fallback before the first update", 0, 1);
+                if (round == 0) {
+                    keys.push_back(PipelineCache::key(pipeline(name)));
+                }
+            }
+        }
+        const PipelineCache::Stats& stats = cache.stats();
+        passed &= check(stats.fallbacks == 30 && stats.deduplicated == 24, "requests deduplicated",
+                        double(stats.deduplicated), 24);
+        if (pool.threadCount() == 1) {
+            // Inline, the first update() compiles maxInFlight pipelines.
+            cache.update();
+            passed &= check(cache.get(keys[0]) != kFallback && cache.get(keys[2]) == kFallback,
+                            "inline compiles ready after one update", 0, 1);
+        }
+        cache.finish();
+
+        passed &= check(stats.compiles == 6 && stats.failures == 1, "compiles", double(stats.compiles), 6);
+        for (const auto& [name, count] : compiler.compiles) {
+            passed &= check(count == 1, "compiles per pipeline", count, 1);
+        }
+        passed &= check(compiler.peakRunning <= 2, "compiles at once", compiler.peakRunning, 2);
+        for (size_t i = 0; i + 1 < keys.size(); ++i) {
+            passed &= check(cache.state(keys[i]) == PipelineCache::State::Ready && cache.get(keys[i]) != kFallback,
+                            "pipeline ready after finish()", double(i), 1);
+        }
+        const PipelineCache::Key broken = keys.back();
+        passed &= check(cache.state(broken) == PipelineCache::State::Failed && cache.get(broken) == kFallback &&
+                        cache.error(broken) == "function broken does not compile", "failed pipeline", 0, 1);
+        cache.get(broken);
+        cache.finish();
+        passed &= check(compiler.compiles["broken"] == 1, "failed pipeline not retried", compiler.compiles["broken"], 1);
+        passed &= check(cache.save(savePath), "save()", 0, 1);
+    }
+    passed &= check(compiler.live.empty(), "pipelines left after the cache", double(compiler.live.size()), 0);
+    return passed;
+}
+
+// Prewarms from the saved file while the frame asks for other pipelines.
+static bool checkPrewarm(ThreadPool& pool, const std::string& savePath) {
+    MockCompiler compiler(std::chrono::microseconds(2000));
+    bool passed = true;
+    {
+        PipelineCache cache(compiler, 2, pool);
+        cache.setFallback(kFallback);
+        const size_t prewarmed = cache.prewarm(savePath);
+        passed &= check(prewarmed == 5 && cache.stats().prewarmed == 5, "pipelines prewarmed", double(prewarmed), 5);
+        passed &= check(cache.state(PipelineCache::key(pipeline("a"))) == PipelineCache::State::Queued,
+                        "prewarmed pipeline queued", 0, 1);
+        passed &= check(cache.prewarm(savePath) == 0, "prewarming twice queues nothing", 0, 0);
+        // "e" was saved last, so it waits behind the others until get() asks for it.
+        cache.get(pipeline("new"));
+        cache.get(pipeline("e"));
+        cache.finish();
+        passed &= check(compiler.order.size() == 6, "compiles", double(compiler.order.size()), 6);
+        if (compiler.order.size() == 6) {
+            const auto position = [&](const char* name) {
+                return std::find(compiler.order.begin(), compiler.order.end(), name) - compiler.order.begin();
+            };
+            // On a pool the two may start in either order.
+            passed &= check(position("new") < 2 && position("e") < 2, "urgent pipelines first",
+                            double(position("e")), 1);
+        }
+        passed &= check(cache.get(pipeline("c")) != kFallback, "prewarmed pipeline ready", 0, 1);
+    }
+    passed &= check(compiler.live.empty(), "pipelines left after the cache", double(compiler.live.size()), 0);
+    return passed;
+}
+
+static bool checkFiles(ThreadPool& pool, const std::string& savePath) {
+    MockCompiler compiler(std::chrono::microseconds(0));
+    PipelineCache cache(compiler, 2, pool);
+    const std::string otherPath = tempPath("pipelinecachesim-other.mgpc").string();
+    bool passed = check(cache.prewarm(tempPath("pipelinecachesim-missing.mgpc").string()) == 0, "missing file", 0, 0);
+
+    std::ifstream in(savePath, std::ios::binary);
+    std::vector<char> bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    auto write = [&](const std::vector<char>& contents) {
+        std::ofstream(otherPath, std::ios::binary).write(contents.data(), std::streamsize(contents.size()));
+    };
+    std::vector<char> stale = bytes;
+    stale[4] ^= 0x7f;  // version
+    write(stale);
+    passed &= check(cache.prewarm(otherPath) == 0, "stale file", 0, 0);
+    // Cut inside the third record: the first two are read.
+    size_t offset = 12;
+    for (int record = 0; record < 2; ++record) {
+        uint32_t size;
+        std::memcpy(&size, bytes.data() + offset, sizeof(size));
+        offset += sizeof(size) + size;
+    }
+    write(std::vector<char>(bytes.begin(), bytes.begin() + ptrdiff_t(offset + 7)));
+    passed &= check(cache.prewarm(otherPath) == 2, "truncated file", double(cache.stats().prewarmed), 2);
+
+    // Prewarming everything and saving writes the file that was read.
+    MockCompiler otherCompiler(std::chrono::microseconds(0));
+    PipelineCache other(otherCompiler, 2, pool);
+    other.prewarm(savePath);
+    other.finish();
+    passed &= check(other.save(otherPath), "save()", 0, 1);
+    std::ifstream resaved(otherPath, std::ios::binary);
+    const std::vector<char> saved{std::istreambuf_iterator<char>(resaved), std::istreambuf_iterator<char>()};
+    passed &= check(saved == bytes, "save() after prewarm() writes the same file", double(saved.size()),
+                    double(bytes.size()));
+    std::filesystem::remove(otherPath);
+    return passed;
+}
+
+// Many pipelines through a wider in-flight limit.
+static bool checkLimit(ThreadPool& pool) {
+    MockCompiler compiler(std::chrono::microseconds(500));
+    PipelineCache cache(compiler, 3, pool);
+    for (int i = 0; i < 60; ++i) {
+        cache.request(pipeline("shader" + std::to_string(i % 40)));
+    }
+    int frames = 0;
+    while (cache.stats().compiles < 40 && frames < 100000) {
+        cache.update();
+        ++frames;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    bool passed = check(cache.stats().compiles == 40 && cache.stats().deduplicated == 20, "compiles",
+                        double(cache.stats().compiles), 40);
+    passed &= check(compiler.peakRunning <= 3, "compiles at once", compiler.peakRunning, 3);
+    std::cout << "  pool of " << pool.threadCount() << ": 40 pipelines in " << frames << " updates, "
+              << compiler.peakRunning << " compiling at once" << std::endl;
+    return passed;
+}
+
+int main() {
+    bool passed = checkKeys();
+    const std::string savePath = tempPath("pipelinecachesim.mgpc").string();
+    for (unsigned threads : {1u, 4u}) {
+        ThreadPool pool(threads);
+        passed &= checkRequests(pool, savePath);
+        passed &= checkPrewarm(pool, savePath);
+        passed &= checkFiles(pool, savePath);
+        passed &= checkLimit(pool);
+    }
+    std::filesystem::remove(savePath);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+//
+//  pngbench.cpp
+//  Metal-Guide
+//
+//  Times stb_image PNG decoding on 4K images, noisy and tile-like, and
+//  generates a corpus of small PNGs for comparing decoders: every colour
+//  type and bit depth, interlaced or not, random filters per row, zlib
+//  levels and strategies, IDATs split at random, and truncated and
+//  bit-flipped copies. With --digests it prints a hash of each decode
+//  (or of the failure) instead, so two builds can be diffed. Build from
+//  lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal tools/pngbench.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -lz -o pngbench
+//
+//  and a reference build from an unmodified stb_image.h, e.g. the one from
+//  before the PNG changes:
+//
+//    git show 01cc886^:lesson2_1/external/stb/stb_image.h > /tmp/stb_image.h
+//    clang++ -std=c++20 -O2 '-DREFERENCE_STB="/tmp/stb_image.h"'
+//        tools/pngbench.cpp -lz -o pngbench-reference
+//    diff <(./pngbench --digests) <(./pngbench-reference --digests)
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "bench_util.hpp"
+
+#if defined(REFERENCE_STB)
+#define STB_IMAGE_IMPLEMENTATION
+#include REFERENCE_STB
+#else
+#include "stb/stb_image.h"
+#endif
+
+struct PngOptions {
+    int width = 0, height = 0;
+    int colorType = 6;       // 0 grey, 2 RGB, 3 palette, 4 grey + alpha, 6 RGBA
+    int bitDepth = 8;
+    bool interlaced = false;
+    int level = 6;           // zlib
+    int strategy = Z_DEFAULT_STRATEGY;
+    int filter = -1;         // per row; -1 picks one at random for each row
+    size_t idatSize = 1 << 16;
+};
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.insert(out.end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    putBigEndian(out, uint32_t(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBigEndian(out, uint32_t(crc32(0, out.data() + start, uInt(out.size() - start))));
+}
+
+static int channelCount(int colorType) {
+    switch (colorType) {
+    case 0: case 3: return 1;
+    case 4: return 2;
+    case 2: return 3;
+    default: return 4;
+    }
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return uint8_t(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// Filters one row of raw bytes against the previous one (empty for the first).
+static void filterRow(int type, const uint8_t* row, const uint8_t* previous, size_t size, size_t bytesPerPixel,
+                      std::vector<uint8_t>& out) {
+    out.push_back(uint8_t(type));
+    for (size_t i = 0; i < size; ++i) {
+        const int a = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+        const int b = previous ? previous[i] : 0;
+        const int c = previous && i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+        const int predicted = type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : type == 4 ? paeth(a, b, c) : 0;
+        out.push_back(uint8_t(row[i] - predicted));
+    }
+}
+
+// rows holds the image packed as PNG stores it: bitDepth bits per channel,
+// each row padded to a whole byte.
+static std::vector<uint8_t> encodePng(const std::vector<uint8_t>& rows, const PngOptions& options, std::mt19937& random,
+                                      const std::vector<uint8_t>& palette = {}) {
+    const int bitsPerPixel = channelCount(options.colorType) * options.bitDepth;
+    const size_t bytesPerPixel = std::max(1, bitsPerPixel / 8);
+    const size_t rowBytes = (size_t(options.width) * bitsPerPixel + 7) / 8;
+
+    // Adam7 passes, or a single pass over the whole image.
+    static const int starts[7][2] = {{0, 0}, {4, 0}, {0, 4}, {2, 0}, {0, 2}, {1, 0}, {0, 1}};
+    static const int steps[7][2] = {{8, 8}, {8, 8}, {4, 8}, {4, 4}, {2, 4}, {2, 2}, {1, 2}};
+    std::vector<uint8_t> filtered;
+    for (int pass = 0; pass < (options.interlaced ? 7 : 1); ++pass) {
+        const int x0 = options.interlaced ? starts[pass][0] : 0, y0 = options.interlaced ? starts[pass][1] : 0;
+        const int dx = options.interlaced ? steps[pass][0] : 1, dy = options.interlaced ? steps[pass][1] : 1;
+        const int passWidth = (options.width - x0 + dx - 1) / dx, passHeight = (options.height - y0 + dy - 1) / dy;
+        if (passWidth <= 0 || passHeight <= 0) {
+            continue;
+        }
+        const size_t passRowBytes = (size_t(passWidth) * bitsPerPixel + 7) / 8;
+        std::vector<uint8_t> row(passRowBytes), previous;
+        for (int y = 0; y < passHeight; ++y) {
+            std::fill(row.begin(), row.end(), 0);
+            const uint8_t* source = &rows[size_t(y0 + y * dy) * rowBytes];
+            for (int x = 0; x < passWidth; ++x) {
+                const int sx = x0 + x * dx;
+                if (bitsPerPixel >= 8) {
+                    std::memcpy(&row[size_t(x) * bytesPerPixel], source + size_t(sx) * bytesPerPixel, bytesPerPixel);
+                } else {
+                    const int shift = 8 - bitsPerPixel - (sx * bitsPerPixel) % 8;
+                    const int value = (source[sx * bitsPerPixel / 8] >> shift) & ((1 << bitsPerPixel) - 1);
+                    row[x * bitsPerPixel / 8] |= uint8_t(value << (8 - bitsPerPixel - (x * bitsPerPixel) % 8));
+                }
+            }
+            const int type = options.filter >= 0 ? options.filter : int(random() % 5);
+            filterRow(type, row.data(), previous.empty() ? nullptr : previous.data(), passRowBytes, bytesPerPixel,
+                      filtered);
+            previous = row;
+        }
+    }
+
+    std::vector<uint8_t> compressed(compressBound(uLong(filtered.size())));
+    z_stream stream{};
+    deflateInit2(&stream, options.level, Z_DEFLATED, 15, 9, options.strategy);
+    stream.next_in = filtered.data();
+    stream.avail_in = uInt(filtered.size());
+    stream.next_out = compressed.data();
+    stream.avail_out = uInt(compressed.size());
+    deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    putBigEndian(header, uint32_t(options.width));
+    putBigEndian(header, uint32_t(options.height));
+    header.insert(header.end(), {uint8_t(options.bitDepth), uint8_t(options.colorType), 0, 0,
+                                 uint8_t(options.interlaced)});
+    putChunk(png, "IHDR", header.data(), header.size());
+    if (options.colorType == 3) {
+        putChunk(png, "PLTE", palette.data(), palette.size());
+    }
+    for (size_t offset = 0; offset < compressed.size(); offset += options.idatSize) {
+        putChunk(png, "IDAT", compressed.data() + offset, std::min(options.idatSize, compressed.size() - offset));
+    }
+    putChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+// Packed rows of noise, smooth gradients or repeated tiles.
+static std::vector<uint8_t> makeRows(const PngOptions& options, int style, std::mt19937& random) {
+    const int bitsPerPixel = channelCount(options.colorType) * options.bitDepth;
+    const size_t rowBytes = (size_t(options.width) * bitsPerPixel + 7) / 8;
+    std::vector<uint8_t> rows(rowBytes * options.height);
+    for (int y = 0; y < options.height; ++y) {
+        for (size_t i = 0; i < rowBytes; ++i) {
+            uint8_t& byte = rows[y * rowBytes + i];
+            byte = style == 0 ? uint8_t(random())
+                 : style == 1 ? uint8_t(i * 3 + y * 2 + (random() % 4))
+                              : uint8_t(((i / 12) ^ (y / 12)) * 37 + (i % 12 == 0) * 90);
+        }
+    }
+    return rows;
+}
+
+static uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = 1469598103934665603ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// A hash of what stb returns for the file, or of its failure reason.
+static uint64_t decodeDigest(const std::vector<uint8_t>& file, int requested) {
+    int width = 0, height = 0, channels = 0;
+    if (stbi_is_16_bit_from_memory(file.data(), int(file.size()))) {
+        stbi_us* pixels = stbi_load_16_from_memory(file.data(), int(file.size()), &width, &height, &channels, requested);
+        if (pixels) {
+            const int stored = requested ? requested : channels;
+            const uint64_t hash = fnv1a(reinterpret_cast<const uint8_t*>(pixels), size_t(width) * height * stored * 2,
+                                        uint64_t(width) << 32 | uint64_t(height) << 8 | uint64_t(channels));
+            stbi_image_free(pixels);
+            return hash;
+        }
+    } else {
+        stbi_uc* pixels = stbi_load_from_memory(file.data(), int(file.size()), &width, &height, &channels, requested);
+        if (pixels) {
+            const int stored = requested ? requested : channels;
+            const uint64_t hash = fnv1a(pixels, size_t(width) * height * stored,
+                                        uint64_t(width) << 32 | uint64_t(height) << 8 | uint64_t(channels));
+            stbi_image_free(pixels);
+            return hash;
+        }
+    }
+    const char* reason = stbi_failure_reason();
+    return fnv1a(reinterpret_cast<const uint8_t*>(reason), std::strlen(reason));
+}
+
+static void printDigests(int count) {
+    std::mt19937 random(28);
+    static const int depths[7][5] = {{1, 2, 4, 8, 16}, {}, {8, 16}, {1, 2, 4, 8}, {8, 16}, {}, {8, 16}};
+    static const int depthCounts[7] = {5, 0, 2, 4, 2, 0, 2};
+    static const int colorTypes[5] = {0, 2, 3, 4, 6};
+    static const int strategies[5] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+    for (int index = 0; index < count; ++index) {
+        PngOptions options;
+        options.width = 1 + int(random() % 300);
+        options.height = 1 + int(random() % 120);
+        options.colorType = colorTypes[random() % 5];
+        options.bitDepth = depths[options.colorType][random() % depthCounts[options.colorType]];
+        options.interlaced = random() % 4 == 0;
+        options.level = int(random() % 10);
+        options.strategy = strategies[random() % 5];
+        options.idatSize = 1 + random() % 40000;
+        const int style = int(random() % 3);
+
+        std::vector<uint8_t> palette;
+        if (options.colorType == 3) {
+            palette.resize(3 << options.bitDepth);
+            for (uint8_t& entry : palette) {
+                entry = uint8_t(random());
+            }
+        }
+        const std::vector<uint8_t> png = encodePng(makeRows(options, style, random), options, random, palette);
+        const int requested = int(random() % 5);
+
+        std::vector<uint8_t> truncated(png.begin(), png.begin() + 8 + random() % (png.size() - 8));
+        std::vector<uint8_t> flipped = png;
+        flipped[33 + random() % (png.size() - 45)] ^= uint8_t(1 << (random() % 8));
+
+        std::cout << index << " " << decodeDigest(png, requested) << " " << decodeDigest(truncated, requested) << " "
+                  << decodeDigest(flipped, requested) << "\n";
+    }
+}
+
+static void time(const char* name, int style, int filter, int level, int strategy = Z_DEFAULT_STRATEGY) {
+    std::mt19937 random(7);
+    PngOptions options;
+    options.width = 3840;
+    options.height = 2160;
+    options.filter = filter;
+    options.level = level;
+    options.strategy = strategy;
+    const std::vector<uint8_t> png = encodePng(makeRows(options, style, random), options, random);
+
+    const double best = bestSeconds(5, [&] {
+        int width, height, channels;
+        stbi_image_free(stbi_load_from_memory(png.data(), int(png.size()), &width, &height, &channels, 4));
+    });
+    const double mb = png.size() / double(1 << 20), megapixels = 3840.0 * 2160.0 / 1e6;
+    std::cout << name << " (" << mb << " MB): " << best * 1e3 << " ms, " << mb / best << " MB/s, "
+              << megapixels / best << " MP/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--digests") == 0) {
+        printDigests(argc > 2 ? std::atoi(argv[2]) : 600);
+        return 0;
+    }
+    time("4K noise, paeth", 0, 4, 6);
+    time("4K gradient, sub", 1, 1, 6);
+    time("4K gradient, mixed filters", 1, -1, 9);
+    time("4K tiles, up", 2, 2, 6);
+    time("4K tiles, huffman only", 2, 0, 6, Z_HUFFMAN_ONLY);
+    return 0;
+}
@@ -0,0 +1,78 @@
+//
+//  qoiconv.cpp
+//  Metal-Guide
+//
+//  Converts any image stb_image can read into .qoi and reports how fast
+//  each format decodes on this machine. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/qoiconv.cpp
+//        Metal-Tutorial/qoi.cpp external/stb/stb_image.cpp
+//        external/stb/stb_image_pool.cpp -o qoiconv
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "qoi.hpp"
+#include "stb/stb_image.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input image> <output.qoi>" << std::endl;
+        return 1;
+    }
+
+    int width, height, channels;
+    if (!stbi_info(argv[1], &width, &height, &channels)) {
+        std::cerr << "Failed to read " << argv[1] << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    const int qoiChannels = (channels == 3) ? 3 : 4;
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned char* image = stbi_load(argv[1], &width, &height, &channels, qoiChannels);
+    const double stbSeconds = secondsSince(start);
+    if (!image) {
+        std::cerr << "Failed to decode " << argv[1] << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> encoded = Qoi::encode(image, width, height, qoiChannels);
+    std::ofstream out(argv[2], std::ios::binary);
+    out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    if (!out) {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        stbi_image_free(image);
+        return 1;
+    }
+
+    // Decode the result back (always RGBA) to check the round trip and time it.
+    std::vector<uint8_t> decoded(size_t(width) * height * 4);
+    Qoi::Decoder decoder;
+    start = std::chrono::steady_clock::now();
+    bool ok = decoder.open(encoded.data(), encoded.size()) &&
+              decoder.decodeRows(decoded.data(), size_t(width) * 4, height);
+    const double qoiSeconds = secondsSince(start);
+
+    for (size_t i = 0; ok && i < size_t(width) * height; ++i) {
+        const uint8_t* expected = image + i * qoiChannels;
+        const uint8_t* actual = decoded.data() + i * 4;
+        ok = std::memcmp(expected, actual, qoiChannels) == 0 && (qoiChannels == 4 || actual[3] == 255);
+    }
+    stbi_image_free(image);
+    if (!ok) {
+        std::cerr << "Round trip mismatch" << std::endl;
+        return 1;
+    }
+
+    const double megapixels = double(width) * height / 1e6;
+    std::cout << width << "x" << height << " " << qoiChannels << " channels, "
+              << encoded.size() / 1024 << " KiB\n"
+              << "stb decode: " << megapixels / stbSeconds << " MP/s\n"
+              << "qoi decode: " << megapixels / qoiSeconds << " MP/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,290 @@
+//
+//  rasterbench.cpp
+//  Metal-Guide
+//
+//  Checks SoftwareRasterizer against the behaviour of the Metal pass it
+//  stands in for, then reports frames per second on a field of ~100k cube
+//  triangles. Checks:
+//  - The engine's cube at rest shows only its front face.
+//  - A jittered mesh covering the screen writes every sample exactly once.
+//  - The depth test is LessEqual.
+//  - Edges get intermediate resolved colours.
+//  - Output is identical for any thread count.
+//  Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/rasterbench.cpp
+//        Metal-Tutorial/software_rasterizer.cpp Metal-Tutorial/thread_pool.cpp
+//        -o rasterbench
+//
+//  Usage: rasterbench [frame.ppm]  (writes the last cube field frame)
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "software_rasterizer.hpp"
+
+// The vertices EngineCore uploads for its cube.
+static const RasterVertex kCubeVertices[] = {
+    {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
+    {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{-0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, 0.5, 0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, -0.5, 0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{-0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}}, {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}}, {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
+};
+
+static const float kClearColor[4] = {41.0f / 255.0f, 42.0f / 255.0f, 48.0f / 255.0f, 1.0f};
+
+// Column-major matrices built like AAPLMathUtilities' row-major helpers.
+static void fromRows(const float rows[16], float m[16]) {
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m[c * 4 + r] = rows[r * 4 + c];
+        }
+    }
+}
+
+static void identity(float m[16]) {
+    const float rows[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    fromRows(rows, m);
+}
+
+// translation * rotation about y, as EngineCore builds the model matrix.
+static void modelMatrix(float tx, float ty, float tz, float angle, float m[16]) {
+    const float c = std::cos(angle), s = std::sin(angle);
+    const float rows[16] = {c, 0, s, tx, 0, 1, 0, ty, -s, 0, c, tz, 0, 0, 0, 1};
+    fromRows(rows, m);
+}
+
+// The engine's camera: at (0, 0, 1) looking down -z.
+static void engineView(float m[16]) {
+    const float rows[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, -1, 0, 0, 0, 1};
+    fromRows(rows, m);
+}
+
+static void perspectiveRightHand(float fovY, float aspect, float nearZ, float farZ, float m[16]) {
+    const float ys = 1.0f / std::tan(fovY * 0.5f), xs = ys / aspect, zs = farZ / (nearZ - farZ);
+    const float rows[16] = {xs, 0, 0, 0, 0, ys, 0, 0, 0, 0, zs, nearZ * zs, 0, 0, -1, 0};
+    fromRows(rows, m);
+}
+
+static RasterTransforms engineTransforms(int width, int height, float tx, float ty, float tz, float angle) {
+    RasterTransforms transforms;
+    modelMatrix(tx, ty, tz, angle, transforms.modelMatrix);
+    engineView(transforms.viewMatrix);
+    perspectiveRightHand(float(M_PI) / 2.0f, float(width) / float(height), 0.1f, 100.0f, transforms.perspectiveMatrix);
+    return transforms;
+}
+
+static std::vector<uint8_t> solidTexture(uint8_t r, uint8_t g, uint8_t b) {
+    std::vector<uint8_t> pixels(4 * 4 * 4);
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        pixels[i] = r; pixels[i + 1] = g; pixels[i + 2] = b; pixels[i + 3] = 255;
+    }
+    return pixels;
+}
+
+static bool checkEngineCube() {
+    const int width = 800, height = 600;
+    SoftwareRasterizer rasterizer(width, height);
+    std::vector<uint8_t> white = solidTexture(255, 255, 255);
+    const RasterTexture texture{white.data(), 4, 4, 16};
+    const RasterTransforms transforms = engineTransforms(width, height, 0.0f, 0.0f, -1.0f, 0.0f);
+    rasterizer.beginFrame(kClearColor);
+    rasterizer.draw(kCubeVertices, 36, transforms, texture);
+    rasterizer.endFrame();
+
+    // The front face, 1.5 units away, spans 200x200 pixels centred on screen.
+    bool passed = check(rasterizer.stats().culled == 10, "engine cube culled triangles", double(rasterizer.stats().culled), 10);
+    passed &= check(rasterizer.stats().samplesWritten == 200 * 200 * 4, "engine cube samples",
+                    double(rasterizer.stats().samplesWritten), 200 * 200 * 4);
+
+    // Turned, the edges are no longer pixel-aligned and resolve to blends.
+    const RasterTransforms turned = engineTransforms(width, height, 0.0f, 0.0f, -1.0f, 0.5f);
+    rasterizer.beginFrame(kClearColor);
+    rasterizer.draw(kCubeVertices, 36, turned, texture);
+    rasterizer.endFrame();
+    int blended = 0;
+    for (int i = 0; i < width * height; ++i) {
+        const uint8_t red = rasterizer.pixels()[i * 4];
+        blended += red > 41 && red < 255;
+    }
+    passed &= check(blended > 100, "antialiased edge pixels", blended, 100);
+    return passed;
+}
+
+// Screen-filling grid of triangles with jittered inner vertices, drawn with
+// identity transforms so positions are clip coordinates.
+static std::vector<RasterVertex> jitteredMesh(int cells, float depth, uint32_t seed) {
+    std::mt19937 random(seed);
+    // Small enough that no triangle folds over.
+    std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+    std::vector<float> xs((cells + 1) * (cells + 1)), ys(xs.size());
+    for (int j = 0; j <= cells; ++j) {
+        for (int i = 0; i <= cells; ++i) {
+            const bool inner = i > 0 && i < cells && j > 0 && j < cells;
+            xs[j * (cells + 1) + i] = -1.0f + 2.0f * (i + (inner ? jitter(random) : 0.0f)) / cells;
+            ys[j * (cells + 1) + i] = -1.0f + 2.0f * (j + (inner ? jitter(random) : 0.0f)) / cells;
+        }
+    }
+    std::vector<RasterVertex> vertices;
+    auto vertex = [&](int i, int j) {
+        vertices.push_back({{xs[j * (cells + 1) + i], ys[j * (cells + 1) + i], depth, 1.0f}, {0.5f, 0.5f}});
+    };
+    for (int j = 0; j < cells; ++j) {
+        for (int i = 0; i < cells; ++i) {
+            // Counter-clockwise with y up.
+            vertex(i, j); vertex(i + 1, j); vertex(i + 1, j + 1);
+            vertex(i, j); vertex(i + 1, j + 1); vertex(i, j + 1);
+        }
+    }
+    return vertices;
+}
+
+static bool checkCoverageAndDepth() {
+    const int width = 333, height = 197;
+    SoftwareRasterizer rasterizer(width, height);
+    RasterTransforms transforms;
+    identity(transforms.modelMatrix);
+    identity(transforms.viewMatrix);
+    identity(transforms.perspectiveMatrix);
+    std::vector<uint8_t> red = solidTexture(255, 0, 0), green = solidTexture(0, 255, 0), blue = solidTexture(0, 0, 255);
+
+    std::vector<RasterVertex> mesh = jitteredMesh(37, 0.5f, 1);
+    rasterizer.beginFrame(kClearColor);
+    rasterizer.draw(mesh.data(), mesh.size(), transforms, {red.data(), 4, 4, 16});
+    rasterizer.endFrame();
+    const uint64_t expected = uint64_t(width) * height * SoftwareRasterizer::kSampleCount;
+    bool passed = check(rasterizer.stats().culled == 0, "mesh triangles culled", double(rasterizer.stats().culled), 0);
+    passed &= check(rasterizer.stats().samplesWritten == expected, "watertight samples",
+                    double(rasterizer.stats().samplesWritten), double(expected));
+
+    // Further mesh drawn later loses; an equal-depth mesh drawn later wins.
+    std::vector<RasterVertex> near = jitteredMesh(23, 0.3f, 2), far = jitteredMesh(29, 0.6f, 3), equal = jitteredMesh(31, 0.3f, 4);
+    rasterizer.beginFrame(kClearColor);
+    rasterizer.draw(near.data(), near.size(), transforms, {red.data(), 4, 4, 16});
+    rasterizer.draw(far.data(), far.size(), transforms, {blue.data(), 4, 4, 16});
+    rasterizer.endFrame();
+    int wrong = 0;
+    for (int i = 0; i < width * height; ++i) {
+        wrong += rasterizer.pixels()[i * 4] != 255 || rasterizer.pixels()[i * 4 + 2] != 0;
+    }
+    passed &= check(wrong == 0, "far mesh hidden (pixels wrong)", wrong, 0);
+
+    rasterizer.beginFrame(kClearColor);
+    rasterizer.draw(near.data(), near.size(), transforms, {red.data(), 4, 4, 16});
+    rasterizer.draw(equal.data(), equal.size(), transforms, {green.data(), 4, 4, 16});
+    rasterizer.endFrame();
+    wrong = 0;
+    for (int i = 0; i < width * height; ++i) {
+        wrong += rasterizer.pixels()[i * 4 + 1] != 255;
+    }
+    passed &= check(wrong == 0, "LessEqual lets equal depth through (pixels wrong)", wrong, 0);
+    return passed;
+}
+
+// 8334 engine cubes (100,008 triangles) in a block in front of the camera,
+// each turning at its own rate.
+struct CubeField {
+    static constexpr int kColumns = 40, kRows = 30, kLayers = 7;
+    static constexpr int kCount = 8334;
+    std::vector<RasterTransforms> transforms;
+
+    void update(int width, int height, float time) {
+        transforms.resize(kCount);
+        for (int i = 0; i < kCount; ++i) {
+            const int column = i % kColumns, row = (i / kColumns) % kRows, layer = i / (kColumns * kRows);
+            const float z = -3.0f - layer * 2.5f;
+            const float spread = -z * 0.9f;
+            const float x = (column + 0.5f - kColumns * 0.5f) / kColumns * 2.6f * spread;
+            const float y = (row + 0.5f - kRows * 0.5f) / kRows * 2.0f * spread;
+            transforms[i] = engineTransforms(width, height, x, y, z, time * (0.5f + (i % 7) * 0.1f) + i);
+        }
+    }
+
+    void draw(SoftwareRasterizer& rasterizer, const RasterTexture& texture) const {
+        rasterizer.beginFrame(kClearColor);
+        for (const RasterTransforms& t : transforms) {
+            rasterizer.draw(kCubeVertices, 36, t, texture);
+        }
+        rasterizer.endFrame();
+    }
+};
+
+static std::vector<uint8_t> checkerTexture(int size) {
+    std::vector<uint8_t> pixels(size_t(size) * size * 4);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            uint8_t* p = &pixels[(size_t(y) * size + x) * 4];
+            const bool dark = ((x / 32) + (y / 32)) % 2;
+            p[0] = dark ? 60 : 120;
+            p[1] = dark ? 140 : 200;
+            p[2] = dark ? 40 : 80;
+            p[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+int main(int argc, char* argv[]) {
+    bool passed = checkEngineCube();
+    passed &= checkCoverageAndDepth();
+
+    std::vector<uint8_t> checker = checkerTexture(256);
+    const RasterTexture texture{checker.data(), 256, 256, 256 * 4};
+    {
+        ThreadPool single(1), several(4);
+        SoftwareRasterizer a(640, 480, single), b(640, 480, several);
+        CubeField field;
+        field.update(640, 480, 1.0f);
+        field.draw(a, texture);
+        field.draw(b, texture);
+        const bool same = memcmp(a.pixels(), b.pixels(), size_t(640) * 480 * 4) == 0;
+        passed &= check(same, "1 and 4 threads give the same image", same, 1);
+    }
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+
+    const int sizes[2][2] = {{800, 600}, {1920, 1080}};
+    for (const auto& size : sizes) {
+        SoftwareRasterizer rasterizer(size[0], size[1]);
+        CubeField field;
+        const int frames = 10;
+        double seconds = 0.0;
+        for (int frame = 0; frame <= frames; ++frame) {
+            field.update(size[0], size[1], frame / 60.0f);
+            auto start = std::chrono::steady_clock::now();
+            field.draw(rasterizer, texture);
+            // Frame 0 warms up the bins and sample buffers.
+            if (frame > 0) {
+                seconds += secondsSince(start);
+            }
+        }
+        const auto& stats = rasterizer.stats();
+        std::cout << size[0] << "x" << size[1] << ", " << ThreadPool::shared().threadCount() << " threads: "
+                  << frames / seconds << " fps (" << seconds / frames * 1e3 << " ms), " << stats.triangles
+                  << " triangles, " << stats.culled << " culled, " << stats.clipped << " clipped, "
+                  << stats.binEntries << " bin entries, " << stats.shadedPixels << " fragments, "
+                  << stats.samplesWritten << " samples" << std::endl;
+        if (argc > 1 && size[0] == 800) {
+            std::ofstream out(argv[1], std::ios::binary);
+            out << "P6\n" << size[0] << " " << size[1] << "\n255\n";
+            for (int i = 0; i < size[0] * size[1]; ++i) {
+                out.write(reinterpret_cast<const char*>(rasterizer.pixels() + i * 4), 3);
+            }
+        }
+    }
+    return passed ? 0 : 1;
+}
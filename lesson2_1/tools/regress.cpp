@@ -0,0 +1,372 @@
+//
+//  regress.cpp
+//  Metal-Guide
+//
+//  Golden-image and frame-time regression checks for the tutorial scenes,
+//  rendered offscreen with SoftwareRasterizer so they run on machines
+//  without a GPU:
+//  - lesson1-triangle: the lesson1 triangle in its flat colour.
+//  - lesson1_3-square: the lesson1_3 square with the grass texture.
+//  - lesson2_1-cube-*: the lesson2_1 cube at t = 0, 1.5 and 2.5 s, in place
+//    of glfwGetTime(). At 4 s the cube has turned 90 degrees and looks as it
+//    does at 0 s.
+//
+//  Images are compared with ImageDiff against tools/golden/<scene>.qoi.
+//  A pixel differs when a channel is off by more than --tolerance (2 by
+//  default). A scene fails when more than 0.1% of its pixels differ.
+//
+//  Timing takes --runs runs of 20 frames per scene, taking the scenes in
+//  turn so that a machine slowing down mid-run affects all of them alike. The per-run mean
+//  frame times are compared with the baseline file, which holds the
+//  samples of an earlier run on the same machine. A scene regresses when
+//  both of these hold:
+//  - the median slowed by more than --slowdown (10% by default)
+//  - a one-sided Mann-Whitney test puts the shift at p < 0.01
+//  One noisy run therefore fails neither check. A missing baseline is
+//  written, not compared against.
+//
+//  --update rewrites the golden images and the baseline. Build and run
+//  from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/regress.cpp
+//        Metal-Tutorial/software_rasterizer.cpp Metal-Tutorial/image_diff.cpp
+//        Metal-Tutorial/qoi.cpp Metal-Tutorial/thread_pool.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -o regress
+//    ./regress [--update] [--runs N] [--tolerance N] [--slowdown PERCENT]
+//              [--golden DIR] [--baseline FILE]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "image_diff.hpp"
+#include "qoi.hpp"
+#include "software_rasterizer.hpp"
+#include "stb/stb_image.h"
+
+static constexpr int kWidth = 400, kHeight = 300;
+static constexpr int kFramesPerRun = 20;
+static const float kClearColor[4] = {41.0f / 255.0f, 42.0f / 255.0f, 48.0f / 255.0f, 1.0f};
+
+// lesson1's triangle, as positions with w = 1.
+static const RasterVertex kTriangleVertices[] = {
+    {{-0.5f, -0.5f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+    {{0.5f, -0.5f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+    {{0.0f, 0.5f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+};
+
+// lesson1_3's square; it is wound clockwise and lesson1_3 does not cull.
+static const RasterVertex kSquareVertices[] = {
+    {{-0.5f, -0.5f, 0.5f, 1.0f}, {0.0f, 0.0f}},
+    {{-0.5f, 0.5f, 0.5f, 1.0f}, {0.0f, 1.0f}},
+    {{0.5f, 0.5f, 0.5f, 1.0f}, {1.0f, 1.0f}},
+    {{-0.5f, -0.5f, 0.5f, 1.0f}, {0.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.5f, 1.0f}, {1.0f, 1.0f}},
+    {{0.5f, -0.5f, 0.5f, 1.0f}, {1.0f, 0.0f}},
+};
+
+// The vertices lesson2_1's EngineCore uploads for its cube.
+static const RasterVertex kCubeVertices[] = {
+    {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
+    {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{-0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{-0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, 0.5, 0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{-0.5, 0.5, 0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, -0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, -0.5, 0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}}, {{-0.5, -0.5, 0.5, 1.0}, {1.0, 0.0}}, {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}},
+    {{-0.5, 0.5, 0.5, 1.0}, {1.0, 1.0}}, {{-0.5, 0.5, -0.5, 1.0}, {0.0, 1.0}}, {{-0.5, -0.5, -0.5, 1.0}, {0.0, 0.0}},
+    {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}}, {{0.5, -0.5, -0.5, 1.0}, {1.0, 0.0}}, {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}},
+    {{0.5, 0.5, -0.5, 1.0}, {1.0, 1.0}}, {{0.5, 0.5, 0.5, 1.0}, {0.0, 1.0}}, {{0.5, -0.5, 0.5, 1.0}, {0.0, 0.0}},
+};
+
+static void fromRows(const float rows[16], float m[16]) {
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m[c * 4 + r] = rows[r * 4 + c];
+        }
+    }
+}
+
+static RasterTransforms identityTransforms() {
+    const float rows[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    RasterTransforms transforms;
+    fromRows(rows, transforms.modelMatrix);
+    fromRows(rows, transforms.viewMatrix);
+    fromRows(rows, transforms.perspectiveMatrix);
+    return transforms;
+}
+
+// lesson2_1's EngineCore::writeTransforms() for a single cube.
+static RasterTransforms cubeTransforms(double time) {
+    const float angle = float(time / 2.0 * 45.0 * M_PI / 180.0);
+    const float c = std::cos(angle), s = std::sin(angle);
+    const float model[16] = {c, 0, s, 0, 0, 1, 0, 0, -s, 0, c, -1, 0, 0, 0, 1};
+    const float view[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, -1, 0, 0, 0, 1};
+    const float fov = float(M_PI) / 2.0f, aspect = float(kWidth) / float(kHeight), nearZ = 0.1f, farZ = 100.0f;
+    const float ys = 1.0f / std::tan(fov * 0.5f), xs = ys / aspect, zs = farZ / (nearZ - farZ);
+    const float perspective[16] = {xs, 0, 0, 0, 0, ys, 0, 0, 0, 0, zs, nearZ * zs, 0, 0, -1, 0};
+    RasterTransforms transforms;
+    fromRows(model, transforms.modelMatrix);
+    fromRows(view, transforms.viewMatrix);
+    fromRows(perspective, transforms.perspectiveMatrix);
+    return transforms;
+}
+
+struct Scene {
+    std::string name;
+    std::function<void(SoftwareRasterizer&)> render;
+};
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return bool(out);
+}
+
+static bool readGolden(const std::string& path, std::vector<uint8_t>& pixels) {
+    const std::vector<uint8_t> encoded = readFile(path);
+    Qoi::Decoder decoder;
+    if (!decoder.open(encoded.data(), encoded.size()) || decoder.header().width != uint32_t(kWidth) ||
+        decoder.header().height != uint32_t(kHeight)) {
+        return false;
+    }
+    pixels.resize(size_t(kWidth) * kHeight * 4);
+    return decoder.decodeRows(pixels.data(), size_t(kWidth) * 4, kHeight);
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+// One-sided Mann-Whitney U test that current tends to be larger than
+// baseline, with the normal approximation and tie correction. Returns the
+// p-value.
+static double mannWhitneyGreater(const std::vector<double>& current, const std::vector<double>& baseline) {
+    std::vector<std::pair<double, int>> all;
+    for (double value : current) {
+        all.push_back({value, 0});
+    }
+    for (double value : baseline) {
+        all.push_back({value, 1});
+    }
+    std::sort(all.begin(), all.end());
+    const double n1 = double(current.size()), n2 = double(baseline.size()), n = n1 + n2;
+    double rankSum = 0.0, tieTerm = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            ++j;
+        }
+        const double rank = 0.5 * double(i + j + 1);  // mean of ranks i + 1 .. j
+        for (size_t k = i; k < j; ++k) {
+            rankSum += all[k].second == 0 ? rank : 0.0;
+        }
+        const double ties = double(j - i);
+        tieTerm += ties * ties * ties - ties;
+        i = j;
+    }
+    const double u = rankSum - n1 * (n1 + 1.0) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+    const double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+static std::map<std::string, std::vector<double>> readBaseline(const std::string& path) {
+    std::map<std::string, std::vector<double>> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        double value;
+        while (fields >> value) {
+            baseline[name].push_back(value);
+        }
+    }
+    return baseline;
+}
+
+static bool writeBaseline(const std::string& path, const std::map<std::string, std::vector<double>>& samples) {
+    std::ofstream out(path);
+    out << "# regress baseline: scene, then the mean frame time in ms of each run\n";
+    for (const auto& [name, values] : samples) {
+        out << name;
+        for (double value : values) {
+            out << ' ' << std::setprecision(6) << value;
+        }
+        out << '\n';
+    }
+    return bool(out);
+}
+
+int main(int argc, char* argv[]) {
+    bool update = false;
+    int runs = 15, tolerance = 2;
+    double slowdown = 10.0;
+    std::string goldenDirectory = "tools/golden", baselinePath = "tools/golden/baseline.txt";
+    for (int i = 1; i < argc; ++i) {
+        const std::string flag = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (flag == "--update") {
+            update = true;
+        } else if (flag == "--runs" && hasValue) {
+            runs = std::max(atoi(argv[++i]), 3);
+        } else if (flag == "--tolerance" && hasValue) {
+            tolerance = std::clamp(atoi(argv[++i]), 0, 255);
+        } else if (flag == "--slowdown" && hasValue) {
+            slowdown = atof(argv[++i]);
+        } else if (flag == "--golden" && hasValue) {
+            goldenDirectory = argv[++i];
+        } else if (flag == "--baseline" && hasValue) {
+            baselinePath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--update] [--runs N] [--tolerance N] [--slowdown PERCENT]"
+                      << " [--golden DIR] [--baseline FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    // lesson1's fragment shader colour, as a texture the rasterizer can sample.
+    const uint8_t triangleColor[4] = {182, 240, 228, 255};
+    const RasterTexture flatTexture{triangleColor, 1, 1, 4};
+    // The grass texture, flipped on load as lesson1_3 and lesson2_1 do.
+    int grassWidth, grassHeight, grassChannels;
+    stbi_set_flip_vertically_on_load(true);
+    uint8_t* grass = stbi_load("assets/mc_grass.jpeg", &grassWidth, &grassHeight, &grassChannels, STBI_rgb_alpha);
+    stbi_set_flip_vertically_on_load(false);
+    if (!grass) {
+        std::cerr << "Failed to load assets/mc_grass.jpeg: " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    const RasterTexture grassTexture{grass, grassWidth, grassHeight, size_t(grassWidth) * 4};
+
+    const RasterTransforms identity = identityTransforms();
+    std::vector<RasterTransforms> cubes;
+    std::vector<Scene> scenes = {
+        {"lesson1-triangle", [&](SoftwareRasterizer& rasterizer) {
+            rasterizer.draw(kTriangleVertices, 3, identity, flatTexture, RasterCullMode::None);
+        }},
+        {"lesson1_3-square", [&](SoftwareRasterizer& rasterizer) {
+            rasterizer.draw(kSquareVertices, 6, identity, grassTexture, RasterCullMode::None);
+        }},
+    };
+    const double times[] = {0.0, 1.5, 2.5};
+    for (double time : times) {
+        cubes.push_back(cubeTransforms(time));
+    }
+    for (size_t i = 0; i < cubes.size(); ++i) {
+        std::ostringstream name;
+        name << "lesson2_1-cube-" << times[i] << "s";
+        const RasterTransforms* transforms = &cubes[i];
+        scenes.push_back({name.str(), [&grassTexture, transforms](SoftwareRasterizer& rasterizer) {
+            rasterizer.draw(kCubeVertices, 36, *transforms, grassTexture);
+        }});
+    }
+
+    SoftwareRasterizer rasterizer(kWidth, kHeight);
+    auto renderScene = [&](const Scene& scene) {
+        rasterizer.beginFrame(kClearColor);
+        scene.render(rasterizer);
+        rasterizer.endFrame();
+    };
+
+    bool passed = true;
+    const size_t pixelCount = size_t(kWidth) * kHeight;
+    std::cout << "images (tolerance " << tolerance << "):" << std::endl;
+    for (const Scene& scene : scenes) {
+        renderScene(scene);
+        const std::string path = goldenDirectory + "/" + scene.name + ".qoi";
+        if (update) {
+            const bool written = writeFile(path, Qoi::encode(rasterizer.pixels(), kWidth, kHeight, 4));
+            std::cout << "  " << scene.name << (written ? ": golden image written" : ": FAILED to write " + path)
+                      << std::endl;
+            passed &= written;
+            continue;
+        }
+        std::vector<uint8_t> golden;
+        if (!readGolden(path, golden)) {
+            std::cout << "  " << scene.name << ": FAIL, no readable " << kWidth << "x" << kHeight << " golden image at "
+                      << path << std::endl;
+            passed = false;
+            continue;
+        }
+        const ImageDiff::Result diff = ImageDiff::compare(rasterizer.pixels(), golden.data(), pixelCount, uint8_t(tolerance));
+        const bool matches = diff.differingPixels * 1000 <= pixelCount;
+        std::cout << "  " << std::left << std::setw(20) << scene.name << std::right << (matches ? " ok  " : " FAIL")
+                  << "  " << diff.differingPixels << " pixels differ, max " << int(diff.maxDifference) << ", PSNR "
+                  << std::fixed << std::setprecision(1) << diff.psnr() << " dB" << std::endl;
+        passed &= matches;
+    }
+
+    std::map<std::string, std::vector<double>> samples;
+    for (int run = 0; run < runs; ++run) {
+        for (const Scene& scene : scenes) {
+            renderScene(scene);
+            const auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < kFramesPerRun; ++frame) {
+                renderScene(scene);
+            }
+            samples[scene.name].push_back(secondsSince(start) * 1e3 / kFramesPerRun);
+        }
+    }
+
+    const std::map<std::string, std::vector<double>> baseline = update ? decltype(samples)() : readBaseline(baselinePath);
+    std::cout << "frame times (" << runs << " runs of " << kFramesPerRun << " frames, "
+              << "on " << ThreadPool::shared().threadCount() << " thread(s)):" << std::endl;
+    for (const Scene& scene : scenes) {
+        const std::vector<double>& current = samples[scene.name];
+        std::cout << "  " << std::left << std::setw(20) << scene.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(9) << median(current) << " ms";
+        auto found = baseline.find(scene.name);
+        if (found == baseline.end() || found->second.size() < 3) {
+            std::cout << std::endl;
+            continue;
+        }
+        const double before = median(found->second), after = median(current);
+        const double change = (after / before - 1.0) * 100.0;
+        const double p = mannWhitneyGreater(current, found->second);
+        const bool regressed = change > slowdown && p < 0.01;
+        std::cout << "  baseline " << before << " ms, " << std::showpos << std::setprecision(1) << change << "%"
+                  << std::noshowpos << ", p = " << std::setprecision(4) << p << (regressed ? "  REGRESSED" : "")
+                  << std::endl;
+        passed &= !regressed;
+    }
+    if (update || baseline.empty()) {
+        const bool written = writeBaseline(baselinePath, samples);
+        std::cout << (written ? "baseline written to " : "FAILED to write baseline ") << baselinePath << std::endl;
+        passed &= written;
+    }
+
+    stbi_image_free(grass);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
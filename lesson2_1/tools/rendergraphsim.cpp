@@ -0,0 +1,203 @@
+//
+//  rendergraphsim.cpp
+//  Metal-Guide
+//
+//  Compiles render graphs with RenderGraph and checks the plans:
+//  - The engine's cube pass gets the load and store actions that
+//    mtl_engine.cpp used to set by hand.
+//  - In a deferred frame (shadows, G-buffer, lighting, bloom, tonemap,
+//    UI), a debug pass nobody reads is culled. Attachments are loaded and
+//    stored only where an earlier or later pass needs them.
+//  - For random graphs, placed textures whose lifetimes overlap never
+//    share memory, every offset is aligned, and the heap is no larger
+//    than giving each texture its own memory.
+//  Reports the memory aliasing saves and the time compile() takes. Texture
+//  sizes round up to 64 KB, as Metal's do on Apple GPUs. Build from
+//  lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/rendergraphsim.cpp
+//        Metal-Tutorial/render_graph.cpp -o rendergraphsim
+//
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "render_graph.hpp"
+
+using Load = RenderGraph::LoadAction;
+using Store = RenderGraph::StoreAction;
+
+// MTL::PixelFormat values.
+static constexpr uint32_t kRGBA8 = 70, kBGRA8 = 80, kRGBA16Float = 115, kDepth32Float = 252;
+
+static RenderGraph::SizeAndAlign sizeOf(const RenderGraph::TextureDescription& description) {
+    const uint64_t bytesPerPixel = description.pixelFormat == kRGBA16Float ? 8 : 4;
+    const uint64_t alignment = 64 << 10;
+    const uint64_t bytes = uint64_t(description.width) * description.height * description.sampleCount * bytesPerPixel;
+    return {(bytes + alignment - 1) / alignment * alignment, alignment};
+}
+
+static bool checkActions(const char* what, const RenderGraph::PlannedAttachment& attachment, Load load, Store store) {
+    return check(attachment.load == load && attachment.store == store, what,
+                 int(attachment.load) * 10 + int(attachment.store), int(load) * 10 + int(store));
+}
+
+static const RenderGraph::PlannedPass* plannedPass(const RenderGraph::Plan& plan, uint32_t pass) {
+    for (const RenderGraph::PlannedPass& planned : plan.passes) {
+        if (planned.pass == pass) {
+            return &planned;
+        }
+    }
+    return nullptr;
+}
+
+// No two textures with overlapping lifetimes overlap in memory, offsets
+// are aligned and everything fits in the heap.
+static bool checkPlacement(const RenderGraph::Plan& plan) {
+    bool passed = true;
+    for (size_t a = 0; a < plan.textures.size(); ++a) {
+        const RenderGraph::PlannedTexture& ta = plan.textures[a];
+        passed &= check(ta.offset % (64 << 10) == 0, "texture offset alignment", double(ta.offset % (64 << 10)), 0);
+        passed &= check(ta.offset + ta.size <= plan.heapSize, "texture end within the heap", double(ta.offset + ta.size),
+                        double(plan.heapSize));
+        for (size_t b = a + 1; b < plan.textures.size(); ++b) {
+            const RenderGraph::PlannedTexture& tb = plan.textures[b];
+            const bool livesOverlap = ta.firstPass <= tb.lastPass && tb.firstPass <= ta.lastPass;
+            const bool memoryOverlaps = ta.offset < tb.offset + tb.size && tb.offset < ta.offset + ta.size;
+            passed &= check(!(livesOverlap && memoryOverlaps), "live textures sharing memory", 1, 0);
+        }
+    }
+    passed &= check(plan.heapSize <= plan.unaliasedSize, "heap size against unaliased size", double(plan.heapSize),
+                    double(plan.unaliasedSize));
+    return passed;
+}
+
+static bool checkEngineGraph() {
+    RenderGraph graph;
+    const RenderGraph::Resource drawable = graph.importTexture("drawable");
+    const RenderGraph::Resource color = graph.createTexture("msaa colour", {kBGRA8, 800, 600, 4});
+    const RenderGraph::Resource depth = graph.createTexture("depth", {kDepth32Float, 800, 600, 4});
+    const float clearColor[4] = {41.0f / 255.0f, 42.0f / 255.0f, 48.0f / 255.0f, 1.0f};
+    graph.addPass("cube", nullptr).clearColor(color, clearColor, drawable).clearDepth(depth, 1.0f);
+    const RenderGraph::Plan plan = graph.compile(sizeOf);
+
+    bool passed = check(plan.passes.size() == 1, "engine passes", plan.passes.size(), 1);
+    if (passed) {
+        passed &= checkActions("engine colour", plan.passes[0].colors[0], Load::Clear, Store::MultisampleResolve);
+        passed &= checkActions("engine depth", plan.passes[0].depth, Load::Clear, Store::DontCare);
+    }
+    passed &= check(plan.heapSize == plan.unaliasedSize, "engine heap, both textures live together",
+                    double(plan.heapSize), double(plan.unaliasedSize));
+    return passed;
+}
+
+static bool checkDeferredGraph() {
+    const uint32_t width = 1920, height = 1080;
+    RenderGraph graph;
+    const RenderGraph::Resource drawable = graph.importTexture("drawable");
+    const RenderGraph::Resource shadow = graph.createTexture("shadow map", {kDepth32Float, 2048, 2048, 1});
+    const RenderGraph::Resource albedo = graph.createTexture("albedo", {kRGBA8, width, height, 1});
+    const RenderGraph::Resource normal = graph.createTexture("normal", {kRGBA16Float, width, height, 1});
+    const RenderGraph::Resource depth = graph.createTexture("depth", {kDepth32Float, width, height, 1});
+    const RenderGraph::Resource hdr = graph.createTexture("hdr", {kRGBA16Float, width, height, 1});
+    const RenderGraph::Resource bright = graph.createTexture("bright", {kRGBA16Float, width / 2, height / 2, 1});
+    const RenderGraph::Resource blur = graph.createTexture("blur", {kRGBA16Float, width / 2, height / 2, 1});
+    const RenderGraph::Resource debug = graph.createTexture("debug", {kRGBA8, width, height, 1});
+    const float black[4] = {0, 0, 0, 1};
+
+    const uint32_t shadowPass = 0, gbufferPass = 1, lightingPass = 2, brightPass = 3, blurPass = 4, tonemapPass = 5,
+                   debugPass = 6, uiPass = 7, capturePass = 8;
+    graph.addPass("shadows", nullptr).clearDepth(shadow, 1.0f);
+    graph.addPass("g-buffer", nullptr).clearColor(albedo, black).clearColor(normal, black).clearDepth(depth, 1.0f);
+    graph.addPass("lighting", nullptr).read(albedo).read(normal).read(shadow).color(hdr).depth(depth);
+    graph.addPass("bright", nullptr).read(hdr).color(bright);
+    graph.addPass("blur", nullptr).read(bright).color(blur);
+    graph.addPass("tonemap", nullptr).read(hdr).read(blur).color(drawable);
+    graph.addPass("debug view", nullptr).read(normal).color(debug);
+    graph.addPass("ui", nullptr).color(drawable);
+    graph.addPass("capture", nullptr).read(depth).sideEffect();
+    const RenderGraph::Plan plan = graph.compile(sizeOf);
+
+    bool passed = check(plan.culledPasses.size() == 1 && plan.culledPasses[0] == debugPass, "culled passes",
+                        plan.culledPasses.size(), 1);
+    passed &= check(plan.passes.size() == 8, "live passes", plan.passes.size(), 8);
+    const RenderGraph::PlannedPass* shadows = plannedPass(plan, shadowPass);
+    const RenderGraph::PlannedPass* gbuffer = plannedPass(plan, gbufferPass);
+    const RenderGraph::PlannedPass* lighting = plannedPass(plan, lightingPass);
+    const RenderGraph::PlannedPass* brightened = plannedPass(plan, brightPass);
+    const RenderGraph::PlannedPass* tonemap = plannedPass(plan, tonemapPass);
+    const RenderGraph::PlannedPass* ui = plannedPass(plan, uiPass);
+    passed &= check(shadows && gbuffer && lighting && brightened && tonemap && ui && plannedPass(plan, blurPass) &&
+                    plannedPass(plan, capturePass), "planned passes", 0, 1);
+    if (!passed) {
+        return false;
+    }
+    passed &= checkActions("shadow map, sampled later", shadows->depth, Load::Clear, Store::Store);
+    passed &= checkActions("albedo, sampled later", gbuffer->colors[0], Load::Clear, Store::Store);
+    passed &= checkActions("g-buffer depth, tested in lighting", gbuffer->depth, Load::Clear, Store::Store);
+    passed &= checkActions("lighting depth, read by capture", lighting->depth, Load::Load, Store::Store);
+    passed &= checkActions("hdr, written first in lighting", lighting->colors[0], Load::DontCare, Store::Store);
+    passed &= checkActions("bright, written once", brightened->colors[0], Load::DontCare, Store::Store);
+    passed &= checkActions("drawable, loaded as imported", tonemap->colors[0], Load::Load, Store::Store);
+    passed &= checkActions("drawable, kept for presenting", ui->colors[0], Load::Load, Store::Store);
+    passed &= checkPlacement(plan);
+    passed &= check(plan.heapSize < plan.unaliasedSize, "aliasing saves memory", double(plan.heapSize),
+                    double(plan.unaliasedSize));
+
+    const double mb = 1.0 / (1 << 20);
+    std::cout << "deferred frame: " << plan.passes.size() << " passes, " << plan.culledPasses.size() << " culled, "
+              << plan.textures.size() << " textures, heap " << plan.heapSize * mb << " MB, " << plan.unaliasedSize * mb
+              << " MB without aliasing (" << 100.0 * (1.0 - double(plan.heapSize) / plan.unaliasedSize)
+              << "% saved)" << std::endl;
+    return passed;
+}
+
+// Random post-processing chains: each pass reads a few recent textures
+// and writes a new one, and the last one writes the drawable.
+static bool checkRandomGraphs(int graphs, int passCount) {
+    std::mt19937 random(11);
+    bool passed = true;
+    uint64_t heapBytes = 0, unaliasedBytes = 0;
+    double seconds = 0.0;
+    for (int g = 0; g < graphs; ++g) {
+        RenderGraph graph;
+        const RenderGraph::Resource drawable = graph.importTexture("drawable");
+        std::vector<RenderGraph::Resource> outputs;
+        for (int p = 0; p < passCount; ++p) {
+            const uint32_t scale = 1u << (random() % 3);
+            const uint32_t format = random() % 2 ? kRGBA16Float : kRGBA8;
+            const RenderGraph::Resource output = graph.createTexture("t", {format, 1280 / scale, 720 / scale, 1});
+            RenderGraph::PassBuilder pass = graph.addPass("p", nullptr);
+            for (int r = 0; r < 3 && !outputs.empty(); ++r) {
+                pass.read(outputs[outputs.size() - 1 - random() % std::min<size_t>(outputs.size(), 6)]);
+            }
+            pass.color(p + 1 == passCount ? drawable : output);
+            outputs.push_back(output);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const RenderGraph::Plan plan = graph.compile(sizeOf);
+        seconds += secondsSince(start);
+        passed &= checkPlacement(plan);
+        heapBytes += plan.heapSize;
+        unaliasedBytes += plan.unaliasedSize;
+        if (!passed) {
+            break;
+        }
+    }
+    std::cout << graphs << " random " << passCount << "-pass graphs: aliasing saves "
+              << 100.0 * (1.0 - double(heapBytes) / unaliasedBytes) << "% on average, compile() "
+              << seconds / graphs * 1e6 << " us" << std::endl;
+    return passed;
+}
+
+int main() {
+    bool passed = checkEngineGraph();
+    passed &= checkDeferredGraph();
+    passed &= checkRandomGraphs(200, 16);
+    passed &= checkRandomGraphs(20, 64);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
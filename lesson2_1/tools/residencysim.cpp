@@ -0,0 +1,163 @@
+//
+//  residencysim.cpp
+//  Metal-Guide
+//
+//  Replays synthetic texture access traces through TextureResidency with a
+//  fake allocator, and reports hit rate, bytes (re)loaded, evictions and
+//  policy overhead. The fake allocator keeps its own byte count, which is
+//  checked against the policy's bookkeeping after every trace. Shedding
+//  levels to fit the budget is also checked to reload a texture once,
+//  however many levels it drops. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/residencysim.cpp
+//        Metal-Tutorial/texture_residency.cpp -o residencysim
+//
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "texture_residency.hpp"
+
+class FakeAllocator : public TextureAllocator {
+public:
+    std::vector<TextureDescription> descriptions;
+    std::vector<uint64_t> resident;
+    uint64_t residentBytes{0};
+    uint64_t loads{0};
+
+    bool makeResident(uint32_t id, uint32_t firstLevel) override {
+        ++loads;
+        evict(id);
+        resident[id] = TextureResidency::bytesFrom(descriptions[id], firstLevel);
+        residentBytes += resident[id];
+        return true;
+    }
+
+    void evict(uint32_t id) override {
+        residentBytes -= resident[id];
+        resident[id] = 0;
+    }
+};
+
+// A trace yields, for each frame, the (texture, wanted level) pairs it draws.
+using Trace = std::function<void(uint64_t frame, std::mt19937& random, std::vector<std::pair<uint32_t, uint32_t>>& uses)>;
+
+static bool run(const char* name, const Trace& trace, uint32_t textureCount, uint64_t budget, int frames) {
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> sizeLog2(6, 10);
+
+    FakeAllocator allocator;
+    TextureResidency residency(allocator, budget);
+    std::vector<TextureHandle> handles;
+    uint64_t totalBytes = 0;
+    for (uint32_t i = 0; i < textureCount; ++i) {
+        uint32_t side = 1u << sizeLog2(random);
+        TextureDescription description{side, side, uint32_t(std::log2(side)) + 1, 4};
+        allocator.descriptions.push_back(description);
+        allocator.resident.push_back(0);
+        handles.push_back(residency.add(description));
+        totalBytes += TextureResidency::bytesFrom(description, 0);
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> uses;
+    uint64_t useCount = 0;
+    double seconds = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        uses.clear();
+        trace(frame, random, uses);
+        auto start = std::chrono::steady_clock::now();
+        residency.beginFrame();
+        for (auto [id, level] : uses) {
+            residency.use(handles[id].id(), level);
+        }
+        seconds += secondsSince(start);
+        useCount += uses.size();
+    }
+
+    const auto& stats = residency.stats();
+    const double mb = 1.0 / (1 << 20);
+    std::cout << name << ": hit rate " << 100.0 * stats.hits / useCount << "%, loaded " << stats.loadedBytes * mb
+              << " MB, peak " << stats.peakBytes * mb << " / " << budget * mb << " MB (all textures "
+              << totalBytes * mb << " MB), " << stats.mipEvictions << " mip + " << stats.textureEvictions
+              << " texture evictions, " << allocator.loads << " allocator loads, " << seconds / useCount * 1e9 << " ns/use" << std::endl;
+
+    bool consistent = allocator.residentBytes == stats.residentBytes;
+    handles.clear();
+    consistent = consistent && allocator.residentBytes == 0 && residency.stats().residentBytes == 0;
+    if (!consistent) {
+        std::cout << name << ": allocator and policy disagree on resident bytes" << std::endl;
+    }
+    return consistent;
+}
+
+// A 1024x1024 texture with every level resident, then a budget that only
+// its smallest levels fit: one reload drops all the levels that do not fit.
+static bool checkShedding() {
+    FakeAllocator allocator;
+    TextureResidency residency(allocator, uint64_t(64) << 20);
+    const TextureDescription description{1024, 1024, 11, 4};
+    allocator.descriptions.push_back(description);
+    allocator.resident.push_back(0);
+    TextureHandle handle = residency.add(description);
+    residency.beginFrame();
+    residency.use(handle.id(), 0);
+
+    residency.beginFrame();
+    const uint64_t loads = allocator.loads;
+    residency.setBudget(TextureResidency::bytesFrom(description, 7));
+    const bool passed = allocator.loads == loads + 1 && residency.firstResidentLevel(handle.id()) == 7 &&
+                        residency.stats().mipEvictions == 7 && allocator.residentBytes == residency.stats().residentBytes;
+    if (!passed) {
+        std::cout << "shedding: " << allocator.loads - loads << " reloads to drop to level "
+                  << residency.firstResidentLevel(handle.id()) << ", expected 1 to drop to level 7" << std::endl;
+    }
+    return passed;
+}
+
+int main() {
+    constexpr uint32_t kTextureCount = 4000;
+    constexpr uint64_t kBudget = uint64_t(512) << 20;
+    constexpr int kFrames = 2000;
+
+    // Popular textures are drawn every frame, a long tail occasionally;
+    // distance picks the level each draw needs.
+    std::vector<double> weights(kTextureCount);
+    for (uint32_t i = 0; i < kTextureCount; ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    std::discrete_distribution<uint32_t> zipf(weights.begin(), weights.end());
+    Trace zipfTrace = [&](uint64_t, std::mt19937& random, auto& uses) {
+        std::geometric_distribution<uint32_t> level(0.5);
+        for (int i = 0; i < 300; ++i) {
+            uses.push_back({zipf(random), level(random)});
+        }
+    };
+
+    // The camera moves through the level; the visible set slides along.
+    Trace slidingTrace = [&](uint64_t frame, std::mt19937& random, auto& uses) {
+        std::uniform_int_distribution<uint32_t> offset(0, 399);
+        uint32_t base = uint32_t(frame * 2) % kTextureCount;
+        for (int i = 0; i < 300; ++i) {
+            uses.push_back({(base + offset(random)) % kTextureCount, 0});
+        }
+    };
+
+    // Every texture in turn at full detail: more than the budget holds,
+    // which is LRU's worst case.
+    Trace scanTrace = [&](uint64_t frame, std::mt19937&, auto& uses) {
+        for (uint32_t i = 0; i < 100; ++i) {
+            uses.push_back({uint32_t(frame * 100 + i) % kTextureCount, 0});
+        }
+    };
+
+    bool passed = checkShedding();
+    passed &= run("zipf", zipfTrace, kTextureCount, kBudget, kFrames);
+    passed &= run("sliding window", slidingTrace, kTextureCount, kBudget, kFrames);
+    passed &= run("full scan", scanTrace, kTextureCount, kBudget, kFrames);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+//
+//  resizebench.cpp
+//  Metal-Guide
+//
+//  Times 8K -> 2K downsampling with each ImageResize filter and runs a few
+//  quality checks. Uses the given image, or a synthetic 8K pattern. Build
+//  from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/resizebench.cpp
+//        Metal-Tutorial/image_resize.cpp Metal-Tutorial/thread_pool.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -o resizebench
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "image_resize.hpp"
+#include "stb/stb_image.h"
+
+struct Image {
+    int width = 0, height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+static Image syntheticImage(int width, int height) {
+    Image image{width, height, std::vector<uint8_t>(size_t(width) * height * 4)};
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* p = &image.pixels[(size_t(y) * width + x) * 4];
+            p[0] = uint8_t(x * 255 / width);
+            p[1] = uint8_t(y * 255 / height);
+            // Rings of rising frequency to show aliasing.
+            double r = std::hypot(x - width / 2, y - height / 2);
+            p[2] = uint8_t(127.5 + 127.5 * std::sin(r * r * 1e-5));
+            p[3] = 255;
+        }
+    }
+    return image;
+}
+
+static Image resize(const Image& src, int width, int height, ImageResize::Filter filter) {
+    Image dst{width, height, std::vector<uint8_t>(size_t(width) * height * 4)};
+    ImageResize::resizeRgba8(src.pixels.data(), src.width, src.height, 4 * src.width,
+                             dst.pixels.data(), width, height, 4 * width, filter);
+    return dst;
+}
+
+// PSNR of `image` against an area average of `src`, when the sizes divide evenly.
+static double psnrAgainstBox(const Image& src, const Image& image) {
+    const int fx = src.width / image.width, fy = src.height / image.height;
+    double squaredError = 0.0;
+    for (int y = 0; y < image.height; ++y) {
+        for (int x = 0; x < image.width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                double box = 0.0;
+                for (int j = 0; j < fy; ++j) {
+                    for (int i = 0; i < fx; ++i) {
+                        box += src.pixels[((size_t(y) * fy + j) * src.width + size_t(x) * fx + i) * 4 + c];
+                    }
+                }
+                double error = box / (fx * fy) - image.pixels[(size_t(y) * image.width + x) * 4 + c];
+                squaredError += error * error;
+            }
+        }
+    }
+    double mse = squaredError / (double(image.width) * image.height * 4);
+    return 10.0 * std::log10(255.0 * 255.0 / std::max(mse, 1e-12));
+}
+
+int main(int argc, char* argv[]) {
+    Image source;
+    if (argc > 1) {
+        int channels;
+        unsigned char* pixels = stbi_load(argv[1], &source.width, &source.height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            std::cerr << "Failed to decode " << argv[1] << ": " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        source.pixels.assign(pixels, pixels + size_t(source.width) * source.height * 4);
+        stbi_image_free(pixels);
+    } else {
+        source = syntheticImage(8192, 8192);
+    }
+
+    int width, height;
+    ImageResize::fitWithin(source.width, source.height, 2048, 0, 4, width, height);
+    std::cout << source.width << "x" << source.height << " -> " << width << "x" << height << std::endl;
+
+    const struct {
+        const char* name;
+        ImageResize::Filter filter;
+    } filters[] = {{"lanczos3", ImageResize::Filter::Lanczos3}, {"mitchell", ImageResize::Filter::Mitchell}};
+
+    bool passed = true;
+    for (const auto& entry : filters) {
+        Image result;
+        const double best = bestSeconds(3, [&] { result = resize(source, width, height, entry.filter); });
+        std::cout << entry.name << ": " << best * 1e3 << " ms, "
+                  << double(source.width) * source.height / best / 1e6 << " source MP/s";
+        if (source.width % width == 0 && source.height % height == 0) {
+            std::cout << ", PSNR vs box " << psnrAgainstBox(source, result) << " dB";
+        }
+        std::cout << std::endl;
+
+        // A flat image must stay flat (weights sum to one, edges clamp).
+        Image flat{257, 131, std::vector<uint8_t>(257 * 131 * 4, 200)};
+        Image flatResult = resize(flat, 64, 300, entry.filter);
+        for (uint8_t value : flatResult.pixels) {
+            if (value != 200) {
+                std::cout << entry.name << ": flat image changed" << std::endl;
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    // Lanczos is interpolating, so same-size resampling is exact.
+    Image strip{source.width, std::min(source.height, 64), {}};
+    strip.pixels.assign(source.pixels.begin(), source.pixels.begin() + size_t(strip.width) * strip.height * 4);
+    if (resize(strip, strip.width, strip.height, ImageResize::Filter::Lanczos3).pixels != strip.pixels) {
+        std::cout << "lanczos3: identity resize changed pixels" << std::endl;
+        passed = false;
+    }
+
+    std::cout << (passed ? "quality checks passed" : "quality checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
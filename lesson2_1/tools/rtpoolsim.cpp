@@ -0,0 +1,185 @@
+//
+//  rtpoolsim.cpp
+//  Metal-Guide
+//
+//  Checks RenderTargetPool against a fake allocator that tracks every
+//  allocation it hands out, and replays window drags through it the way
+//  MTLEngine did before its attachments moved to the render graph: each
+//  frame, the framebuffer size events are coalesced
+//  into one update of the MSAA colour and depth targets. Reports how many
+//  allocations that takes next to reallocating on every event, as the
+//  engine used to. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/rtpoolsim.cpp
+//        Metal-Tutorial/render_target_pool.cpp -o rtpoolsim
+//
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "render_target_pool.hpp"
+
+static constexpr uint32_t kColorFormat = 80, kDepthFormat = 252;  // BGRA8Unorm, Depth32Float
+
+class FakeAllocator : public RenderTargetAllocator {
+public:
+    std::map<void*, RenderTargetDescription> live;
+    uint64_t liveBytes{0};
+    uint64_t allocations{0};
+    bool failNext{false};
+
+    void* allocate(const RenderTargetDescription& description) override {
+        if (failNext) {
+            failNext = false;
+            return nullptr;
+        }
+        void* texture = reinterpret_cast<void*>(++nextId);
+        live[texture] = description;
+        liveBytes += RenderTargetPool::bytes(description);
+        ++allocations;
+        return texture;
+    }
+
+    void free(void* texture) override {
+        auto found = live.find(texture);
+        if (found == live.end()) {
+            std::cout << "FAIL freed a texture that is not live" << std::endl;
+            std::exit(1);
+        }
+        liveBytes -= RenderTargetPool::bytes(found->second);
+        live.erase(found);
+    }
+
+private:
+    uintptr_t nextId{0};
+};
+
+static RenderTargetDescription colorTarget(uint32_t width, uint32_t height) {
+    return {kColorFormat, width, height, 4, 4};
+}
+
+static RenderTargetDescription depthTarget(uint32_t width, uint32_t height) {
+    return {kDepthFormat, width, height, 4, 4};
+}
+
+static bool checkSizeClasses() {
+    bool passed = true;
+    uint32_t previous = 0;
+    for (uint32_t size = 1; size <= 8192; ++size) {
+        const uint32_t sized = RenderTargetPool::sizeClass(size);
+        passed &= check(sized >= size, "size class below the size", sized, size);
+        passed &= check(sized >= previous, "size classes are monotonic", sized, previous);
+        if (size > 256) {
+            passed &= check(sized - size < size / 4 + 1, "size class slack", sized - size, size / 4);
+        }
+        previous = sized;
+    }
+    passed &= check(RenderTargetPool::sizeClass(800) == 896, "size class of 800", RenderTargetPool::sizeClass(800), 896);
+    passed &= check(RenderTargetPool::sizeClass(1024) == 1024, "size class of 1024", RenderTargetPool::sizeClass(1024), 1024);
+    return passed;
+}
+
+static bool checkPolicy() {
+    bool passed = true;
+    FakeAllocator allocator;
+    {
+        RenderTargetPool pool(allocator, 3);
+        RenderTarget color;
+        // A new target, then sizes within its class keep it.
+        passed &= check(!pool.update(color, colorTarget(800, 600)), "first update changes the target", 1, 0);
+        void* first = color.texture;
+        passed &= check(pool.update(color, colorTarget(810, 630)), "same-class update keeps the target", 0, 1);
+        passed &= check(color.texture == first && color.description.width == 896 && color.description.height == 640,
+                        "kept target size", color.description.width, 896);
+        // Growing out of the class and back reuses the first allocation.
+        pool.update(color, colorTarget(1000, 700));
+        pool.update(color, colorTarget(800, 600));
+        passed &= check(color.texture == first, "shrinking back reuses the pooled target", 0, 1);
+        passed &= check(allocator.allocations == 2, "allocations", allocator.allocations, 2);
+        passed &= check(pool.stats().reuses == 1 && pool.stats().kept == 1, "reuses", pool.stats().reuses, 1);
+        // Formats and sample counts are kept apart.
+        RenderTarget depth = pool.acquire(depthTarget(800, 600));
+        RenderTargetDescription singleSample = colorTarget(800, 600);
+        singleSample.sampleCount = 1;
+        RenderTarget resolve = pool.acquire(singleSample);
+        passed &= check(depth.texture != first && resolve.texture != first && allocator.allocations == 4,
+                        "targets of other formats or sample counts", allocator.allocations, 4);
+        // Pooled targets go once they have sat unused for retainFrames frames.
+        pool.release(depth);
+        pool.release(resolve);
+        for (int frame = 0; frame < 3; ++frame) {
+            pool.beginFrame();
+        }
+        passed &= check(pool.stats().frees == 0, "frees within the retain window", pool.stats().frees, 0);
+        pool.beginFrame();
+        passed &= check(pool.stats().frees == 3 && pool.stats().pooledBytes == 0, "frees after the retain window",
+                        pool.stats().frees, 3);
+        passed &= check(allocator.liveBytes == pool.stats().liveBytes, "live bytes", pool.stats().liveBytes,
+                        allocator.liveBytes);
+        // A failed allocation leaves an empty target and the counters alone.
+        allocator.failNext = true;
+        RenderTarget failed = pool.acquire(colorTarget(4000, 4000));
+        passed &= check(!failed && allocator.liveBytes == pool.stats().liveBytes, "failed allocation", 0, 0);
+        pool.release(color);
+    }
+    passed &= check(allocator.live.empty(), "textures left after destroying the pool", allocator.live.size(), 0);
+    return passed;
+}
+
+// A drag: the window width follows a triangle wave between two sizes,
+// with eventsPerFrame framebuffer size events between frames.
+static bool replayDrag(const char* name, uint32_t fromWidth, uint32_t toWidth, int frames, int eventsPerFrame) {
+    FakeAllocator allocator;
+    uint64_t eventCount = 0, applied = 0;
+    {
+        RenderTargetPool pool(allocator);
+        RenderTarget color, depth;
+        uint32_t height = 720;
+        for (int frame = 0; frame < frames; ++frame) {
+            pool.beginFrame();
+            uint32_t width = 0;
+            for (int event = 0; event < eventsPerFrame; ++event) {
+                const double phase = double(frame * eventsPerFrame + event) / (frames * eventsPerFrame) * 4.0;
+                const double wave = 1.0 - std::abs(std::fmod(phase, 2.0) - 1.0);
+                width = uint32_t(fromWidth + (toWidth - fromWidth) * wave);
+                height = 720 + (width - fromWidth) / 8;
+                ++eventCount;
+            }
+            // The engine applies only the last size of the frame.
+            pool.update(color, colorTarget(width, height));
+            pool.update(depth, depthTarget(width, height));
+            ++applied;
+            if (allocator.liveBytes != pool.stats().liveBytes + pool.stats().pooledBytes) {
+                std::cout << "FAIL " << name << ": allocator and pool disagree on bytes" << std::endl;
+                return false;
+            }
+        }
+        const auto& stats = pool.stats();
+        const double mb = 1.0 / (1 << 20);
+        std::cout << name << ": " << eventCount << " resize events, " << applied << " applied, " << stats.allocations
+                  << " allocations (" << 2 * eventCount << " reallocating per event), " << stats.reuses << " reused, "
+                  << stats.kept << " kept, " << stats.frees << " freed, peak " << stats.peakBytes * mb << " MB"
+                  << std::endl;
+        pool.release(color);
+        pool.release(depth);
+        if (!check(stats.allocations * 10 < 2 * eventCount, "allocations against reallocating per event",
+                   stats.allocations, 2 * eventCount / 10)) {
+            return false;
+        }
+    }
+    return check(allocator.live.empty(), "textures left after the drag", allocator.live.size(), 0);
+}
+
+int main() {
+    bool passed = checkSizeClasses();
+    passed &= checkPolicy();
+    passed &= replayDrag("drag 800-1600", 800, 1600, 600, 3);
+    passed &= replayDrag("drag 1280-1320", 1280, 1320, 300, 5);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,388 @@
+//
+//  statefilterbench.cpp
+//  Metal-Guide
+//
+//  Checks StateFilteredEncoder against a backend that records what it is
+//  sent, then measures it on a frame of many draws. Checks:
+//  - Repeated state is skipped, changed state is forwarded, and reset()
+//    forgets everything bound. Metal's defaults for winding, cull mode
+//    and fill mode count as bound.
+//  - Rebinding a bound buffer at a new offset is forwarded as
+//    setVertexBufferOffset(). Slots past the tracked range always pass
+//    through.
+//  - For random call streams, every draw sees the same bound state with
+//    the filter as without it.
+//  The benchmark encodes the frame the way EngineCore's cube pass does,
+//  setting every piece of state for every draw. Draws are sorted by
+//  pipeline and material, and each has its own transform offset. It
+//  reports the calls issued and skipped, and the time per draw with and
+//  without the filter. Recording a call is much cheaper than a call into
+//  Metal. --call-ns adds a busy wait to each call the backend receives,
+//  to model a slower driver. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/statefilterbench.cpp
+//        Metal-Tutorial/render_state_filter.cpp -o statefilterbench
+//
+//  Usage: statefilterbench [--draws N] [--call-ns N]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "render_state_filter.hpp"
+
+using Call = StateFilteredEncoder::Call;
+
+// MTL::CullMode and MTL::Winding values.
+static constexpr uint32_t kCullNone = 0, kCullBack = 2, kClockwise = 0, kCounterClockwise = 1;
+
+// A fake object address for handle n.
+static const void* handle(uintptr_t n) {
+    return reinterpret_cast<const void*>(0x1000 * (n + 1));
+}
+
+// Records each call it receives, optionally spending callNs on it.
+class RecordingBackend : public RenderEncoderBackend {
+public:
+    struct Record {
+        int call;  // a StateFilteredEncoder::Call, or kDraw
+        const void* object;
+        uint64_t value;
+        uint32_t index;
+    };
+    static constexpr int kDraw = int(Call::Count);
+
+    explicit RecordingBackend(double callNs = 0.0) : callNs(callNs) {}
+
+    void setRenderPipelineState(const void* state) override { record(Call::SetRenderPipelineState, state, 0, 0); }
+    void setDepthStencilState(const void* state) override { record(Call::SetDepthStencilState, state, 0, 0); }
+    void setFrontFacingWinding(uint32_t winding) override { record(Call::SetFrontFacingWinding, nullptr, winding, 0); }
+    void setCullMode(uint32_t cullMode) override { record(Call::SetCullMode, nullptr, cullMode, 0); }
+    void setTriangleFillMode(uint32_t fillMode) override { record(Call::SetTriangleFillMode, nullptr, fillMode, 0); }
+    void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        record(Call::SetVertexBuffer, buffer, offset, index);
+    }
+    void setVertexBufferOffset(uint64_t offset, uint32_t index) override {
+        record(Call::SetVertexBufferOffset, nullptr, offset, index);
+    }
+    void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        record(Call::SetFragmentBuffer, buffer, offset, index);
+    }
+    void setFragmentTexture(const void* texture, uint32_t index) override {
+        record(Call::SetFragmentTexture, texture, 0, index);
+    }
+    void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t) override {
+        record(Call(kDraw), nullptr, vertexStart, primitiveType);
+    }
+
+    std::vector<Record> records;
+
+private:
+    void record(Call call, const void* object, uint64_t value, uint32_t index) {
+        records.push_back({int(call), object, value, index});
+        if (callNs > 0.0) {
+            const auto until = std::chrono::steady_clock::now() + std::chrono::duration<double, std::nano>(callNs);
+            while (std::chrono::steady_clock::now() < until) {
+            }
+        }
+    }
+
+    double callNs;
+};
+
+// Replays records into the state an encoder would have bound, and takes
+// a snapshot of it at every draw.
+class BoundState {
+public:
+    static constexpr uint32_t kSlots = 40;
+
+    BoundState() { reset(); }
+
+    void reset() {
+        std::fill(std::begin(state), std::end(state), ~uint64_t(0));
+        state[kWinding] = kClockwise;
+        state[kCullMode] = kCullNone;
+        state[kFillMode] = 0;
+    }
+
+    void apply(const RecordingBackend::Record& r) {
+        const uint64_t object = reinterpret_cast<uintptr_t>(r.object);
+        switch (Call(r.call)) {
+        case Call::SetRenderPipelineState: state[kPipeline] = object; break;
+        case Call::SetDepthStencilState: state[kDepthStencil] = object; break;
+        case Call::SetFrontFacingWinding: state[kWinding] = r.value; break;
+        case Call::SetCullMode: state[kCullMode] = r.value; break;
+        case Call::SetTriangleFillMode: state[kFillMode] = r.value; break;
+        case Call::SetVertexBuffer:
+            state[kVertexBuffers + 2 * r.index] = object;
+            state[kVertexBuffers + 2 * r.index + 1] = r.value;
+            break;
+        case Call::SetVertexBufferOffset: state[kVertexBuffers + 2 * r.index + 1] = r.value; break;
+        case Call::SetFragmentBuffer:
+            state[kFragmentBuffers + 2 * r.index] = object;
+            state[kFragmentBuffers + 2 * r.index + 1] = r.value;
+            break;
+        case Call::SetFragmentTexture: state[kFragmentTextures + r.index] = object; break;
+        default:
+            snapshots.insert(snapshots.end(), std::begin(state), std::end(state));
+            snapshots.push_back(r.value);
+            break;
+        }
+    }
+
+    std::vector<uint64_t> snapshots;
+
+private:
+    enum : uint32_t {
+        kPipeline,
+        kDepthStencil,
+        kWinding,
+        kCullMode,
+        kFillMode,
+        kVertexBuffers,
+        kFragmentBuffers = kVertexBuffers + 2 * kSlots,
+        kFragmentTextures = kFragmentBuffers + 2 * kSlots,
+        kCount = kFragmentTextures + kSlots
+    };
+    uint64_t state[kCount];
+};
+
+static bool checkFiltering() {
+    RecordingBackend backend;
+    StateFilteredEncoder encoder(backend);
+    bool passed = true;
+    auto expectForwarded = [&](size_t expected, const char* what) {
+        passed &= check(backend.records.size() == expected, what, backend.records.size(), expected);
+    };
+
+    encoder.setCullMode(kCullNone);
+    encoder.setFrontFacingWinding(kClockwise);
+    encoder.setTriangleFillMode(0);
+    expectForwarded(0, "Metal's defaults skipped");
+    encoder.setCullMode(kCullBack);
+    encoder.setCullMode(kCullBack);
+    encoder.setFrontFacingWinding(kCounterClockwise);
+    expectForwarded(2, "changed state forwarded once");
+    encoder.setRenderPipelineState(handle(1));
+    encoder.setRenderPipelineState(handle(1));
+    encoder.setRenderPipelineState(handle(2));
+    encoder.setDepthStencilState(handle(3));
+    encoder.setDepthStencilState(handle(3));
+    expectForwarded(5, "objects compared by address");
+
+    encoder.setVertexBuffer(handle(4), 0, 1);
+    encoder.setVertexBuffer(handle(4), 0, 1);
+    encoder.setVertexBuffer(handle(4), 256, 1);
+    expectForwarded(7, "buffer rebound at a new offset");
+    passed &= check(backend.records.back().call == int(Call::SetVertexBufferOffset) && backend.records.back().value == 256,
+                    "new offset sent as setVertexBufferOffset", backend.records.back().call,
+                    int(Call::SetVertexBufferOffset));
+    encoder.setVertexBufferOffset(256, 1);
+    encoder.setVertexBufferOffset(512, 1);
+    encoder.setVertexBuffer(handle(4), 512, 1);
+    expectForwarded(8, "offsets tracked");
+    encoder.setVertexBufferOffset(64, 2);
+    expectForwarded(9, "offset on an unbound slot forwarded");
+    encoder.setVertexBuffer(handle(5), 0, 0);
+    encoder.setFragmentBuffer(handle(5), 0, 0);
+    encoder.setFragmentBuffer(handle(5), 0, 0);
+    encoder.setFragmentTexture(handle(6), 0);
+    encoder.setFragmentTexture(handle(6), 0);
+    encoder.setFragmentTexture(handle(6), 1);
+    expectForwarded(13, "stages and slots tracked separately");
+    encoder.setVertexBuffer(handle(5), 0, StateFilteredEncoder::kBufferSlots);
+    encoder.setVertexBuffer(handle(5), 0, StateFilteredEncoder::kBufferSlots);
+    encoder.setFragmentTexture(handle(6), StateFilteredEncoder::kTextureSlots);
+    encoder.setFragmentTexture(handle(6), StateFilteredEncoder::kTextureSlots);
+    expectForwarded(17, "untracked slots passed through");
+    encoder.drawPrimitives(3, 0, 36);
+    encoder.drawPrimitives(3, 0, 36);
+    expectForwarded(19, "draws passed through");
+
+    encoder.reset();
+    encoder.setRenderPipelineState(handle(2));
+    encoder.setCullMode(kCullBack);
+    encoder.setVertexBuffer(handle(4), 512, 1);
+    encoder.setCullMode(kCullNone);
+    expectForwarded(23, "reset() forgets bound state");
+
+    const StateFilteredEncoder::Stats& stats = encoder.stats();
+    passed &= check(stats.totalIssued() + stats.draws == backend.records.size(), "issued counter",
+                    stats.totalIssued() + stats.draws, backend.records.size());
+    passed &= check(stats.totalSkipped() == 11, "skipped counter", stats.totalSkipped(), 11);
+    passed &= check(stats.issued[size_t(Call::SetVertexBufferOffset)] == 3, "setVertexBufferOffset counter",
+                    stats.issued[size_t(Call::SetVertexBufferOffset)], 3);
+    passed &= check(stats.draws == 2, "draw counter", stats.draws, 2);
+    return passed;
+}
+
+// Sends one random call, from a small set of objects and values so that
+// many are redundant.
+static void randomCall(std::mt19937& random, RenderEncoderBackend& target) {
+    const uint32_t slot = random() % 4 == 0 ? StateFilteredEncoder::kBufferSlots + random() % 2 : random() % 3;
+    switch (random() % 11) {
+    case 0: target.setRenderPipelineState(handle(random() % 3)); break;
+    case 1: target.setDepthStencilState(handle(random() % 2)); break;
+    case 2: target.setFrontFacingWinding(random() % 2); break;
+    case 3: target.setCullMode(random() % 3); break;
+    case 4: target.setTriangleFillMode(random() % 2); break;
+    case 5: target.setVertexBuffer(handle(random() % 3), 256 * (random() % 3), slot); break;
+    case 6: target.setVertexBufferOffset(256 * (random() % 3), slot); break;
+    case 7: target.setFragmentBuffer(handle(random() % 3), 256 * (random() % 2), slot); break;
+    case 8: target.setFragmentTexture(handle(random() % 4), slot); break;
+    default: target.drawPrimitives(3, random() % 4, 36); break;
+    }
+}
+
+// Forwards to a StateFilteredEncoder, so randomCall() can drive either path.
+class FilterInput : public RenderEncoderBackend {
+public:
+    explicit FilterInput(StateFilteredEncoder& encoder) : encoder(encoder) {}
+    void setRenderPipelineState(const void* state) override { encoder.setRenderPipelineState(state); }
+    void setDepthStencilState(const void* state) override { encoder.setDepthStencilState(state); }
+    void setFrontFacingWinding(uint32_t winding) override { encoder.setFrontFacingWinding(winding); }
+    void setCullMode(uint32_t cullMode) override { encoder.setCullMode(cullMode); }
+    void setTriangleFillMode(uint32_t fillMode) override { encoder.setTriangleFillMode(fillMode); }
+    void setVertexBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        encoder.setVertexBuffer(buffer, offset, index);
+    }
+    void setVertexBufferOffset(uint64_t offset, uint32_t index) override { encoder.setVertexBufferOffset(offset, index); }
+    void setFragmentBuffer(const void* buffer, uint64_t offset, uint32_t index) override {
+        encoder.setFragmentBuffer(buffer, offset, index);
+    }
+    void setFragmentTexture(const void* texture, uint32_t index) override { encoder.setFragmentTexture(texture, index); }
+    void drawPrimitives(uint32_t primitiveType, uint64_t vertexStart, uint64_t vertexCount) override {
+        encoder.drawPrimitives(primitiveType, vertexStart, vertexCount);
+    }
+
+private:
+    StateFilteredEncoder& encoder;
+};
+
+static bool checkEquivalence(int streams, int callsPerEncoder) {
+    bool passed = true;
+    uint64_t issued = 0, skipped = 0;
+    for (int s = 0; s < streams && passed; ++s) {
+        RecordingBackend direct, filtered;
+        StateFilteredEncoder encoder(filtered);
+        FilterInput input(encoder);
+        // A few encoders per stream, each starting from the defaults.
+        std::mt19937 random(s), sameRandom(s);
+        BoundState directState, filteredState;
+        for (int e = 0; e < 3; ++e) {
+            direct.records.clear();
+            filtered.records.clear();
+            encoder.reset();
+            for (int c = 0; c < callsPerEncoder; ++c) {
+                randomCall(random, direct);
+                randomCall(sameRandom, input);
+            }
+            directState.reset();
+            filteredState.reset();
+            for (const RecordingBackend::Record& r : direct.records) {
+                directState.apply(r);
+            }
+            for (const RecordingBackend::Record& r : filtered.records) {
+                filteredState.apply(r);
+            }
+        }
+        passed &= check(directState.snapshots == filteredState.snapshots, "state at each draw",
+                        filteredState.snapshots.size(), directState.snapshots.size());
+        issued += encoder.stats().totalIssued();
+        skipped += encoder.stats().totalSkipped();
+    }
+    std::cout << streams << " random streams: every draw sees the same state; " << skipped << " of "
+              << issued + skipped << " state calls skipped" << std::endl;
+    return passed;
+}
+
+struct Draw {
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+};
+
+// Encodes the draws the way EngineCore's cube pass does, into target.
+template <typename Encoder>
+static void encodeFrame(Encoder& target, const std::vector<Draw>& draws) {
+    for (size_t i = 0; i < draws.size(); ++i) {
+        const Draw& draw = draws[i];
+        target.setFrontFacingWinding(kCounterClockwise);
+        target.setCullMode(kCullBack);
+        target.setRenderPipelineState(handle(draw.pipeline));
+        target.setDepthStencilState(handle(100));
+        target.setVertexBuffer(handle(200 + draw.mesh), 0, 0);
+        target.setVertexBuffer(handle(300), 192 * i, 1);
+        target.setFragmentTexture(handle(400 + draw.material), 0);
+        target.drawPrimitives(3, 0, 36);
+    }
+}
+
+static void benchmark(size_t drawCount, double callNs) {
+    std::mt19937 random(5);
+    std::vector<Draw> draws(drawCount);
+    for (Draw& draw : draws) {
+        draw = {uint32_t(random() % 8), uint32_t(random() % 64), uint32_t(random() % 16)};
+    }
+    std::sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) {
+        return a.pipeline != b.pipeline ? a.pipeline < b.pipeline : a.material < b.material;
+    });
+
+    const int runs = 5;
+    double directSeconds = 1e9, filteredSeconds = 1e9;
+    size_t directCalls = 0, filteredCalls = 0;
+    StateFilteredEncoder::Stats stats{};
+    for (int run = 0; run < runs; ++run) {
+        RecordingBackend direct(callNs), filtered(callNs);
+        direct.records.reserve(drawCount * 8);
+        filtered.records.reserve(drawCount * 8);
+        StateFilteredEncoder encoder(filtered);
+
+        auto start = std::chrono::steady_clock::now();
+        encodeFrame(static_cast<RenderEncoderBackend&>(direct), draws);
+        directSeconds = std::min(directSeconds, secondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        encodeFrame(encoder, draws);
+        filteredSeconds = std::min(filteredSeconds, secondsSince(start));
+        directCalls = direct.records.size();
+        filteredCalls = filtered.records.size();
+        stats = encoder.stats();
+    }
+
+    std::cout << drawCount << " draws, " << callNs << " ns per backend call, best of " << runs << ":" << std::endl;
+    std::cout << "  unfiltered: " << directCalls << " calls, " << directSeconds / drawCount * 1e9 << " ns per draw"
+              << std::endl;
+    std::cout << "  filtered:   " << filteredCalls << " calls, " << filteredSeconds / drawCount * 1e9
+              << " ns per draw (" << directSeconds / filteredSeconds << "x)" << std::endl;
+    for (size_t c = 0; c < size_t(Call::Count); ++c) {
+        if (stats.issued[c] + stats.skipped[c] > 0) {
+            std::cout << "    " << StateFilteredEncoder::callName(Call(c)) << ": " << stats.issued[c] << " issued, "
+                      << stats.skipped[c] << " skipped" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t draws = 100000;
+    double callNs = 0.0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--draws")) {
+            draws = size_t(atol(argv[i + 1]));
+        } else if (!strcmp(argv[i], "--call-ns")) {
+            callNs = atof(argv[i + 1]);
+        }
+    }
+
+    bool passed = checkFiltering();
+    passed &= checkEquivalence(500, 400);
+    benchmark(draws, callNs);
+    std::cout << (passed ? "All checks passed" : "Checks FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
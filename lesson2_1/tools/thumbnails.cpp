@@ -0,0 +1,495 @@
+//
+//  thumbnails.cpp
+//  Metal-Guide
+//
+//  Builds preview thumbnails for a whole texture library. Every image goes
+//  through read -> decode -> resize -> encode -> write, and each stage has
+//  its own worker threads with bounded queues in between. File reads
+//  overlap with decoding, and a slow stage backs up its input queue
+//  instead of letting memory grow. Decoding follows Texture's RGBA8 path:
+//  QOI through Qoi::Decoder, anything else through stb_image with
+//  PixelConvert expanding RGB, and buffers taken from StbImagePool. Images
+//  are fitted with ImageResize and written as .qoi next to the same
+//  relative path under the output directory. At the end it prints per-stage
+//  throughput, how busy, starved and blocked each stage was, and how full
+//  each queue ran on average. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -Iexternal -IMetal-Tutorial tools/thumbnails.cpp
+//        Metal-Tutorial/image_resize.cpp Metal-Tutorial/pixel_convert.cpp
+//        Metal-Tutorial/qoi.cpp Metal-Tutorial/thread_pool.cpp
+//        external/stb/stb_image.cpp external/stb/stb_image_pool.cpp -o thumbnails
+//
+//  Usage: thumbnails [--size 256] [--queue 16] [--generate N]
+//                    [--workers read=2,decode=8,resize=4,encode=2,write=1]
+//                    <input dir> <output dir>
+//
+//  --generate first fills <input dir> with N synthetic .qoi images, for
+//  trying out worker counts without a real library.
+//
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "image_resize.hpp"
+#include "pixel_convert.hpp"
+#include "qoi.hpp"
+#include "thread_pool.hpp"
+#include "stb/stb_image.h"
+#include "stb/stb_image_pool.h"
+
+namespace fs = std::filesystem;
+
+// Multi-producer, multi-consumer FIFO holding at most capacity items.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // Blocks while the queue is full.
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    // Blocks while the queue is empty. Returns false once it is closed and drained.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // No more pushes; consumers drain what is left and stop.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    size_t limit() const { return capacity; }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    bool closed{false};
+};
+
+// One image on its way through the pipeline. Each stage consumes the
+// previous stage's buffer and frees it, so only one copy is alive at a time.
+struct Job {
+    ~Job() { StbImagePool::release(pixels); }
+
+    fs::path source;
+    fs::path destination;
+    std::vector<uint8_t> file;
+    uint8_t* pixels{nullptr};  // decoded RGBA8, from StbImagePool
+    int width{0};
+    int height{0};
+    std::vector<uint8_t> thumbnail;
+    int thumbnailWidth{0};
+    int thumbnailHeight{0};
+    std::vector<uint8_t> encoded;
+};
+
+using JobQueue = BoundedQueue<std::unique_ptr<Job>>;
+
+// A pool of threads that take jobs from in, run work on them and pass them
+// to out. The last worker to finish closes out, which stops the next stage.
+class Stage {
+public:
+    // Returns false when the image cannot be processed; the job is dropped.
+    // bytes receives the size of what the stage produced.
+    using Work = std::function<bool(Job& job, uint64_t& bytes)>;
+
+    Stage(const char* name, unsigned workerCount, JobQueue& in, JobQueue* out, Work work)
+        : name(name), workerCount(std::max(workerCount, 1u)), in(in), out(out), work(std::move(work)) {}
+
+    void start() {
+        running = workerCount;
+        for (unsigned i = 0; i < workerCount; ++i) {
+            threads.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    void join() {
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    const char* name;
+    unsigned workerCount;
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> busyNs{0};
+    std::atomic<uint64_t> starvedNs{0};  // waiting for input
+    std::atomic<uint64_t> blockedNs{0};  // waiting for room in the next queue
+
+private:
+    void workerLoop() {
+        for (;;) {
+            auto waitStart = std::chrono::steady_clock::now();
+            std::unique_ptr<Job> job;
+            if (!in.pop(job)) {
+                break;
+            }
+            starvedNs += uint64_t(nanosecondsSince(waitStart));
+
+            auto workStart = std::chrono::steady_clock::now();
+            uint64_t produced = 0;
+            const bool ok = work(*job, produced);
+            busyNs += uint64_t(nanosecondsSince(workStart));
+            if (!ok) {
+                std::cerr << name << " failed: " << job->source.string() << std::endl;
+                ++failures;
+                continue;
+            }
+            ++items;
+            bytes += produced;
+
+            if (out) {
+                auto pushStart = std::chrono::steady_clock::now();
+                out->push(std::move(job));
+                blockedNs += uint64_t(nanosecondsSince(pushStart));
+            }
+        }
+        if (--running == 0 && out) {
+            out->close();
+        }
+    }
+
+    JobQueue& in;
+    JobQueue* out;
+    Work work;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> running{0};
+};
+
+static bool readFile(Job& job, uint64_t& bytes) {
+    FILE* file = fopen(job.source.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::error_code error;
+    const uintmax_t size = fs::file_size(job.source, error);
+    job.file.resize(error ? 0 : size_t(size));
+    const bool ok = !error && fread(job.file.data(), 1, job.file.size(), file) == job.file.size();
+    fclose(file);
+    bytes = job.file.size();
+    return ok && !job.file.empty();
+}
+
+static bool decodeImage(Job& job, uint64_t& bytes) {
+    const uint8_t* data = job.file.data();
+    const size_t size = job.file.size();
+    if (Qoi::isQoi(data, size)) {
+        Qoi::Decoder decoder;
+        if (!decoder.open(data, size)) {
+            return false;
+        }
+        job.width = int(decoder.header().width);
+        job.height = int(decoder.header().height);
+        job.pixels = static_cast<uint8_t*>(StbImagePool::allocate(size_t(job.width) * job.height * 4));
+        if (!decoder.decodeRows(job.pixels, 4 * size_t(job.width), uint32_t(job.height))) {
+            return false;
+        }
+    } else {
+        int fileChannels = 0, channels = 0;
+        if (!stbi_info_from_memory(data, int(size), &job.width, &job.height, &fileChannels)) {
+            return false;
+        }
+        const int requestedChannels = (fileChannels == 3) ? STBI_rgb : STBI_rgb_alpha;
+        uint8_t* decoded = stbi_load_from_memory(data, int(size), &job.width, &job.height, &channels, requestedChannels);
+        if (!decoded) {
+            return false;
+        }
+        if (requestedChannels == STBI_rgb) {
+            job.pixels = static_cast<uint8_t*>(StbImagePool::allocate(size_t(job.width) * job.height * 4));
+            PixelConvert::rgbToRgba(decoded, job.pixels, size_t(job.width) * job.height);
+            stbi_image_free(decoded);
+        } else {
+            job.pixels = decoded;
+        }
+    }
+    std::vector<uint8_t>().swap(job.file);
+    bytes = size_t(job.width) * job.height * 4;
+    return true;
+}
+
+static bool resizeImage(Job& job, int thumbnailSize, uint64_t& bytes) {
+    ImageResize::fitWithin(job.width, job.height, thumbnailSize, 0, 4, job.thumbnailWidth, job.thumbnailHeight);
+    job.thumbnail.resize(size_t(job.thumbnailWidth) * job.thumbnailHeight * 4);
+    if (job.thumbnailWidth == job.width && job.thumbnailHeight == job.height) {
+        memcpy(job.thumbnail.data(), job.pixels, job.thumbnail.size());
+    } else {
+        ImageResize::resizeRgba8(job.pixels, job.width, job.height, 4 * size_t(job.width),
+                                 job.thumbnail.data(), job.thumbnailWidth, job.thumbnailHeight,
+                                 4 * size_t(job.thumbnailWidth));
+    }
+    StbImagePool::release(job.pixels);
+    job.pixels = nullptr;
+    bytes = job.thumbnail.size();
+    return true;
+}
+
+static bool encodeImage(Job& job, uint64_t& bytes) {
+    job.encoded = Qoi::encode(job.thumbnail.data(), uint32_t(job.thumbnailWidth), uint32_t(job.thumbnailHeight), 4);
+    std::vector<uint8_t>().swap(job.thumbnail);
+    bytes = job.encoded.size();
+    return !job.encoded.empty();
+}
+
+static bool writeFile(Job& job, uint64_t& bytes) {
+    std::error_code error;
+    fs::create_directories(job.destination.parent_path(), error);
+    FILE* file = fopen(job.destination.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool ok = fwrite(job.encoded.data(), 1, job.encoded.size(), file) == job.encoded.size();
+    bytes = job.encoded.size();
+    return fclose(file) == 0 && ok;
+}
+
+// Smooth gradients, a few discs and light noise: compresses about as well
+// as painted textures do, unlike pure noise or flat colour.
+static void generateLibrary(const fs::path& directory, size_t count) {
+    fs::create_directories(directory);
+    ThreadPool::shared().parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::mt19937 random(static_cast<uint32_t>(i));
+            std::uniform_int_distribution<int> side(512, 2048);
+            const int width = side(random), height = side(random);
+            std::vector<uint8_t> pixels(size_t(width) * height * 4);
+            const float cx = float(random() % width), cy = float(random() % height);
+            const float radius = float(std::min(width, height)) * 0.3f;
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    uint8_t* p = &pixels[(size_t(y) * width + x) * 4];
+                    const bool inside = std::hypot(x - cx, y - cy) < radius;
+                    const uint32_t noise = random() & 7;
+                    p[0] = uint8_t(x * 255 / width + noise);
+                    p[1] = uint8_t(y * 255 / height + noise);
+                    p[2] = inside ? uint8_t(200 + noise) : uint8_t(i * 37);
+                    p[3] = 255;
+                }
+            }
+            std::vector<uint8_t> encoded = Qoi::encode(pixels.data(), uint32_t(width), uint32_t(height), 4);
+            char name[32];
+            snprintf(name, sizeof(name), "texture_%05zu.qoi", i);
+            FILE* file = fopen((directory / name).c_str(), "wb");
+            if (file) {
+                fwrite(encoded.data(), 1, encoded.size(), file);
+                fclose(file);
+            }
+        }
+    });
+}
+
+static double cpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static bool parseWorkers(const std::string& spec, const std::vector<std::string>& names, std::vector<unsigned>& counts) {
+    size_t position = 0;
+    while (position < spec.size()) {
+        size_t comma = spec.find(',', position);
+        if (comma == std::string::npos) {
+            comma = spec.size();
+        }
+        const std::string item = spec.substr(position, comma - position);
+        const size_t equals = item.find('=');
+        auto it = std::find(names.begin(), names.end(), item.substr(0, equals));
+        if (equals == std::string::npos || it == names.end()) {
+            return false;
+        }
+        counts[it - names.begin()] = unsigned(std::max(std::stoi(item.substr(equals + 1)), 1));
+        position = comma + 1;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    const std::vector<std::string> stageNames = {"read", "decode", "resize", "encode", "write"};
+    // Decoding is most of the work; resize fans its rows out to
+    // ThreadPool::shared() on top of its own workers.
+    std::vector<unsigned> workers = {2, cores, std::max(cores / 2, 1u), std::max(cores / 4, 1u), 1};
+    int thumbnailSize = 256;
+    size_t queueDepth = 16;
+    size_t generateCount = 0;
+    std::vector<fs::path> directories;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--size" && i + 1 < argc) {
+            thumbnailSize = std::max(std::atoi(argv[++i]), 1);
+        } else if (argument == "--queue" && i + 1 < argc) {
+            queueDepth = size_t(std::max(std::atoi(argv[++i]), 1));
+        } else if (argument == "--generate" && i + 1 < argc) {
+            generateCount = size_t(std::max(std::atoi(argv[++i]), 0));
+        } else if (argument == "--workers" && i + 1 < argc) {
+            if (!parseWorkers(argv[++i], stageNames, workers)) {
+                std::cerr << "Bad --workers list: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            directories.push_back(argument);
+        }
+    }
+    if (directories.size() != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--size 256] [--queue 16] [--generate N]"
+                  << " [--workers read=2,decode=8,resize=4,encode=2,write=1] <input dir> <output dir>" << std::endl;
+        return 1;
+    }
+    const fs::path input = directories[0], output = directories[1];
+
+    if (generateCount > 0) {
+        auto start = std::chrono::steady_clock::now();
+        generateLibrary(input, generateCount);
+        std::cout << "Generated " << generateCount << " images in " << nanosecondsSince(start) * 1e-9 << " s" << std::endl;
+    }
+
+    std::error_code error;
+    std::vector<fs::path> sources;
+    for (auto it = fs::recursive_directory_iterator(input, error); !error && it != fs::recursive_directory_iterator();
+         it.increment(error)) {
+        if (it->is_regular_file()) {
+            sources.push_back(it->path());
+        }
+    }
+    if (error || sources.empty()) {
+        std::cerr << "No images found in " << input.string() << std::endl;
+        return 1;
+    }
+    std::sort(sources.begin(), sources.end());
+
+    // The read stage's input holds every job up front; the queues after it are bounded.
+    JobQueue pending(sources.size());
+    for (const fs::path& source : sources) {
+        auto job = std::make_unique<Job>();
+        job->source = source;
+        job->destination = output / fs::relative(source, input);
+        job->destination.replace_extension(".qoi");
+        pending.push(std::move(job));
+    }
+    pending.close();
+
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    for (size_t i = 0; i + 1 < stageNames.size(); ++i) {
+        queues.push_back(std::make_unique<JobQueue>(queueDepth));
+    }
+    std::vector<Stage::Work> work = {
+        readFile,
+        decodeImage,
+        [thumbnailSize](Job& job, uint64_t& bytes) { return resizeImage(job, thumbnailSize, bytes); },
+        encodeImage,
+        writeFile,
+    };
+    std::vector<std::unique_ptr<Stage>> stages;
+    for (size_t i = 0; i < stageNames.size(); ++i) {
+        JobQueue& in = i == 0 ? pending : *queues[i - 1];
+        JobQueue* out = i < queues.size() ? queues[i].get() : nullptr;
+        stages.push_back(std::make_unique<Stage>(stageNames[i].c_str(), workers[i], in, out, work[i]));
+    }
+
+    // Queue occupancy is sampled rather than tracked on every push and pop.
+    struct Occupancy {
+        uint64_t total{0};
+        uint64_t full{0};
+        uint64_t empty{0};
+    };
+    std::vector<Occupancy> occupancy(queues.size());
+    uint64_t samples = 0;
+    std::atomic<bool> done{false};
+
+    const double cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    for (auto& stage : stages) {
+        stage->start();
+    }
+    std::thread sampler([&] {
+        while (!done) {
+            for (size_t i = 0; i < queues.size(); ++i) {
+                const size_t size = queues[i]->size();
+                occupancy[i].total += size;
+                occupancy[i].full += size == queues[i]->limit();
+                occupancy[i].empty += size == 0;
+            }
+            ++samples;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+    for (auto& stage : stages) {
+        stage->join();
+    }
+    const double seconds = nanosecondsSince(start) * 1e-9;
+    const double cpu = cpuSeconds() - cpuStart;
+    done = true;
+    sampler.join();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << sources.size() << " images -> " << stages.back()->items << " thumbnails in " << seconds << " s ("
+              << stages.back()->items / seconds << " images/s), CPU use " << 100.0 * cpu / (seconds * cores)
+              << "% of " << cores << " cores" << std::endl;
+    std::cout << "stage    workers  items/s    MB/s   busy  starved  blocked  failed" << std::endl;
+    for (auto& stage : stages) {
+        const double workerSeconds = seconds * stage->workerCount * 1e9;
+        std::cout << std::left << std::setw(9) << stage->name << std::right << std::setw(7) << stage->workerCount
+                  << std::setw(9) << stage->items / seconds << std::setw(8) << stage->bytes / seconds / 1e6
+                  << std::setw(6) << 100.0 * stage->busyNs / workerSeconds << "%" << std::setw(8)
+                  << 100.0 * stage->starvedNs / workerSeconds << "%" << std::setw(8)
+                  << 100.0 * stage->blockedNs / workerSeconds << "%" << std::setw(8) << stage->failures << std::endl;
+    }
+    std::cout << "queue            depth  mean fill   full  empty" << std::endl;
+    for (size_t i = 0; i < queues.size(); ++i) {
+        const double count = double(std::max<uint64_t>(samples, 1));
+        const std::string name = stageNames[i] + " -> " + stageNames[i + 1];
+        std::cout << std::left << std::setw(17) << name << std::right << std::setw(5) << queues[i]->limit()
+                  << std::setw(11) << occupancy[i].total / count << std::setw(6) << 100.0 * occupancy[i].full / count
+                  << "%" << std::setw(6) << 100.0 * occupancy[i].empty / count << "%" << std::endl;
+    }
+
+    uint64_t failures = 0;
+    for (auto& stage : stages) {
+        failures += stage->failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
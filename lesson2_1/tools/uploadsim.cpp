@@ -0,0 +1,268 @@
+//
+//  uploadsim.cpp
+//  Metal-Guide
+//
+//  Streams randomly sized textures through UploadQueue against a mock
+//  device that runs each submit's copies a few frames later, reading the
+//  staging memory only then, the way a GPU would. Checks that every
+//  completed texture matches its source (so the ring never reused memory
+//  still in flight), that tokens complete in order, that each frame stays
+//  within its byte budget and that every release callback runs once.
+//  Reports per-frame flush cost against the stall a synchronous upload
+//  of the largest texture would have caused. Build from lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/uploadsim.cpp
+//        Metal-Tutorial/upload_queue.cpp -o uploadsim
+//
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "upload_queue.hpp"
+
+struct MockTexture {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+class MockDevice : public UploadBackend {
+public:
+    MockDevice(size_t stagingBytes, int latencyFrames) : staging(stagingBytes), latency(latencyFrames) {}
+
+    uint8_t* stagingMemory() override { return staging.data(); }
+    size_t stagingSize() const override { return staging.size(); }
+    void copyToTexture(const UploadCopy& copy) override { recording.push_back(copy); }
+
+    uint64_t submit() override {
+        batches.push_back({++submitted, frame + latency, std::move(recording)});
+        recording.clear();
+        return submitted;
+    }
+
+    uint64_t completedFence() override { return completed; }
+
+    void waitForFence(uint64_t fence) override {
+        while (completed < fence) {
+            execute(batches.front());
+        }
+    }
+
+    // One frame of device time: runs the batches that are due.
+    void advance() {
+        ++frame;
+        while (!batches.empty() && batches.front().dueFrame <= frame) {
+            execute(batches.front());
+        }
+    }
+
+private:
+    struct Batch {
+        uint64_t fence;
+        uint64_t dueFrame;
+        std::vector<UploadCopy> copies;
+    };
+
+    void execute(Batch& batch) {
+        for (const UploadCopy& copy : batch.copies) {
+            MockTexture& texture = *static_cast<MockTexture*>(copy.texture);
+            const uint32_t levelWidth = std::max(texture.width >> copy.level, 1u);
+            const size_t rowBytes = size_t(copy.width) * texture.bytesPerPixel;
+            for (uint32_t row = 0; row < copy.height; ++row) {
+                memcpy(&texture.levels[copy.level][(size_t(copy.y + row) * levelWidth + copy.x) * texture.bytesPerPixel],
+                       &staging[copy.stagingOffset + row * copy.bytesPerRow], rowBytes);
+            }
+        }
+        completed = batch.fence;
+        batches.pop_front();
+    }
+
+    std::vector<uint8_t> staging;
+    int latency;
+    uint64_t frame{0};
+    uint64_t submitted{0};
+    uint64_t completed{0};
+    std::vector<UploadCopy> recording;
+    std::deque<Batch> batches;
+};
+
+// A texture being streamed, with the source pixels it should end up holding.
+struct Upload {
+    std::unique_ptr<MockTexture> texture;
+    std::vector<std::vector<uint8_t>> source;
+    UploadToken token;
+    uint64_t enqueuedFrame;
+    int releases{0};
+    bool cancelled{false};
+    bool verified{false};
+};
+
+struct Scenario {
+    const char* name;
+    size_t stagingBytes;
+    size_t frameBudget;
+    int latencyFrames;
+    int frames;
+    int burst;           // textures queued on the first frame
+    double arrivalRate;  // textures per frame after that
+    double cancelRate;   // chance a queued texture is destroyed each frame
+};
+
+static bool run(const Scenario& scenario) {
+    std::mt19937 random(11);
+    std::uniform_int_distribution<int> sideLog2(6, 11);
+    std::uniform_int_distribution<int> format(0, 3);
+    std::bernoulli_distribution arrives(scenario.arrivalRate);
+    std::bernoulli_distribution cancels(scenario.cancelRate);
+
+    MockDevice device(scenario.stagingBytes, scenario.latencyFrames);
+    std::vector<std::unique_ptr<Upload>> uploads;
+    bool passed = true;
+    double flushSeconds = 0.0, worstFlush = 0.0, worstStall = 0.0;
+    uint64_t latencyFrames = 0, worstLatency = 0, completedCount = 0, lastCompleted = 0;
+
+    {
+        UploadQueue queue(device);
+        auto addTexture = [&](uint64_t frame) {
+            auto upload = std::make_unique<Upload>();
+            const uint32_t width = 1u << sideLog2(random), height = 1u << sideLog2(random);
+            const uint32_t bytesPerPixel = format(random) == 0 ? 8 : 4;
+            const bool mipmapped = format(random) != 0;
+            upload->texture.reset(new MockTexture{width, height, bytesPerPixel, {}});
+            const uint32_t levelCount = mipmapped ? std::bit_width(std::max(width, height)) : 1;
+            for (uint32_t level = 0; level < levelCount; ++level) {
+                const size_t bytes = size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * bytesPerPixel;
+                std::vector<uint8_t> pixels(bytes);
+                for (size_t i = 0; i < bytes; i += 4) {
+                    const uint32_t word = uint32_t(random());
+                    memcpy(&pixels[i], &word, 4);
+                }
+                upload->texture->levels.emplace_back(bytes);
+                upload->source.push_back(std::move(pixels));
+            }
+
+            // What a synchronous replaceRegion of the whole chain costs.
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t level = 0; level < levelCount; ++level) {
+                memcpy(upload->texture->levels[level].data(), upload->source[level].data(), upload->source[level].size());
+            }
+            worstStall = std::max(worstStall, secondsSince(start));
+            for (auto& level : upload->texture->levels) {
+                std::fill(level.begin(), level.end(), 0);
+            }
+
+            Upload* raw = upload.get();
+            // Like Texture::upload, only the last level carries the release.
+            for (uint32_t level = 0; level < levelCount; ++level) {
+                const uint32_t levelWidth = std::max(width >> level, 1u), levelHeight = std::max(height >> level, 1u);
+                std::function<void()> release;
+                if (level + 1 == levelCount) {
+                    release = [raw] { ++raw->releases; };
+                }
+                raw->token = queue.enqueue(raw->texture.get(), level, 0, 0, levelWidth, levelHeight, bytesPerPixel,
+                                           raw->source[level].data(), size_t(levelWidth) * bytesPerPixel,
+                                           std::move(release));
+            }
+            raw->enqueuedFrame = frame;
+            uploads.push_back(std::move(upload));
+        };
+
+        for (int i = 0; i < scenario.burst; ++i) {
+            addTexture(0);
+        }
+        for (int frame = 0; frame < scenario.frames; ++frame) {
+            if (frame > 0 && arrives(random)) {
+                addTexture(frame);
+            }
+            for (auto& upload : uploads) {
+                if (!upload->cancelled && !queue.isSubmitted(upload->token) && cancels(random)) {
+                    queue.cancel(upload->texture.get());
+                    upload->cancelled = true;
+                }
+            }
+
+            queue.beginFrame();
+            const uint64_t bytesBefore = queue.stats().bytesUploaded;
+            auto start = std::chrono::steady_clock::now();
+            queue.flush(scenario.frameBudget);
+            const double seconds = secondsSince(start);
+            flushSeconds += seconds;
+            worstFlush = std::max(worstFlush, seconds);
+            const uint64_t frameBytes = queue.stats().bytesUploaded - bytesBefore;
+            if (frameBytes > std::max<size_t>(scenario.frameBudget, 2048 * 8)) {
+                std::cout << scenario.name << ": frame " << frame << " uploaded " << frameBytes << " bytes" << std::endl;
+                passed = false;
+            }
+            device.advance();
+
+            for (auto& upload : uploads) {
+                if (upload->cancelled || upload->verified || !queue.isComplete(upload->token)) {
+                    continue;
+                }
+                if (upload->token.value < lastCompleted) {
+                    std::cout << scenario.name << ": tokens completed out of order" << std::endl;
+                    passed = false;
+                }
+                lastCompleted = upload->token.value;
+                if (upload->texture->levels != upload->source) {
+                    std::cout << scenario.name << ": texture " << upload->token.value << " was corrupted" << std::endl;
+                    passed = false;
+                }
+                upload->verified = true;
+                ++completedCount;
+                latencyFrames += frame - upload->enqueuedFrame;
+                worstLatency = std::max<uint64_t>(worstLatency, frame - upload->enqueuedFrame);
+            }
+        }
+
+        queue.finish();
+        for (auto& upload : uploads) {
+            if (!upload->cancelled && (!queue.isComplete(upload->token) || upload->texture->levels != upload->source)) {
+                std::cout << scenario.name << ": texture " << upload->token.value << " did not finish" << std::endl;
+                passed = false;
+            }
+        }
+
+        const auto& stats = queue.stats();
+        size_t cancelledCount = std::count_if(uploads.begin(), uploads.end(), [](auto& upload) { return upload->cancelled; });
+        std::cout << scenario.name << ": " << uploads.size() << " textures (" << cancelledCount << " cancelled), "
+                  << stats.bytesUploaded / 1e6 << " MB in " << stats.copies << " copies / " << stats.submits
+                  << " submits; flush " << flushSeconds / scenario.frames * 1e3 << " ms/frame avg, "
+                  << worstFlush * 1e3 << " ms worst, vs " << worstStall * 1e3
+                  << " ms for the largest synchronous upload; latency "
+                  << (completedCount ? double(latencyFrames) / completedCount : 0.0) << " frames avg, " << worstLatency
+                  << " worst; " << stats.ringStalls << " ring stalls" << std::endl;
+    }
+
+    for (auto& upload : uploads) {
+        if (upload->releases != 1) {
+            std::cout << scenario.name << ": texture " << upload->token.value << " released " << upload->releases
+                      << " times" << std::endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+int main() {
+    const Scenario scenarios[] = {
+        {"steady streaming", size_t(32) << 20, size_t(8) << 20, 2, 600, 0, 0.2, 0.0},
+        {"level load burst", size_t(32) << 20, size_t(8) << 20, 2, 600, 40, 0.0, 0.0},
+        {"small ring", size_t(1) << 20, size_t(8) << 20, 3, 600, 10, 0.05, 0.0},
+        {"with cancels", size_t(16) << 20, size_t(4) << 20, 2, 600, 20, 0.2, 0.01},
+    };
+    bool passed = true;
+    for (const Scenario& scenario : scenarios) {
+        passed &= run(scenario);
+    }
+    return passed ? 0 : 1;
+}
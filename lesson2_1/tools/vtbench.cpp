@@ -0,0 +1,329 @@
+//
+//  vtbench.cpp
+//  Metal-Guide
+//
+//  Writes a synthetic tiled image, checks that every tile decodes to the
+//  expected pixels, then drives VirtualTexture through synthetic camera
+//  paths with a fake backend. After every frame the fake backend's copy of
+//  the indirection table is checked against the page table and the tile
+//  cache contents. Reports hit rate, decode throughput, update() cost and
+//  how many frames a view takes to become fully resident. Build from
+//  lesson2_1/:
+//
+//    clang++ -std=c++20 -O2 -IMetal-Tutorial tools/vtbench.cpp
+//        Metal-Tutorial/virtual_texture.cpp Metal-Tutorial/tiled_image.cpp
+//        Metal-Tutorial/qoi.cpp Metal-Tutorial/image_resize.cpp
+//        Metal-Tutorial/mapped_file.cpp Metal-Tutorial/thread_pool.cpp -o vtbench
+//
+//  Usage: vtbench [image side, default 8192]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "image_resize.hpp"
+#include "thread_pool.hpp"
+#include "tiled_image.hpp"
+#include "virtual_texture.hpp"
+
+static uint64_t fnv1a(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Mirrors what a GPU backend would hold: the tile cache contents and a
+// copy of the indirection texture. Slots are hashed lazily, outside the
+// timed update().
+class FakeTileCache : public TileCacheBackend {
+public:
+    FakeTileCache(const TiledImage& image, uint32_t cacheTilesX, uint32_t cacheTilesY)
+        : image(image), cacheTilesX(cacheTilesX), pageBytes(size_t(image.pageSize()) * image.pageSize() * 4),
+          slots(size_t(cacheTilesX) * cacheTilesY * pageBytes), slotHashes(size_t(cacheTilesX) * cacheTilesY),
+          slotChanged(slotHashes.size()) {
+        for (uint32_t level = 0; level < image.info().levelCount; ++level) {
+            indirection.emplace_back(size_t(image.tilesX(level)) * image.tilesY(level));
+        }
+    }
+
+    void uploadTile(uint32_t slotX, uint32_t slotY, const uint8_t* pixels) override {
+        const size_t slot = slotY * cacheTilesX + slotX;
+        memcpy(&slots[slot * pageBytes], pixels, pageBytes);
+        slotChanged[slot] = true;
+    }
+
+    uint64_t slotHash(uint32_t slotX, uint32_t slotY) {
+        const size_t slot = slotY * cacheTilesX + slotX;
+        if (slotChanged[slot]) {
+            slotHashes[slot] = fnv1a(&slots[slot * pageBytes], pageBytes);
+            slotChanged[slot] = false;
+        }
+        return slotHashes[slot];
+    }
+
+    void uploadIndirection(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                           const uint32_t* entries, uint32_t rowLength) override {
+        const uint32_t columns = image.tilesX(level);
+        for (uint32_t row = 0; row < height; ++row) {
+            std::copy_n(entries + size_t(row) * rowLength, width, &indirection[level][size_t(y + row) * columns + x]);
+        }
+        indirectionTexels += uint64_t(width) * height;
+    }
+
+    const TiledImage& image;
+    uint32_t cacheTilesX;
+    size_t pageBytes;
+    std::vector<uint8_t> slots;
+    std::vector<uint64_t> slotHashes;
+    std::vector<bool> slotChanged;
+    std::vector<std::vector<uint32_t>> indirection;
+    uint64_t indirectionTexels{0};
+};
+
+static bool checkTiles(const TiledImage& image, const std::vector<uint8_t>& source, std::vector<std::vector<uint64_t>>& pageHashes) {
+    const TiledImage::Info& info = image.info();
+    const uint32_t pageSize = image.pageSize();
+
+    // Rebuild the mip chain the way the writer does and cut the expected
+    // pages out of it, border clamped to the level.
+    std::vector<uint8_t> level = source, next;
+    std::vector<uint8_t> expected(size_t(pageSize) * pageSize * 4), decoded(expected.size());
+    for (uint32_t l = 0; l < info.levelCount; ++l) {
+        const uint32_t width = image.levelWidth(l), height = image.levelHeight(l);
+        if (l > 0) {
+            const uint32_t srcWidth = image.levelWidth(l - 1), srcHeight = image.levelHeight(l - 1);
+            next.resize(size_t(width) * height * 4);
+            ImageResize::resizeRgba8(level.data(), int(srcWidth), int(srcHeight), 4 * size_t(srcWidth),
+                                     next.data(), int(width), int(height), 4 * size_t(width));
+            level.swap(next);
+        }
+        pageHashes.emplace_back(size_t(image.tilesX(l)) * image.tilesY(l));
+        for (uint32_t ty = 0; ty < image.tilesY(l); ++ty) {
+            for (uint32_t tx = 0; tx < image.tilesX(l); ++tx) {
+                for (uint32_t row = 0; row < pageSize; ++row) {
+                    for (uint32_t column = 0; column < pageSize; ++column) {
+                        int64_t x = std::clamp<int64_t>(int64_t(tx) * info.tileSize - info.border + column, 0, width - 1);
+                        int64_t y = std::clamp<int64_t>(int64_t(ty) * info.tileSize - info.border + row, 0, height - 1);
+                        memcpy(&expected[(size_t(row) * pageSize + column) * 4], &level[(size_t(y) * width + x) * 4], 4);
+                    }
+                }
+                if (!image.decodeTile(l, tx, ty, decoded.data()) || decoded != expected) {
+                    std::cout << "tile " << l << "/" << tx << "," << ty << " does not match the source" << std::endl;
+                    return false;
+                }
+                pageHashes[l][ty * image.tilesX(l) + tx] = fnv1a(decoded.data(), decoded.size());
+            }
+        }
+    }
+    return true;
+}
+
+// Every indirection entry must point at a slot holding the page itself or
+// one of its ancestors, must be the page itself when that is resident, and
+// the backend must have received exactly what the page table says.
+static bool checkConsistency(const VirtualTexture& texture, FakeTileCache& cache,
+                             const std::vector<std::vector<uint64_t>>& pageHashes) {
+    const TiledImage& image = cache.image;
+    for (uint32_t level = 0; level < image.info().levelCount; ++level) {
+        if (cache.indirection[level] != texture.indirectionLevel(level)) {
+            std::cout << "indirection level " << level << " was not fully uploaded" << std::endl;
+            return false;
+        }
+        for (uint32_t y = 0; y < image.tilesY(level); ++y) {
+            for (uint32_t x = 0; x < image.tilesX(level); ++x) {
+                const uint32_t entry = texture.entry(level, x, y);
+                const uint32_t slotX = entry & 0xff, slotY = (entry >> 8) & 0xff, mapped = (entry >> 16) & 0xff;
+                uint32_t ancestorX = x, ancestorY = y;
+                for (uint32_t l = level; l < mapped; ++l) {
+                    ancestorX = std::min(ancestorX / 2, image.tilesX(l + 1) - 1);
+                    ancestorY = std::min(ancestorY / 2, image.tilesY(l + 1) - 1);
+                }
+                const uint32_t page = texture.pageInSlot(slotX, slotY);
+                const bool valid = (entry >> 24) == 0xff && mapped >= level && mapped < image.info().levelCount &&
+                                   page == VirtualTexture::pageKey(mapped, ancestorX, ancestorY) &&
+                                   (mapped == level || !texture.isResident(level, x, y)) &&
+                                   cache.slotHash(slotX, slotY) ==
+                                       pageHashes[mapped][ancestorY * image.tilesX(mapped) + ancestorX];
+                if (!valid) {
+                    std::cout << "bad indirection entry at " << level << "/" << x << "," << y << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Where the camera is: the texel at the screen's centre and texels per pixel.
+struct Camera {
+    double centerX;
+    double centerY;
+    double texelsPerPixel;
+};
+using Path = std::function<Camera(int frame)>;
+
+static bool run(const char* name, const TiledImage& image, const std::vector<std::vector<uint64_t>>& pageHashes,
+                uint32_t cacheTiles, const Path& path, int frames) {
+    constexpr double kScreenWidth = 1920, kScreenHeight = 1080;
+    constexpr auto kFrameTime = std::chrono::milliseconds(8);
+
+    // Decoders get their own threads, which run while the frame loop sleeps
+    // as a render thread would wait for the display.
+    ThreadPool decodePool(5);
+    FakeTileCache cache(image, cacheTiles, cacheTiles);
+    VirtualTexture texture(image, cache, cacheTiles, cacheTiles, 32, decodePool);
+
+    double updateSeconds = 0.0, worstUpdate = 0.0;
+    uint64_t wanted = 0, complete = 0;
+    int framesWaiting = 0, longestWait = 0;
+    bool consistent = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames && consistent; ++frame) {
+        auto frameStart = std::chrono::steady_clock::now();
+        const Camera camera = path(frame);
+        const uint32_t level = std::min(uint32_t(std::max(std::log2(camera.texelsPerPixel), 0.0)),
+                                        image.info().levelCount - 1);
+        const double scale = camera.texelsPerPixel / double(1u << level);
+        const double tileSize = image.info().tileSize;
+        const auto tileRange = [&](double center, double screen, uint32_t levelSize, uint32_t tiles, uint32_t& first, uint32_t& last) {
+            double begin = std::clamp((center / double(1u << level) - screen * scale / 2) / tileSize, 0.0, double(levelSize) / tileSize);
+            double end = std::clamp((center / double(1u << level) + screen * scale / 2) / tileSize, 0.0, double(levelSize) / tileSize);
+            first = std::min(uint32_t(begin), tiles - 1);
+            last = std::min(uint32_t(std::ceil(end)), tiles);
+        };
+        uint32_t x0, x1, y0, y1;
+        tileRange(camera.centerX, kScreenWidth, image.levelWidth(level), image.tilesX(level), x0, x1);
+        tileRange(camera.centerY, kScreenHeight, image.levelHeight(level), image.tilesY(level), y0, y1);
+
+        texture.beginFrame();
+        uint32_t residentCount = 0;
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                residentCount += texture.isResident(level, x, y);
+                texture.request(level, x, y);
+            }
+        }
+        const uint32_t viewTiles = (x1 - x0) * (y1 - y0);
+        wanted += viewTiles;
+        complete += residentCount == viewTiles;
+
+        // Longest run of frames drawn partly from coarser fallback pages.
+        framesWaiting = residentCount < viewTiles ? framesWaiting + 1 : 0;
+        longestWait = std::max(longestWait, framesWaiting);
+
+        auto updateStart = std::chrono::steady_clock::now();
+        texture.update(32);
+        const double seconds = secondsSince(updateStart);
+        updateSeconds += seconds;
+        worstUpdate = std::max(worstUpdate, seconds);
+
+        consistent = checkConsistency(texture, cache, pageHashes);
+        std::this_thread::sleep_until(frameStart + kFrameTime);
+    }
+    texture.waitForDecodes();
+    texture.update(UINT32_MAX);
+    consistent = consistent && checkConsistency(texture, cache, pageHashes);
+    const double elapsed = secondsSince(start);
+
+    const auto& stats = texture.stats();
+    std::cout << name << ": hit rate " << 100.0 * stats.hits / stats.requests << "%, "
+              << 100.0 * complete / frames << "% of frames fully resident, longest wait " << longestWait
+              << " frames; " << stats.decodes << " decodes (" << stats.decodedBytes / elapsed / 1e6
+              << " MB/s compressed), " << stats.evictions << " evictions, " << stats.dropped << " dropped; update "
+              << updateSeconds / frames * 1e6 << " us/frame avg, " << worstUpdate * 1e6 << " us worst; "
+              << cache.indirectionTexels << " indirection texels uploaded" << std::endl;
+    return consistent;
+}
+
+int main(int argc, char* argv[]) {
+    const uint32_t side = argc > 1 ? uint32_t(std::atoi(argv[1])) : 8192;
+    if (side < 256) {
+        std::cerr << "Image side must be at least 256" << std::endl;
+        return 1;
+    }
+
+    // Smooth gradients with some detail, so tiles compress like real content.
+    std::vector<uint8_t> source(size_t(side) * side * 4);
+    ThreadPool::shared().parallelFor(side, 64, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (size_t x = 0; x < side; ++x) {
+                uint8_t* pixel = &source[(y * side + x) * 4];
+                pixel[0] = uint8_t(x * 255 / side);
+                pixel[1] = uint8_t(y * 255 / side);
+                pixel[2] = uint8_t(128 + 100 * std::sin(x * 0.05) * std::cos(y * 0.03));
+                pixel[3] = 255;
+            }
+        }
+    });
+
+    const std::string path = (std::filesystem::temp_directory_path() / "vtbench.mgvt").string();
+    auto start = std::chrono::steady_clock::now();
+    if (!TiledImage::write(path.c_str(), source.data(), side, side)) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return 1;
+    }
+    const double writeSeconds = secondsSince(start);
+    TiledImage image(path.c_str());
+    if (!image.isOpen()) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    std::cout << side << "x" << side << ", " << image.info().levelCount << " levels, "
+              << std::filesystem::file_size(path) / 1e6 << " MB tiled, written in " << writeSeconds << " s" << std::endl;
+
+    std::vector<std::vector<uint64_t>> pageHashes;
+    if (!checkTiles(image, source, pageHashes)) {
+        return 1;
+    }
+    source = {};
+
+    // Raw decode throughput over level 0.
+    const uint32_t columns = image.tilesX(0), tileCount = columns * image.tilesY(0);
+    for (bool parallel : {false, true}) {
+        start = std::chrono::steady_clock::now();
+        auto decodeRange = [&](size_t begin, size_t end) {
+            std::vector<uint8_t> pixels(size_t(image.pageSize()) * image.pageSize() * 4);
+            for (size_t i = begin; i < end; ++i) {
+                image.decodeTile(0, uint32_t(i % columns), uint32_t(i / columns), pixels.data());
+            }
+        };
+        if (parallel) {
+            ThreadPool::shared().parallelFor(tileCount, 16, decodeRange);
+        } else {
+            decodeRange(0, tileCount);
+        }
+        const double seconds = secondsSince(start);
+        std::cout << (parallel ? "parallel" : "single thread") << " decode: " << tileCount / seconds << " tiles/s, "
+                  << double(tileCount) * image.pageSize() * image.pageSize() * 4 / seconds / 1e6 << " MB/s decoded"
+                  << std::endl;
+    }
+
+    const double extent = side;
+    Path pan = [&](int frame) { return Camera{2000 + frame * 12.0, 1500 + frame * 7.0, 1.0}; };
+    Path zoom = [&](int frame) {
+        return Camera{extent / 2, extent / 2, std::exp2(3.0 + 3.0 * std::sin(frame * 0.02))};
+    };
+    Path jumps = [&](int frame) {
+        uint32_t seed = uint32_t(frame / 60) * 2654435761u;
+        return Camera{double(seed % side), double((seed >> 8) % side), 1.0};
+    };
+
+    bool passed = true;
+    passed &= run("pan", image, pageHashes, 32, pan, 300);
+    passed &= run("zoom", image, pageHashes, 32, zoom, 300);
+    passed &= run("jumps", image, pageHashes, 32, jumps, 300);
+    passed &= run("cache too small", image, pageHashes, 8, pan, 300);
+    std::filesystem::remove(path);
+    return passed ? 0 : 1;
+}